@@ -0,0 +1,437 @@
+//
+// bench-micro.cpp
+//
+// Microbenchmarks of storage server internals. Each benchmark drives a
+// component directly with synthetic data, without RPCs or the network,
+// and reports its throughput (ops/s) and the time of each operation
+// (ns/op, per thread).
+//
+// Usage: bench-micro [-t nthreads] [-n nops] [benchmark...]
+//   -t: number of threads running each benchmark (default 1)
+//   -n: operations per thread (default 1000000)
+// Without arguments, runs all benchmarks. bench-micro -l lists them.
+//
+
+/*
+  Original code: Copyright (c) 2014 Microsoft Corporation
+  Modified code: Copyright (c) 2015-2016 VMware, Inc
+  All rights reserved.
+
+  Written by Marcos K. Aguilera
+
+  MIT License
+
+  Permission is hereby granted, free of charge, to any person
+  obtaining a copy of this software and associated documentation files
+  (the "Software"), to deal in the Software without restriction,
+  including without limitation the rights to use, copy, modify, merge,
+  publish, distribute, sublicense, and/or sell copies of the Software,
+  and to permit persons to whom the Software is furnished to do so,
+  subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED *AS IS*, WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+  BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+  ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#include "options.h"
+#include "tmalloc.h"
+#include "os.h"
+#include "prng.h"
+#include "datastruct.h"
+#include "datastructmt.h"
+#include "gaiatypes.h"
+#include "supervalue.h"
+#include "record.h"
+#include "pendingtx.h"
+#include "diskstorage.h"
+#include "logmem.h"
+#include "gaiarpcaux.h"
+
+#define MB_VALUE_LEN 100      // length of values written to LogInMemory
+#define MB_SV_NCELLS 50       // cells in supervalues
+#define MB_NKEYS 65536        // keys in hash tables and skiplists
+#define MB_TMALLOC_LIVE 64    // buffers kept allocated by each thread
+#define MB_WRITES_PER_GC 1000 // see mbWriteTs()
+
+static u64 nowns(void){
+  struct timespec ts;
+  int res = clock_gettime(CLOCK_MONOTONIC, &ts); assert(res==0);
+  return (u64) ts.tv_sec * 1000000000LL + (u64) ts.tv_nsec;
+}
+
+// state shared by the benchmarks, created in main
+static DiskStorage *MBDiskStorage;
+static LogInMemory *MBLog;
+static TxWriteSVItem *MBSV;  // supervalue with MB_SV_NCELLS integer cells
+static Ptr<TxUpdateCoid> MBListAdd; // tucoid adding one cell to MBSV
+static HashTableMT<COid,u64> *MBHashTable;
+static SkipList<COid,u64> *MBSkipList;
+
+// creates supervalue with ncells integer cells, with the even keys
+// 0, 2, ..., so that odd keys can be added without replacing a cell
+static TxWriteSVItem *newSV(COid &coid, int ncells){
+  TxWriteSVItem *twsvi = new TxWriteSVItem(coid, 0);
+  twsvi->nattrs = GAIA_MAX_ATTRS;
+  twsvi->celltype = 0;
+  twsvi->attrs = new u64[GAIA_MAX_ATTRS];
+  memset(twsvi->attrs, 0, GAIA_MAX_ATTRS * sizeof(u64));
+  for (int i=0; i < ncells; ++i){
+    ListCellPlus *lc = new ListCellPlus(&twsvi->prki);
+    lc->nKey = 2*i;
+    lc->pKey = 0;
+    lc->value = i;
+    twsvi->cells.insert(lc, 0);
+  }
+  return twsvi;
+}
+
+static Ptr<TxUpdateCoid> newValue(COid &coid){
+  TxWriteItem *twi = new TxWriteItem(coid, 0);
+  twi->len = MB_VALUE_LEN;
+  twi->buf = (char*) malloc(MB_VALUE_LEN);
+  memset(twi->buf, 'x', MB_VALUE_LEN);
+  twi->rpcrequest = 0;
+  twi->alloctype = 1;  // allocated via malloc
+  return new TxUpdateCoid(twi);
+}
+
+static COid hotCoid(int n){
+  COid coid;
+  coid.cid = 0xbe4c;
+  coid.oid = n;
+  return coid;
+}
+
+// Timestamp of a write. LogInMemory only garbage collects versions older
+// than LOG_STALE_GC_MS, which would keep seconds worth of writes in memory.
+// So every MB_WRITES_PER_GC writes, timestamps jump ahead by that amount.
+static u64 MBNWrites;
+static Timestamp mbWriteTs(void){
+  Timestamp ts;
+  u64 n = AtomicInc64(&MBNWrites);
+  ts.setNew();
+  ts.addMs((i64)(n / MB_WRITES_PER_GC) * (LOG_STALE_GC_MS+1));
+  return ts;
+}
+
+//----------------------------- benchmarks --------------------------------
+
+// readCOid of a 100-byte value, all threads on the same coid
+static void setupLogRead(void){
+  COid coid = hotCoid(1);
+  Timestamp ts;
+  ts.setNew();
+  MBLog->writeCOid(coid, ts, newValue(coid));
+}
+static void runLogRead(int threadno, Prng &rng, int nops){
+  COid coid = hotCoid(1);
+  Ptr<TxUpdateCoid> tucoid;
+  Timestamp ts;
+  int res;
+  for (int i=0; i < nops; ++i){
+    ts.setNew();
+    res = MBLog->readCOid(coid, ts, tucoid, 0, 0); assert(res==0);
+  }
+}
+
+// writeCOid of a 100-byte value, all threads on the same coid
+static void runLogWrite(int threadno, Prng &rng, int nops){
+  COid coid = hotCoid(2);
+  for (int i=0; i < nops; ++i)
+    MBLog->writeCOid(coid, mbWriteTs(), newValue(coid));
+}
+
+// copy of a 50-cell supervalue, as done by readCOid before applying deltas
+static void runSVCopy(int threadno, Prng &rng, int nops){
+  for (int i=0; i < nops; ++i){
+    TxWriteSVItem *twsvi = new TxWriteSVItem(*MBSV);
+    delete twsvi;
+  }
+}
+
+// ListAdd of one cell into a copy of a 50-cell supervalue
+static void setupListAdd(void){
+  COid coid = hotCoid(3);
+  ListCell cell;
+  Ptr<RcKeyInfo> prki;
+  cell.nKey = MB_SV_NCELLS+1; // odd key, lands in the middle
+  cell.pKey = 0;
+  cell.value = 0;
+  MBListAdd = new TxUpdateCoid;
+  MBListAdd->Litems.pushTail(new TxListAddItem(coid, prki, cell, 0));
+}
+static void runListAdd(int threadno, Prng &rng, int nops){
+  LogInMemory::NUpdates nupdates;
+  for (int i=0; i < nops; ++i){
+    TxWriteSVItem *twsvi = new TxWriteSVItem(*MBSV);
+    nupdates = LogInMemory::applyTucoid(twsvi, MBListAdd);
+    assert(nupdates.res == 0 && nupdates.nadd == 1);
+    delete twsvi;
+  }
+}
+
+// lookups of random keys in a HashTableMT
+static void setupHashTable(void){
+  MBHashTable = new HashTableMT<COid,u64>(COID_CACHE_HASHTABLE_SIZE);
+  for (int i=0; i < MB_NKEYS; ++i){
+    COid coid = hotCoid(i);
+    MBHashTable->insert(coid, i);
+  }
+}
+static void runHashTable(int threadno, Prng &rng, int nops){
+  COid coid;
+  u64 value;
+  int res;
+  for (int i=0; i < nops; ++i){
+    coid = hotCoid((int)(rng.next() % MB_NKEYS));
+    res = MBHashTable->lookup(coid, value); assert(res==0);
+  }
+}
+
+// lookups of random keys in a SkipList
+static void setupSkipList(void){
+  MBSkipList = new SkipList<COid,u64>;
+  for (int i=0; i < MB_NKEYS; ++i){
+    COid coid = hotCoid(i);
+    MBSkipList->insert(coid, i);
+  }
+}
+static void runSkipList(int threadno, Prng &rng, int nops){
+  COid coid;
+  u64 *value;
+  int res;
+  for (int i=0; i < nops; ++i){
+    coid = hotCoid((int)(rng.next() % MB_NKEYS));
+    res = MBSkipList->lookup(coid, value); assert(res==0);
+  }
+}
+
+// FULLREAD response of a 50-cell supervalue: marshall at the server,
+// gather into one buffer as the transport does, demarshall and unpack
+// the cells at the client
+static void runFullRead(int threadno, Prng &rng, int nops){
+  iovec bufs[16];
+  int nbufs, k, ncelloids, lencelloids;
+  char *buf, *ptr;
+  SuperValue sv;
+
+  buf = (char*) malloc(sizeof(FullReadRPCResp) + GAIA_MAX_ATTRS*sizeof(u64) +
+                       MB_SV_NCELLS * 32 + 1024);
+  for (int i=0; i < nops; ++i){
+    FullReadRPCRespData *resp = new FullReadRPCRespData;
+    FullReadRPCResp data;
+    data.status = 0;
+    data.readts.setNew();
+    data.nattrs = MBSV->nattrs;
+    data.celltype = MBSV->celltype;
+    data.celloids = MBSV->getCelloids(ncelloids, lencelloids);
+    data.ncelloids = ncelloids;
+    data.lencelloids = lencelloids;
+    data.attrs = MBSV->attrs;
+    data.prki = MBSV->prki;
+    resp->data = &data;
+    nbufs = resp->marshall(bufs, 16);
+    for (k = 0, ptr = buf; k < nbufs; ++k){
+      memcpy(ptr, bufs[k].iov_base, bufs[k].iov_len);
+      ptr += bufs[k].iov_len;
+    }
+    delete resp;
+
+    FullReadRPCRespData rresp;
+    rresp.demarshall(buf);
+    FullReadRPCResp *r = rresp.data;
+    sv.Nattrs = r->nattrs;
+    sv.CellType = r->celltype;
+    sv.Ncells = r->ncelloids;
+    sv.CellsSize = r->lencelloids;
+    sv.Attrs = new u64[sv.Nattrs];
+    memcpy(sv.Attrs, r->attrs, sizeof(u64) * sv.Nattrs);
+    sv.Cells = new ListCell[sv.Ncells];
+    ptr = r->celloids;
+    for (int j=0; j < sv.Ncells; ++j){
+      u64 nkey;
+      ptr += myGetVarint((unsigned char*) ptr, &nkey);
+      sv.Cells[j].nKey = nkey;
+      sv.Cells[j].pKey = 0; // integer cells
+      sv.Cells[j].value = *(Oid*)ptr;
+      ptr += sizeof(u64);
+    }
+    sv.prki = r->prki;
+    sv.Free();
+  }
+  free(buf);
+}
+
+// tmalloc/tfree of random sizes, with MB_TMALLOC_LIVE buffers live
+static void runTmalloc(int threadno, Prng &rng, int nops){
+  void *live[MB_TMALLOC_LIVE];
+  int i, slot;
+  for (i=0; i < MB_TMALLOC_LIVE; ++i) live[i] = malloc(16);
+  for (i=0; i < nops; ++i){
+    slot = i % MB_TMALLOC_LIVE;
+    free(live[slot]);
+    live[slot] = malloc(16 << (rng.next() % 7)); // 16 to 1024 bytes
+  }
+  for (i=0; i < MB_TMALLOC_LIVE; ++i) free(live[i]);
+}
+
+struct MicroBench {
+  const char *name;
+  const char *descr;
+  void (*setup)(void); // called once before running, may be 0
+  void (*run)(int threadno, Prng &rng, int nops);
+};
+
+static MicroBench Benchmarks[] = {
+  { "logread", "LogInMemory::readCOid of a value, same coid",
+    setupLogRead, runLogRead },
+  { "logwrite", "LogInMemory::writeCOid of a value, same coid",
+    0, runLogWrite },
+  { "svcopy", "copy of a 50-cell supervalue",
+    0, runSVCopy },
+  { "listadd", "copy of 50-cell supervalue plus applyTucoid of a ListAdd",
+    setupListAdd, runListAdd },
+  { "hashtable", "HashTableMT::lookup of random key",
+    setupHashTable, runHashTable },
+  { "skiplist", "SkipList::lookup of random key",
+    setupSkipList, runSkipList },
+  { "fullread", "marshall and demarshall of FULLREAD reply of 50 cells",
+    0, runFullRead },
+  { "tmalloc", "tmalloc and tfree of 16-1024 bytes",
+    0, runTmalloc },
+};
+#define NBENCHMARKS (int)(sizeof(Benchmarks)/sizeof(MicroBench))
+
+//------------------------------- runner ----------------------------------
+
+struct MBThreadArg {
+  MicroBench *mb;
+  int threadno;
+  int nops;
+  u64 startns, endns;
+};
+
+static u32 MBReady;        // threads ready to start
+static volatile int MBGo;  // set when all threads are ready
+
+static OSTHREAD_FUNC mbWorker(void *parm){
+  MBThreadArg *arg = (MBThreadArg*) parm;
+  Prng rng(arg->threadno+1);
+  AtomicInc32(&MBReady);
+  while (!MBGo) ;
+  arg->startns = nowns();
+  arg->mb->run(arg->threadno, rng, arg->nops);
+  arg->endns = nowns();
+  return 0;
+}
+
+static void runBenchmark(MicroBench *mb, int nthreads, int nops){
+  OSThread_t *threads = new OSThread_t[nthreads];
+  MBThreadArg *args = new MBThreadArg[nthreads];
+  u64 start, end, threadns;
+  void *tres;
+  int i, res;
+
+  if (mb->setup) mb->setup();
+  MBReady = 0;
+  MBGo = 0;
+  for (i=0; i < nthreads; ++i){
+    args[i].mb = mb;
+    args[i].threadno = i;
+    args[i].nops = nops;
+    res = OSCreateThread(threads+i, mbWorker, (void*) &args[i]);
+    assert(res==0);
+  }
+  while (MBReady < (u32) nthreads) ;
+  MemBarrier();
+  MBGo = 1;
+  for (i=0; i < nthreads; ++i) OSWaitThread(threads[i], &tres);
+
+  start = args[0].startns;
+  end = args[0].endns;
+  threadns = 0;
+  for (i=0; i < nthreads; ++i){
+    if (args[i].startns < start) start = args[i].startns;
+    if (args[i].endns > end) end = args[i].endns;
+    threadns += args[i].endns - args[i].startns;
+  }
+  printf("%-10s %3d %10lld %14.0f %10.1f  %s\n", mb->name, nthreads,
+         (long long) nops * nthreads,
+         (double) nops * nthreads * 1e9 / (end - start),
+         (double) threadns / ((double) nops * nthreads), mb->descr);
+  fflush(stdout);
+  delete [] threads;
+  delete [] args;
+}
+
+int main(int argc, char **argv){
+  int nthreads = 1, nops = 1000000;
+  int i, j, c;
+  bool badargs = false, list = false;
+
+  while ((c = getopt(argc, argv, "t:n:l")) != -1){
+    switch(c){
+    case 't': nthreads = atoi(optarg); break;
+    case 'n': nops = atoi(optarg); break;
+    case 'l': list = true; break;
+    default: badargs = true;
+    }
+  }
+  if (badargs || nthreads < 1 || nops < 1){
+    fprintf(stderr, "usage: %s [-t nthreads] [-n nops] [-l] "
+            "[benchmark...]\n", argv[0]);
+    exit(1);
+  }
+  if (list){
+    for (j=0; j < NBENCHMARKS; ++j)
+      printf("%-10s %s\n", Benchmarks[j].name, Benchmarks[j].descr);
+    exit(0);
+  }
+  for (i = optind; i < argc; ++i){
+    for (j=0; j < NBENCHMARKS; ++j)
+      if (strcmp(argv[i], Benchmarks[j].name) == 0) break;
+    if (j == NBENCHMARKS){
+      fprintf(stderr, "Unknown benchmark %s (-l lists them)\n", argv[i]);
+      exit(1);
+    }
+  }
+
+  UniqueId::init();
+  MBDiskStorage = new DiskStorage((char*) "");
+  MBLog = new LogInMemory(MBDiskStorage);
+  COid coid = hotCoid(0);
+  MBSV = newSV(coid, MB_SV_NCELLS);
+  int ncelloids, lencelloids;
+  MBSV->getCelloids(ncelloids, lencelloids); // cache celloids before threads
+                                             // share MBSV
+
+  printf("%-10s %3s %10s %14s %10s\n", "benchmark", "thr", "ops", "ops/s",
+         "ns/op");
+  for (j=0; j < NBENCHMARKS; ++j){
+    if (optind < argc){ // run only benchmarks given in command line
+      for (i = optind; i < argc; ++i)
+        if (strcmp(argv[i], Benchmarks[j].name) == 0) break;
+      if (i == argc) continue;
+    }
+    runBenchmark(&Benchmarks[j], nthreads, nops);
+  }
+  return 0;
+}
@@ -56,6 +56,7 @@
 #include <unordered_map>
 #include <vector>
 #include <algorithm>
+#include <atomic>
 
 #include "bench-config.h"
 #include "bench-log.h"
@@ -237,16 +238,74 @@ private:
 
 typedef std::chrono::time_point<windows_clock> Timepoint;
 
+// Latency histogram in the style of HdrHistogram. Values below
+// 2^LH_SUBBITS are kept exactly; larger values go into buckets whose width
+// is 2^-(LH_SUBBITS-1) of their magnitude, so any value is recorded with
+// under 1% relative error, in constant time and space.
+#define LH_SUBBITS 8
+#define LH_NBUCKETS ((64 - LH_SUBBITS + 2) << (LH_SUBBITS - 1))
+
+class LatencyHistogram {
+public:
+  LatencyHistogram() : _counts(LH_NBUCKETS, 0), _n(0), _sum(0), _max(0){}
+
+  void record(uint64_t v){
+    ++_counts[index(v)];
+    ++_n;
+    _sum += v;
+    if (v > _max) _max = v;
+  }
+
+  void merge(const LatencyHistogram& h){
+    for (int i = 0; i < LH_NBUCKETS; ++i) _counts[i] += h._counts[i];
+    _n += h._n;
+    _sum += h._sum;
+    if (h._max > _max) _max = h._max;
+  }
+
+  uint64_t count() const { return _n; }
+  uint64_t max() const { return _max; }
+  double mean() const { return _n ? (double)_sum / _n : 0.0; }
+
+  // Highest value that falls in the bucket of the given percentile
+  // (0 < percent <= 100), capped at the largest recorded value
+  uint64_t percentile(double percent) const {
+    if (!_n) return 0;
+    uint64_t target = (uint64_t) ceil(_n * percent / 100.0);
+    if (target < 1) target = 1;
+    uint64_t sofar = 0;
+    for (int i = 0; i < LH_NBUCKETS; ++i){
+      sofar += _counts[i];
+      if (sofar >= target) return std::min(highest(i), _max);
+    }
+    return _max;
+  }
+
+private:
+  static int index(uint64_t v){
+    if (v < (1 << LH_SUBBITS)) return (int) v;
+    int shift = 63 - __builtin_clzll(v) - (LH_SUBBITS - 1);
+    return (shift << (LH_SUBBITS - 1)) + (int)(v >> shift);
+  }
+
+  static uint64_t highest(int idx){
+    if (idx < (1 << LH_SUBBITS)) return idx;
+    int shift = (idx >> (LH_SUBBITS - 1)) - 1;
+    uint64_t m = (idx & ((1 << (LH_SUBBITS - 1)) - 1)) + (1 << (LH_SUBBITS - 1));
+    return ((m + 1) << shift) - 1;
+  }
+
+  std::vector<uint64_t> _counts;
+  uint64_t _n;
+  uint64_t _sum;
+  uint64_t _max;
+};
+
 struct Parameters;
 
 class ExperimentState {
 public:
-  ExperimentState(std::shared_ptr<ZipfianGenerator> zipf, Parameters* p) :
-    _workerno(0),
-    _zipf(zipf),
-    _start_time(windows_clock::now()),
-    _params(p),
-    _real_start(std::chrono::system_clock::now()){}
+  ExperimentState(std::shared_ptr<ZipfianGenerator> zipf, Parameters* p);
 
   int getZipfIdx(){
     int id = _zipf->GetIndex(_wrapper._generator);
@@ -273,6 +332,23 @@ public:
 
   void PrintTimes();
 
+  // Adds the latencies of this worker to those of the other workers of
+  // the experiment. The last worker to do so prints the merged latencies
+  // and writes them as JSON if json_out is set.
+  void MergeTimes(const Config* conf);
+
+  // In open-loop mode (target_rate > 0), waits until the scheduled start
+  // of the next operation. Operations are scheduled at fixed intervals
+  // regardless of how long earlier ones took, and their latency is
+  // measured from the scheduled start, so a slow operation also counts
+  // against the operations that it delays (no coordinated omission).
+  void Pace();
+
+  // start time to be used for the latency of the operation about to begin
+  Timepoint OpStart(){
+    return _paced ? _intended : windows_clock::now();
+  }
+
 private:
   ExperimentState(const ExperimentState&);
   ExperimentState& operator=(const ExperimentState&);
@@ -288,14 +364,18 @@ private:
   Timepoint _start_time;
   Parameters* _params;
   std::chrono::time_point<std::chrono::system_clock> _real_start;
-  std::unordered_map<const char*,std::map<long long, int>> _ops_time_map;
+  std::map<std::string,LatencyHistogram> _ops_latency;
   std::unordered_map<const char*,std::map<long long, int>> _ops_count_map;
+  windows_clock::duration _interval; // between scheduled operations
+  bool _paced;          // whether some operation was scheduled
+  Timepoint _next;      // scheduled start of next operation
+  Timepoint _intended;  // scheduled start of current operation
 };
 
 class Timer {
 public:
   Timer(ExperimentState& es, const char* place) :
-    _start(windows_clock::now()), _es(es),
+    _start(es.OpStart()), _es(es),
     _loc(place), _record(true){
   }
 
@@ -337,6 +417,10 @@ struct Parameters {
     txn_ops = conf->get<int>("txn_ops", 4);
     seed = conf->get<int>("seed", 1012013);
     wiki_mix = conf->get<int>("wiki-mix", 95);
+    threads = conf->get<int>("threads", 1);
+    merge_wait = conf->get<int>("merge-wait", 10);
+    target_rate = conf->get<double>("target_rate", 0.0);
+    json_out = conf->get<std::string>("json_out", "");
   }
 
   int nTuples;
@@ -357,8 +441,37 @@ struct Parameters {
   int cooldown;
   int txn_ops;
   int wiki_mix;
+  int threads;
+  int merge_wait;
+  double target_rate; // ops/s of each worker in open-loop mode, 0 for
+                      // closed loop
+  std::string json_out; // file where to write merged latencies as JSON
 };
 
+ExperimentState::ExperimentState(std::shared_ptr<ZipfianGenerator> zipf,
+                                 Parameters* p) :
+  _workerno(0),
+  _zipf(zipf),
+  _start_time(windows_clock::now()),
+  _params(p),
+  _real_start(std::chrono::system_clock::now()),
+  _interval(p->target_rate > 0 ?
+            windows_clock::duration((long long)(1e9 / p->target_rate)) :
+            windows_clock::duration(0)),
+  _paced(false){}
+
+void ExperimentState::Pace(){
+  if (_params->target_rate <= 0) return;
+  auto now = windows_clock::now();
+  if (!_paced){
+    _next = now;
+    _paced = true;
+  }
+  if (now < _next) std::this_thread::sleep_for(_next - now);
+  _intended = _next;
+  _next += _interval;
+}
+
 int do_zipfian_test(ExperimentState& es){
   {
     ZipfianGenerator zg(1000, 2);
@@ -410,14 +523,7 @@ void ExperimentState::RecordTime(long long nanoseconds, const char* function){
   auto since_start = std::chrono::duration_cast<std::chrono::seconds>(now - _real_start).count();
   if (since_start < _params->warmup || since_start > (_params->duration - _params->cooldown))
     return;
-  // Bucket into 100s of microseconds
-  long long delay_key = nanoseconds/(1000 * 100);
-  auto it = _ops_time_map[function].find(delay_key);
-  if (it != _ops_time_map[function].end()){
-    _ops_time_map[function][delay_key]++;
-  } else {
-    _ops_time_map[function][delay_key] = 1;
-  }
+  _ops_latency[function].record(nanoseconds > 0 ? nanoseconds : 0);
 
   long long interval_key = get_interval();
   auto it2 = _ops_count_map[function].find(interval_key);
@@ -428,20 +534,71 @@ void ExperimentState::RecordTime(long long nanoseconds, const char* function){
   }
 }
 
+static void PrintLatency(const std::string& op, const LatencyHistogram& h){
+  LOG("%s: n %llu mean %0.1f us p50 %0.1f us p99 %0.1f us p99.9 %0.1f us "
+      "max %0.1f us\n", op.c_str(), (unsigned long long) h.count(),
+      h.mean() / 1000., h.percentile(50) / 1000., h.percentile(99) / 1000.,
+      h.percentile(99.9) / 1000., h.max() / 1000.);
+}
+
+static void WriteLatencyJson(const char* path, const Config* conf,
+                             const Parameters* p,
+                             const std::map<std::string,LatencyHistogram>& ops){
+  FILE* f = fopen(path, "w");
+  if (!f){
+    LOG("Cannot open %s to write results: %s\n", path, strerror(errno));
+    return;
+  }
+  fprintf(f, "{\n  \"workload\" : \"%s\",\n", conf->_workload.c_str());
+  fprintf(f, "  \"client\" : %d,\n  \"threads\" : %d,\n", optClientno,
+          p->threads);
+  fprintf(f, "  \"target_rate\" : %g,\n  \"duration\" : %d,\n",
+          p->target_rate, p->duration - p->warmup - p->cooldown);
+  fprintf(f, "  \"ops\" : {");
+  const char* sep = "\n";
+  for (auto& it : ops){
+    const LatencyHistogram& h = it.second;
+    fprintf(f, "%s    \"%s\" : { \"count\" : %llu, \"mean_us\" : %0.1f, "
+            "\"p50_us\" : %0.1f, \"p99_us\" : %0.1f, \"p999_us\" : %0.1f, "
+            "\"max_us\" : %0.1f }", sep, it.first.c_str(),
+            (unsigned long long) h.count(), h.mean() / 1000.,
+            h.percentile(50) / 1000., h.percentile(99) / 1000.,
+            h.percentile(99.9) / 1000., h.max() / 1000.);
+    sep = ",\n";
+  }
+  fprintf(f, "\n  }\n}\n");
+  fclose(f);
+  LOG("Wrote results to %s\n", path);
+}
+
+// latencies of workers that finished the current experiment
+static std::mutex merge_mutex;
+static int merged_workers = 0;
+static std::map<std::string,LatencyHistogram> merged_latency;
+
+void ExperimentState::MergeTimes(const Config* conf){
+  std::lock_guard<std::mutex> lock(merge_mutex);
+  for (auto& it : _ops_latency)
+    merged_latency[it.first].merge(it.second);
+  if (++merged_workers < std::max(_params->threads, 1)) return;
+
+  StartBulkLog();
+  LOG("================= Request latency (all workers) ===============\n");
+  for (auto& it : merged_latency)
+    PrintLatency(it.first, it.second);
+  LOG("\n");
+  EndBulkLog();
+  if (_params->json_out != "")
+    WriteLatencyJson(_params->json_out.c_str(), conf, _params, merged_latency);
+  merged_latency.clear();
+  merged_workers = 0;
+}
+
 void ExperimentState::PrintTimes(){
   StartBulkLog();
   LOG("===================== Request latency ====================\n");
-  for (auto& it : _ops_time_map){
-    for (auto& it2 : it.second){
-      // Was bucketed into 100s of microseconds, dividing by 10 will
-      // yield milliseconds
-      double this_start = it2.first/10.;
-      double this_end = this_start + 1/10.;
-      LOG("%s: [%0.2f -- %0.2f ms]: %d\n",
-                       it.first, this_start, this_end, it2.second);
-    }
-    LOG("\n");
-  }
+  for (auto& it : _ops_latency)
+    PrintLatency(it.first, it.second);
   LOG("\n\n");
   LOG("===================== Throughput ====================\n");
   for (auto& it : _ops_count_map){
@@ -785,6 +942,7 @@ static int do_workload_a(ClientPtr clp, ExperimentState& st, Parameters& param){
   auto now = std::bind(std::chrono::system_clock::now);
 
   while (std::chrono::duration_cast<std::chrono::seconds>(now() - start).count() < param.duration){
+    st.Pace();
     int idx = st.getZipfIdx();
     Key key = keys_[idx];
     //if (st.getRandom().GetRandomInt(0, 2) == 1){
@@ -802,6 +960,7 @@ static int do_workload_b(ClientPtr clp, ExperimentState& st, Parameters& param){
   auto now = std::bind(std::chrono::system_clock::now);
 
   while (std::chrono::duration_cast<std::chrono::seconds>(now() - start).count() < param.duration){
+    st.Pace();
     Key key = keys_[st.getZipfIdx()];
     if (st.getRandom().GetRandomInt(0,100) < 95){
       do_read(st, clp, param.max_fields, key);
@@ -818,6 +977,7 @@ static int do_workload_c(ClientPtr clp, ExperimentState& st, Parameters& param){
   auto now = std::bind(std::chrono::system_clock::now);
 
   while (std::chrono::duration_cast<std::chrono::seconds>(now() - start).count() < param.duration){
+    st.Pace();
     Key key = keys_[st.getZipfIdx()];
     do_read(st, clp, param.max_fields, key);
   }
@@ -830,6 +990,7 @@ static int do_workload_e(ClientPtr clp, ExperimentState& st, Parameters& param){
   auto now = std::bind(std::chrono::system_clock::now);
 
   while (std::chrono::duration_cast<std::chrono::seconds>(now() - start).count() < param.duration){
+    st.Pace();
     Key key = keys_[st.getZipfIdx()];
     if (st.getRandom().GetRandomInt(0,100) < 95){
       int nRows = st.getRandom().GetRandomInt(1, param.scan_max);
@@ -847,6 +1008,7 @@ static int do_workload_f(ClientPtr clp, ExperimentState& st, Parameters& param){
   auto now = std::bind(std::chrono::system_clock::now);
 
   while (std::chrono::duration_cast<std::chrono::seconds>(now() - start).count() < param.duration){
+    st.Pace();
     do_insert(st, clp, param.max_fields, param.key_len, param.value_len);
   }
   return 0;
@@ -859,6 +1021,7 @@ static int do_workload_g(ClientPtr clp, ExperimentState& st, Parameters& param,
   auto now = std::bind(std::chrono::system_clock::now);
 
   while (std::chrono::duration_cast<std::chrono::seconds>(now() - start).count() < param.duration){
+    st.Pace();
     do_monot_insert(st, clp, firstkey, param.max_fields, param.value_len);
   }
   return 0;
@@ -870,6 +1033,7 @@ static int do_workload_h(ClientPtr clp, ExperimentState& st, Parameters& param){
   auto now = std::bind(std::chrono::system_clock::now);
 
   while (std::chrono::duration_cast<std::chrono::seconds>(now() - start).count() < param.duration){
+    st.Pace();
     do_txn(st, clp, param);
   }
   return 0;
@@ -930,6 +1094,7 @@ static int do_workload_k(ClientPtr clp, ExperimentState& st, Parameters& param){
   auto now = std::bind(std::chrono::system_clock::now);
 
   while (std::chrono::duration_cast<std::chrono::seconds>(now() - start).count() < param.duration){
+    st.Pace();
     Key key = keys_[st.getZipfIdx()];
     int nRows = st.getRandom().GetRandomInt(1, param.scan_max);
     do_scan(st, clp, param.max_fields, nRows, key, false);
@@ -943,6 +1108,7 @@ static int do_workload_l(ClientPtr clp, ExperimentState& st, Parameters& param){
   auto now = std::bind(std::chrono::system_clock::now);
 
   while (std::chrono::duration_cast<std::chrono::seconds>(now() - start).count() < param.duration){
+    st.Pace();
     Key key1 = keys_[st.getZipfIdx()];
     Key key2 = keys_[st.getZipfIdx()];
     int nRows = st.getRandom().GetRandomInt(1, param.scan_max);
@@ -958,6 +1124,7 @@ static int do_workload_m(ClientPtr clp, ExperimentState& st, Parameters& param){
   auto now = std::bind(std::chrono::system_clock::now);
 
   while (std::chrono::duration_cast<std::chrono::seconds>(now() - start).count() < param.duration){
+    st.Pace();
     Key key = keys_[st.getZipfIdx()];
     int nRows = st.getRandom().GetRandomInt(1, param.scan_max);
     do_txm(st, clp, param.max_fields, nRows, key, keys_, param.nTuples, param.value_len);
@@ -971,6 +1138,7 @@ static int do_workload_n(ClientPtr clp, ExperimentState& st, Parameters& param){
   auto now = std::bind(std::chrono::system_clock::now);
 
   while (std::chrono::duration_cast<std::chrono::seconds>(now() - start).count() < param.duration){
+    st.Pace();
     Key key = keys_[st.getZipfIdx()];
     int nRows = param.scan_max;
     do_scan(st, clp, param.max_fields, nRows, key, true);
@@ -984,6 +1152,7 @@ static int do_workload_o(ClientPtr clp, ExperimentState& st, Parameters& param){
   auto now = std::bind(std::chrono::system_clock::now);
 
   while (std::chrono::duration_cast<std::chrono::seconds>(now() - start).count() < param.duration){
+    st.Pace();
     Key key1 = keys_[st.getZipfIdx()];
     Key key2 = keys_[st.getZipfIdx()];
     int nRows = param.scan_max;
@@ -1001,6 +1170,7 @@ static int do_workload_p(ClientPtr clp, ExperimentState& st, Parameters& param){
   tim.tv_sec  = 0;
   tim.tv_nsec = 2000000;
   while (std::chrono::duration_cast<std::chrono::seconds>(now() - start).count() < param.duration){
+    st.Pace();
     nanosleep(&tim, NULL);
     do_txn(st, clp, param);
   }
@@ -1008,12 +1178,56 @@ static int do_workload_p(ClientPtr clp, ExperimentState& st, Parameters& param){
 }
 
 
+static std::atomic<int> q_deleters_done(0);
+
+// delete 90% of the keys, then scan. Each worker deletes its share of the
+// keys whose index is not a multiple of 10, waits for all workers to finish
+// deleting and then for merge-wait seconds (so servers can merge the nodes
+// left sparse), and then scans with data from random remaining keys for the
+// rest of the duration. Prints the scan throughput at the end.
+static int do_workload_q(ClientPtr clp, ExperimentState& st, Parameters& param){
+  auto start = std::chrono::system_clock::now();
+  auto now = std::bind(std::chrono::system_clock::now);
+  int nthreads = param.threads > 0 ? param.threads : 1;
+  int nkeys = (int) keys_.size();
+  int err_count = 0, ndeletes = 0, nscans = 0;
+
+  for (auto i = st.getWorkerno(); i < nkeys; i += nthreads){
+    if (i % 10 == 0) continue;
+    if (0 != do_remove(st, clp, keys_[i])) err_count++;
+    ++ndeletes;
+  }
+  auto deleted = now();
+  LOG("deleted %d keys in %lld ms, %d errors\n", ndeletes,
+      (long long) std::chrono::duration_cast<std::chrono::milliseconds>(deleted - start).count(),
+      err_count);
+  ++q_deleters_done;
+  while (q_deleters_done < nthreads)
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  std::this_thread::sleep_for(std::chrono::seconds(param.merge_wait));
+
+  err_count = 0;
+  auto scanstart = now();
+  while (nkeys >= 10 &&
+         std::chrono::duration_cast<std::chrono::seconds>(now() - start).count() < param.duration){
+    const Key key = keys_[10 * st.getRandom().GetRandomInt(0, (nkeys + 9) / 10)];
+    if (0 != do_scan(st, clp, param.max_fields, param.scan_max, key, true)) err_count++;
+    else ++nscans;
+  }
+  auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(now() - scanstart).count();
+  LOG("scanned %d times (%d rows each) in %lld ms: %.1f scans/s, %d errors\n",
+      nscans, param.scan_max, (long long) ms, ms ? nscans * 1000.0 / ms : 0.0,
+      err_count);
+  return 0;
+}
+
 // wikipedia workload
 static int do_workload_w(ClientPtr clp, ExperimentState& st, Parameters& param){
   auto start = std::chrono::system_clock::now();
   auto now = std::bind(std::chrono::system_clock::now);
 
   while (std::chrono::duration_cast<std::chrono::seconds>(now() - start).count() < param.duration){
+    st.Pace();
     int seed = st.getRandom().GetRandomInt(0, INT_MAX);
     if (st.getRandom().GetRandomInt(0,100) < param.wiki_mix){
       do_bcache_read(st, clp, seed);
@@ -1380,6 +1594,9 @@ Workload getWorkloadFromString(const std::string& desc){
     case 'p':
     case 'P':
       return WorkloadP;
+    case 'q':
+    case 'Q':
+      return WorkloadQ;
     case 'w':
     case 'W':
       return WorkloadW;
@@ -1435,72 +1652,93 @@ int RunWorkload(ClientPtr clp, Workload w, const Config* conf){
   case WorkloadA:
     do_workload_a(clp, st, p);
     st.PrintTimes();
+    st.MergeTimes(conf);
     return 0;
   case WorkloadB:
     do_workload_b(clp, st, p);
     st.PrintTimes();
+    st.MergeTimes(conf);
     return 0;
   case WorkloadC:
     do_workload_c(clp, st, p);
     st.PrintTimes();
+    st.MergeTimes(conf);
     return 0;
   case WorkloadE:
     do_workload_e(clp, st, p);
     st.PrintTimes();
+    st.MergeTimes(conf);
     return 0;
   case WorkloadF:
     do_workload_f(clp, st, p);
     st.PrintTimes();
+    st.MergeTimes(conf);
     return 0;
   case WorkloadG:
     { // this { is here to avoid warning about non-initialization of firstkey
     int firstkey = conf->get<int>("firstkey", 1);
     do_workload_g(clp, st, p, firstkey);
     st.PrintTimes();
+    st.MergeTimes(conf);
     return 0;
     }
   case WorkloadH:
     do_workload_h(clp, st, p);
     st.PrintTimes();
+    st.MergeTimes(conf);
     return 0;
   case WorkloadI:
     { // this { is here to avoid warning about non-initialization of firstkey
     int firstkey = conf->get<int>("firstkey", 1);
     do_workload_i(clp, st, p, firstkey);
     st.PrintTimes();
+    st.MergeTimes(conf);
     return 0;
     }
   case WorkloadJ:
     do_workload_j(clp, st, p);
     st.PrintTimes();
+    st.MergeTimes(conf);
     return 0;
   case WorkloadK:
     do_workload_k(clp, st, p);
     st.PrintTimes();
+    st.MergeTimes(conf);
     return 0;
   case WorkloadL:
     do_workload_l(clp, st, p);
     st.PrintTimes();
+    st.MergeTimes(conf);
     return 0;
   case WorkloadM:
     do_workload_m(clp, st, p);
     st.PrintTimes();
+    st.MergeTimes(conf);
     return 0;
   case WorkloadN:
     do_workload_n(clp, st, p);
     st.PrintTimes();
+    st.MergeTimes(conf);
     return 0;
   case WorkloadO:
     do_workload_o(clp, st, p);
     st.PrintTimes();
+    st.MergeTimes(conf);
     return 0;
   case WorkloadP:
     do_workload_p(clp, st, p);
     st.PrintTimes();
+    st.MergeTimes(conf);
+    return 0;
+  case WorkloadQ:
+    do_workload_q(clp, st, p);
+    st.PrintTimes();
+    st.MergeTimes(conf);
     return 0;
   case WorkloadW:
     do_workload_w(clp, st, p);
     st.PrintTimes();
+    st.MergeTimes(conf);
     return 0;
   // Regression test performs basic sanity checks, then runs simple test.
   case RegressionTest:
@@ -52,6 +52,7 @@ enum Workload {
   WorkloadN,
   WorkloadO,
   WorkloadP,
+  WorkloadQ,
   WorkloadW,
   RegressionTest,
   SimpleTest,
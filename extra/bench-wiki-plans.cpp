@@ -0,0 +1,295 @@
+//
+// bench-wiki-plans.cpp
+//
+// Compares the query plans that the SQL planner picks for the wiki workload
+// with and without RPC-aware costs (see whereRpcCost in where.c). Loads a
+// small wiki-like database (page, revision, text, user, with the indexes of
+// the wiki schema), then, for each of the main wiki queries of bench-sql.h
+// and for each cost model, prints the plan (EXPLAIN QUERY PLAN) and the
+// average latency of the query (us) over random arguments.
+//
+// Usage: bench-wiki-plans [-n npages] [-r reps] dbname
+//   -n: pages to load, each with one revision and one text (default 10000)
+//   -r: executions of each query in each cost model (default 1000)
+// If the tables already exist, skips the load and uses the existing rows;
+// -n must then match the number of pages loaded before.
+//
+
+/*
+  Original code: Copyright (c) 2014 Microsoft Corporation
+  Modified code: Copyright (c) 2015-2016 VMware, Inc
+  All rights reserved.
+
+  Written by Marcos K. Aguilera
+
+  MIT License
+
+  Permission is hereby granted, free of charge, to any person
+  obtaining a copy of this software and associated documentation files
+  (the "Software"), to deal in the Software without restriction,
+  including without limitation the rights to use, copy, modify, merge,
+  publish, distribute, sublicense, and/or sell copies of the Software,
+  and to permit persons to whom the Software is furnished to do so,
+  subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED *AS IS*, WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+  BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+  ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "gaiatypes.h"
+#include "sqlite3.h"
+#include "prng.h"
+
+#define INCLUDE_WIKI_QUERIES
+#include "bench-sql.h"
+
+#define WP_NAMESPACES 16     // page_namespace of page i is i % WP_NAMESPACES
+#define WP_USERS_DIV 10      // one user per this many pages
+#define WP_LOAD_BATCH 500    // rows inserted per transaction when loading
+#define WP_TEXT_LEN 200      // length of old_text
+
+// bit of sqlite3_test_control(SQLITE_TESTCTRL_OPTIMIZATIONS) that disables
+// RPC-aware costs (SQLITE_RpcCost in sqlite.h)
+#define WP_DISABLE_RPCCOST 0x80
+
+static const char *WPSchema[] = {
+  "CREATE TABLE page (page_id integer primary key, page_namespace int, "
+  "page_title text, page_restrictions text, page_counter int, "
+  "page_is_redirect int, page_is_new int, page_random real, "
+  "page_touched text, page_latest int, page_len int)",
+  "CREATE UNIQUE INDEX name_title ON page (page_namespace, page_title)",
+  "CREATE INDEX page_len ON page (page_len)",
+  "CREATE TABLE revision (rev_id integer primary key, rev_page int, "
+  "rev_text_id int, rev_comment text, rev_user int, rev_user_text text, "
+  "rev_timestamp text, rev_minor_edit int, rev_deleted int, rev_len int, "
+  "rev_parent_id int, rev_sha1 text)",
+  "CREATE UNIQUE INDEX rev_page_id ON revision (rev_page, rev_id)",
+  "CREATE INDEX rev_timestamp ON revision (rev_timestamp)",
+  "CREATE INDEX user_timestamp ON revision (rev_user, rev_timestamp)",
+  "CREATE TABLE text (old_id integer primary key, old_text text, "
+  "old_flags text)",
+  "CREATE TABLE user (user_id integer primary key, user_name text)",
+  "CREATE UNIQUE INDEX user_name ON user (user_name)",
+  0
+};
+
+static u64 nowus(void){
+  struct timespec ts;
+  int res = clock_gettime(CLOCK_MONOTONIC, &ts); assert(res==0);
+  return (u64) ts.tv_sec * 1000000LL + (u64) ts.tv_nsec / 1000;
+}
+
+static void execOrDie(sqlite3 *db, const char *sql){
+  char *errmsg = 0;
+  if (sqlite3_exec(db, sql, 0, 0, &errmsg) != SQLITE_OK){
+    fprintf(stderr, "Error executing %s: %s\n", sql, errmsg ? errmsg : "");
+    exit(1);
+  }
+}
+
+// Creates the schema and loads npages pages. Returns 0 if loaded, or
+// non-zero if the tables already exist.
+static int load(sqlite3 *db, int npages){
+  sqlite3_stmt *spage, *srev, *stext, *suser;
+  char title[64], text[WP_TEXT_LEN+1];
+  int i, res;
+
+  if (sqlite3_exec(db, WPSchema[0], 0, 0, 0) != SQLITE_OK) return -1;
+  for (i=1; WPSchema[i]; ++i) execOrDie(db, WPSchema[i]);
+
+  res = sqlite3_prepare_v2(db, "INSERT INTO page VALUES "
+        "(?1, ?2, ?3, '', 0, 0, 0, 0.5, '20170101000000', ?1, ?4)", -1,
+        &spage, 0); assert(res==0);
+  res = sqlite3_prepare_v2(db, "INSERT INTO revision VALUES (?1, ?1, ?1, "
+        "'comment', ?2, 'user', '20170101000000', 0, 0, ?3, 0, 'sha1')", -1,
+        &srev, 0); assert(res==0);
+  res = sqlite3_prepare_v2(db, "INSERT INTO text VALUES (?1, ?2, 'utf-8')",
+        -1, &stext, 0); assert(res==0);
+  res = sqlite3_prepare_v2(db, "INSERT INTO user VALUES (?1, ?2)", -1,
+        &suser, 0); assert(res==0);
+  memset(text, 'x', WP_TEXT_LEN);
+  text[WP_TEXT_LEN] = 0;
+
+  for (i=1; i <= npages; ++i){
+    if (i % WP_LOAD_BATCH == 1) execOrDie(db, "BEGIN");
+    sprintf(title, "Title_%d", i);
+    sqlite3_bind_int(spage, 1, i);
+    sqlite3_bind_int(spage, 2, i % WP_NAMESPACES);
+    sqlite3_bind_text(spage, 3, title, -1, SQLITE_TRANSIENT);
+    sqlite3_bind_int(spage, 4, WP_TEXT_LEN);
+    sqlite3_bind_int(srev, 1, i);
+    sqlite3_bind_int(srev, 2, i / WP_USERS_DIV);
+    sqlite3_bind_int(srev, 3, WP_TEXT_LEN);
+    sqlite3_bind_int(stext, 1, i);
+    sqlite3_bind_text(stext, 2, text, -1, SQLITE_STATIC);
+    if (sqlite3_step(spage) != SQLITE_DONE ||
+        sqlite3_step(srev) != SQLITE_DONE ||
+        sqlite3_step(stext) != SQLITE_DONE){
+      fprintf(stderr, "Error loading page %d: %s\n", i, sqlite3_errmsg(db));
+      exit(1);
+    }
+    sqlite3_reset(spage);
+    sqlite3_reset(srev);
+    sqlite3_reset(stext);
+    if (i % WP_USERS_DIV == 0){
+      sprintf(title, "User_%d", i / WP_USERS_DIV);
+      sqlite3_bind_int(suser, 1, i / WP_USERS_DIV);
+      sqlite3_bind_text(suser, 2, title, -1, SQLITE_TRANSIENT);
+      if (sqlite3_step(suser) != SQLITE_DONE){
+        fprintf(stderr, "Error loading user: %s\n", sqlite3_errmsg(db));
+        exit(1);
+      }
+      sqlite3_reset(suser);
+    }
+    if (i % WP_LOAD_BATCH == 0 || i == npages) execOrDie(db, "COMMIT");
+  }
+  sqlite3_finalize(spage);
+  sqlite3_finalize(srev);
+  sqlite3_finalize(stext);
+  sqlite3_finalize(suser);
+  return 0;
+}
+
+// A page of namespace ns, chosen at random among npages
+static int randomPage(Prng &rng, int npages, int ns){
+  int n = (npages - ns) / WP_NAMESPACES;
+  if (n <= 0) return 1;
+  return (int)(rng.next() % n) * WP_NAMESPACES + ns + (ns ? 0 : WP_NAMESPACES);
+}
+
+// binds the arguments of query q for page i
+typedef void (*BindFunc)(sqlite3_stmt *stmt, int i);
+
+static void bindTitle(sqlite3_stmt *stmt, int i){
+  char title[64];
+  sprintf(title, "Title_%d", i);
+  sqlite3_bind_text(stmt, 1, title, -1, SQLITE_TRANSIENT);
+}
+static void bindPageRev(sqlite3_stmt *stmt, int i){
+  sqlite3_bind_int(stmt, 1, i);
+  sqlite3_bind_int(stmt, 2, i);
+}
+static void bindId(sqlite3_stmt *stmt, int i){
+  sqlite3_bind_int(stmt, 1, i);
+}
+
+struct WikiQuery {
+  const char *name;
+  const char **sql;
+  int ns;          // namespace of the random pages used as arguments
+  BindFunc bind;
+};
+
+static WikiQuery WPQueries[] = {
+  { "get_page_cols", &get_page_cols, 0, bindTitle },
+  { "add_link_obj", &add_link_obj, 10, bindTitle },
+  { "fetch_from_conds", &fetch_from_conds, 1, bindPageRev },
+  { "load_stub_text", &load_stub_text, 10, bindTitle },
+  { "load_text", &load_text, 1, bindId },
+  { "update_page_stats", &update_page_stats, 1, bindId },
+  { 0, 0, 0, 0 }
+};
+
+static void explain(sqlite3 *db, const char *sql){
+  sqlite3_stmt *stmt;
+  char *esql = (char*) malloc(strlen(sql) + 32);
+  int res;
+  sprintf(esql, "EXPLAIN QUERY PLAN %s", sql);
+  res = sqlite3_prepare_v2(db, esql, -1, &stmt, 0);
+  free(esql);
+  if (res){
+    printf("    (cannot explain: %s)\n", sqlite3_errmsg(db));
+    return;
+  }
+  while (sqlite3_step(stmt) == SQLITE_ROW)
+    printf("    %s\n", (const char*) sqlite3_column_text(stmt, 3));
+  sqlite3_finalize(stmt);
+}
+
+// runs query q reps times, returns the average latency in us
+static double run(sqlite3 *db, WikiQuery *q, int npages, int reps, Prng &rng){
+  sqlite3_stmt *stmt;
+  u64 start, total = 0;
+  int i, res;
+
+  res = sqlite3_prepare_v2(db, *q->sql, -1, &stmt, 0);
+  if (res){
+    printf("    (cannot prepare: %s)\n", sqlite3_errmsg(db));
+    return 0;
+  }
+  for (i=0; i < reps; ++i){
+    q->bind(stmt, randomPage(rng, npages, q->ns));
+    start = nowus();
+    while ((res = sqlite3_step(stmt)) == SQLITE_ROW) ;
+    total += nowus() - start;
+    if (res != SQLITE_DONE){
+      printf("    (error: %s)\n", sqlite3_errmsg(db));
+      break;
+    }
+    sqlite3_reset(stmt);
+  }
+  sqlite3_finalize(stmt);
+  return reps ? (double) total / reps : 0;
+}
+
+int main(int argc, char **argv){
+  sqlite3 *db;
+  Prng rng;
+  double lat[2];
+  int npages = 10000, reps = 1000;
+  int c, mode, res;
+  WikiQuery *q;
+
+  while ((c = getopt(argc, argv, "n:r:")) != -1){
+    switch(c){
+    case 'n': npages = atoi(optarg); break;
+    case 'r': reps = atoi(optarg); break;
+    default:
+      fprintf(stderr, "usage: %s [-n npages] [-r reps] dbname\n", argv[0]);
+      exit(1);
+    }
+  }
+  if (optind != argc-1 || npages < 2*WP_NAMESPACES){
+    fprintf(stderr, "usage: %s [-n npages] [-r reps] dbname\n", argv[0]);
+    exit(1);
+  }
+
+  res = sqlite3_open(argv[optind], &db);
+  if (res){
+    fprintf(stderr, "Cannot open database %s\n", argv[optind]);
+    exit(1);
+  }
+  if (load(db, npages)) printf("Tables exist, skipping load\n");
+  else printf("Loaded %d pages\n", npages);
+
+  for (q = WPQueries; q->name; ++q){
+    printf("%s\n", q->name);
+    for (mode=0; mode < 2; ++mode){
+      sqlite3_test_control(SQLITE_TESTCTRL_OPTIMIZATIONS, db,
+                           mode ? WP_DISABLE_RPCCOST : 0);
+      printf("  %s costs:\n", mode ? "sqlite" : "rpc-aware");
+      explain(db, *q->sql);
+      lat[mode] = run(db, q, npages, reps, rng);
+    }
+    printf("  avg latency (us): rpc-aware %.1f sqlite %.1f\n", lat[0], lat[1]);
+  }
+  sqlite3_test_control(SQLITE_TESTCTRL_OPTIMIZATIONS, db, 0);
+  sqlite3_close(db);
+  return 0;
+}
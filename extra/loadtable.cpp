@@ -0,0 +1,212 @@
+//
+// loadtable.cpp
+//
+// Loads rows into a table of a distributed B-tree using the bulk-load path
+// (DdBulkLoad), or one row at a time for comparison, and reports the rate.
+// Rows come from a file with one "key value" line per row, sorted by key,
+// or are generated.
+//
+
+/*
+  Original code: Copyright (c) 2014 Microsoft Corporation
+  Modified code: Copyright (c) 2015-2016 VMware, Inc
+  All rights reserved. 
+
+  Written by Marcos K. Aguilera
+
+  MIT License
+
+  Permission is hereby granted, free of charge, to any person
+  obtaining a copy of this software and associated documentation files
+  (the "Software"), to deal in the Software without restriction,
+  including without limitation the rights to use, copy, modify, merge,
+  publish, distribute, sublicense, and/or sell copies of the Software,
+  and to permit persons to whom the Software is furnished to do so,
+  subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED *AS IS*, WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+  BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+  ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#include <unistd.h>
+#include <vector>
+#include <string>
+
+#include "options.h"
+#include "tmalloc.h"
+#include "os.h"
+#include "treedirect.h"
+
+#define LINELEN 4096
+#define INSERT_TXROWS 100 // rows per transaction when inserting one at a time
+#define INSERT_RETRIES 10 // attempts of each such transaction
+
+DdConnection *conn;
+DdTable *table;
+
+struct RowSource {
+  FILE *f;          // file with rows, or 0 to generate them
+  i64 nrows;        // rows to generate
+  int valuesize;    // size of generated values
+  i64 next;         // next row
+  char line[LINELEN];
+  char *value;
+};
+
+// Returns 0 and the next row, or 1 at the end (see DdBulkLoad)
+int nextRow(i64 *key, const char **data, int *len, void *parm){
+  RowSource *rs = (RowSource*) parm;
+  char *ptr;
+
+  if (rs->f){
+    do {
+      if (!fgets(rs->line, LINELEN, rs->f)) return 1;
+      ptr = strchr(rs->line, '\n');
+      if (ptr) *ptr = 0;
+    } while (!rs->line[0]);
+    *key = (i64) strtoll(rs->line, &ptr, 10);
+    while (*ptr == ' ' || *ptr == '\t') ++ptr;
+    *data = ptr;
+    *len = (int) strlen(ptr)+1;
+  } else {
+    if (rs->next >= rs->nrows) return 1;
+    *key = rs->next;
+    sprintf(rs->value, "%lld", (long long) rs->next);
+    *data = rs->value;
+    *len = rs->valuesize;
+  }
+  ++rs->next;
+  return 0;
+}
+
+// Inserts rows in one transaction, retrying it if it aborts
+int insertTx(std::vector<i64> &keys, std::vector<std::string> &values){
+  int i, res, attempt;
+
+  res = 0;
+  for (attempt=0; attempt < INSERT_RETRIES; ++attempt){
+    DdStartTx(conn);
+    for (i=0; i < (int) keys.size(); ++i){
+      res = DdInsert(table, keys[i], values[i].data(), (int) values[i].size());
+      if (res) break;
+    }
+    if (res) DdRollbackTx(conn);
+    else res = DdCommitTx(conn);
+    if (!res) break;
+  }
+  return res;
+}
+
+// Inserts the rows with DdInsert, INSERT_TXROWS rows per transaction
+int insertRows(RowSource *rs, u64 *nrows){
+  std::vector<i64> keys;
+  std::vector<std::string> values;
+  i64 key;
+  const char *data;
+  int len, res;
+
+  *nrows = 0;
+  while (nextRow(&key, &data, &len, rs) == 0){
+    keys.push_back(key);
+    values.push_back(std::string(data, len));
+    if ((int) keys.size() == INSERT_TXROWS){
+      res = insertTx(keys, values);
+      if (res) return res;
+      *nrows += keys.size();
+      keys.clear();
+      values.clear();
+    }
+  }
+  if (keys.empty()) return 0;
+  res = insertTx(keys, values);
+  if (!res) *nrows += keys.size();
+  return res;
+}
+
+int main(int argc, char **argv)
+{
+  char *dbname, *filename = 0;
+  int badargs=0;
+  u64 itable, nrows;
+  int res, c;
+  bool optcreate = false, optinsert = false;
+  RowSource rs;
+  u64 start, elapsed;
+
+  memset(&rs, 0, sizeof(RowSource));
+  rs.nrows = 100000;
+  rs.valuesize = 100;
+
+  while ((c = getopt(argc,argv, "cif:n:s:")) != -1){
+    switch(c){
+    case 'c': optcreate = true; break;
+    case 'i': optinsert = true; break;
+    case 'f': filename = optarg; break;
+    case 'n': rs.nrows = atoll(optarg); break;
+    case 's': rs.valuesize = atoi(optarg); break;
+    default: ++badargs;
+    }
+  }
+  argc = argc - optind;
+
+  if (argc != 2 || badargs || rs.valuesize < 24){
+    fprintf(stderr, "usage: %s [-c] [-i] [-f file | -n nrows] [-s size] "
+            "dbname containerid  (containerid in hex)\n", argv[0]);
+    fprintf(stderr, "  -c create the table\n");
+    fprintf(stderr, "  -i insert rows one at a time instead of bulk loading\n");
+    fprintf(stderr, "  -f load rows from file, one \"key value\" line per row, "
+            "sorted by key\n");
+    fprintf(stderr, "  -n generate this many rows (default 100000)\n");
+    fprintf(stderr, "  -s size of generated values, at least 24 "
+            "(default 100)\n");
+    exit(1);
+  }
+
+  dbname = argv[optind];
+  sscanf(argv[optind+1], "%llx", (long long*)&itable);
+  if (filename){
+    rs.f = fopen(filename, "r");
+    if (!rs.f){ fprintf(stderr, "Cannot open %s\n", filename); exit(1); }
+  }
+  rs.value = new char[rs.valuesize];
+  memset(rs.value, 0, rs.valuesize);
+
+  DdInit();
+  res = DdInitConnection(dbname, conn);
+  if (res){ fprintf(stderr, "Error connecting to %s: %d\n", dbname, res); exit(1); }
+
+  if (optcreate) res = DdCreateTable(conn, itable, table);
+  else res = DdOpenTable(conn, itable, table);
+  if (res){ fprintf(stderr, "Error %s table %llx: %d\n", optcreate ? "creating" : "opening", (long long)itable, res); exit(1); }
+
+  start = Time::now();
+  if (optinsert) res = insertRows(&rs, &nrows);
+  else res = DdBulkLoad(table, nextRow, (void*) &rs, &nrows);
+  elapsed = Time::now() - start;
+  if (res){ fprintf(stderr, "Error loading table: %d\n", res); exit(1); }
+
+  printf("%s %llu rows in %.3f s: %.0f rows/s\n",
+         optinsert ? "Inserted" : "Bulk loaded", (unsigned long long) nrows,
+         (double) elapsed / 1000.0,
+         elapsed ? (double) nrows * 1000.0 / elapsed : 0.0);
+
+  if (rs.f) fclose(rs.f);
+  delete [] rs.value;
+  DdCloseTable(table);
+  DdCloseConnection(conn);
+  DdUninit();
+  exit(0);
+}
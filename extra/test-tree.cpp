@@ -176,7 +176,8 @@ void checkHorizontal(Transaction *tx, COid coid, int direction, bool strongcheck
 
 // if allkeys is set, stores all found keys there
 // if strongcheck is true, do full horizontal traversals for every node (slow)
-void checkCoid(COid startcoid, Set<I64> *allkeys, bool strongcheck){
+// Returns the number of nodes in the tree
+int checkCoid(COid startcoid, Set<I64> *allkeys, bool strongcheck){
   Transaction *tx;
   tx = new Transaction(SC);
   LinkList<COidQueueElement> coidqueue;
@@ -260,19 +261,21 @@ void checkCoid(COid startcoid, Set<I64> *allkeys, bool strongcheck){
     }
   }
   delete tx;
+  return pastcoids.getNitems();
 }
 
 // checks an entire tree.
 // If keys is set, check that tree stores exactly those keys
 // If strongcheck is done, do full horizontal traversals for every node (slow)
-void checkTree(COid startcoid, Set<I64> *keys, bool strongcheck=true){
+// Returns the number of nodes in the tree
+int checkTree(COid startcoid, Set<I64> *keys, bool strongcheck=true){
   Set<I64> allkeys;
-  int i;
+  int i, nnodes;
   
   if (!keys){
-    checkCoid(startcoid, 0, strongcheck);
+    nnodes = checkCoid(startcoid, 0, strongcheck);
   } else {
-    checkCoid(startcoid, &allkeys, strongcheck);
+    nnodes = checkCoid(startcoid, &allkeys, strongcheck);
     if (allkeys.getNitems() != keys->getNitems()){
       printf("checkTree: got %d expected %d\n", allkeys.getNitems(), keys->getNitems());
     }
@@ -287,6 +290,7 @@ void checkTree(COid startcoid, Set<I64> *keys, bool strongcheck=true){
       ptr2 = allkeys.getNext(ptr2);
     }
   }
+  return nnodes;
 }
 
 // test1: without concurrency, write random keys, read them, update them,
@@ -1229,6 +1233,81 @@ void launch_test7(){
 }
 
 
+// test8: without concurrency, write keys, delete 90% of them, and check that
+// the server splitter merges the sparse nodes left behind
+#define TEST8_NITEMS 10000
+#define TEST8_MERGE_WAIT_MS 5000
+#define TEST8_VAL "VAL"
+#define TEST8_LEN 4
+
+void test8(){
+  int i;
+  i64 key;
+  u64 itable;
+  DdTable *table;
+  bool done;
+  int res, nbefore, nafter;
+  Set<I64> allkeys;
+  COid coid;
+
+  itable = 8;
+  DdInit();
+  res = DdInitConnection(dbname, conn);
+  if (res){ fprintf(stderr, "Error connecting to %s: %d\n", dbname, res); exit(1); }
+
+  res = DdCreateTable(conn, itable, table);
+  if (res){ fprintf(stderr, "Error creating table %llx: %d\n",
+                    (long long)itable, res); exit(1); }
+
+  for (i=0; i < TEST8_NITEMS; ++i){
+    key = i+1;
+    res = allkeys.insert(key); assert(res==0);
+    do {
+      res = DdStartTx(conn); assert(res==0);
+      res = DdInsert(table, key, TEST8_VAL, TEST8_LEN); assert(res==0);
+      res = DdCommitTx(conn);
+      done = res == 0;
+    } while (!done);
+  }
+
+  coid.cid = getCidTable(nameToDbid(dbname, false), itable);
+  coid.oid = 0;
+  mssleep(TEST8_MERGE_WAIT_MS); // let pending splits finish
+  nbefore = checkTree(coid, &allkeys, false);
+
+  for (i=0; i < TEST8_NITEMS; ++i){
+    if (i % 10 == 0) continue;
+    key = i+1;
+    res = allkeys.remove(key); assert(res==0);
+    do {
+      res = DdStartTx(conn); assert(res==0);
+      res = DdDelete(table, key); assert(res==0);
+      res = DdCommitTx(conn);
+      done = res == 0;
+    } while (!done);
+  }
+
+  mssleep(TEST8_MERGE_WAIT_MS);
+  nafter = checkTree(coid, &allkeys, true);
+  printf("  Nodes before deletes %d after %d\n", nbefore, nafter);
+  assert(nafter * 4 < nbefore);
+
+  DdCloseConnection(conn);
+  DdUninit();
+}
+
+void launch_test8(){
+  pid_t pid;
+  int status;
+  pid = fork();
+  if (!pid){ // child
+    test8();
+    exit(0);
+  } else { // park
+    waitpid(pid, &status, 0);
+  }
+}
+
 int main(){
   printf("Test1\n");
   launch_test1();
@@ -1247,8 +1326,14 @@ int main(){
   launch_test7();
 #else
   printf("  Skipped (nodesplits disabled)\n");
-  printf("Done\n");
 #endif  
+  printf("Test8\n");
+#if DTREE_SPLIT_LOCATION == 2
+  launch_test8();
+#else
+  printf("  Skipped (merges need DTREE_SPLIT_LOCATION=2)\n");
+#endif
+  printf("Done\n");
   
   exit(0);
 }  
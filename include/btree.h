@@ -207,6 +207,21 @@ int sqlite3BtreeCursorIsValid(BtCursor*);
 int sqlite3BtreeCount(BtCursor *, i64 *);
 #endif
 
+int sqlite3BtreeScanFilter(BtCursor*, const char*, int); // YESQUEL CH: added
+int sqlite3BtreeJoinBatch(BtCursor*, BtCursor*, int); // YESQUEL CH: added
+
+/* YESQUEL CH: added. Shape of the distributed tree of a table or index,
+** estimated from a few root-to-leaf paths (see sqlite3BtreeTreeStats) */
+typedef struct BtTreeStats BtTreeStats;
+struct BtTreeStats {
+  double nRow;       /* cells in the leaves */
+  double nLeaf;      /* leaves */
+  int nHeight;       /* levels of inner nodes above the leaves */
+  int nServer;       /* storage servers holding the leaves or row data */
+  u64 tSample;       /* when sampled (in ms), 0 if never */
+};
+int sqlite3BtreeTreeStats(Btree*, u64 iTable, BtTreeStats*); // YESQUEL CH: added
+
 #ifdef SQLITE_TEST
 int sqlite3BtreeCursorInfo(BtCursor*, int*, int);
 void sqlite3BtreeCursorList(Btree*);
@@ -222,6 +222,10 @@
 
 #include "cellbuf.h"
 
+class DtParallelScan; // YESQUEL CH: added (see dtreescan.h)
+struct DtScanLeaf;
+struct DtJoinBatch; // YESQUEL CH: added (see dtree.cpp)
+
 
 /* The following value is the maximum cell size assuming a maximum page
 ** size give above.
@@ -531,6 +535,11 @@ struct BtCursor {
   //u8 atLast;                /* Cursor pointing to the last entry */ // YESQUEL CH: removed 
   //u8 validNKey;             /* True if info.nKey is valid */ // YESQUEL CH: removed
   u8 eState;                   /* One of the CURSOR_XXX constants (see below) */
+  DtParallelScan *pscan;       /* parallel scan feeding Next(), or NULL */ // YESQUEL CH: added
+  DtScanLeaf *scanLeaf;        /* leaf returned by pscan, with prefetched data */ // YESQUEL CH: added
+  const char *scanFilter;      /* filter pushed to pscan (see scanfilter.h), or NULL */ // YESQUEL CH: added
+  int scanFilterLen;           /* length of scanFilter */ // YESQUEL CH: added
+  DtJoinBatch *joinBatch;      /* rows read ahead of lookups, or NULL */ // YESQUEL CH: added
 #ifndef SQLITE_OMIT_INCRBLOB
   //  Pgno *aOverflow;           /* Cache of overflow page locations */ // YESQUEL CH: removed
   //  u8 isIncrblobHandle;       /* True if this cursor is an incr. io handle */ // YESQUEL CH: removed
@@ -60,11 +60,18 @@
 #include "ccache.h"
 
 struct ServerInfo;
+struct GetStatusRPCResp;
+struct ServerMetrics;
 
-// maps object id's to servers
+// maps object id's to servers, using the placement directory in ConfigState
 class ObjectDirectory {
 private:
   ConfigState *Config;
+  Ptr<RPCTcp> Rpcc;  // to fetch the directory from servers (if set)
+  int Stale;         // set when a reply carries a newer epoch than ours
+  u32 Refreshing;    // 1 while some thread is fetching the directory
+  static void directoryCallback(char *data, int len, void *callbackdata);
+  static void replyTagObserver(void *ctx, u16 tag);
 
 public:
   // get server IPPort and server number (optionally) of a given object id,
@@ -73,7 +80,25 @@ public:
   void GetServerId(const COid& coid, IPPortServerno &ipps);
   //void GetServerId(const COid& coid, IPPort &ipport);
 
-  ObjectDirectory(ConfigState *cs){ Config = cs; }
+  // Fetch directory from all servers and install the one with the largest
+  // epoch, if larger than ours. If another thread is already fetching it,
+  // return immediately. Returns number of servers that did not respond.
+  int refresh(void);
+
+  // Installs a copy of dir if it is newer than the directory in use
+  void setDir(PlacementDir *dir);
+  PlacementDir *getDir(void){ return Config->Dir; }
+
+  // returns a bucket (serverid) owned by the given server, searching from
+  // hint onwards, or -1 if the server owns no buckets
+  int bucketOfServer(int serverno, unsigned hint);
+
+  // Fetch directory from servers, and from now on track the epochs
+  // piggybacked on replies received by rpcc, refreshing the directory
+  // when they change
+  void track(Ptr<RPCTcp> rpcc);
+
+  ObjectDirectory(ConfigState *cs){ Config = cs; Stale = 0; Refreshing = 0; }
 };
 
 // stores a storage configuration, indicating names of storage servers, etc
@@ -91,17 +116,70 @@ private:
   static void flushServersCallback(char *data, int len, void *callbackdata);
   static void loadServersCallback(char *data, int len, void *callbackdata);
 
+  // aux functions for resizeServers
+  int migrateRPC(int server, int op, u16 *buckets, int nbuckets, char *buf,
+                 int len, u64 *retcount, char **retbuf, int *retlen);
+  int moveBuckets(PlacementDir *dir, u16 *buckets, int nbuckets, int src,
+                  int dst);
+
+  // backups for follower reads: Backups[i] is a backup of server i, or has
+  // ip 0 if server i has none. Null if GAIABACKUPS_ENV is not set.
+  IPPort *Backups;
+  void initBackups(void); // parses GAIABACKUPS_ENV
+
+  // how far behind the clock the safe timestamp of each server was when it
+  // was last piggybacked on a read reply, in us, or -1 if not heard yet
+  int *SafeTsLagUs;
+
 public:
   ConfigState *CS;
   ObjectDirectory *Od;
   Ptr<RPCTcp> Rpcc;
   ClientCache *CCache;
 
+  // If server serverno has a backup for follower reads, sets ipport to it
+  // and returns true. Otherwise returns false.
+  bool getBackup(int serverno, IPPort &ipport){
+    if (!Backups || serverno < 0 || serverno >= CS->Nservers ||
+        !Backups[serverno].ip) return false;
+    ipport = Backups[serverno];
+    return true;
+  }
+
+  // records the safe timestamp piggybacked on a read reply of a server
+  void reportSafeTs(int serverno, Timestamp &safets){
+    int lag;
+    if (safets.isIllegal() || serverno < 0 || serverno >= CS->Nservers)
+      return;
+    lag = safets.ageus();
+    SafeTsLagUs[serverno] = lag > 0 ? lag : 0;
+  }
+
+  // Returns how far in the past to read, in us, so that no server makes
+  // the reads wait for pending transactions, assuming the safe timestamps
+  // of servers keep their last reported lag. Servers not heard yet are
+  // assumed to lag by unknownus.
+  int safeTsLagUs(int unknownus){
+    int i, lag, maxlag = 0;
+    for (i=0; i < CS->Nservers; ++i){
+      lag = SafeTsLagUs[i];
+      if (lag < 0) lag = unknownus;
+      if (lag > maxlag) maxlag = lag;
+    }
+    return maxlag;
+  }
+
   // ping and wait for response once to each server (eg, to make sure
   // they are all up)
   void pingServers(void);
 
-  void getStatusServers(void);
+  // get status of all servers. If resps!=0, it should have room for
+  // CS->Nservers entries, and the status of server i is stored in resps[i].
+  // Likewise for metrics, which if set asks servers for their metrics.
+  // If verbose, print status. Returns number of servers that did not respond
+  // (their entries are zeroed).
+  int getStatusServers(GetStatusRPCResp *resps=0, bool verbose=true,
+                       ServerMetrics *metrics=0);
 
   // the functions below invoke various RPCs on all servers to ask them
   // to do various things
@@ -113,6 +191,10 @@ public:
   void loadServers(char *filename=0);  // load storage contents from a given
                                         // filename or the default filename
 
+  // Move objects so that bucket b belongs to server b % nactive, while
+  // servers keep serving. Returns 0 if ok, non-0 if error.
+  int resizeServers(int nactive);
+
   StorageConfig(const char *configfile); // this constructor builds the RPCTcp
          // object. Intended to be used at the client
                  
@@ -122,6 +204,8 @@ public:
   ~StorageConfig(){
     if (CS && Rpcc.isset()) CS->disconnectHosts(Rpcc); // disconnect clients
     if (Od){ delete Od; Od=0; }
+    if (Backups){ delete [] Backups; Backups=0; }
+    if (SafeTsLagUs){ delete [] SafeTsLagUs; SafeTsLagUs=0; }
     if (CS){ delete CS; CS=0; }
   }
 };
@@ -77,6 +77,7 @@ public:
   // the methods below are as in class Transaction
   int start();
   int startDeferredTs(void);
+  int startReadOnly(int maxstalems=-1);
   int write(COid coid, char *buf, int len);
   int writev(COid coid, int nbufs, iovec *bufs);
   int put(COid coid, char *buf, int len){ return write(coid, buf, len); }
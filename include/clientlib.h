@@ -66,6 +66,10 @@
 // will be now minus MAX_DEFERRED_START_TS
 #define MAX_DEFERRED_START_TS 1000
 
+// how far in the past read-only transactions read, in ms, when the client
+// has not yet heard the safe timestamp of some server (see startReadOnly)
+#define READONLY_DEFAULT_LAG_MS 100
+
 #define TID_TO_RPCHASHID(tid) ((u32)tid.d1)  // rpc hashid to use for a given
      // tid. Currently, returns d1, which is the client's IP + PID. Thus, all
      // requests of the client are assigned the same rpc hashid, so they are
@@ -153,6 +157,11 @@ private:
   bool hasWrites;
   bool hasWritesCachable; // whether tx writes to cachable items
   int currlevel;          // current subtransaction level
+  bool followerRead;      // whether reads may go to backups (see
+                          // startFollowerRead)
+  bool readOnly;          // whether tx is read-only (see startReadOnly)
+  static Tlocal Timestamp LastCommitTs; // commit timestamp of the last
+                          // transaction committed by this thread
 
   char *piggy_buf;   // data to be piggybacked
   IPPortServerno piggy_server; // server holding coid to be written
@@ -163,6 +172,8 @@ private:
                      // the order does not match as piggy writes are
                      // always done first)
   int piggy_level;   // level of data
+  SkipList<IPPortServerno,SubtransHeader> PendingSubtrans; // level changes
+                     // not yet sent to each server (see SubtransHeader)
 #ifdef GAIA_OCC
   Set<COid> ReadSet;
 #endif
@@ -232,19 +243,37 @@ private:
     InbacCallbackData *prev, *next; // linklist stuff
   };
 
-  int auxinbac(Timestamp committs);
+  int auxinbac(Timestamp &committs);
   static void auxinbaccallback(char *data, int len, void *callbackdata);
 
-  // ---------------------------- Subtrans RPC ---------------------------------
-
-  struct SubtransCallbackData {
-    Semaphore sem; // to wait for response
-    SubtransRPCResp data;
-    SubtransCallbackData *prev, *next; // linklist stuff
+  // ---------------------------- FilterRead RPC -------------------------------
+
+  struct FilterReadCallbackData {
+    Semaphore sem;     // to wait for response
+    IPPortServerno server;
+    Cid cid;
+    Timestamp readts;  // start timestamp of transaction
+    int n;             // entries in idx
+    int *idx;          // indices of requested objects sent to server
+    Oid *oids;         // requested objects, indexed by idx
+    Ptr<Valbuf> *bufs; // where to place results, indexed by idx
+    u8 *filtered;      // ditto
+    int status;        // 0 if got response, else error
+    Timestamp safeTs;  // safe timestamp reported by server
+    FilterReadCallbackData *prev, *next; // linklist stuff
+    FilterReadCallbackData(){ idx = 0; }
+    ~FilterReadCallbackData(){ if (idx) delete [] idx; }
   };
 
-  static void auxsubtranscallback(char *data, int len, void *callbackdata);
-  int auxsubtrans(int level, int action);
+  static void auxfilterreadcallback(char *data, int len, void *callbackdata);
+
+  // ------------------------- Subtrans level changes --------------------------
+
+  // records a level change (0=abort, 1=release) for all servers of the
+  // transaction, to be sent with the next request to each of them
+  void addSubtrans(int level, int action);
+  // moves the level changes not yet sent to server into sh
+  void takeSubtrans(IPPortServerno &server, SubtransHeader &sh);
 
 
 public:
@@ -264,6 +293,31 @@ public:
   // having read.
   int startDeferredTs(void);
 
+  // start a transaction whose start timestamp is stalems in the past, and
+  // whose reads go to the backups listed in GAIABACKUPS_ENV, if any. A backup
+  // that has not yet applied the updates up to the start timestamp returns
+  // GAIAERR_REPL_LAG, in which case the read goes to the primary instead.
+  // The transaction may write, but it is then more likely to abort.
+  int startFollowerRead(int stalems);
+
+  // start a read-only transaction. Its start timestamp is below the safe
+  // timestamps that servers piggyback on read replies, so its reads do not
+  // wait for pending transactions, and committing it costs no round trip.
+  // It still sees the transactions previously committed by this thread.
+  // If maxstalems >= 0, the start timestamp is at most maxstalems in the
+  // past (a bounded-staleness snapshot), even if reads may then wait.
+  // Updates return GAIAERR_READ_ONLY.
+  int startReadOnly(int maxstalems=-1);
+
+  // start a read-only transaction that reads the snapshot at startts,
+  // typically the start timestamp of another transaction (see getStartTs).
+  // This lets several threads read the same snapshot.
+  int startReadOnlyAt(Timestamp startts);
+
+  // returns the start timestamp. It is illegal if the transaction was
+  // started with startDeferredTs and has not read yet
+  Timestamp getStartTs(void){ return StartTs; }
+
   // write an object in the context of a transaction.
   // Returns status:
   //   0=no error
@@ -292,6 +346,19 @@ public:
   int vsuperget(COid coid, Ptr<Valbuf> &buf, ListCell *cell,
                 Ptr<RcKeyInfo> prki);
 
+  // read the values of n objects of container cid, skipping those whose
+  // contents after the first skip bytes do not satisfy filter (see
+  // scanfilter.h). Each server evaluates the filter on its objects, so that
+  // the values of skipped objects are not sent. For each i, sets
+  // filtered[i] to 1 if oids[i] was skipped; otherwise sets bufs[i] to its
+  // value, or leaves bufs[i] unset if it could not be read.
+  // Returns 0 if ok, 1 if the filter cannot be evaluated by the servers
+  // because the transaction has written or has no start timestamp yet (in
+  // which case nothing is read and the caller should use vget), or
+  // a negative error.
+  int vgetFilter(Cid cid, int n, Oid *oids, int skip, const char *filter,
+                 int filterlen, Ptr<Valbuf> *bufs, u8 *filtered);
+
   static void readFreeBuf(char *buf); // frees a buffer returned by
                                       // readNewBuf() or get()
   static char *allocReadBuf(int len); // allocates a buffer that can be freed
@@ -103,7 +103,22 @@ inline u64 getCidTable(u64 dbid, u64 iTable){
   return ((u64)dbid<<32) | DTREE_CID_BIT | (u64)iTable;
 }
 
+// Placement policies for nodes created by splits. A table keeps its policy
+// in the flags of its root node; DTREE_PLACEMENT_DEFAULT means use the
+// compile-time DTREE_PLACEMENT_POLICY.
+#define DTREE_PLACEMENT_DEFAULT     0
+#define DTREE_PLACEMENT_RANDOM      1 // random server
+#define DTREE_PLACEMENT_SIBLING     2 // same server as sibling node
+#define DTREE_PLACEMENT_LEASTLOADED 3 // least loaded server
+#define DTREE_PLACEMENT_MAX         3
+
 void setRandomServerid(u64 *oid); // change oid to have a random serverid
+void setLeastLoadedServerid(u64 *oid); // change oid to have the serverid of
+                                       // the least loaded server
+// change oid to have a serverid chosen according to the given placement
+// policy. sibling is the oid of the node next to the new node, used by
+// DTREE_PLACEMENT_SIBLING (if 0, a random serverid is chosen instead).
+void setPlacementServerid(u64 *oid, int policy, Oid sibling);
 void setOid(u64 *oid, u64 issuerid, u64 counter, u64 serverid); // constructs
   // oid from its components
 inline u64 getDbid(u64 cid){ return cid >> 32; } // return dbid of given cid
@@ -0,0 +1,104 @@
+//
+// coldstore.h
+//
+// Cold tier of a storage server with a memory budget. Objects that have not
+// been accessed recently, with a single version and no pending updates, have
+// their data evicted from LogInMemory to a memory-mapped file, and are
+// brought back when accessed (see LogInMemory::sweepColdTier). The file is
+// a cache of what is in memory, not a durable copy: it is truncated when the
+// server starts.
+//
+
+/*
+  Original code: Copyright (c) 2014 Microsoft Corporation
+  Modified code: Copyright (c) 2015-2016 VMware, Inc
+  All rights reserved.
+
+  Written by Marcos K. Aguilera
+
+  MIT License
+
+  Permission is hereby granted, free of charge, to any person
+  obtaining a copy of this software and associated documentation files
+  (the "Software"), to deal in the Software without restriction,
+  including without limitation the rights to use, copy, modify, merge,
+  publish, distribute, sublicense, and/or sell copies of the Software,
+  and to permit persons to whom the Software is furnished to do so,
+  subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED *AS IS*, WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+  BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+  ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+
+#ifndef _COLDSTORE_H
+#define _COLDSTORE_H
+
+#include "tmalloc.h"
+#include "os.h"
+#include "options.h"
+#include "gaiatypes.h"
+#include "pendingtx.h"
+#include "diskstorage.h"
+
+class LogInMemory;
+
+// The file is a sequence of segments of COLDTIER_SEGMENT_BYTES, each mapped
+// separately so that mappings never move as the file grows. Objects are
+// appended in the format of DiskStorage::writeCOidToFile and never cross
+// segments. An object is located by the offset and length kept in its
+// LogOneObjectInMemory.
+class ColdStore {
+private:
+  int Fd;
+  char *Segments[COLDTIER_MAX_SEGMENTS]; // mapped segments, never unmapped
+  int NSegments;
+  u64 Next;             // offset where next object is appended
+  u64 Garbage;          // bytes of objects that were superseded
+  RWLock Lock;          // serializes appends
+  DiskStorage *DS;      // to serialize objects
+  LogInMemory *Lim;     // log being swept
+  u64 Budget;           // bytes of objects to keep in memory
+  int ThreadNo;         // thread that sweeps, -1 if not launched
+
+  int addSegment(void);
+  static int sweepHandler(void *parm);
+
+public:
+  ColdStore();
+  ~ColdStore();
+
+  // Creates or truncates the file. Returns 0 if ok, non-zero if error.
+  int open(const char *filename, DiskStorage *ds);
+
+  // Appends an object. Returns 0 and its location if ok, non-zero if there
+  // is no space for it.
+  int put(Ptr<TxUpdateCoid> tucoid, u64 *retoffset, u32 *retlen);
+  // Reads back an object appended by put. Returns 0 if ok, non-zero if
+  // error. May be called concurrently with put and with other gets.
+  int get(COid &coid, u64 offset, u32 len, Ptr<TxUpdateCoid> &tucoid);
+  // Records that an object appended by put will not be read again
+  void release(u32 len){ FetchAndAdd64(&Garbage, len); }
+
+  // Schedules a sweep of lim every COLDTIER_SWEEP_MS, evicting objects
+  // while lim holds more than budget bytes of objects. The sweeps run as
+  // events of the first server worker thread, so that they are serialized
+  // with requests when there is one worker thread (in which case looims
+  // are not locked; see SKIP_LOOIM_LOCKS). Must be called after the worker
+  // threads are launched.
+  void launch(LogInMemory *lim, u64 budget);
+
+  u64 getBytes(void){ return Next; }
+  u64 getGarbage(void){ return Garbage; }
+};
+
+#endif
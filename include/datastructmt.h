@@ -36,6 +36,8 @@
 #ifndef _DATASTRUCTMT_H
 #define _DATASTRUCTMT_H
 
+#include <vector>
+
 #include "os.h"
 #include "datastruct.h"
 
@@ -67,6 +69,20 @@ public:
     return Buckets+i;
   }
 
+  // appends the keys in bucket i to keys, holding the bucket lock while
+  // copying them, so that the keys can be visited while other threads
+  // insert elements
+  void getBucketKeys(int i, std::vector<T> &keys){
+    SkipList<T,U> *b;
+    SkipListNode<T,U> *ptr;
+    assert(0 <= i && i < Nbuckets);
+    b = Buckets + i;
+    Bucket_l[i].lockRead();
+    for (ptr = b->getFirst(); ptr != b->getLast(); ptr = b->getNext(ptr))
+      keys.push_back(ptr->key);
+    Bucket_l[i].unlockRead();
+  }
+
   // clear HashTable. If delkey!=0 then invoke it for each key deleted.
   // If delvalue!= then invoke it for each value deleted.
   void clear(void (*delkey)(T&), void (*delvalue)(U)){
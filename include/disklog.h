@@ -48,13 +48,39 @@ class TaskInfo;
 #define ALIGNMOD(x)  ((x) & (ALIGNBUFSIZE-1))    // low bits of x
 
 #include <list>
+#include <sys/uio.h>
 
 #include "tmalloc.h"
 #include "gaiatypes.h"
+#include "util-more.h"
 #include "pendingtx.h"
 
 using namespace std;
 
+// On-disk format. The log is a sequence of segment files named
+// <logfile>.<segno>. A server never appends to existing segments: it starts
+// a new segment when it starts, and when the current segment reaches
+// DISKLOG_SEGMENT_BYTES. Each segment has a DiskLogSegmentHeader followed by
+// frames. A frame is a DiskLogFrameHeader followed by len bytes of payload,
+// which is either a LogEntry, or a MultiWriteLogEntry with the updates of
+// each object followed by a LogEntry with the yes vote. The crc of a frame
+// covers len and the payload, so a frame that was torn by a crash is
+// detected. The segment ends at the first frame with len 0 (the unwritten
+// tail of a segment is zero-filled) or with a bad crc.
+#define DISKLOG_MAGIC 0x474f4c59 // "YLOG"
+#define DISKLOG_FORMAT_VERSION 1
+
+struct DiskLogSegmentHeader {
+  u32 magic;   // DISKLOG_MAGIC
+  u32 version; // DISKLOG_FORMAT_VERSION
+  u64 segno;   // number of this segment
+};
+
+struct DiskLogFrameHeader {
+  u32 len;     // bytes of payload after this header
+  u32 crc;     // crc32c of len and the payload
+};
+
 enum LogEntryType { LEMultiWrite, LECommit, LEAbort, LEVoteYes };
 
 struct LogEntry {
@@ -118,9 +144,65 @@ struct DiskLogThreadContext {
 
 class TaskInfo;
 
+// Payload of a frame being written, as a list of pieces. Small fields are
+// copied into a scratch buffer, where they stay together. Data held by the
+// transaction (values, keys of cells) are referenced where they are, such
+// as the RPC request that a TxWriteItem points to, if at least
+// DISKLOG_INPLACE_MIN long, and copied only once, when the frame is written.
+class DiskLogRecord {
+private:
+  struct Piece {
+    const char *buf; // 0 if piece is in Scratch
+    int off;         // offset in Scratch if buf==0
+    int len;
+  };
+  Piece *Pieces;
+  int NPieces, MaxPieces;
+  char *Scratch;
+  int ScratchLen, ScratchMax;
+  iovec *Iov;   // filled by getIovecs
+  int MaxIov;
+  u32 Len;      // length of payload
+  Piece *newPiece(void);
+
+public:
+  DiskLogRecord();
+  ~DiskLogRecord();
+  void clear(void){ NPieces = ScratchLen = 0; Len = 0; }
+  void add(const void *buf, int len);    // copies buf
+  void addRef(const void *buf, int len); // references buf if it is long,
+                         // so buf must remain valid until the frame is written
+  u32 getLen(void){ return Len; }
+
+  // Returns the pieces as iovecs in entries 1..niov-1 of the returned
+  // array, whose entry 0 is left for the frame header. Valid until the next
+  // add() or clear().
+  iovec *getIovecs(int &niov);
+};
+
+// what caused the disk log to flush a batch
+enum DiskLogFlushReason { DLFlushBytes, DLFlushTxs, DLFlushDeadline,
+                          DLFlushIdle, DLFlushNReasons };
+
+// group commit statistics, kept by the disklog thread
+struct DiskLogStats {
+  Log2Histogram batchTxs;   // yes votes per flush
+  Log2Histogram batchBytes; // bytes per flush
+  Log2Histogram flushUs;    // latency of each flush (write and fsync), in us
+  Log2Histogram waitUs;     // how long the oldest item of each batch waited
+  u64 nflushes[DLFlushNReasons]; // number of flushes due to each reason
+  u64 flushUsAvg;           // moving average of flush latency
+  u64 waitBudgetUs;         // current maximum wait for batching
+  DiskLogStats(){ memset(nflushes, 0, sizeof(nflushes));
+                  flushUsAvg = waitBudgetUs = 0; }
+};
+
 class DiskLog {
 private:
   int f; // file handle
+  char *LogName; // prefix of names of segment files
+  u64 SegNo;     // number of the segment being written
+  DiskLogRecord Rec; // frame being written, used by writeWqi
 
   char *RawWritebuf;     // unaligned buffer as returned by new()
   char *Writebuf;        // aligned buffer to be used
@@ -132,13 +214,31 @@ private:
   WriteQueueItem *WriteQueueHead, *WriteQueueTail;  // head and tail of
                                                    // write queue
 
+  // group commit state, used only by the disklog thread
+  WriteQueueItem *PendingHead, *PendingTail; // items written to Writebuf
+                                 // but not flushed yet, with their notifies
+  u64 PendingBytes;   // bytes written to Writebuf since last flush
+  int PendingTxs;     // number of yes votes among pending items
+  u64 FirstPendingUs; // when the oldest pending item arrived
+  u64 LastArrivalUs;  // when the last yes vote arrived
+  u64 ArrivalGapUs;   // moving average of the time between yes votes
+  DiskLogStats Stats;
+
+  u64 waitBudgetUs(void); // how long a batch may wait
+  int flushReason(u64 now); // returns a DiskLogFlushReason if pending items
+                            // should be flushed now, -1 otherwise
+  void groupFlush(int reason); // flushes pending items and notifies
+
   void BufWrite(char *buf, int len);   // buffers a write to disk;
                                        // calls AlignWrite
   void auxwrite(char *buf, int len);   // writes an aligned buffer
   void BufFlush(void);                 // flushes write done
 
-  void writeWqi(WriteQueueItem *wqi);  // writes a WriteQueueItem
-                                       // (calls BufWrite several times)
+  void BufWritev(iovec *iov, int niov); // buffers a write of several pieces
+
+  void writeWqi(WriteQueueItem *wqi);  // writes a WriteQueueItem as a frame
+  void writeFrame(DiskLogRecord &rec); // writes a frame with given payload
+  void openSegment(u64 segno);         // starts writing a new segment
 
   static int PROGShipDiskReqs(TaskInfo *ti);
 
@@ -173,6 +273,20 @@ public:
   // log an abort record
   static void logAbortAsync(Tid tid, Timestamp ts);
 
+  // prints group commit statistics. Called from other threads, so numbers
+  // may be slightly inconsistent with each other
+  void printStats(void);
+
+  // Returns the highest segment number of the given log, 0 if none
+  static u64 lastSegment(const char *logname);
+
+  // Checks the frames of a segment file. Returns the number of bytes up to
+  // the end of the last valid frame (0 if the file has no valid segment
+  // header) and sets *nframes to the number of valid frames. Sets *torn
+  // if the valid frames are followed by a partially written or corrupted
+  // frame rather than by the zero-filled end of the segment.
+  static u64 checkSegment(const char *segname, u64 *nframes, bool *torn);
+
   // runs a test that logs consecutive integers from 0 to niter-1,
   // flushing batches of increasingly larger sizes
   void test(int niter);
@@ -56,6 +56,29 @@
 
 #define DTREENODE_FLAG_INTKEY    0x0001 // node holds integer keys only
 #define DTREENODE_FLAG_LEAF      0x0002 // node is a leaf
+#define DTREENODE_FLAG_PLACEMENT_MASK  0x00f0 // placement policy of table,
+#define DTREENODE_FLAG_PLACEMENT_SHIFT 4      // only meaningful in root node.
+                                              // See DTREE_PLACEMENT_* in coid.h
+// Split and merge thresholds of the table (see DTreeThresholds below). A value
+// of 0 in a field means use the compile-time default. The root holds the
+// table's thresholds; other nodes hold a copy, refreshed when they are split
+// or merged, so that servers can check them without reading the root.
+#define DTREENODE_FLAG_MERGE_MASK       0x000000000000ff00ULL // merge percent
+#define DTREENODE_FLAG_MERGE_SHIFT      8
+#define DTREENODE_FLAG_SPLITCELLS_MASK  0x00000000ffff0000ULL // split cells
+#define DTREENODE_FLAG_SPLITCELLS_SHIFT 16
+#define DTREENODE_FLAG_SPLITBYTES_MASK  0x0000ffff00000000ULL // split bytes,
+#define DTREENODE_FLAG_SPLITBYTES_SHIFT 32                    // in units of
+#define DTREENODE_SPLITBYTES_UNIT       64                    // this many bytes
+#define DTREENODE_FLAG_THRESHOLD_MASK (DTREENODE_FLAG_MERGE_MASK | \
+          DTREENODE_FLAG_SPLITCELLS_MASK | DTREENODE_FLAG_SPLITBYTES_MASK)
+#define DTREENODE_MERGE_NEVER           0xff // merge percent: never merge
+
+// Header stored before the data in a data KV pair.
+// This header is not used for Dtree nodes.
+struct DataHeader {
+  int dummy;
+};
 
 #define DTREENODE_NATTRIBS           5  // number of attribs in each node
 // attribute numbers
@@ -92,6 +115,10 @@ public:
   bool isRoot(){ return raw->coid.oid==0; } // root is oid 0
   bool isLeaf(){ return (Flags() & DTREENODE_FLAG_LEAF) != 0; }
   bool isInner(){ return !isLeaf(); }
+  int PlacementPolicy(){ // placement policy stored in flags (0 if none)
+    return (int)((Flags() & DTREENODE_FLAG_PLACEMENT_MASK) >>
+                 DTREENODE_FLAG_PLACEMENT_SHIFT);
+  }
   bool isIntKey(){ 
     assert(((Flags() & DTREENODE_FLAG_INTKEY) != 0) ==
            (raw->u.raw->CellType==0));
@@ -106,6 +133,46 @@ public:
   static void InitSuperValue(SuperValue *sv, u8 celltype);
 };
 
+// Split and merge thresholds of a table, decoded from the flags of a node
+class DTreeThresholds {
+public:
+  int splitCells;   // split node with more cells than this
+  int splitBytes;   // split node whose cells take more bytes than this
+  int mergePercent; // merge node below this % of the split thresholds
+                    // (0 = never merge)
+
+  DTreeThresholds(){ fromFlags(0); }
+  DTreeThresholds(u64 flags){ fromFlags(flags); }
+
+  void fromFlags(u64 flags){
+    int v;
+    v = (int)((flags & DTREENODE_FLAG_SPLITCELLS_MASK) >>
+              DTREENODE_FLAG_SPLITCELLS_SHIFT);
+    splitCells = v ? v : DTREE_SPLIT_SIZE;
+    v = (int)((flags & DTREENODE_FLAG_SPLITBYTES_MASK) >>
+              DTREENODE_FLAG_SPLITBYTES_SHIFT);
+    splitBytes = v ? v * DTREENODE_SPLITBYTES_UNIT : DTREE_SPLIT_SIZE_BYTES;
+    v = (int)((flags & DTREENODE_FLAG_MERGE_MASK) >> DTREENODE_FLAG_MERGE_SHIFT);
+    if (v == DTREENODE_MERGE_NEVER) mergePercent = 0;
+    else mergePercent = v ? v : DTREE_MERGE_PERCENT;
+  }
+
+  // whether a node with the given number of cells and size should be split
+  bool needSplit(int ncells, int size){
+    return ncells > splitCells || size > splitBytes && ncells >= 2;
+  }
+  // whether a node is sparse enough that it should be merged with a sibling
+  bool needMerge(int ncells, int size){
+    return ncells * 100 < splitCells * mergePercent &&
+           size * 100 < splitBytes * mergePercent;
+  }
+  // whether a node resulting from a merge is small enough to keep
+  bool canMerge(int ncells, int size){
+    return ncells * 100 <= splitCells * DTREE_MERGE_FILL_PERCENT &&
+           size * 100 <= splitBytes * DTREE_MERGE_FILL_PERCENT;
+  }
+};
+
 // prototype definitions
 int auxReadReal(KVTransaction *tx, COid coid, DTreeNode &outptr,
                 ListCell *cell, Ptr<RcKeyInfo> prki);
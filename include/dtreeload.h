@@ -0,0 +1,110 @@
+//
+// dtreeload.h
+//
+// Bulk loading of a distributed B-tree. Rows sorted by key are packed into
+// full leaves, and the inner nodes are built bottom-up as leaves fill up.
+// Nodes and rows are written in large transactions spread across the
+// servers, and the new tree is swapped in under the table's root at the end,
+// in one transaction.
+//
+
+/*
+  Original code: Copyright (c) 2014 Microsoft Corporation
+  Modified code: Copyright (c) 2015-2016 VMware, Inc
+  All rights reserved.
+
+  Written by Marcos K. Aguilera
+
+  MIT License
+
+  Permission is hereby granted, free of charge, to any person
+  obtaining a copy of this software and associated documentation files
+  (the "Software"), to deal in the Software without restriction,
+  including without limitation the rights to use, copy, modify, merge,
+  publish, distribute, sublicense, and/or sell copies of the Software,
+  and to permit persons to whom the Software is furnished to do so,
+  subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED *AS IS*, WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+  BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+  ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#ifndef _DTREELOAD_H
+#define _DTREELOAD_H
+
+#include <vector>
+
+#include "options.h"
+#include "gaiatypes.h"
+#include "kvinterface.h"
+#include "dtreeaux.h"
+
+struct DtLoadWrite;
+
+class DtBulkLoad {
+private:
+  // node being filled at each level of the new tree
+  struct Level {
+    SuperValue node;
+    Oid oid;
+    int nnodes;        // nodes started at this level
+    bool hasPending;   // inner levels: whether pending holds a child
+    ListCell pending;  // last child closed, not yet placed in node
+    i64 maxKey;        // largest key under node, once its last child is set
+  };
+
+  u64 RootCid;
+  bool Remote;
+  u64 RootFlags;
+  int Policy;                 // placement policy of table
+  int MaxCells, MaxBytes;     // fill limits of new nodes
+  Oid FirstLeaf;              // empty leaf of the table, if any, which
+                              // becomes the first leaf of the new tree
+  SuperValue *FirstLeafNode;  // its new contents, written with the root
+  Level Levels[DTREE_MAX_LEVELS];
+  bool HasLastKey;
+  i64 LastKey;
+  std::vector<DtLoadWrite*> Batch; // writes of the next transaction
+  u64 NRows, NNodes, NTxs;
+
+  DtBulkLoad();
+  Oid newOid(Oid sibling);
+  void openNode(int level, Oid oid);
+  int closeNode(int level, Oid rightoid);
+  int addChild(int level, ListCell &child);
+  int write(COid coid, SuperValue *sv, char *buf, int len);
+  int flush(void);
+  int swapRoot(SuperValue *top, int height);
+
+public:
+  ~DtBulkLoad();
+
+  // Starts loading the tree with root rootcid. The table must be an intkey
+  // table, it must be empty, and it should not be written until the load
+  // finishes. Returns 0 and sets *loadp if ok, SQLITE_MISUSE if the table is
+  // not suitable, or another error.
+  static int start(u64 rootcid, bool remote, DtBulkLoad **loadp);
+
+  // Adds a row. Keys must be given in increasing order.
+  // Returns 0 if ok, non-zero if error.
+  int add(i64 key, const char *data, int len);
+
+  // Writes what remains and swaps the new tree in. The loader should be
+  // deleted afterwards. Returns 0 if ok, non-zero if error.
+  int finish(void);
+
+  u64 getNRows(void){ return NRows; }
+  u64 getNNodes(void){ return NNodes; }
+  u64 getNTxs(void){ return NTxs; } // transactions committed
+};
+
+#endif
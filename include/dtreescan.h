@@ -0,0 +1,124 @@
+//
+// dtreescan.h
+//
+// Parallel scans of a distributed B-tree. The leaves of the tree are split
+// into ranges using its inner nodes, and a pool of client threads reads the
+// ranges concurrently, each thread in its own read-only transaction at the
+// snapshot of the scanning transaction. The scanning thread gets the leaves
+// back one at a time, in key order or in the order they are read.
+//
+
+/*
+  Original code: Copyright (c) 2014 Microsoft Corporation
+  Modified code: Copyright (c) 2015-2016 VMware, Inc
+  All rights reserved.
+
+  Written by Marcos K. Aguilera
+
+  MIT License
+
+  Permission is hereby granted, free of charge, to any person
+  obtaining a copy of this software and associated documentation files
+  (the "Software"), to deal in the Software without restriction,
+  including without limitation the rights to use, copy, modify, merge,
+  publish, distribute, sublicense, and/or sell copies of the Software,
+  and to permit persons to whom the Software is furnished to do so,
+  subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED *AS IS*, WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+  BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+  ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#ifndef _DTREESCAN_H
+#define _DTREESCAN_H
+
+#include <mutex>
+#include <condition_variable>
+
+#include "options.h"
+#include "gaiatypes.h"
+#include "kvinterface.h"
+#include "dtreeaux.h"
+
+#define DTSCAN_ORDERED   0x1 // return leaves in key order
+#define DTSCAN_FETCHDATA 0x2 // also read the data of each cell (intkey trees)
+#define DTSCAN_NOTHREADS 0x4 // read all leaves in the scanning thread
+
+// A leaf returned by a scan
+struct DtScanLeaf {
+  DTreeNode node;
+  Ptr<Valbuf> *data; // if DTSCAN_FETCHDATA, data of each cell, else 0
+  u8 *filtered;      // if the scan has a filter, whether the data of each
+                     // cell fails the filter (and is not set), else 0
+  DtScanLeaf *next;  // linklist stuff
+
+  DtScanLeaf(){ data = 0; filtered = 0; next = 0; }
+  ~DtScanLeaf(){
+    if (data) delete [] data;
+    if (filtered) delete [] filtered;
+  }
+};
+
+// A range of leaves, from the leftmost leaf of subtree First up to, and
+// excluding, the leftmost leaf of subtree End (or the last leaf if End==0)
+struct DtScanPart;
+
+class DtParallelScan {
+  friend class DtScanPool;
+private:
+  std::mutex Lock;            // protects fields below, and the parts
+  std::condition_variable Cv; // signals new leaves, finished parts, cancel
+  KVTransaction *Tx;          // scanning transaction
+  Timestamp StartTs;          // its snapshot
+  u64 RootCid;
+  int Flags;
+  int NParts;
+  DtScanPart *Parts;
+  int NextQueued;             // next part no thread has claimed yet
+  int Consuming;              // if DTSCAN_ORDERED, part being returned
+  int Buffered;               // leaves read but not yet returned
+  int Running;                // parts being read by pool threads
+  int Err;                    // first error found by a pool thread
+  bool Canceled;
+  int FrontierHeight;         // height of subtrees in parts
+  char *Filter;               // filter on the data of cells, or 0
+  int FilterLen;
+
+  DtParallelScan(){ Filter = 0; }
+  ~DtParallelScan();
+  int split(int maxparts);    // fills the parts
+  int claim(bool inline_);    // claims next unread part, -1 if none
+  void runPart(int partno);   // pool thread: reads a part
+  int readLeaf(DtScanPart *part, KVTransaction *tx, DtScanLeaf **leaf);
+
+public:
+  // Starts a scan of the tree with root rootcid, reading at the snapshot of
+  // tx. flags is a combination of DTSCAN_*. Pool threads are used only if tx
+  // is remote and has not written, since they do not see the writes of tx;
+  // otherwise the scan reads in the calling thread with tx. If filter is
+  // given and flags has DTSCAN_FETCHDATA, the data of cells that fail the
+  // filter (see scanfilter.h) is not fetched, and the cells are marked in
+  // DtScanLeaf::filtered. Returns 0 and sets *pscan if ok, or returns an
+  // error.
+  static int start(KVTransaction *tx, u64 rootcid, int flags,
+                   DtParallelScan **pscan, const char *filter=0,
+                   int filterlen=0);
+
+  // Sets *leaf to the next non-empty leaf, or to 0 at the end of the scan.
+  // The caller should delete the leaf. Returns 0 if ok, non-zero if error.
+  int next(DtScanLeaf **leaf);
+
+  // Stops the scan and deletes it
+  void close(void);
+};
+
+#endif
@@ -44,5 +44,6 @@
 int DtSplit(COid toSplit, ListCellPlus *cell, bool remote,
             int (*enqueueMoreSplit)(COid, int, void*, int), 
             void *enqueueMoreSplitParm);
+int DtMerge(COid toMerge, bool remote);
 
 #endif
@@ -48,6 +48,7 @@
 #include "supervalue.h"
 #include "pendingtx.h"
 #include "datastruct.h"
+#include "servermetrics.h"
 
 class TxWriteItem;
 class TxWriteSVItem;
@@ -73,8 +74,12 @@ const int NULL_RPCNO = 0,
           LOADFILE_RPCNO = 15,
           INBAC_RPCNO = 16,
           INBACMESSAGE_RPCNO = 17,
-          CONSMESSAGE_RPCNO = 18;
+          CONSMESSAGE_RPCNO = 18,
           // RPC 19 is used by storageserver-splitter.h when STORAGESERVER_SPLITTER is defined (see also splitter-client.h)
+          DIRECTORY_RPCNO = 20,
+          MIGRATE_RPCNO = 21,
+          REPLICATE_RPCNO = 22,
+          FILTERREAD_RPCNO = 23;
 
 // error codes
 #define GAIAERR_GENERIC         -1 // generic error code
@@ -94,6 +99,14 @@ const int NULL_RPCNO = 0,
 #define GAIAERR_NO_MEMORY      -12 // insufficient memory
 #define GAIAERR_CELL_OUTRANGE  -13 // cell does not belong to this coid
 #define GAIAERR_ATTR_OUTRANGE  -14 // attribute id out of range
+#define GAIAERR_WRONG_SERVER   -15 // server does not own the object, or the
+                                   // object is being migrated
+#define GAIAERR_REPL_LAG       -16 // backup has not yet applied all updates
+                                   // up to the requested timestamp
+#define GAIAERR_REPL_GAP       -17 // backup missed part of the replication
+                                   // stream and needs a full copy
+#define GAIAERR_READ_ONLY      -18 // trying to update in a read-only
+                                   // transaction
 #define GAIAERR_WRONG_TYPE     -99 // trying to read value but got supervalue,
                                    // or vice-versa
 
@@ -141,8 +154,11 @@ public:
 
 // ------------------------------ GETSTATUS RPC --------------------------------
 
+#define GETSTATUS_FLAG_METRICS 1 // ask server to include its metrics in
+                                 // the reply
+
 struct GetStatusRPCParm {
-  int reserved;
+  int flags; // GETSTATUS_FLAG_*
 };
 
 class GetStatusRPCData : public Marshallable {
@@ -164,24 +180,70 @@ public:
 
 struct GetStatusRPCResp {
   int reserved;
+  u32 splitQueueSize; // number of nodes waiting to be split at server
+  u64 nobjects;       // number of objects kept in memory by server
+  u64 nrequests;      // number of data requests served since server started
+  u32 metricslen;     // length of the ServerMetrics that follows, 0 if none
+  u32 reserved2;
 };
 
 class GetStatusRPCRespData : public Marshallable {
 public:
   GetStatusRPCResp *data;
+  ServerMetrics *metrics; // set iff data->metricslen != 0
   int freedata;
-  GetStatusRPCRespData(){ freedata = 0; }
-  ~GetStatusRPCRespData(){ if (freedata){ delete data; } }
+  GetStatusRPCRespData(){ freedata = 0; metrics = 0; }
+  ~GetStatusRPCRespData(){ if (freedata){ delete data; delete metrics; } }
   int marshall(iovec *bufs, int maxbufs){
-    assert(maxbufs >= 1);
+    assert(maxbufs >= 2);
     bufs[0].iov_base = (char*) data;
     bufs[0].iov_len = sizeof(GetStatusRPCResp);
-    return 1;
+    if (!data->metricslen) return 1;
+    bufs[1].iov_base = (char*) metrics;
+    bufs[1].iov_len = data->metricslen;
+    return 2;
+  }
+  void demarshall(char *buf){
+    data = (GetStatusRPCResp*) buf;
+    if (data->metricslen)
+      metrics = (ServerMetrics*) (buf + sizeof(GetStatusRPCResp));
+    else metrics = 0;
   }
-  void demarshall(char *buf){ data = (GetStatusRPCResp*) buf; }
 };
 
 
+// ---------------------------- SUBTRANS HEADER --------------------------------
+
+#define SUBTRANS_NOLEVEL 0x7fffffff
+
+// Subtransaction level changes not yet sent to a server. Instead of a
+// SUBTRANS RPC to every server of the transaction on each release or abort
+// of a subtransaction, the client records the changes and sends them with
+// the next WRITE, FULLWRITE, LISTADD, LISTDELRANGE, ATTRSET, PREPARE, or
+// INBAC RPC of the transaction to the server, which applies them before
+// handling the request. Any sequence of changes amounts to discarding
+// updates with level > abortlevel and then changing updates with
+// level > releaselevel to releaselevel.
+struct SubtransHeader {
+  int abortlevel;        // SUBTRANS_NOLEVEL if nothing to abort
+  int releaselevel;      // SUBTRANS_NOLEVEL if nothing to release
+  SubtransHeader(){ clear(); }
+  void clear(){ abortlevel = releaselevel = SUBTRANS_NOLEVEL; }
+  bool empty(){ return abortlevel == SUBTRANS_NOLEVEL &&
+                       releaselevel == SUBTRANS_NOLEVEL; }
+  // adds a change after the ones recorded: action 0 discards updates with
+  // level > level, action 1 changes updates with level > level to level
+  void add(int level, int action){
+    if (action == 1){
+      if (level < releaselevel) releaselevel = level;
+    } else if (level < abortlevel && level < releaselevel){
+      // updates left by the recorded changes are all above level
+      abortlevel = level;
+      releaselevel = SUBTRANS_NOLEVEL;
+    }
+  }
+};
+
 // --------------------------------- WRITE RPC ---------------------------------
 
 struct WriteRPCParm {
@@ -189,6 +251,7 @@ struct WriteRPCParm {
   Cid cid;   // container id
   Oid oid;   // object id
   int level; // subtransaction level
+  SubtransHeader subtrans; // level changes to apply first
   int len;   // buffer length
   char *buf; // buffer
 };
@@ -255,6 +318,7 @@ struct ReadRPCResp {
   u64 versionNoForCache;         // version number for cache
   Timestamp tsForCache;          // timestamp for cache
   Timestamp reserveTsForCache;   // reserve timestamp for cache
+  Timestamp safeTs;              // safe timestamp of server (see safets.h)
 };
 
 class ReadRPCRespData : public Marshallable {
@@ -305,6 +369,7 @@ struct PrepareRPCParm {
   Timestamp startts;      // start timestamp
   int onephasecommit;     // whether to commit as well as prepare
                           // (used when transaction spans just one server)
+  SubtransHeader subtrans; // level changes to apply first
 
   // stuff for piggyback write optimization (if GAIA_WRITE_ON_PREPARE enabled)
   Cid piggy_cid;          // piggyback container id
@@ -396,6 +461,7 @@ struct InbacRPCParm {
   int onephasecommit;     // whether to commit as well as prepare
                           // (used when transaction spans just one server)
   u64 inbacId;            // inbac id
+  SubtransHeader subtrans; // level changes to apply first
 
   Set<IPPortServerno> *serverset; // set of storage servers
   IPPortServerno owner; // server that will receive the message
@@ -732,6 +798,303 @@ public:
 };
 
 
+// ------------------------------ DIRECTORY RPC --------------------------------
+// RPC to get or set the placement directory of a server (see PlacementDir in
+// newconfig.h). A set only takes effect if it has a larger epoch than the
+// directory at the server.
+
+struct DirectoryRPCParm {
+  int set;          // 0=get directory, 1=set directory to dir
+  int dirlen;       // length of dir (0 for get)
+  char *dir;        // PlacementDir to set
+};
+
+class DirectoryRPCData : public Marshallable {
+public:
+  DirectoryRPCParm *data;
+  int freedata;
+  DirectoryRPCData(){ freedata = 0; }
+  ~DirectoryRPCData(){ if (freedata) delete data; }
+  int marshall(iovec *bufs, int maxbufs){
+    assert(maxbufs >= 2);
+    bufs[0].iov_base = (char*) data;
+    bufs[0].iov_len = sizeof(DirectoryRPCParm);
+    bufs[1].iov_base = data->dir;
+    bufs[1].iov_len = data->dirlen;
+    return 2;
+  }
+  void demarshall(char *buf){
+    data = (DirectoryRPCParm*) buf;
+    data->dir = buf + sizeof(DirectoryRPCParm);
+  }
+};
+
+struct DirectoryRPCResp {
+  int status;       // status of operation
+  u32 epoch;        // epoch of directory at server (0 if server has none)
+  int dirlen;       // length of dir (0 if server has no directory)
+  char *dir;        // PlacementDir at server, after a set if any
+};
+
+class DirectoryRPCRespData : public Marshallable {
+public:
+  DirectoryRPCResp *data;
+  int freedata;
+  DirectoryRPCRespData(){ freedata = 0; }
+  ~DirectoryRPCRespData(){ if (freedata){ delete data; } }
+  int marshall(iovec *bufs, int maxbufs){
+    assert(maxbufs >= 2);
+    bufs[0].iov_base = (char*) data;
+    bufs[0].iov_len = sizeof(DirectoryRPCResp);
+    bufs[1].iov_base = data->dir;
+    bufs[1].iov_len = data->dirlen;
+    return 2;
+  }
+  void demarshall(char *buf){
+    data = (DirectoryRPCResp*) buf;
+    data->dir = buf + sizeof(DirectoryRPCResp);
+  }
+};
+
+// ------------------------------- MIGRATE RPC ---------------------------------
+// RPC to move buckets of objects between servers. Whoever coordinates the
+// move (see StorageConfig::resizeServers) freezes the buckets at the source,
+// waits for their pending transactions to drain, seals them, copies them
+// with export and import, and finally installs a directory with the new
+// owner at all servers.
+
+#define MIGRATE_OP_FREEZE   0 // refuse new updates to the buckets
+#define MIGRATE_OP_SEAL     1 // refuse reads to the buckets as well
+#define MIGRATE_OP_UNFREEZE 2 // undo freeze and seal (eg, to abort a move)
+#define MIGRATE_OP_PENDING  3 // count prepared but unfinished updates
+#define MIGRATE_OP_EXPORT   4 // serialize objects in the buckets
+#define MIGRATE_OP_IMPORT   5 // load objects serialized by export
+
+struct MigrateRPCParm {
+  int op;           // one of MIGRATE_OP_*
+  int nbuckets;     // number of entries in buckets (all ops except import)
+  int len;          // length of buf (import)
+  int reserved;
+  u16 *buckets;     // buckets to operate on
+  char *buf;        // data produced by an export
+};
+
+class MigrateRPCData : public Marshallable {
+public:
+  MigrateRPCParm *data;
+  int freedata;
+  char *freebuf;    // if non-null, free it in destructor
+  MigrateRPCData(){ freedata = 0; freebuf = 0; }
+  ~MigrateRPCData(){
+    if (freedata) delete data;
+    if (freebuf) free(freebuf);
+  }
+  int marshall(iovec *bufs, int maxbufs){
+    assert(maxbufs >= 3);
+    bufs[0].iov_base = (char*) data;
+    bufs[0].iov_len = sizeof(MigrateRPCParm);
+    bufs[1].iov_base = (char*) data->buckets;
+    bufs[1].iov_len = data->nbuckets * sizeof(u16);
+    bufs[2].iov_base = data->buf;
+    bufs[2].iov_len = data->len;
+    return 3;
+  }
+  void demarshall(char *buf){
+    data = (MigrateRPCParm*) buf;
+    data->buckets = (u16*)(buf + sizeof(MigrateRPCParm));
+    data->buf = buf + sizeof(MigrateRPCParm) + data->nbuckets * sizeof(u16);
+  }
+};
+
+struct MigrateRPCResp {
+  int status;       // status of operation
+  int len;          // length of buf (export)
+  u64 count;        // pending updates (pending), objects exported (export),
+                    // or objects imported (import)
+  char *buf;        // exported data
+};
+
+class MigrateRPCRespData : public Marshallable {
+public:
+  MigrateRPCResp *data;
+  int freedata;
+  char *freebuf;    // if non-null, free it in destructor
+  MigrateRPCRespData(){ freedata = 0; freebuf = 0; }
+  ~MigrateRPCRespData(){
+    if (freedata){ delete data; }
+    if (freebuf) free(freebuf);
+  }
+  int marshall(iovec *bufs, int maxbufs){
+    assert(maxbufs >= 2);
+    bufs[0].iov_base = (char*) data;
+    bufs[0].iov_len = sizeof(MigrateRPCResp);
+    bufs[1].iov_base = data->buf;
+    bufs[1].iov_len = data->len;
+    return 2;
+  }
+  void demarshall(char *buf){
+    data = (MigrateRPCResp*) buf;
+    data->buf = buf + sizeof(MigrateRPCResp);
+  }
+};
+
+// ------------------------------ REPLICATE RPC --------------------------------
+// RPC from a primary to its backups, carrying either a full copy of the
+// objects of the primary (as serialized by LogInMemory::exportBuckets) or a
+// batch of committed transactions (see replication.h), with the timestamp
+// up to which the backup may serve reads once the batch is applied.
+
+#define REPL_OP_SNAPSHOT 0 // full copy; resets the stream
+#define REPL_OP_BATCH    1 // committed transactions
+
+struct ReplicateRPCParm {
+  int op;           // one of REPL_OP_*
+  int len;          // length of buf
+  int serverno;     // server number of primary
+  int reserved;
+  u64 streamid;     // identifies primary incarnation
+  u64 seq;          // sequence number of batch in stream
+  u64 watermark;    // closed timestamp (only the first 64 bits)
+  char *buf;        // data
+};
+
+class ReplicateRPCData : public Marshallable {
+public:
+  ReplicateRPCParm *data;
+  int freedata;
+  ReplicateRPCData(){ freedata = 0; }
+  ~ReplicateRPCData(){ if (freedata) delete data; }
+  int marshall(iovec *bufs, int maxbufs){
+    assert(maxbufs >= 2);
+    bufs[0].iov_base = (char*) data;
+    bufs[0].iov_len = sizeof(ReplicateRPCParm);
+    bufs[1].iov_base = data->buf;
+    bufs[1].iov_len = data->len;
+    return 2;
+  }
+  void demarshall(char *buf){
+    data = (ReplicateRPCParm*) buf;
+    data->buf = buf + sizeof(ReplicateRPCParm);
+  }
+};
+
+struct ReplicateRPCResp {
+  int status;       // 0 if applied, GAIAERR_REPL_GAP if backup needs a full
+                    // copy, other errors otherwise
+  int reserved;
+  u64 count;        // transactions or objects applied
+};
+
+class ReplicateRPCRespData : public Marshallable {
+public:
+  ReplicateRPCResp *data;
+  int freedata;
+  ReplicateRPCRespData(){ freedata = 0; }
+  ~ReplicateRPCRespData(){ if (freedata){ delete data; } }
+  int marshall(iovec *bufs, int maxbufs){
+    assert(maxbufs >= 1);
+    bufs[0].iov_base = (char*) data;
+    bufs[0].iov_len = sizeof(ReplicateRPCResp);
+    return 1;
+  }
+  void demarshall(char *buf){ data = (ReplicateRPCResp*) buf; }
+};
+
+// ----------------------------- FILTERREAD RPC --------------------------------
+// RPC to read many objects of a container, returning only those whose
+// contents satisfy a filter (see scanfilter.h). Used by scans to avoid
+// fetching rows that the query would discard. The filter is evaluated on
+// the contents of each object after its first skip bytes.
+
+struct FilterReadRPCParm {
+  Tid tid;       // transaction id
+  Timestamp ts;  // timestamp
+  Cid cid;       // container id
+  int noids;     // number of objects
+  int skip;      // bytes of each object before the part the filter sees
+  int filterlen; // length of filter
+  int reserved;
+  Oid *oids;     // objects to read
+  char *filter;  // filter
+};
+
+class FilterReadRPCData : public Marshallable {
+public:
+  FilterReadRPCParm *data;
+  int freedata;
+  FilterReadRPCData(){ freedata = 0; }
+  ~FilterReadRPCData(){
+    if (freedata){ delete [] data->oids; delete [] data->filter; delete data; }
+  }
+  int marshall(iovec *bufs, int maxbufs){
+    assert(maxbufs >= 3);
+    bufs[0].iov_base = (char*) data;
+    bufs[0].iov_len = sizeof(FilterReadRPCParm);
+    bufs[1].iov_base = (char*) data->oids;
+    bufs[1].iov_len = data->noids * sizeof(Oid);
+    bufs[2].iov_base = data->filter;
+    bufs[2].iov_len = data->filterlen;
+    return 3;
+  }
+  void demarshall(char *buf){
+    data = (FilterReadRPCParm*) buf;
+    data->oids = (Oid*) (buf + sizeof(FilterReadRPCParm));
+    data->filter = buf + sizeof(FilterReadRPCParm) +
+                   data->noids * sizeof(Oid);
+  }
+};
+
+// Result for one object. If status is 0, the object satisfies the filter
+// and its len bytes come next in FilterReadRPCResp::buf
+#define FILTERREAD_MATCH    0
+#define FILTERREAD_FILTERED 1 // object does not satisfy the filter
+                              // (< 0 is an error reading the object)
+struct FilterReadRPCItem {
+  int status;       // FILTERREAD_* or error
+  int len;          // length of data
+  Timestamp readts; // timestamp of data
+};
+
+struct FilterReadRPCResp {
+  int status;       // 0 if ok, error if the RPC failed as a whole
+  int nitems;       // entries in items, one per requested object
+  int buflen;       // length of buf
+  int reserved;
+  Timestamp safeTs; // safe timestamp of server (see safets.h)
+  FilterReadRPCItem *items;
+  char *buf;        // data of matching objects, one after the other
+};
+
+class FilterReadRPCRespData : public Marshallable {
+public:
+  FilterReadRPCResp *data;
+  int freedata;
+  FilterReadRPCRespData(){ freedata = 0; }
+  ~FilterReadRPCRespData(){
+    if (freedata){
+      delete [] data->items;
+      if (data->buf) free(data->buf);
+      delete data;
+    }
+  }
+  int marshall(iovec *bufs, int maxbufs){
+    assert(maxbufs >= 3);
+    bufs[0].iov_base = (char*) data;
+    bufs[0].iov_len = sizeof(FilterReadRPCResp);
+    bufs[1].iov_base = (char*) data->items;
+    bufs[1].iov_len = data->nitems * sizeof(FilterReadRPCItem);
+    bufs[2].iov_base = data->buf;
+    bufs[2].iov_len = data->buflen;
+    return 3;
+  }
+  void demarshall(char *buf){
+    data = (FilterReadRPCResp*) buf;
+    data->items = (FilterReadRPCItem*) (buf + sizeof(FilterReadRPCResp));
+    data->buf = buf + sizeof(FilterReadRPCResp) +
+                data->nitems * sizeof(FilterReadRPCItem);
+  }
+};
+
 // ------------------------------- LISTADD RPC ---------------------------------
 // RPC to add an item to a list of a Value
 
@@ -740,6 +1103,7 @@ struct ListAddRPCParm {
   Cid cid;             // container id
   Oid oid;             // object id
   int level;           // subtransaction level
+  SubtransHeader subtrans; // level changes to apply first
   u32 flags;           // if flags&1, check cell being added before adding
                        // if flags&2, bypass throttle
   Timestamp ts;        // start timestamp of transaction (used for reading,
@@ -797,6 +1161,7 @@ struct ListDelRangeRPCParm {
   Cid cid;            // container id
   Oid oid;            // object id
   int level;          // subtransaction level
+  SubtransHeader subtrans; // level changes to apply first
   Ptr<RcKeyInfo> prki;// information about the record format
   u8 intervalType;    // 0 = (key1,key2), 1 = (key1,key2],
                       // 2=[key1,key2), 3=[key1,key2]
@@ -848,6 +1213,7 @@ struct AttrSetRPCParm {
   Cid cid;        // container id
   Oid oid;        // object id
   int level;      // subtransaction level
+  SubtransHeader subtrans; // level changes to apply first
   u32 attrid;     // attribute id
   u64 attrvalue;  // attribute value
 };
@@ -964,6 +1330,7 @@ struct FullReadRPCResp {
   u64 versionNoForCache;       // version number for cache
   Timestamp tsForCache;        // timestamp for cache
   Timestamp reserveTsForCache; // reserve timestamp for cache
+  Timestamp safeTs;            // safe timestamp of server (see safets.h)
 };
 
 class FullReadRPCRespData : public Marshallable {
@@ -997,6 +1364,7 @@ struct FullWriteRPCParm {
   Cid cid;            // container id
   Oid oid;            // object id
   int level;          // subtransaction level
+  SubtransHeader subtrans; // level changes to apply first
   u16 nattrs;         // number of 64-bit attribute values
   u8  celltype;       // type of cells: 0=int, 1=nKey+pKey
   u32 ncelloids;      // number of (cell,oid) pairs in list
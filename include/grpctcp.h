@@ -121,6 +121,7 @@ public:
     data = d;
     len = l;
     resp = 0;
+    startus = 0;
     //seen = 0;
   }
   void setResp(Marshallable *r){ resp = r; }
@@ -143,6 +144,9 @@ public:
 
   // information to be returned
   Marshallable *resp;
+
+  u64 startus; // when the RPC was received, in us. Set only if there is a
+               // request observer
 };
 
 typedef int (*RPCProc)(RPCTaskInfo *); // Parameter RPCTaskInfo includes
@@ -176,6 +180,12 @@ private:
   RPCServerInfo Servers[MAXRPCSERVERS];
   int NextServer; // index of next server to be added
 
+  u16 ReplyTag;   // tag piggybacked on all replies sent by this server
+  void (*ReplyTagObserver)(void *ctx, u16 tag); // called with non-zero tags
+  void *ReplyTagCtx;                            // of replies received
+  void (*RequestObserver)(void *ctx, u32 req, u64 elapsedus); // called as
+  void *RequestCtx;                             // each RPC is replied to
+
 protected:
   OutstandingRPC *RequestLookupAndDelete(u32 xid);
   
@@ -242,8 +252,28 @@ public:
   // Comment about parameter "data" for asyncRPC applies here too
   char *syncRPC(IPPort dest, int rpcno, u32 flags, Marshallable *data);
   
+  // register a function to be called with the tag of every reply that
+  // carries a non-zero tag. The function is called from worker threads,
+  // so it should be quick and must not block
+  void setReplyTagObserver(void (*observer)(void *ctx, u16 tag), void *ctx){
+    ReplyTagCtx = ctx;
+    ReplyTagObserver = observer;
+  }
+
   // ---------------------------- Server methods ------------------------------
   void registerNewServer(RPCProc *procs, int nprocs, int portno);
+
+  // set tag to piggyback on subsequent replies (0 for no tag)
+  void setReplyTag(u16 tag){ ReplyTag = tag; }
+
+  // register a function to be called with the RPC number and the time
+  // between receipt and reply, in us, of every RPC served. The function is
+  // called from worker threads, so it should be quick and must not block
+  void setRequestObserver(void (*observer)(void *ctx, u32 req, u64 elapsedus),
+                          void *ctx){
+    RequestCtx = ctx;
+    RequestObserver = observer;
+  }
   void waitServerEnd(void){ TCPDatagramCommunication::waitServerEnd(); }
 
   void exitThreads(void){ TCPDatagramCommunication::exitThreads(); }
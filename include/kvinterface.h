@@ -146,6 +146,14 @@ int memKVput3(KVTransaction *tx, COid &coid,  char *data1, int len1,
               char *data2, int len2, char *data3, int len3);
 
 int beginTx(KVTransaction **txp, bool remote=true, bool deferred=false);
+// Begins a read-only transaction (see Transaction::startReadOnly)
+int beginReadOnlyTx(KVTransaction **txp, bool remote=true, int maxstalems=-1);
+// Begins a remote read-only transaction that reads the snapshot at startts
+// (see Transaction::startReadOnlyAt)
+int beginReadOnlyTxAt(KVTransaction **txp, Timestamp startts);
+// Sets *startts to the start timestamp of remote transaction tx. Returns 0 if
+// ok, non-zero if tx is local or its start timestamp is not yet set
+int txStartTs(KVTransaction *tx, Timestamp *startts);
 int commitTx(KVTransaction *tx, Timestamp *retcommitts=0);
 int abortTx(KVTransaction *tx);
 int freeTx(KVTransaction *tx);
@@ -155,6 +163,16 @@ int releaseSubTx(KVTransaction *tx, int level);
   
 int KVget(KVTransaction *tx, COid coid, Ptr<Valbuf> &buf);
 
+// reads the values of n objects of container cid, skipping those whose
+// contents after the first skip bytes do not satisfy filter (see
+// scanfilter.h and Transaction::vgetFilter). For each i, sets filtered[i]
+// to 1 if oids[i] was skipped; otherwise sets bufs[i] to its value, or
+// leaves bufs[i] unset if it could not be read. Returns 0 if ok, non-zero
+// if error.
+int KVgetFilter(KVTransaction *tx, Cid cid, int n, Oid *oids, int skip,
+                const char *filter, int filterlen, Ptr<Valbuf> *bufs,
+                u8 *filtered);
+
 // get variation that allocates pad extra space in buffer beyond received data.
 // Padded space is NOT zeroed */
 int KVput(KVTransaction *tx, COid coid,  char *data, int len);
@@ -181,6 +199,8 @@ int KVattrset(KVTransaction *tx, COid coid, u32  attrid, u64 attrval);
 
 int KVtxreadonly(KVTransaction *tx); // return whether transaction is
                                      // read-only so far
+int KVserverOf(COid coid); // return the storage server of an object (0 if
+                           // storage is local)
   
 #ifdef __cplusplus
 }; // extern "C"
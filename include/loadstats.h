@@ -1,11 +1,16 @@
 //
 // loadstats.h
 //
-// Keeps statistics about access to coid's and cells within coids.
-// We keep track of all read accesses within the last StatIntervalMs ms.
-// Then, once this interval is past, we look at the statistics to find
-// coids with a large number of accesses. For those coids, we look at
-// the cell accesses to determine where they should be split.
+// Keeps statistics about access to coid's and cells within coids, to find
+// nodes that get a large share of the load of a server (hot nodes) and split
+// them at the median accessed cell (load splits).
+//
+// Access counters are decayed every LOADSPLIT_INTERVAL_MS ms rather than
+// reset, so a node that is hot across periods is detected even if its load
+// fluctuates. For each node, the cells accessed are kept in a fixed-size
+// reservoir sample, so memory per node is bounded regardless of the number
+// of distinct keys accessed. A node is hot if its access rate exceeds
+// LOADSPLIT_HOT_PERCENT of the capacity of the server thread.
 //
 
 /*
@@ -41,47 +46,76 @@
 #ifndef _LOADSTATS_H
 #define _LOADSTATS_H
 
-const int StatIntervalMs=1000;
-const int HeavyHitterThreshold=5000; // hits above which a coid is considered
-                                     // a heavy hitter
-
-
 #include <stdio.h>
 #include <stdlib.h>
 #include <malloc.h>
 
 #include "os.h"
 #include "tmalloc.h"
+#include "options.h"
 #include "datastruct.h"
 #include "gaiatypes.h"
 #include "util.h"
+#include "prng.h"
 #include "supervalue.h"
 
 
 // statistics kept for a given coid
 struct COidStat {
-  int Hits;
-  SkipListBK<ListCellPlus,int> CellStat; // statistics for each accessed cell
-  COidStat(){ Hits=0; }
+  int Hits;   // decayed number of accesses
+  int Seen;   // decayed number of accesses considered for the sample
+  int NSample; // number of cells in Sample
+  ListCell Sample[LOADSPLIT_SAMPLE_CELLS]; // reservoir sample of accessed cells
+  Ptr<RcKeyInfo> prki; // key info of sampled cells
+  COidStat(){ Hits = Seen = NSample = 0; }
   ~COidStat();
 };
 
+// a recent load split, used to report how the load of the split node
+// redistributes
+struct LoadSplitRecord {
+  COid coid;      // node that was split
+  int rateBefore; // accesses per period before the split
+  int periods;    // periods since the split
+};
+
+// summary of load split activity, for reporting
+struct LoadSplitStats {
+  u64 nsplits;          // load splits requested
+  u64 nreported;        // load splits whose outcome was measured
+  u64 sumRemainPercent; // sum over measured splits of the percentage of
+                        // load that stayed in the split node
+  int hotNodes;         // hot nodes found in the last period
+  int capacity;         // accesses per period taken as the thread capacity
+  int tracked;          // nodes being tracked
+};
+
 class LoadStats {
  private:
   SkipList<COid,COidStat*> Stats;
   u64 PeriodStart; // time when the period started
-  
+  int PeriodHits;  // accesses reported in the current period
+  int PeakHits;    // (slowly decayed) maximum of PeriodHits across periods
+  SimplePrng Prng; // for reservoir sampling
+  LoadSplitRecord Recent[LOADSPLIT_TRACK_SPLITS]; // recent load splits
+  int NextRecent;  // next entry to use in Recent
+  LoadSplitStats LS;
+
+  int capacity(void); // accesses per period a thread can take
+  void splitHot(COid &coid, COidStat *cs, int rate); // request a load split
+  void reportSplits(void); // report how load redistributed after splits
+  void decay(int nperiods); // decay counters, dropping idle coids
+
  public:
-  LoadStats(){
-    PeriodStart = Time::now();
-  }
+  LoadStats();
   
-  void report(COid &coid, ListCellPlus *cell); // reports an access. cell will
-      // be owned by LoadStats and should have its own RcKeyInfo (or RcKeyInfo
-      // should be guaranteed to remain valid until the end of the interval)
-  int check(void); // check if period is done. If so, find heavy hitters, call
-      // the splitter and start new period. Returns 0 if period continues,
-      // non-zero if new period started
+  void report(COid &coid, ListCell &cell, Ptr<RcKeyInfo> prki); // reports an
+      // access to a cell of coid. The cell is copied only if it is sampled
+  int check(void); // check if period is done. If so, find hot nodes, call
+      // the splitter, decay counters and start new period. Returns 0 if
+      // period continues, non-zero if new period started
+  bool isHot(COid &coid); // whether coid was close to being hot last period
+  LoadSplitStats &getStats(void){ return LS; }
   void print(void); // prints all stats
 };
 
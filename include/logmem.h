@@ -113,17 +113,31 @@ public:
   }
 };
 
+class ColdStore;
+
 // entry for a given COid in LogInMemory
 class LogOneObjectInMemory {
 private:
   RWLock object_lock; // lock for object
 public:
-  LogOneObjectInMemory(){ LastRead.setLowest(); }
+  LogOneObjectInMemory(){
+    LastRead.setLowest(); Cold = false; Referenced = 0; Size = 0;
+    ColdLen = 0; ColdOffset = 0;
+  }
   LinkList<SingleLogEntryInMemory> logentries;
   LinkList<SingleLogEntryInMemory> pendingentries;
 
   Timestamp LastRead; // Largest timestamp of a read on object
 
+  // cold tier (see LogInMemory::sweepColdTier)
+  bool Cold;          // if true, the only version of the object is in the
+                      // cold store and logentries is empty
+  u8 Referenced;      // set when object is accessed, cleared by sweeps
+  u32 Size;           // estimated bytes of logentries, as of last sweep
+  u32 ColdLen;        // copy of object in cold store, if ColdLen != 0
+  u64 ColdOffset;
+  Timestamp ColdTs;   // timestamp of that copy
+
   // convenience methods to lock/unlock looim
 #ifndef SKIP_LOOIM_LOCKS
   void lock(){ object_lock.lock(); }
@@ -146,16 +160,31 @@ private:
   HashTableMT<COid,LogOneObjectInMemory *> COidMap;
   DiskStorage *DS;
   bool SingleVersion; // if true, keep at most one version per COid
+  u64 NObjects;       // number of entries in COidMap
+  u64 NVersions;      // number of entries in logentries across all objects
+  ColdStore *Cold;    // cold tier, 0 if none
+  u64 ResidentBytes;  // estimated bytes of objects in memory, as of the
+                      // last sweep of the cold tier
+  u64 NCold;          // number of objects in cold tier
 
   // auxilliary functions
   static void getAndLockaux(int res, LogOneObjectInMemory **looimptr);
+  // brings the version of a cold object back into logentries.
+  // Assumes looim->object_lock is held in write mode.
+  void faultIn(COid &coid, LogOneObjectInMemory *looim);
+  // moves the version of an object to the cold store, if the object has
+  // a single version and no pending entries. Returns 0 if object was
+  // moved, non-zero otherwise.
+  // Assumes looim->object_lock is held in write mode.
+  int evict(LogOneObjectInMemory *looim);
 
 public:
   LogInMemory(DiskStorage *ds);
 
   // Return entry for an object and locks it for reading or writing.
   // If entry does not exist, create it, reading object from disk
-  // to set the sole entry in the log.
+  // to set the sole entry in the log. If object is in the cold tier, bring
+  // it back into memory.
   //   coid is the coid of the object
   //   writelock=true if locking for write, false if locking for read
   // If createfirstlog is true, then create first log entry for object if
@@ -164,6 +193,20 @@ public:
                                    bool createfirstlog);
 
   void setSingleVersion(bool sv){ SingleVersion = sv; }
+  u64 getNObjects(){ return NObjects; } // number of objects in memory
+  u64 getNVersions(){ return NVersions; } // number of versions in memory
+
+  // Support for a cold tier (see coldstore.h). Once a cold store is set,
+  // sweepColdTier should be called periodically. Each call estimates the
+  // bytes used by each object in memory, and evicts objects not accessed
+  // since the previous call while the total is above budget. Returns the
+  // number of objects evicted.
+  void setColdStore(ColdStore *cs){ Cold = cs; }
+  int sweepColdTier(u64 budget);
+  u64 getResidentBytes(){ return ResidentBytes; }
+  u64 getNCold(){ return NCold; } // number of objects in cold tier
+  // estimated bytes used by a version of an object
+  static u32 estimateSize(Ptr<TxUpdateCoid> tucoid);
 
   // Eliminates old entries from log. The eliminated entries are the ones that
   // are subsumed by a newer entry and that are older than LOG_STALE_GC_MS
@@ -221,6 +264,7 @@ public:
     }
     if (sleim2 != wheretoadd->rGetLast()) wheretoadd->addAfter(sleim, sleim2);
     else wheretoadd->pushHead(sleim);
+    AtomicInc64(&NVersions);
 
     if (SingleVersion){ // delete previous versions if any
       // search for a checkpoint
@@ -234,6 +278,7 @@ public:
         while (sleim3 != sleim2){ // delete entries up to sleim2 (not including)
           wheretoadd->popHead();
           delete sleim3;
+          AtomicDec64(&NVersions);
           sleim3 = wheretoadd->getFirst();
         }
       }
@@ -310,6 +355,15 @@ public:
   // have allocated it and should not free it.
   int writeCOid(COid& coid, Timestamp ts, Ptr<TxUpdateCoid> tucoid);
 
+  // Like writeCOid, but does not read the object from disk if it is not in
+  // memory. Used to load snapshots.
+  int installCOid(COid& coid, Timestamp ts, Ptr<TxUpdateCoid> tucoid);
+
+  // Adds an update committed at another server (the primary of a backup)
+  // to the log of coid. Unlike writeCOid, tucoid may hold attribute and
+  // list updates to apply on top of earlier versions.
+  int applyCOid(COid& coid, Timestamp ts, Ptr<TxUpdateCoid> tucoid);
+
   // Wakes up deferred RPCs in the waiting list of a sleim or move them to the
   // sleim of another pending entry, based on the given ts. If the given ts
   // is < than all pending entries (though it suffices to check the first
@@ -343,12 +397,25 @@ public:
 
   // flushes all entries in memory to disk or file
   void flushToDisk(Timestamp &ts);
+  // writes a snapshot of all objects as of ts (see snapshot.h), while the
+  // server keeps running. Returns 0 if ok, non-zero if error.
   int flushToFile(Timestamp &ts, char *flushfilename=FLUSH_FILENAME);
 
   // load contents of disk or file into memory cache
   void loadFromDisk(void);
+  // loads a snapshot written by flushToFile, using SNAPSHOT_LOAD_THREADS
+  // threads. Returns 0 if ok, non-zero if error.
   int loadFromFile(char *flushfilename=FLUSH_FILENAME);
 
+  // Support for migrating buckets of objects between servers (see
+  // migrateRpc). inbucket has PLACEMENT_NBUCKETS entries, and entry b is
+  // non-zero if bucket b is selected.
+  u64 countPending(u8 *inbucket); // count pending entries in buckets
+  // serialize objects in buckets into a buffer allocated with malloc
+  int exportBuckets(u8 *inbucket, char **retbuf, int *retlen, u64 *retcount);
+  // load objects serialized by exportBuckets
+  int importBuckets(char *buf, int len, u64 *retcount);
+
   // prints state of all objects
   void printAllLooim(); // print just latest content of each object
   void printAllLooimDetailed();  // print entire log of each object
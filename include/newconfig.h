@@ -60,6 +60,29 @@ struct ServerHT {
   static int CompareKey(int i1, int i2){ if (i1<i2) return -1; else if (i1==i2) return 0; else return 1; }
 };
 
+// Placement directory. The low 16 bits of an oid (its serverid) select one of
+// PLACEMENT_NBUCKETS buckets, and the directory maps each bucket to the
+// number of the server that owns it. Moving a bucket to another server only
+// requires changing its entry, so servers can be added without rehashing
+// the other buckets. Every change increments the epoch. Epoch 0 denotes the
+// static mapping bucket % nservers, used when no server hands out a directory.
+#define PLACEMENT_NBUCKETS 65536
+#define PLACEMENT_BUCKET(oid) ((unsigned)((oid) & 0xffff))
+
+struct PlacementDir {
+  u32 epoch;   // version of directory
+  u32 nservers;// servers in configuration (owners are in [0,nservers))
+  u16 owner[PLACEMENT_NBUCKETS]; // owner of each bucket
+
+  // assign bucket b to server b % nactive
+  void setDefault(int nactive, int nserv, u32 ep){
+    epoch = ep;
+    nservers = nserv;
+    for (int b=0; b < PLACEMENT_NBUCKETS; ++b)
+      owner[b] = (u16)(nactive > 0 ? b % nactive : 0);
+  }
+};
+
 #define SERVER_HASHTABLE_SIZE 64
 #define SERVERCONFIG_HASHTABLE_SIZE 64
 #define HOSTSCONFIG_HASHTABLE_SIZE 64
@@ -97,6 +120,9 @@ public:
   HashTableBK<IPPort,HostConfig> Hosts;
   HashTable<int,ServerHT> Servers;
   int Nservers;     // number of servers
+  PlacementDir *Dir; // placement directory. Replaced (never modified in
+                     // place) when a newer epoch is learned; old versions
+                     // are not freed since readers do not lock it
 
   unsigned PreferredIP;
   unsigned PreferredIPMask;
@@ -121,6 +147,7 @@ public:
                   Servers(SERVERCONFIG_HASHTABLE_SIZE)
   {
     StripeMethod = StripeParm = Nservers = -1;
+    Dir = 0;
     PreferredIP = 0;
     PreferredIPMask = 0;
     nerrors = 0;
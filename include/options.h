@@ -52,15 +52,17 @@
 // while 1 is better tested and more reliable.
 
 #define DTREE_SPLIT_SIZE 50
-// Number of cells above which to split a node. This must be at least 2 since
-// we cannot split a node with only 2 cells
+// Default number of cells above which to split a node. This must be at least 2
+// since we cannot split a node with only 2 cells. Tables can pick their own
+// value at runtime with DdSetSplitThresholds.
 
-#define DTREE_SPLIT_SIZE_BYTES 8000 // node size (bytes) above which to split
+#define DTREE_SPLIT_SIZE_BYTES 8000 // default node size (bytes) above which to
+                                    // split
 
-//#define DTREE_LOADSPLITS
-// If set and DTREE_SPLIT_LOCATION==2, then enable load splits.
-// Load splits make Yesquel more efficient but it is less tested and therefore
-// less reliable.
+#define DTREE_LOADSPLITS
+// If set and DTREE_SPLIT_LOCATION==2, then enable load splits: nodes that get
+// a large share of the reads of a server are split at their median accessed
+// cell, spreading skewed workloads over more nodes. See LOADSPLIT_* below.
 
 // YESQUEL SQL PROCESSOR OPTIONS ----------------------------------------------
 
@@ -140,6 +142,19 @@
 // Setting this option could corrupt the distributed B-tree as a node may be
 // left with no cells
 
+#define MIGRATE_BATCH_BUCKETS 1024
+// Number of buckets (out of 65536) that "callserver resize" moves at a time.
+// Transactions that touch buckets being moved abort, so smaller batches
+// shorten these windows at the cost of more directory changes.
+
+#define MIGRATE_DRAIN_POLL_MS 10
+// How often, in ms, to check whether prepared transactions of frozen buckets
+// have finished, when moving buckets between servers.
+
+#define MIGRATE_SEAL_GRACE_MS 50
+// Time, in ms, to wait for reads already in progress after refusing further
+// reads to buckets being moved, before copying them.
+
 // RPC and TCP OPTIONS -------------------------------------------------------
 
 #define SERVER_DEFAULT_PORT 11223
@@ -203,10 +218,111 @@
 // This functionality works irrespective of whether disk logging is employed
 // or not.
 
+#define SNAPSHOT_CHUNK_BYTES (1024*1024)
+// Storage checkpoints (snapshots) are written in chunks holding about this
+// many bytes of objects before compression. Chunks are the unit of parallel
+// loading.
+
+#define SNAPSHOT_COMPRESS_LEVEL 1
+// zlib compression level of snapshot chunks, from 1 (fastest) to 9 (best).
+
+#define SNAPSHOT_LOAD_THREADS 4
+// Number of threads that decompress and install chunks when a server loads
+// a snapshot.
+
+#define SNAPSHOT_PENDING_WAIT_MS 5000
+// Longest time, in ms, that writing a snapshot waits for a transaction
+// pending on an object to commit or abort, before failing. Such a
+// transaction may commit with a timestamp before that of the snapshot.
+
+#define COLDTIER_SEGMENT_BYTES (64*1024*1024)
+// When a storage server runs with a memory budget (option -m), objects not
+// accessed recently are evicted to a memory-mapped file, which grows in
+// segments of this many bytes. An object larger than a segment stays in
+// memory.
+
+#define COLDTIER_MAX_SEGMENTS 4096
+// Maximum number of segments of the memory-mapped file
+
+#define COLDTIER_SWEEP_MS 1000
+// Interval, in ms, between sweeps over the objects in memory that estimate
+// their size and evict objects when over the memory budget. An object is
+// evicted only if it was not accessed since the previous sweep.
+
 #define WRITEBUFSIZE (64*1024*1024)
 // Size of buffer used to group together writes that need to be flushed
 // to disk.
 
+#define DISKLOG_GROUP_BYTES (1024*1024)
+// Group commit: the disk log is flushed as soon as this many bytes are
+// waiting to be flushed, ...
+
+#define DISKLOG_GROUP_TXS 64
+// ... or as soon as this many transactions wait for their yes votes to be
+// flushed, ...
+
+#define DISKLOG_GROUP_MAX_WAIT_US 2000
+// ... or once the oldest item has waited this long, in us, whichever comes
+// first. The wait is further limited to DISKLOG_GROUP_WAIT_PERCENT of the
+// measured flush latency, and the log is flushed right away if no other
+// transaction is expected to arrive before the wait ends. Ignored if
+// DISKLOG_SIMPLE is set.
+
+#define DISKLOG_GROUP_WAIT_PERCENT 50
+// Maximum wait for batching, as a percentage of the measured flush latency.
+// With slow fsyncs, batching is worth more latency; with fast fsyncs (or
+// DISKLOG_NOFSYNC), items are flushed almost immediately.
+
+#define DISKLOG_SEGMENT_BYTES (256*1024*1024)
+// The disk log moves on to a new segment file once the current one reaches
+// this size. Checked after each flush, so segments can be larger by one
+// batch.
+
+#define DISKLOG_INPLACE_MIN 64
+// Pieces of a log record at least this long (such as values being written)
+// are copied straight from where they are held to the write buffer. Shorter
+// ones are first gathered into a scratch buffer.
+
+#define SERVER_METRICS
+// If defined, server threads count RPCs, their latencies, deferred reads and
+// prepare votes, which callserver stats retrieves with GETSTATUS. See
+// servermetrics.h.
+
+#define SERVERMETRICS_MAX_THREADS 64
+// Maximum number of server threads that keep metrics. Activity of threads
+// beyond this limit is not counted.
+
+// SAFE TIMESTAMP OPTIONS -----------------------------------------------------
+
+#define SAFETS_LAG_MS 50
+// A server closes timestamps this far behind its clock, in ms. Transactions
+// that vote yes afterwards get a larger commit timestamp, so reads below a
+// closed timestamp never wait for them (see safets.h). A large value makes
+// read-only transactions and follower reads more stale, and a small value
+// bumps more commit timestamps ahead of the clock.
+
+#define SAFETS_REFRESH_MS 5
+// How often a server recomputes the safe timestamp that it piggybacks on
+// read replies, in ms.
+
+// REPLICATION OPTIONS --------------------------------------------------------
+
+#define REPL_MAX_BACKUPS 4
+// Maximum number of backups of a storage server.
+
+#define REPL_INTERVAL_MS 10
+// How often a primary ships committed transactions to its backups, in ms.
+
+#define REPL_MAX_QUEUE_BYTES (64*1024*1024)
+// If the updates waiting to be shipped grow beyond this size (because a
+// backup is slow or down), they are dropped and the backups are sent a full
+// copy of the primary instead.
+
+#define GAIABACKUPS_ENV "GAIABACKUPS"
+// Name of environment variable that, if set, lists the backups that clients
+// may send follower reads to, as serverno=host:port entries separated by
+// commas. See Transaction::startFollowerRead.
+
 
 // DISTRIBUTED B-TREE OPTIONS -------------------------------------------------
 
@@ -226,6 +342,12 @@
 //#define NODIRECTSEEK
 // If defined, disable the direct seek optimization.
 
+//#define DTREE_READONLY_SAFE_TS
+// If defined, SQL statements that only read run in read-only transactions
+// (see Transaction::startReadOnly), which read slightly stale data but never
+// wait for pending transactions. A thread still sees its own commits, but
+// not the latest commits of other threads.
+
 #define DTREE_MAX_LEVELS 14 // max # of levels in tree
 #define DTREE_ROOT_OID   0 // oid of root node
 #define DTREE_SPLIT_MINSIZE 3 // minimum size of cell that can be split
@@ -252,6 +374,121 @@
 #define DTREE_OPTIMISTIC_INSERT
 // Use optimization of optimistic inserts.
 
+#define DTREE_PLACEMENT_POLICY 1
+// Default policy for choosing the server of nodes created by splits. It
+// applies to tables that do not pick their own policy with
+// DtSetPlacementPolicy. 1=random server, 2=same server as the node being
+// split (keeps sibling leaves together, so range scans touch fewer servers),
+// 3=least loaded server, based on the load that servers report in GETSTATUS.
+
+#define DTREE_PLACEMENT_LOAD_REFRESH_MS 2000
+// How often, in ms, the least-loaded placement policy refreshes its view of
+// server loads.
+
+#define DTREE_MERGE_PERCENT 25
+// Default fill level, as a percentage of the split thresholds, below which
+// the server splitter merges a node with a sibling. Nodes become this sparse
+// after large deletes, and merging them makes scans and counts read fewer
+// nodes. Tables can pick their own value with DdSetSplitThresholds. Merges
+// happen only if DTREE_SPLIT_LOCATION==2.
+
+#define DTREE_MERGE_FILL_PERCENT 75
+// Merge two siblings only if the merged node is at most this percentage of
+// the split thresholds, so that it is not split again soon after.
+
+#define DTREE_MERGE_RETRY_MS 1000
+// If a merge conflicts with other transactions, the splitter retries it for
+// up to this long, in ms, before giving up. Merges have lower priority than
+// splits and run only when there are no splits to do.
+
+#define DTREE_PSCAN_THREADS 4
+// Number of client threads that read the leaves of a tree in parallel, for
+// full scans and counts of large tables (see dtreescan.h). 0 disables
+// parallel scans. Parallel scans are also disabled with GAIA_OCC, since
+// reads of other threads would not be validated at commit.
+
+#define DTREE_PSCAN_PARTS_PER_THREAD 4
+// A parallel scan splits the leaves into about this many ranges per thread,
+// so that threads that finish early can take more ranges.
+
+#define DTREE_PSCAN_MIN_HEIGHT 2
+// SQL scans and counts go parallel only for trees at least this tall, so
+// that small tables, and scans that stop after a few rows, do not pay for it.
+
+#define DTREE_PSCAN_MAX_LEAVES 64
+// Leaves read ahead by a parallel scan and not yet consumed, above which
+// its threads stop reading.
+
+#define DTREE_SCAN_FILTER
+// If defined, full scans of SQL tables give the parallel scan the simple
+// terms of the WHERE clause on the table (column compared to a literal, IS
+// NULL, LIKE prefix), and storage servers send only the rows that may
+// satisfy them (see scanfilter.h).
+
+#define DTREE_JOIN_BATCH 64
+// In a join whose inner table is looked up by rowid, the rows of the inner
+// table needed by up to this many upcoming outer rows are read in one batch
+// of requests to the storage servers, instead of one request per outer row
+// (see sqlite3BtreeJoinBatch). 0 disables batching.
+
+#define DTREE_STATS_PATHS 4
+// The SQL planner estimates the rows, leaves, height, and servers of the tree
+// of a table or index by reading this many root-to-leaf paths, spread evenly
+// across the tree (see sqlite3BtreeTreeStats).
+
+#define DTREE_STATS_MAX_SERVERS 64
+// Distinct servers counted by these estimates.
+
+#define DTREE_STATS_REFRESH_MS 30000
+// The estimates of a table are redone when older than this, in ms.
+
+#define DTREE_COST_RPC 20
+// Cost of a round trip to a storage server for the SQL planner, in units of
+// its cost of stepping to the next row. 0 keeps sqlite's cost model, which
+// assumes local pages.
+
+#define DTREE_BULKLOAD_FILL_PERCENT 80
+// Bulk loads fill nodes up to this percentage of the split thresholds of the
+// table, leaving room for later inserts before nodes need to be split.
+
+#define DTREE_BULKLOAD_BATCH 64
+// Number of objects (nodes and rows) a bulk load writes in each transaction.
+// Larger transactions take longer to prepare and more often miss the commit
+// protocol's vote timeout (MSG_DELAY), which aborts them.
+
+#define LOADSPLIT_INTERVAL_MS 1000
+// Period, in ms, with which load statistics are checked for hot nodes and
+// decayed.
+
+#define LOADSPLIT_DECAY_PERCENT 50
+// Percentage of the access counters of a node kept from one period to the
+// next. Higher values react more slowly to changes in load but are less
+// fooled by short bursts.
+
+#define LOADSPLIT_HOT_PERCENT 10
+// A node is hot, and gets a load split, if its accesses per period exceed
+// this percentage of the capacity of the server thread.
+
+#define LOADSPLIT_CAPACITY 0
+// Accesses per second that a server thread can serve. If 0, the capacity is
+// estimated as the peak load seen by the thread.
+
+#define LOADSPLIT_MIN_RATE 1000
+// A node with fewer accesses per second than this is never hot, however
+// small the capacity.
+
+#define LOADSPLIT_SAMPLE_CELLS 16
+// Number of accessed cells kept per node (as a reservoir sample) to choose
+// where to split it.
+
+#define LOADSPLIT_MAX_COIDS 16384
+// Maximum number of nodes tracked per server thread. Accesses to other nodes
+// are ignored until idle nodes decay out of the statistics.
+
+#define LOADSPLIT_TRACK_SPLITS 16
+// Number of recent load splits for which the server measures, one period
+// later, how much of the load stayed in the split node.
+
 //#define ALL_SPLITS_UNCONDITIONAL
 // If defined, splitter server always tries to split a node, even if a recent
 // identical request was made
@@ -288,10 +525,23 @@
 #error DTREE_SPLIT_SIZE must be at least two, otherwise data will be corrupted
 #endif
 
+#if DTREE_MERGE_PERCENT < 0 || DTREE_MERGE_PERCENT > 100 || \
+    DTREE_MERGE_FILL_PERCENT > 100 || DTREE_MERGE_FILL_PERCENT < 2*DTREE_MERGE_PERCENT
+#error DTREE_MERGE_PERCENT must be between 0 and 100, and at most half of DTREE_MERGE_FILL_PERCENT
+#endif
+
+#if DTREE_PLACEMENT_POLICY < 1 || DTREE_PLACEMENT_POLICY > 3
+#error DTREE_PLACEMENT_POLICY must be 1, 2, or 3
+#endif
+
 #if defined(DTREE_LOADSPLITS) && DTREE_SPLIT_LOCATION != 2
 #error DTREE_LOADSPLITS works only when DTREE_SPLIT_LOCATION=2
 #endif
 
+#if LOADSPLIT_DECAY_PERCENT < 0 || LOADSPLIT_DECAY_PERCENT >= 100
+#error LOADSPLIT_DECAY_PERCENT must be between 0 and 99
+#endif
+
 #if YS_SCHEMA_CACHE == 2
 //#define GAIA_CLIENT_CONSISTENT_CACHE
 // If set, enable the consistent client cache in the key-value storage system.
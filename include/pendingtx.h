@@ -373,6 +373,7 @@ public:
 class PendingTx {
 private:
   HashTableMT<Tid,Ptr<PendingTxInfo> > cTxList;
+  u64 NPending; // number of entries in cTxList
   static int getInfoLockaux(Tid &tid, Ptr<PendingTxInfo> *pti, int status,
                             SkipList<Tid,Ptr<PendingTxInfo>> *b, u64 parm);
 public:
@@ -391,6 +392,8 @@ public:
 
   // returns 0 if item removed, -1 if item not found
   int removeInfo(Tid &tid);
+
+  u64 getNPending(){ return NPending; } // number of pending transactions
 };
 
 #endif
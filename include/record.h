@@ -97,6 +97,11 @@ char *myVdbeRecordPack(UnpackedRecord *pIdxKey, int file_format, int &length);
 // otherwise
 int testRecordPack(UnpackedRecord *pIdxKey, int file_format);
 
+// Reads field col of the record of reclen bytes at rec as an integer into
+// *value. Returns 0 if ok, non-zero if the record does not have the field
+// or the field is not an integer.
+int myRecordIntField(const char *rec, int reclen, int col, i64 *value);
+
 #ifndef SQLITE_CORE
 
 int binCollFunc(void *padFlag, int nKey1, const void *pKey1,
@@ -0,0 +1,134 @@
+//
+// replication.h
+//
+// Asynchronous primary-backup replication of a storage server. The primary
+// ships the updates of committed transactions to its backups, which apply
+// them to their own LogInMemory and serve snapshot reads below the safe
+// timestamp of the primary (see safets.h).
+//
+
+/*
+  Original code: Copyright (c) 2014 Microsoft Corporation
+  Modified code: Copyright (c) 2015-2016 VMware, Inc
+  All rights reserved.
+
+  Written by Marcos K. Aguilera
+
+  MIT License
+
+  Permission is hereby granted, free of charge, to any person
+  obtaining a copy of this software and associated documentation files
+  (the "Software"), to deal in the Software without restriction,
+  including without limitation the rights to use, copy, modify, merge,
+  publish, distribute, sublicense, and/or sell copies of the Software,
+  and to permit persons to whom the Software is furnished to do so,
+  subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED *AS IS*, WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+  BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+  ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#ifndef _REPLICATION_H
+#define _REPLICATION_H
+
+#include "tmalloc.h"
+#include "os.h"
+#include "options.h"
+#include "gaiatypes.h"
+#include "ipmisc.h"
+#include "datastruct.h"
+#include "pendingtx.h"
+#include "grpctcp.h"
+#include "gaiarpcaux.h"
+
+class LogInMemory;
+
+// The stream is a sequence of batches. A batch holds committed transactions,
+// each serialized as a ReplTxHeader followed by, for each object, its COid
+// and its TxUpdateCoid (see encodeTucoid in replication.cpp).
+struct ReplTxHeader {
+  Timestamp committs; // commit timestamp of transaction
+  int ncoids;         // number of objects updated
+  int reserved;
+};
+
+struct ReplBackup {
+  IPPort ipport;      // address of backup
+  bool connected;     // whether we connected to it
+  bool needSnapshot;  // whether to send a full copy before the next batch
+  u64 nextseq;        // sequence number of the next batch to send
+  u64 batches;        // batches acknowledged by backup
+  u64 snapshots;      // full copies acknowledged by backup
+  u64 failures;       // batches or copies that failed
+};
+
+class Replication {
+private:
+  // --- primary ---
+  int NBackups;
+  ReplBackup Backups[REPL_MAX_BACKUPS];
+  u64 StreamId;         // taken from the clock when server starts, so that
+                        // backups can tell a restarted primary
+  RWLock Lock;          // protects the queue below
+  char *QueueBuf;       // committed transactions not yet shipped
+  int QueueLen, QueueSize;
+  bool QueueOverflow;   // queue was dropped; backups need a full copy
+  int ThreadNo;         // thread that ships batches, -1 if not launched
+  Ptr<RPCTcp> *Rpcc;    // to talk to the backups
+
+  // --- backup ---
+  int BackupOf;         // server we replicate, -1 if not a backup
+  u64 PrimaryStreamId;  // stream being applied
+  u64 ExpectedSeq;      // next batch we accept
+  u64 AppliedWatermark; // reads with ts.getd1() <= this can be served
+  u64 AppliedBatches, AppliedTxs;
+
+  // ships a batch, and a full copy first if needed, to backup b
+  void shipToBackup(ReplBackup *b, char *buf, int len, u64 watermark);
+  static OSTHREAD_FUNC replicatorThread(void *parm);
+
+public:
+  Replication();
+  ~Replication();
+
+  // primary: adds a backup. Must be called before launch()
+  int addBackup(IPPort ipport);
+  bool hasBackups(){ return NBackups > 0; }
+  // primary: starts the thread that ships updates to the backups
+  void launch(Ptr<RPCTcp> *rpcc);
+
+  // primary: called when a transaction commits, after its updates are moved
+  // to the log in memory and before it leaves the safe timestamp.
+  // Queues its updates for the backups.
+  void committed(Tid tid, Timestamp committs, Ptr<PendingTxInfo> pti);
+
+  // backup: marks this server as a backup of server serverno
+  void setBackupOf(int serverno){ BackupOf = serverno; }
+  bool isBackup(){ return BackupOf >= 0; }
+  // backup: returns 0 if a read at ts can be served here,
+  // GAIAERR_REPL_LAG if ts is not yet closed at the backup
+  int checkRead(Timestamp &ts){
+    if (BackupOf < 0) return 0;
+    if (ts.isIllegal() || ts.getd1() > AppliedWatermark)
+      return GAIAERR_REPL_LAG;
+    return 0;
+  }
+  // backup: applies a batch or a full copy received from the primary.
+  // Returns 0 if ok, GAIAERR_REPL_GAP if the primary should send a full copy
+  // first, or another error
+  int apply(LogInMemory *lim, int op, u64 streamid, u64 seq, u64 watermark,
+            char *buf, int len);
+
+  void printStats(void);
+};
+
+#endif
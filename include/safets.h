@@ -0,0 +1,128 @@
+//
+// safets.h
+//
+// Safe timestamp of a storage server. Reads below it never wait for pending
+// transactions, because every transaction that can still commit at the
+// server will commit above it. Servers piggyback it on read replies, so that
+// clients can choose start timestamps for read-only transactions (see
+// Transaction::startReadOnly), and primaries send it to their backups as the
+// replication watermark (see replication.h).
+//
+
+/*
+  Original code: Copyright (c) 2014 Microsoft Corporation
+  Modified code: Copyright (c) 2015-2016 VMware, Inc
+  All rights reserved.
+
+  Written by Marcos K. Aguilera
+
+  MIT License
+
+  Permission is hereby granted, free of charge, to any person
+  obtaining a copy of this software and associated documentation files
+  (the "Software"), to deal in the Software without restriction,
+  including without limitation the rights to use, copy, modify, merge,
+  publish, distribute, sublicense, and/or sell copies of the Software,
+  and to permit persons to whom the Software is furnished to do so,
+  subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED *AS IS*, WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+  BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+  ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#ifndef _SAFETS_H
+#define _SAFETS_H
+
+#include "tmalloc.h"
+#include "os.h"
+#include "options.h"
+#include "gaiatypes.h"
+#include "datastruct.h"
+
+// The server periodically closes a timestamp ClosedTs some time in the past:
+// transactions that vote yes afterwards propose a commit timestamp above it
+// (see prepared()). Transactions that voted yes earlier may still commit
+// below it, so the safe timestamp is the smaller of ClosedTs and the proposed
+// commit timestamps of those transactions. A transaction must be removed
+// with finished() only after its outcome is applied.
+class SafeTimestamp {
+private:
+  RWLock Lock;        // protects the fields below
+  Timestamp ClosedTs; // no transaction that votes yes from now on proposes a
+                      // commit timestamp <= ClosedTs
+  SkipList<Tid,Timestamp> InFlight; // transactions that voted yes and have
+                      // not finished, with their proposed commit ts
+  Timestamp Cached;   // last value computed by advance()
+  u64 CachedUs;       // when Cached was computed
+
+  void auxadvance(void){ // sets Cached. Must be called with Lock held
+    SkipListNode<Tid,Timestamp> *ptr;
+    Timestamp ts;
+    ts.setOld(SAFETS_LAG_MS);
+    if (Timestamp::cmp(ts, ClosedTs) > 0) ClosedTs = ts;
+    Cached = ClosedTs;
+    for (ptr = InFlight.getFirst(); ptr != InFlight.getLast();
+         ptr = InFlight.getNext(ptr))
+      if (Timestamp::cmp(ptr->value, Cached) < 0) Cached = ptr->value;
+    CachedUs = Time::nowus();
+  }
+
+public:
+  SafeTimestamp(){ ClosedTs.setIllegal(); Cached.setIllegal(); CachedUs = 0; }
+
+  // called when a transaction votes yes, with the objects that it updates
+  // locked. Raises proposecommitts above the closed timestamp and remembers
+  // the transaction until it finishes.
+  void prepared(Tid tid, Timestamp &proposecommitts){
+    Timestamp *tsptr;
+    Lock.lock();
+    if (Timestamp::cmp(proposecommitts, ClosedTs) <= 0){
+      proposecommitts = ClosedTs;
+      proposecommitts.addEpsilon();
+    }
+    InFlight.lookupInsert(tid, tsptr);
+    *tsptr = proposecommitts;
+    Lock.unlock();
+  }
+
+  // called when a transaction that voted yes commits or aborts
+  void finished(Tid tid){
+    Timestamp dummy;
+    Lock.lock();
+    InFlight.lookupRemove(tid, 0, dummy);
+    Lock.unlock();
+  }
+
+  // closes the timestamp SAFETS_LAG_MS in the past and returns the safe
+  // timestamp: reads at timestamps smaller than it never wait
+  Timestamp advance(void){
+    Timestamp safets;
+    Lock.lock();
+    auxadvance();
+    safets = Cached;
+    Lock.unlock();
+    return safets;
+  }
+
+  // returns a recent safe timestamp, to piggyback on replies. It is
+  // recomputed if older than SAFETS_REFRESH_MS
+  Timestamp get(void){
+    Timestamp safets;
+    Lock.lock();
+    if (Time::nowus() - CachedUs >= SAFETS_REFRESH_MS * 1000) auxadvance();
+    safets = Cached;
+    Lock.unlock();
+    return safets;
+  }
+};
+
+#endif
@@ -0,0 +1,95 @@
+//
+// scanfilter.h
+//
+// Filters that a scan pushes down to the storage servers. A filter is built
+// by the SQL planner from simple WHERE terms on the columns of a table, and
+// servers evaluate it on the records of rows to return only those rows that
+// may satisfy the terms. A filter is only a pre-filter: the rows returned
+// are still checked by the query, so a filter may keep rows it is unsure
+// about, but it must never drop a row that satisfies the terms.
+//
+
+/*
+  Original code: Copyright (c) 2014 Microsoft Corporation
+  Modified code: Copyright (c) 2015-2016 VMware, Inc
+  All rights reserved.
+
+  Written by Marcos K. Aguilera
+
+  MIT License
+
+  Permission is hereby granted, free of charge, to any person
+  obtaining a copy of this software and associated documentation files
+  (the "Software"), to deal in the Software without restriction,
+  including without limitation the rights to use, copy, modify, merge,
+  publish, distribute, sublicense, and/or sell copies of the Software,
+  and to permit persons to whom the Software is furnished to do so,
+  subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED *AS IS*, WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+  BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+  ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#ifndef _SCANFILTER_H
+#define _SCANFILTER_H
+
+#include "inttypes.h"
+
+// Operations of a term. Each compares field col of the record with the
+// value of the term.
+#define SCANF_EQ            1
+#define SCANF_NE            2
+#define SCANF_LT            3  // field < value
+#define SCANF_LE            4
+#define SCANF_GT            5
+#define SCANF_GE            6
+#define SCANF_ISNULL        7  // value is not used
+#define SCANF_NOTNULL       8  // value is not used
+#define SCANF_PREFIX        9  // field is text starting with value (GLOB)
+#define SCANF_PREFIX_NOCASE 10 // ditto, ignoring the case of ASCII letters
+                               // (LIKE)
+
+// Types of the value of a term
+#define SCANF_NONE 0
+#define SCANF_INT  1
+#define SCANF_REAL 2
+#define SCANF_TEXT 3  // UTF-8, compared with memcmp
+
+#define SCANFILTER_MAX_TERMS 16 // terms in a filter
+
+// A filter is a sequence of terms, all of which must hold. Each term is a
+// ScanFilterTerm followed, if its value is text, by len bytes of text padded
+// to a multiple of 8 bytes.
+struct ScanFilterTerm {
+  u8 op;       // SCANF_EQ, ...
+  u8 type;     // SCANF_NONE, ...
+  u16 col;     // field of record
+  u32 len;     // bytes of text following the term
+  union {
+    i64 i;     // if type is SCANF_INT
+    double r;  // if type is SCANF_REAL
+  } v;
+};
+
+// Size of a term with len bytes of text
+inline int ScanFilterTermSize(int len){
+  return (int) sizeof(ScanFilterTerm) + ((len + 7) & ~7);
+}
+
+// Returns 0 if the record of reclen bytes at rec does not satisfy the
+// filter of filterlen bytes, non-zero if it satisfies it or if it cannot
+// tell (e.g., field of a different type than the value, or bad record).
+// Implemented in record.cpp.
+int ScanFilterMatch(const char *filter, int filterlen, const char *rec,
+                    int reclen);
+
+#endif
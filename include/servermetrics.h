@@ -0,0 +1,101 @@
+//
+// servermetrics.h
+//
+// Metrics of a storage server: RPC counts and latencies, deferred reads,
+// prepare votes, and the size of the in-memory state. Counters are kept
+// per thread, so updating them needs no synchronization; they are summed up
+// only when read, by GETSTATUS (see callserver stats) or the console.
+//
+
+/*
+  Original code: Copyright (c) 2014 Microsoft Corporation
+  Modified code: Copyright (c) 2015-2016 VMware, Inc
+  All rights reserved.
+
+  Written by Marcos K. Aguilera
+
+  MIT License
+
+  Permission is hereby granted, free of charge, to any person
+  obtaining a copy of this software and associated documentation files
+  (the "Software"), to deal in the Software without restriction,
+  including without limitation the rights to use, copy, modify, merge,
+  publish, distribute, sublicense, and/or sell copies of the Software,
+  and to permit persons to whom the Software is furnished to do so,
+  subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED *AS IS*, WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+  BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+  ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#ifndef _SERVERMETRICS_H
+#define _SERVERMETRICS_H
+
+#include "tmalloc.h"
+#include "os.h"
+#include "options.h"
+#include "inttypes.h"
+#include "util-more.h"
+
+#define SERVERMETRICS_NRPCS 25 // RPC numbers tracked. Higher numbers are
+                               // counted in the last entry
+
+// reasons for a participant to vote no on a prepare
+enum VoteNoReason {
+  VoteNoWrongServer = 0, // object not served here, or its bucket is migrating
+  VoteNoReadSet,         // object in the read set changed (GAIA_OCC only)
+  VoteNoCommitted,       // conflict with update committed after start ts
+  VoteNoPending,         // conflict with update of a prepared transaction
+  VoteNoNReasons
+};
+
+// Metrics of a server. Each thread has its own instance, where only the
+// counters are used. Gauges are filled in when the instances are summed up.
+// This struct is sent as is in GETSTATUS replies, so it has no pointers.
+struct ServerMetrics {
+  // counters
+  u64 rpcCount[SERVERMETRICS_NRPCS];       // RPCs served, by RPC number
+  Log2Histogram rpcLatencyUs[SERVERMETRICS_NRPCS]; // time from receipt of
+                                           // RPC to its reply, in us
+  u64 deferredReads;           // reads deferred behind a pending transaction
+  u64 voteYes;                 // prepares voted yes
+  u64 voteNo[VoteNoNReasons];  // prepares voted no, by reason
+
+  // gauges
+  u32 nthreads;        // number of threads whose counters were summed up
+  u32 splitQueueSize;  // number of nodes waiting to be split
+  u64 nobjects;        // objects in memory
+  u64 nversions;       // versions of objects in memory
+  u64 pendingTxs;      // transactions with pending state at the server
+  u64 tmallocInUse;    // bytes allocated from the pools of server threads
+  u64 tmallocReserved; // bytes obtained from the system by those pools
+
+  ServerMetrics(){ reset(); }
+  void reset();
+  void add(ServerMetrics &m); // add counters of m to this instance
+  void print(void);
+};
+
+#ifdef SERVER_METRICS
+// Returns the instance of the calling thread, creating it on first use.
+ServerMetrics *ServerMetricsLocal(void);
+#endif
+
+// Sums up the counters of all threads into m, and fills in the tmalloc
+// gauges. Other gauges are left for the caller. Counters are read while
+// their threads update them, so the sum is approximate.
+void ServerMetricsCollect(ServerMetrics *m);
+
+// To be passed to RPCTcp::setRequestObserver
+void ServerMetricsRequestObserver(void *ctx, u32 req, u64 elapsedus);
+
+#endif
@@ -0,0 +1,134 @@
+//
+// snapshot.h
+//
+// Snapshots of the objects of a storage server as of one timestamp, used
+// for backups and to seed new servers (see LogInMemory::flushToFile and
+// LogInMemory::loadFromFile).
+//
+
+/*
+  Original code: Copyright (c) 2014 Microsoft Corporation
+  Modified code: Copyright (c) 2015-2016 VMware, Inc
+  All rights reserved.
+
+  Written by Marcos K. Aguilera
+
+  MIT License
+
+  Permission is hereby granted, free of charge, to any person
+  obtaining a copy of this software and associated documentation files
+  (the "Software"), to deal in the Software without restriction,
+  including without limitation the rights to use, copy, modify, merge,
+  publish, distribute, sublicense, and/or sell copies of the Software,
+  and to permit persons to whom the Software is furnished to do so,
+  subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED *AS IS*, WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+  BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+  ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#ifndef _SNAPSHOT_H
+#define _SNAPSHOT_H
+
+#include <stdio.h>
+#include <vector>
+
+#include "options.h"
+#include "gaiatypes.h"
+#include "pendingtx.h"
+#include "diskstorage.h"
+
+// File format. A snapshot is a SnapshotHeader, followed by chunks, followed
+// by an index and a SnapshotFooter. A chunk is a SnapshotChunkHeader
+// followed by clen bytes compressed with zlib; uncompressed, they are
+// ulen bytes with a sequence of objects, each a COid followed by the object
+// in the format of DiskStorage::writeCOidToFile. The index has one
+// SnapshotIndexEntry per chunk. It is written last and found through the
+// footer at the end of the file, so that chunks can be written as they fill
+// up and read in any order.
+#define SNAPSHOT_MAGIC 0x50414e53 // "SNAP"
+#define SNAPSHOT_FORMAT_VERSION 1
+
+struct SnapshotHeader {
+  u32 magic;     // SNAPSHOT_MAGIC
+  u32 version;   // SNAPSHOT_FORMAT_VERSION
+  Timestamp ts;  // objects are as of this timestamp
+};
+
+struct SnapshotChunkHeader {
+  u32 clen;      // compressed bytes after this header
+  u32 ulen;      // bytes once uncompressed
+  u32 nobjects;  // objects in chunk
+  u32 crc;       // crc32c of the compressed bytes
+};
+
+struct SnapshotIndexEntry {
+  u64 offset;    // offset of chunk header in file
+  SnapshotChunkHeader ch;
+};
+
+struct SnapshotFooter {
+  u64 indexoffset; // offset of index in file
+  u64 nchunks;     // entries in index
+  u64 nobjects;    // objects in snapshot
+  u32 crc;         // crc32c of the index
+  u32 magic;       // SNAPSHOT_MAGIC
+};
+
+// Writes a snapshot, one object at a time
+class SnapshotWriter {
+private:
+  FILE *F;
+  FILE *Chunk;      // temporary file with objects of the current chunk
+  u32 ChunkObjects;
+  std::vector<SnapshotIndexEntry> Index;
+  u64 Offset;       // of next chunk
+  u64 NObjects;
+  int flushChunk(void);
+
+public:
+  SnapshotWriter();
+  ~SnapshotWriter();
+  // Creates the file. Returns 0 if ok, non-zero if error.
+  int open(const char *filename, Timestamp ts);
+  // Adds an object. Returns 0 if ok, non-zero if error.
+  int add(COid &coid, Ptr<TxUpdateCoid> tucoid, DiskStorage *ds);
+  // Writes the last chunk, the index, and the footer, and closes the file.
+  // Returns 0 if ok, non-zero if error.
+  int close(void);
+  u64 getNObjects(void){ return NObjects; }
+};
+
+// Reads a snapshot. After open, chunks can be read concurrently by
+// many threads.
+class SnapshotReader {
+private:
+  int Fd;
+  Timestamp Ts;
+  std::vector<SnapshotIndexEntry> Index;
+  u64 NObjects;
+
+public:
+  SnapshotReader(){ Fd = -1; NObjects = 0; }
+  ~SnapshotReader();
+  // Opens the file and reads its header and index. Returns 0 if ok,
+  // non-zero if error or the file is not a snapshot.
+  int open(const char *filename);
+  Timestamp getTs(void){ return Ts; }
+  int getNChunks(void){ return (int) Index.size(); }
+  u64 getNObjects(void){ return NObjects; }
+  // Reads and uncompresses chunk i into a buffer allocated with malloc.
+  // Returns 0 if ok, non-zero if error.
+  int readChunk(int i, char **retbuf, int *retlen);
+};
+
+#endif
@@ -7937,10 +7937,8 @@ typedef struct VdbeOpList VdbeOpList;
 #define OP_Trace                              136
 #define OP_Noop                               137
 #define OP_Explain                            138
-
-/* The following opcode values are never used */
-#define OP_NotUsed_139                        139
-#define OP_NotUsed_140                        140
+#define OP_ScanFilter                         139 // YESQUEL CH: added
+#define OP_JoinBatch                          140 // YESQUEL CH: added
 
 
 /* Properties such as "out2" or "jump" that are specified in
@@ -9049,6 +9047,7 @@ struct sqlite3 {
 #define SQLITE_IndexCover     0x10        /* Disable index covering table */
 #define SQLITE_GroupByOrder   0x20        /* Disable GROUPBY cover of ORDERBY */
 #define SQLITE_FactorOutConst 0x40        /* Disable factoring out constants */
+#define SQLITE_RpcCost        0x80        /* Disable RPC-aware plan costs */ // YESQUEL CH: added
 #define SQLITE_OptMask        0xff        /* Mask of all disablable opts */
 
 /*
@@ -9369,6 +9368,7 @@ struct Table {
   Index *pIndex;       /* List of SQL indexes on this table. */
   Pgno tnum;            /* Root BTree node for this table (see note above) */
   unsigned nRowEst;    /* Estimated rows in table - from sqlite_stat1 table */
+  BtTreeStats dtStats; /* Sampled shape of the tree of the table */ // YESQUEL CH: added
   Select *pSelect;     /* NULL for tables.  Points to definition if a view. */
   u16 nRef;            /* Number of pointers to this Table */
   u8 tabFlags;         /* Mask of TF_* values */
@@ -9588,6 +9588,7 @@ struct Index {
   u8 *aSortOrder;  /* Array of size Index.nColumn. True==DESC, False==ASC */
   char **azColl;   /* Array of collation sequence names for index */
   IndexSample *aSample;    /* Array of SQLITE_INDEX_SAMPLES samples */
+  BtTreeStats dtStats;     /* Sampled shape of the tree of the index */ // YESQUEL CH: added
 };
 
 /*
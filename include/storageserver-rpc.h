@@ -61,6 +61,10 @@ int shutdownRpcStub(RPCTaskInfo *rti);
 int startsplitterRpcStub(RPCTaskInfo *rti);
 int flushfileRpcStub(RPCTaskInfo *rti);
 int loadfileRpcStub(RPCTaskInfo *rti);
+int directoryRpcStub(RPCTaskInfo *rti);
+int migrateRpcStub(RPCTaskInfo *rti);
+int replicateRpcStub(RPCTaskInfo *rti);
+int filterreadRpcStub(RPCTaskInfo *rti);
 int inbacRpcStub(RPCTaskInfo *rti);
 int inbacmessageRpcStub(RPCTaskInfo *rti);
 int consmessageRpcStub(RPCTaskInfo *rti);
@@ -48,6 +48,8 @@ void initServerTask(TaskScheduler *ts); // to be called at initialization of
                                         // each RPC worker thread
 int ss_getrowidRpcStub(RPCTaskInfo *rti);
 void SplitNode(COid &coid, ListCellPlus *cell);
-void ReportAccess(COid &coid, ListCellPlus *cell);
+void MergeNode(COid &coid);
+void ReportAccess(COid &coid, ListCell &cell, Ptr<RcKeyInfo> prki);
+bool IsHotNode(COid &coid);
 
 #endif
@@ -64,6 +64,10 @@ Marshallable *shutdownRpc(ShutdownRPCData *d);
 Marshallable *startsplitterRpc(StartSplitterRPCData *d);
 Marshallable *flushfileRpc(FlushFileRPCData *d);
 Marshallable *loadfileRpc(LoadFileRPCData *d);
+Marshallable *directoryRpc(DirectoryRPCData *d);
+Marshallable *migrateRpc(MigrateRPCData *d);
+Marshallable *replicateRpc(ReplicateRPCData *d);
+Marshallable *filterreadRpc(FilterReadRPCData *d, void *handle, bool &defer);
 Marshallable *inbacRpc(InbacRPCData *d, void *&state, void *rpctasknotify);
 Marshallable *inbacMessageRpc(InbacMessageRPCData *d);
 Marshallable *consMessageRpc(ConsensusMessageRPCData *d);
@@ -75,5 +79,11 @@ void serverAuxWakeDeferred(void *handle);
 // a function that schedules an exit to occur after a while (2 seconds)
 void scheduleExit();
 
+// number of nodes waiting to be split at this server
+u32 serverSplitQueueSize(void);
+
+// fills in m with the metrics of this server (see servermetrics.h)
+void getServerMetrics(ServerMetrics *m);
+
 
 #endif
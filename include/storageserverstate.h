@@ -44,6 +44,9 @@
 #include "newconfig.h"
 #include "ccache-server.h"
 #include "inbac.h"
+#include "replication.h"
+#include "coldstore.h"
+#include "safets.h"
 
 class StorageServerState {
 public:
@@ -55,6 +58,37 @@ public:
   LogInMemory cLogInMemory;
   PendingTx cPendingTx;
   CCacheServerState cCCacheServerState;
+  Replication cRepl;
+  ColdStore cColdStore;
+  SafeTimestamp cSafeTs;
+  u64 NRequests; // number of data requests served, reported by GETSTATUS
+
+  PlacementDir *Dir; // placement directory, 0 if server owns every object.
+                     // Replaced rather than modified in place, and old
+                     // versions are not freed since readers do not lock it
+  int MyServerno;    // number of this server in the directory
+  RWLock DirLock;    // serializes changes to Dir
+  u8 Frozen[PLACEMENT_NBUCKETS]; // 0=normal, 1=updates refused,
+                                 // 2=updates and reads refused (see
+                                 // migrateRpc)
+
+  // Returns 0 if this server currently serves coid, GAIAERR_WRONG_SERVER
+  // otherwise. Updates are also refused if the bucket of coid is frozen,
+  // and reads if it is sealed. Backups refuse all updates.
+  int checkOwner(const COid &coid, bool update){
+    unsigned bucket = PLACEMENT_BUCKET(coid.oid);
+    PlacementDir *dir = Dir;
+    if (update && cRepl.isBackup()) return GAIAERR_WRONG_SERVER;
+    if (!dir) return 0;
+    if (dir->owner[bucket] != MyServerno) return GAIAERR_WRONG_SERVER;
+    if (Frozen[bucket] > (update ? 0 : 1)) return GAIAERR_WRONG_SERVER;
+    return 0;
+  }
+
+  // Installs a copy of newdir if it is newer than the current directory.
+  // Buckets that this server no longer owns are unfrozen, since requests
+  // for them are refused anyway. Returns 0 if installed, non-0 otherwise.
+  int setDirectory(PlacementDir *newdir);
 };
 
 #endif
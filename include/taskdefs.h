@@ -73,6 +73,7 @@
 // storageserver-splitter.h
 #define IMMEDIATEFUNC_SPLITTERTHREADNEWWORK 26
 #define IMMEDIATEFUNC_SPLITTERTHREADREPORTWORK 27
+#define IMMEDIATEFUNC_SPLITTERTHREADMERGEWORK 28
 
 //------------------------------ Fixed tasks -----------------------------------
 // core
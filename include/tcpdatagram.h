@@ -64,6 +64,7 @@ struct DatagramMsg {
 
 #define FLAG_HID(hid) ((hid)<<16)//given hid, returns corresponding bits in flag
 #define FLAG_GET_HID(flag) ((flag)>>16) // extract hid bits from flag
+#define FLAG_TAG_MASK 0xffff // bits of flag with the tag piggybacked on replies
 
 // wire format for RPC header
 struct DatagramMsgHeader {
@@ -71,7 +72,8 @@ struct DatagramMsgHeader {
   u32 flags;  // The 16 high bits of flags are a hash id, which determines which
               // server thread will handle the request. Requests with the same
               // hashid are guaranteed to be handled by the same server thread.
-              // The 16 low bits of flags are currently unused flags
+              // The 16 low bits of flags are unused in requests. In replies,
+              // they carry a tag set by the server (see RPCTcp::setReplyTag)
   u32 size; // size of payload (does not include header or footer)
   u32 req;  // request number (rpc number)
   u32 xid;  // unique per-sender identifier for request
@@ -151,6 +151,7 @@ private:
   int IncGrow;    // incremental number of units to grow when no more units
                   // available
   int NAllocated; // number of units allocated
+  int NUnits;     // number of units obtained by grow()
   u64 Tag;        // tag to be added at each allocated block
   void *(*PageAllocFunc)(size_t);
   unsigned PageSize;
@@ -185,6 +186,9 @@ public:
   static void setSize(void *buf, size_t newsize); // sets size of allocated
                                                   // block (must be <= Size)
   int getNAllocated(void){ return NAllocated; }
+  int getNUnits(void){ return NUnits; }
+  int getUnitSize(void){ return Size; }
+  int getRealUnitSize(void){ return Realsize; }
   void grow(void){ grow(IncGrow); }
   void *alloc(u64 reqsize=-1LL); // allocate new buffer. buffer will have
                                  // fixed size. 
@@ -222,6 +226,8 @@ public:
   ~VariableAllocatorNolock();
   void *alloc(size_t size);
   void free(void *ptr);
+  void getUsage(size_t *inuse, size_t *reserved); // bytes in allocated units
+                        // and bytes obtained from the system, across pools
   static size_t getSize(void *buf){
     // returns size of allocated block (requested size in myalloc)
     return FixedAllocatorNolock::getSize(buf);
@@ -83,6 +83,12 @@ void *_tmalloc(size_t size);
 void _tfree(void *buf);
 void *_trealloc(void *ptr, size_t size);
 size_t _tgetsize(void *buf);
+void *_tgetpool(void); // returns handle to the local pool of calling thread,
+                       // or 0 if there is none
+void _tgetpoolusage(void *pool, size_t *inuse, size_t *reserved); // bytes
+          // allocated to the user and bytes obtained from the system by the
+          // pool of _tgetpool(). May be called by any thread, in which case
+          // the result is approximate
 #define malloc _tmalloc
 #define free _tfree
 #define realloc _trealloc
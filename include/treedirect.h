@@ -73,6 +73,23 @@ int DdOpenTable(DdConnection *conn, u64 iTable, DdTable *&table); // Open a
 int DdCreateTable(DdConnection *conn, u64 iTable, DdTable *&table); // Create
   // and open a table given connection. Returns table number in iTable
   // and handle in table
+int DdSetPlacementPolicy(DdTable *table, int policy); // Set the server
+  // placement policy for new nodes of table (DTREE_PLACEMENT_* in coid.h).
+  // Returns 0 if ok, non-zero otherwise.
+int DdSetSplitThresholds(DdTable *table, int splitCells, int splitBytes,
+  int mergePercent); // Set the number of cells and bytes above which nodes of
+  // table are split, and the fill percentage below which they are merged.
+  // 0 means use the default in options.h; mergePercent=-1 disables merges.
+  // Returns 0 if ok, non-zero otherwise.
+int DdBulkLoad(DdTable *table,
+  int (*next)(i64 *key, const char **data, int *len, void *nextparm),
+  void *nextparm, u64 *nrows=0); // Load an empty table with the rows
+  // returned by next, which must come in increasing key order. next returns
+  // 0 and sets key, data, and len for each row, or returns non-zero at the
+  // end. data needs to be valid only until the next call. Builds full
+  // nodes directly instead of inserting rows one at a time (see dtreeload.h),
+  // and does not use the connection's transaction. Sets *nrows to the
+  // number of rows loaded. Returns 0 if ok, non-zero otherwise.
 void DdCloseTable(DdTable *table); // Close a table.
 int DdStartTx(DdConnection *conn); // Start a transaction
 int DdRollbackTx(DdConnection *conn); // Rollback a transaction
@@ -103,5 +120,14 @@ int DdScan(DdTable *table, i64 key, int nelems,
   // will be set to 0), and a callback parameter given to DdScan().
   // Returns 0 if no error (reaching eof before nelems is not error),
   // non-zero otherwise.
+int DdParallelScan(DdTable *table, bool ordered,
+  void (*callback)(i64 key, const char *data, int len, void *callbackparm),
+  void *callbackparm, bool fetchdata=true); // Scan the whole table using
+  // several threads, each reading a range of keys at the snapshot of the
+  // current transaction (see dtreescan.h). Invokes callback in the calling
+  // thread for each element, in key order if ordered is set, otherwise in
+  // the order the elements are read. data is valid only during the callback.
+  // If the transaction has written, the scan uses only the calling thread.
+  // Returns 0 if no error, non-zero otherwise.
 
 #endif
@@ -37,6 +37,8 @@
 #ifndef _UTIL_MORE_H
 #define _UTIL_MORE_H
 
+#include <string.h>
+#include <math.h>
 #include <list>
 #include <set>
 using namespace std;
@@ -103,4 +105,34 @@ public:
   double getStdDev(void){ return sqrt(getVariance()); }
 };
 
+// Histogram with buckets of exponentially increasing size: bucket 0 holds
+// the value 0 and bucket i>0 holds values in [2^(i-1), 2^i). Unlike Stat,
+// it uses constant space, so it can be updated on every operation.
+#define LOG2HISTOGRAM_NBUCKETS 48
+class Log2Histogram {
+  u64 buckets[LOG2HISTOGRAM_NBUCKETS];
+  u64 nitems;
+  u64 sum;
+  u64 max;
+public:
+  Log2Histogram(){ reset(); }
+  void reset(){ memset(buckets, 0, sizeof(buckets)); nitems=sum=max=0; }
+  void put(u64 item);
+  u64 getN(void){ return nitems; }
+  u64 getMax(void){ return max; }
+  double getAvg(void){ if (!nitems) return 0; return (double)sum/nitems; }
+  u64 getBucket(int i){ return buckets[i]; }
+  static u64 bucketLimit(int i){ return i ? (u64)1 << i : 1; } // exclusive
+  u64 getPercentile(int percent); // upper limit of bucket with percentile
+  void add(Log2Histogram &h); // merge counts of h into this histogram
+  void printSummary(const char *name, const char *unit); // one line
+  void print(const char *name, const char *unit); // prints summary and
+                                                  // non-empty buckets
+};
+
+// CRC32C (Castagnoli) of len bytes at buf, continuing from crc (0 to
+// start). Uses the SSE4.2 crc32 instruction if the CPU has it, otherwise a
+// table.
+u32 crc32c(u32 crc, const void *buf, size_t len);
+
 #endif
@@ -54,6 +54,7 @@
 #include "gaiatypes.h"
 #include "clientdir.h"
 #include "clientlib.h"
+#include "servermetrics.h"
 
 #ifdef DEBUG
 extern int DebugLevel;
@@ -69,6 +70,8 @@ struct {
   {"shutdown-splitter", 3},
   {"shutdown",4},
   {"splitter",5},
+  {"resize",6},
+  {"stats",7},
   {0,-1} // to indicate end
 };
 
@@ -124,6 +127,8 @@ int main(int argc, char **argv)
     fprintf(stderr, "  shutdown-splitter\n");
     fprintf(stderr, "  shutdown\n");
     fprintf(stderr, "  splitter\n");
+    fprintf(stderr, "  resize nservers\n");
+    fprintf(stderr, "  stats\n");
     exit(1);
   }
 
@@ -181,6 +186,27 @@ int main(int argc, char **argv)
   case 5: // splitter
     sc.startsplitterServers();
     break;
+  case 6: // resize
+    if (!commandarg){
+      printf("resize requires the number of servers to use\n");
+      exit(1);
+    }
+    if (sc.resizeServers(atoi(commandarg))) exit(1);
+    break;
+  case 7: { // stats
+    int n = sc.CS->Nservers;
+    GetStatusRPCResp *resps = new GetStatusRPCResp[n];
+    ServerMetrics *metrics = new ServerMetrics[n];
+    sc.getStatusServers(resps, false, metrics);
+    for (i=0; i < n; ++i){
+      printf("Server %d: requests %llu\n", i,
+             (unsigned long long) resps[i].nrequests);
+      metrics[i].print();
+    }
+    delete [] resps;
+    delete [] metrics;
+    break;
+  }
   default: assert(0);
   }
 
@@ -63,11 +63,16 @@ StorageConfig::StorageConfig(const char *configfile) {
 
   CS->connectHosts(Rpcc);
   Od = new ObjectDirectory(CS);
+  Od->track(Rpcc);
 #ifdef GAIA_CLIENT_CONSISTENT_CACHE
   CCache = new ClientCache(CS->Nservers);
 #else
   CCache = 0;
 #endif
+  Backups = 0;
+  initBackups();
+  SafeTsLagUs = new int[CS->Nservers];
+  for (int i=0; i < CS->Nservers; ++i) SafeTsLagUs[i] = -1;
 }
 
 StorageConfig::StorageConfig(const char *configfile, Ptr<RPCTcp> rpcc) {
@@ -82,11 +87,53 @@ StorageConfig::StorageConfig(const char *configfile, Ptr<RPCTcp> rpcc) {
 
   CS->connectHosts(Rpcc);
   Od = new ObjectDirectory(CS);
+  Od->track(Rpcc);
 #ifdef GAIA_CLIENT_CONSISTENT_CACHE
   CCache = new ClientCache(CS->Nservers);
 #else
   CCache = 0;
 #endif
+  Backups = 0;
+  SafeTsLagUs = new int[CS->Nservers];
+  for (int i=0; i < CS->Nservers; ++i) SafeTsLagUs[i] = -1;
+}
+
+// Parses GAIABACKUPS_ENV, a list of serverno=host:port entries separated by
+// commas. Backups must be hosts of the configuration file, so that
+// connectHosts has connected to them already.
+void StorageConfig::initBackups(void){
+  char *env, *str, *entry, *saveptr, *eq, *colon;
+  IPPort ipport;
+  int serverno;
+
+  env = getenv(GAIABACKUPS_ENV);
+  if (!env || !*env) return;
+  str = (char*) malloc(strlen(env)+1);
+  strcpy(str, env);
+  Backups = new IPPort[CS->Nservers];
+  memset(Backups, 0, sizeof(IPPort) * CS->Nservers);
+
+  for (entry = strtok_r(str, ",", &saveptr); entry;
+       entry = strtok_r(0, ",", &saveptr)){
+    eq = strchr(entry, '=');
+    colon = strrchr(entry, ':');
+    if (!eq || !colon || colon < eq){
+      fprintf(stderr, "%s: bad entry %s, should be serverno=host:port\n",
+              GAIABACKUPS_ENV, entry);
+      continue;
+    }
+    *eq = *colon = 0;
+    serverno = atoi(entry);
+    ipport.set(IPMisc::resolveName(eq+1, CS->PreferredIP, CS->PreferredIPMask),
+               htons(atoi(colon+1)));
+    if (serverno < 0 || serverno >= CS->Nservers || !CS->Hosts.lookup(&ipport)){
+      fprintf(stderr, "%s: server %d or host %s:%s not in config file\n",
+              GAIABACKUPS_ENV, serverno, eq+1, colon+1);
+      continue;
+    }
+    if (!Backups[serverno].ip) Backups[serverno] = ipport; // first one wins
+  }
+  free(str);
 }
 
 struct pingCallbackData {
@@ -136,57 +183,78 @@ void StorageConfig::pingServers(void){
 
 struct GetStatusCallbackData {
   Semaphore *sem;
-  GetStatusRPCRespData resp; // this field gets filled by getStatusCallback
-                             // with server response
+  int ok;                // set to 1 by getStatusCallback if server responded
+  GetStatusRPCResp resp; // this field gets filled by getStatusCallback
+                         // with server response
+  ServerMetrics *metrics; // if non-zero, filled by getStatusCallback with
+                          // the metrics in the server response
 };
 
 void StorageConfig::getStatusCallback(char *data, int len, void *callbackdata){
   GetStatusRPCRespData resp;
   GetStatusCallbackData *gscd = (GetStatusCallbackData *) callbackdata;
   if (data){ // RPC got response
-    dprintf(2, "Ping: got a response");
+    dprintf(2, "GetStatus: got a response");
     resp.demarshall(data); // now resp->data has return results of RPC
-    gscd->resp = resp;
+    gscd->resp = *resp.data; // copy it, since data is freed on return
+    if (gscd->metrics){
+      // ignore metrics of servers built with a different ServerMetrics
+      if (resp.metrics && resp.data->metricslen == sizeof(ServerMetrics))
+        memcpy((void*) gscd->metrics, resp.metrics, sizeof(ServerMetrics));
+      else gscd->metrics->reset();
+    }
+    gscd->ok = 1;
   }
   gscd->sem->signal();
   return; // free return results of RPC
 }
 
-
-void StorageConfig::getStatusServers(void){
+int StorageConfig::getStatusServers(GetStatusRPCResp *resps, bool verbose,
+                                    ServerMetrics *metrics){
   GetStatusRPCData *parm;
-  HostConfig *hc;
+  ServerHT *sht;
   Semaphore sem;
-  int i, count;
+  int i, count, nerrors;
   GetStatusCallbackData *gscd;
-  list<GetStatusCallbackData*> responses;
 
-  count = 0;
-  for (hc = CS->Hosts.getFirst(); hc != CS->Hosts.getLast();
-       hc = CS->Hosts.getNext(hc)){
-    ++count;
-    printf("GetStatus server %08x port %d\n", hc->ipport.ip, hc->ipport.port);
+  count = CS->Nservers;
+  gscd = new GetStatusCallbackData[count];
+  for (i=0; i < count; ++i){
+    sht = CS->Servers[i];
+    if (verbose)
+      printf("GetStatus server %08x port %d\n", sht->ipport.ip,
+             sht->ipport.port);
     parm = new GetStatusRPCData;
     parm->data = new GetStatusRPCParm;
-    parm->data->reserved = 0;
+    parm->data->flags = metrics ? GETSTATUS_FLAG_METRICS : 0;
     parm->freedata = true;
-    gscd = new GetStatusCallbackData;
-    gscd->sem = &sem;
-    responses.push_back(gscd);
-    Rpcc->asyncRPC(hc->ipport, GETSTATUS_RPCNO, 0, parm, getStatusCallback,
-                   (void *) gscd);
+    gscd[i].sem = &sem;
+    gscd[i].ok = 0;
+    gscd[i].metrics = metrics ? metrics + i : 0;
+    Rpcc->asyncRPC(sht->ipport, GETSTATUS_RPCNO, 0, parm, getStatusCallback,
+                   (void *) &gscd[i]);
   }
-  printf("Waiting for responses\n");
+  if (verbose) printf("Waiting for responses\n");
   for (i=0; i < count; ++i){
     // wait for responses for all issued RPCs
     sem.wait(INFINITE);
   }
-  for (list<GetStatusCallbackData*>::iterator it = responses.begin();
-       it != responses.end(); ++it){
-    gscd = *it;
-    // **!** do something with gscd->resp
-    delete gscd;
+  nerrors = 0;
+  for (i=0; i < count; ++i){
+    if (!gscd[i].ok){
+      ++nerrors;
+      memset(&gscd[i].resp, 0, sizeof(GetStatusRPCResp));
+      if (metrics) metrics[i].reset();
+    }
+    if (resps) resps[i] = gscd[i].resp;
+    if (verbose)
+      printf("Server %d: objects %llu requests %llu splitqueue %u%s\n", i,
+             (unsigned long long) gscd[i].resp.nobjects,
+             (unsigned long long) gscd[i].resp.nrequests,
+             gscd[i].resp.splitQueueSize, gscd[i].ok ? "" : " (no response)");
   }
+  delete [] gscd;
+  return nerrors;
 }
 
 struct ShutdownCallbackData {
@@ -383,12 +451,13 @@ void StorageConfig::loadServers(char *filename){
 
 //-------------------------------------------------------------------------
 
-static inline unsigned GetServerNumber(const COid &coid, int nservers,
+static inline unsigned GetServerNumber(const COid &coid, PlacementDir *dir,
                                        int method, int parm){
   switch(method){
   case 0:
-    // parm is not used for method 0
-    return (coid.oid & 0xffff)%nservers;
+    // parm is not used for method 0. Without a directory from the servers,
+    // dir maps the low 16 bits of oid modulo the number of servers
+    return dir->owner[PLACEMENT_BUCKET(coid.oid)];
   default: assert(0);
   }
   return 0;
@@ -397,8 +466,10 @@ static inline unsigned GetServerNumber(const COid &coid, int nservers,
 void ObjectDirectory::GetServerId(const COid& coid, IPPortServerno &ipps){
   unsigned serverno;
 
+  if (Stale) refresh();
+
   // get server number
-  serverno = GetServerNumber(coid, Config->Nservers, Config->StripeMethod,
+  serverno = GetServerNumber(coid, Config->Dir, Config->StripeMethod,
                              Config->StripeParm);
   ipps.ipport = Config->Servers[serverno]->ipport;
   ipps.serverno = serverno;
@@ -413,3 +484,248 @@ void ObjectDirectory::GetServerId(const COid& coid, IPPortServerno &ipps){
 //   ipport = Config->Servers[serverno]->ipport;
 // }
 
+struct DirectoryCallbackData {
+  Semaphore *sem;
+  PlacementDir *dir; // directory returned by server, 0 if none
+};
+
+void ObjectDirectory::directoryCallback(char *data, int len,
+                                        void *callbackdata){
+  DirectoryRPCRespData resp;
+  DirectoryCallbackData *dcd = (DirectoryCallbackData*) callbackdata;
+  if (data){ // RPC got response
+    resp.demarshall(data);
+    if (resp.data->status == 0 &&
+        resp.data->dirlen == (int) sizeof(PlacementDir)){
+      dcd->dir = new PlacementDir;
+      memcpy((void*) dcd->dir, resp.data->dir, sizeof(PlacementDir));
+    }
+  }
+  dcd->sem->signal();
+}
+
+int ObjectDirectory::refresh(void){
+  DirectoryRPCData *parm;
+  DirectoryCallbackData *dcd;
+  Semaphore sem;
+  PlacementDir *best=0;
+  int i, count, nerrors=0;
+
+  if (!Rpcc.isset()) return 0;
+  if (CompareSwap32(&Refreshing, 0, 1) != 0) return 0; // someone else is at it
+  Stale = 0; // replies tagged from now on will set it again if needed
+
+  count = Config->Nservers;
+  dcd = new DirectoryCallbackData[count];
+  for (i=0; i < count; ++i){
+    parm = new DirectoryRPCData;
+    parm->data = new DirectoryRPCParm;
+    parm->data->set = 0;
+    parm->data->dirlen = 0;
+    parm->data->dir = 0;
+    parm->freedata = true;
+    dcd[i].sem = &sem;
+    dcd[i].dir = 0;
+    Rpcc->asyncRPC(Config->Servers[i]->ipport, DIRECTORY_RPCNO, 0, parm,
+                   directoryCallback, (void *) &dcd[i]);
+  }
+  for (i=0; i < count; ++i) sem.wait(INFINITE);
+  for (i=0; i < count; ++i){
+    if (!dcd[i].dir){ ++nerrors; continue; }
+    if ((int) dcd[i].dir->nservers == Config->Nservers &&
+        (!best || dcd[i].dir->epoch > best->epoch)) best = dcd[i].dir;
+  }
+  if (best) setDir(best);
+  for (i=0; i < count; ++i) if (dcd[i].dir) delete dcd[i].dir;
+  delete [] dcd;
+  Refreshing = 0;
+  return nerrors;
+}
+
+void ObjectDirectory::setDir(PlacementDir *dir){
+  PlacementDir *newdir;
+  if (dir->epoch <= Config->Dir->epoch) return;
+  newdir = new PlacementDir;
+  *newdir = *dir;
+  MemBarrier(); // ensure directory contents are visible before the pointer
+  Config->Dir = newdir; // old directory is not freed, see ConfigState::Dir
+  dprintf(1, "ObjectDirectory: now using epoch %u", newdir->epoch);
+}
+
+int ObjectDirectory::bucketOfServer(int serverno, unsigned hint){
+  PlacementDir *dir = Config->Dir;
+  unsigned i, b;
+  for (i=0; i < PLACEMENT_NBUCKETS; ++i){
+    b = (hint + i) % PLACEMENT_NBUCKETS;
+    if (dir->owner[b] == serverno) return (int) b;
+  }
+  return -1;
+}
+
+// Called by RPC layer with the tag of each reply, which is the low 16 bits
+// of the epoch of the server's directory. Mark our directory as stale if the
+// tag is ahead of our epoch, so that the next GetServerId refreshes it.
+void ObjectDirectory::replyTagObserver(void *ctx, u16 tag){
+  ObjectDirectory *od = (ObjectDirectory*) ctx;
+  if ((i16)(tag - (u16)(od->Config->Dir->epoch & FLAG_TAG_MASK)) > 0)
+    od->Stale = 1;
+}
+
+void ObjectDirectory::track(Ptr<RPCTcp> rpcc){
+  Rpcc = rpcc;
+  Rpcc->setReplyTagObserver(replyTagObserver, (void*) this);
+  refresh();
+}
+
+//-------------------------------------------------------------------------
+
+// Invokes a MIGRATE RPC at the given server. If retbuf!=0, sets *retbuf to
+// a buffer with the exported data, which the caller should free with free().
+// Returns status of RPC.
+int StorageConfig::migrateRPC(int server, int op, u16 *buckets, int nbuckets,
+                              char *buf, int len, u64 *retcount,
+                              char **retbuf, int *retlen){
+  MigrateRPCData *parm;
+  MigrateRPCRespData rpcresp;
+  char *resp;
+  int status;
+
+  parm = new MigrateRPCData;
+  parm->data = new MigrateRPCParm;
+  parm->freedata = true;
+  parm->data->op = op;
+  parm->data->nbuckets = nbuckets;
+  parm->data->len = len;
+  parm->data->reserved = 0;
+  parm->data->buckets = buckets;
+  parm->data->buf = buf;
+
+  resp = Rpcc->syncRPC(CS->Servers[server]->ipport, MIGRATE_RPCNO, 0, parm);
+  if (!resp) return GAIAERR_SERVER_TIMEOUT;
+  rpcresp.demarshall(resp);
+  status = rpcresp.data->status;
+  if (retcount) *retcount = rpcresp.data->count;
+  if (retbuf){
+    *retlen = rpcresp.data->len;
+    *retbuf = (char*) malloc(*retlen ? *retlen : 1);
+    memcpy(*retbuf, rpcresp.data->buf, *retlen);
+  }
+  free(resp);
+  return status;
+}
+
+// Moves the given buckets from server src to server dst and installs a
+// directory reflecting the move at all servers. dir is updated accordingly.
+// Returns 0 if ok, non-0 if error.
+int StorageConfig::moveBuckets(PlacementDir *dir, u16 *buckets, int nbuckets,
+                               int src, int dst){
+  DirectoryRPCData *parm;
+  DirectoryRPCRespData rpcresp;
+  char *resp, *buf=0;
+  int res, len, i, server;
+  u64 count;
+
+  // stop new updates to buckets, then wait for prepared ones to finish
+  res = migrateRPC(src, MIGRATE_OP_FREEZE, buckets, nbuckets, 0, 0, 0, 0, 0);
+  if (res) goto error;
+  do {
+    res = migrateRPC(src, MIGRATE_OP_PENDING, buckets, nbuckets, 0, 0, &count,
+                     0, 0);
+    if (res) goto error;
+    if (count) mssleep(MIGRATE_DRAIN_POLL_MS);
+  } while (count);
+
+  // stop reads too, so that the read timestamps we copy are final
+  res = migrateRPC(src, MIGRATE_OP_SEAL, buckets, nbuckets, 0, 0, 0, 0, 0);
+  if (res) goto error;
+  mssleep(MIGRATE_SEAL_GRACE_MS); // let reads already in progress finish
+
+  res = migrateRPC(src, MIGRATE_OP_EXPORT, buckets, nbuckets, 0, 0, &count,
+                   &buf, &len);
+  if (res) goto error;
+  res = migrateRPC(dst, MIGRATE_OP_IMPORT, 0, 0, buf, len, &count, 0, 0);
+  if (res) goto error;
+  printf("Moved %d buckets with %llu objects from server %d to %d\n",
+         nbuckets, (unsigned long long) count, src, dst);
+
+  // flip owner of buckets. Install at dst first so that it is ready to serve
+  // when other servers start pointing clients to it
+  for (i=0; i < nbuckets; ++i) dir->owner[buckets[i]] = (u16) dst;
+  ++dir->epoch;
+  for (i=-1; i < CS->Nservers; ++i){
+    server = i == -1 ? dst : i;
+    if (i == dst) continue;
+    parm = new DirectoryRPCData;
+    parm->data = new DirectoryRPCParm;
+    parm->freedata = true;
+    parm->data->set = 1;
+    parm->data->dirlen = sizeof(PlacementDir);
+    parm->data->dir = (char*) dir;
+    resp = Rpcc->syncRPC(CS->Servers[server]->ipport, DIRECTORY_RPCNO, 0,
+                         parm);
+    if (!resp){
+      printf("Cannot set directory at server %d\n", server);
+      continue;
+    }
+    rpcresp.demarshall(resp);
+    if (rpcresp.data->status)
+      printf("Server %d refused directory with epoch %u\n", server,
+             dir->epoch);
+    free(resp);
+  }
+  Od->setDir(dir);
+  free(buf);
+  return 0;
+
+ error:
+  printf("Error %d moving buckets from server %d to %d\n", res, src, dst);
+  migrateRPC(src, MIGRATE_OP_UNFREEZE, buckets, nbuckets, 0, 0, 0, 0, 0);
+  if (buf) free(buf);
+  return res;
+}
+
+// Buckets move in batches of up to MIGRATE_BATCH_BUCKETS buckets with the same
+// source and destination. For each batch, freeze it at the source, wait for
+// its pending updates to drain, seal it, copy it to the destination, and
+// install a directory with the new owners at all servers. Transactions that
+// touch a batch while it moves get GAIAERR_WRONG_SERVER and abort.
+int StorageConfig::resizeServers(int nactive){
+  PlacementDir *dir;
+  u16 *batch;
+  int b, n, src, dst, res=0;
+
+  if (nactive <= 0 || nactive > CS->Nservers){
+    printf("Number of servers must be between 1 and %d\n", CS->Nservers);
+    return -1;
+  }
+  if (Od->refresh()){
+    printf("Some servers did not respond\n");
+    return -1;
+  }
+  if (Od->getDir()->epoch == 0){
+    printf("Servers do not have a placement directory\n");
+    return -1;
+  }
+  dir = new PlacementDir;
+  *dir = *Od->getDir();
+  batch = new u16[MIGRATE_BATCH_BUCKETS];
+
+  for (src=0; src < CS->Nservers; ++src){
+    for (dst=0; dst < CS->Nservers; ++dst){
+      if (src == dst) continue;
+      n = 0;
+      for (b=0; b < PLACEMENT_NBUCKETS; ++b){
+        if (dir->owner[b] == src && b % nactive == dst) batch[n++] = (u16) b;
+        if (n == MIGRATE_BATCH_BUCKETS || n > 0 && b == PLACEMENT_NBUCKETS-1){
+          res = moveBuckets(dir, batch, n, src, dst);
+          if (res) goto end;
+          n = 0;
+        }
+      }
+    }
+  }
+ end:
+  delete [] batch;
+  delete dir;
+  return res;
+}
@@ -97,6 +97,9 @@ int LocalTransaction::start(){
 // start a new transaction
 int LocalTransaction::startDeferredTs(){ return start(); }
 
+// local storage has no other clients, so there is nothing to wait for
+int LocalTransaction::startReadOnly(int maxstalems){ return start(); }
+
 static void iovecmemcpy(char *dest, iovec *bufs, int nbufs){
   for (int i=0; i < nbufs; ++i){
     memcpy((void*) dest, (void*) bufs[i].iov_base, bufs[i].iov_len);
@@ -96,10 +96,14 @@ int Transaction::start(){
   StartTs.setNew();
   Id.setNew();
   txCache.clear();
+  Servers.clear(); // the object may be reused for another transaction
+  PendingSubtrans.clear(0, 0);
   State = 0;  // valid
   hasWrites = false;
   hasWritesCachable = false;
   currlevel = 0;
+  followerRead = false;
+  readOnly = false;
   if (piggy_buf) delete piggy_buf;
   piggy_len = -1;
   piggy_buf = 0;
@@ -107,6 +111,38 @@ int Transaction::start(){
   return 0;
 }
 
+// start a transaction that reads at a timestamp stalems in the past, from
+// the backups of the servers if possible
+int Transaction::startFollowerRead(int stalems){
+  start();
+  StartTs.setOld(stalems);
+  followerRead = true;
+  return 0;
+}
+
+Tlocal Timestamp Transaction::LastCommitTs;
+
+// start a read-only transaction that reads below the safe timestamps of the
+// servers, or at most maxstalems in the past if maxstalems >= 0
+int Transaction::startReadOnly(int maxstalems){
+  int lagms;
+  start();
+  lagms = Sc->safeTsLagUs(READONLY_DEFAULT_LAG_MS * 1000) / 1000 + 1;
+  if (maxstalems >= 0 && lagms > maxstalems) lagms = maxstalems;
+  StartTs.setOld(lagms);
+  if (Timestamp::cmp(StartTs, LastCommitTs) < 0)
+    StartTs = LastCommitTs; // read our own writes
+  readOnly = true;
+  return 0;
+}
+
+int Transaction::startReadOnlyAt(Timestamp startts){
+  start();
+  StartTs = startts;
+  readOnly = true;
+  return 0;
+}
+
 // start a transaction with a start timestamp that will be set when the
 // transaction first read, to be the timestamp of the latest available version
 // to read.
@@ -117,8 +153,12 @@ int Transaction::startDeferredTs(void){
   StartTs.setIllegal();
   Id.setNew();
   txCache.clear();
+  Servers.clear();
+  PendingSubtrans.clear(0, 0);
   State = 0;  // valid
   hasWrites = false;
+  followerRead = false;
+  readOnly = false;
   return 0;
 }
 
@@ -147,6 +187,7 @@ int Transaction::writev(COid coid, int nbufs, iovec *bufs){
   Sc->Od->GetServerId(coid, server);
 
   if (State) return GAIAERR_TX_ENDED;
+  if (readOnly) return GAIAERR_READ_ONLY;
   // add server index to set of servers participating in transaction
   hasWrites = true;
 
@@ -191,6 +232,7 @@ int Transaction::writev(COid coid, int nbufs, iovec *bufs){
   rpcdata->data->cid = coid.cid;
   rpcdata->data->oid = coid.oid;
   rpcdata->data->level = currlevel;
+  takeSubtrans(server, rpcdata->data->subtrans);
   rpcdata->data->buf = 0;  // data->buf is not used by client
 
   // this is the buf information really used by the marshaller
@@ -293,6 +335,8 @@ int Transaction::tryLocalRead(COid &coid, Ptr<Valbuf> &buf, int typ){
 
 int Transaction::vget(COid coid, Ptr<Valbuf> &buf){
   IPPortServerno server;
+  IPPort target;
+  bool tobackup;
   int reslocalread;
 
   ReadRPCData *rpcdata;
@@ -332,6 +376,10 @@ int Transaction::vget(COid coid, Ptr<Valbuf> &buf){
   }
 #endif
 
+  target = server.ipport;
+  tobackup = followerRead && Sc->getBackup(server.serverno, target);
+
+ again:
   rpcdata = new ReadRPCData;
   rpcdata->data = new ReadRPCParm;
   rpcdata->freedata = true;
@@ -343,10 +391,15 @@ int Transaction::vget(COid coid, Ptr<Valbuf> &buf){
   rpcdata->data->oid = coid.oid;
   rpcdata->data->len = -1;  // requested max bytes to read
 
-  resp = Sc->Rpcc->syncRPC(server.ipport, READ_RPCNO,
+  resp = Sc->Rpcc->syncRPC(target, READ_RPCNO,
                            FLAG_HID(TID_TO_RPCHASHID(Id)), rpcdata);
 
   if (!resp){ // error contacting server
+    if (tobackup){ // try primary instead
+      tobackup = false;
+      target = server.ipport;
+      goto again;
+    }
     //State=-2; // mark transaction as aborted due to I/O error
     buf = 0;
     return GAIAERR_SERVER_TIMEOUT;
@@ -354,10 +407,23 @@ int Transaction::vget(COid coid, Ptr<Valbuf> &buf){
 
   rpcresp.demarshall(resp);
 
+  if (tobackup && (rpcresp.data->status == GAIAERR_REPL_LAG ||
+                   rpcresp.data->status == GAIAERR_WRONG_SERVER)){
+    // backup is behind or does not have object; try primary instead
+    free(resp);
+    tobackup = false;
+    target = server.ipport;
+    goto again;
+  }
+
+  if (!tobackup) Sc->reportSafeTs(server.serverno, rpcresp.data->safeTs);
+
 #ifdef GAIA_CLIENT_CONSISTENT_CACHE
   // refresh client cache metadata
-  Sc->CCache->report(server.serverno, rpcresp.data->versionNoForCache,
-                     rpcresp.data->tsForCache, rpcresp.data->reserveTsForCache);
+  if (!tobackup)
+    Sc->CCache->report(server.serverno, rpcresp.data->versionNoForCache,
+                       rpcresp.data->tsForCache,
+                       rpcresp.data->reserveTsForCache);
 #endif
 
   respstatus = rpcresp.data->status;
@@ -402,6 +468,8 @@ int Transaction::vget(COid coid, Ptr<Valbuf> &buf){
 int Transaction::vsuperget(COid coid, Ptr<Valbuf> &buf, ListCell *cell,
                            Ptr<RcKeyInfo> prki){
   IPPortServerno server;
+  IPPort target;
+  bool tobackup;
   int reslocalread;
   FullReadRPCData *rpcdata;
   FullReadRPCRespData rpcresp;
@@ -425,6 +493,10 @@ int Transaction::vsuperget(COid coid, Ptr<Valbuf> &buf, ListCell *cell,
   ReadSet.insert(coid);
 #endif
 
+  target = server.ipport;
+  tobackup = followerRead && Sc->getBackup(server.serverno, target);
+
+ again:
   rpcdata = new FullReadRPCData;
   rpcdata->data = new FullReadRPCParm;
   rpcdata->freedata = true;
@@ -444,10 +516,15 @@ int Transaction::vsuperget(COid coid, Ptr<Valbuf> &buf, ListCell *cell,
     memset(&rpcdata->data->cell, 0, sizeof(ListCell));
   }
 
-  resp = Sc->Rpcc->syncRPC(server.ipport, FULLREAD_RPCNO,
+  resp = Sc->Rpcc->syncRPC(target, FULLREAD_RPCNO,
                            FLAG_HID(TID_TO_RPCHASHID(Id)), rpcdata);
 
   if (!resp){ // error contacting server
+    if (tobackup){ // try primary instead
+      tobackup = false;
+      target = server.ipport;
+      goto again;
+    }
     //State=-2; // mark transaction as aborted due to I/O error
     buf = 0;
     return GAIAERR_SERVER_TIMEOUT;
@@ -455,10 +532,23 @@ int Transaction::vsuperget(COid coid, Ptr<Valbuf> &buf, ListCell *cell,
 
   rpcresp.demarshall(resp);
 
+  if (tobackup && (rpcresp.data->status == GAIAERR_REPL_LAG ||
+                   rpcresp.data->status == GAIAERR_WRONG_SERVER)){
+    // backup is behind or does not have object; try primary instead
+    free(resp);
+    tobackup = false;
+    target = server.ipport;
+    goto again;
+  }
+
+  if (!tobackup) Sc->reportSafeTs(server.serverno, rpcresp.data->safeTs);
+
 #ifdef GAIA_CLIENT_CONSISTENT_CACHE
   // refresh client cache metadata
-  Sc->CCache->report(server.serverno, rpcresp.data->versionNoForCache,
-                     rpcresp.data->tsForCache, rpcresp.data->reserveTsForCache);
+  if (!tobackup)
+    Sc->CCache->report(server.serverno, rpcresp.data->versionNoForCache,
+                       rpcresp.data->tsForCache,
+                       rpcresp.data->reserveTsForCache);
 #endif
 
   respstatus = rpcresp.data->status;
@@ -520,6 +610,135 @@ int Transaction::vsuperget(COid coid, Ptr<Valbuf> &buf, ListCell *cell,
   return respstatus;
 }
 
+void Transaction::auxfilterreadcallback(char *data, int len,
+                                        void *callbackdata){
+  FilterReadCallbackData *frcd = (FilterReadCallbackData*) callbackdata;
+  FilterReadRPCRespData rpcresp;
+  FilterReadRPCItem *item;
+  Valbuf *vbuf;
+  char *ptr;
+  int i;
+
+  if (!data){ // error contacting server
+    frcd->status = GAIAERR_SERVER_TIMEOUT;
+    frcd->sem.signal();
+    return;
+  }
+  rpcresp.demarshall(data);
+  frcd->status = rpcresp.data->status;
+  frcd->safeTs = rpcresp.data->safeTs;
+  if (!frcd->status){
+    assert(rpcresp.data->nitems == frcd->n);
+    ptr = rpcresp.data->buf;
+    for (i=0; i < frcd->n; ++i){
+      item = &rpcresp.data->items[i];
+      if (item->status == FILTERREAD_FILTERED) frcd->filtered[frcd->idx[i]] = 1;
+      if (item->status != FILTERREAD_MATCH) continue; // errors leave buf unset
+      // copy data, since the response buffer is freed when we return
+      vbuf = new Valbuf;
+      vbuf->type = 0;
+      vbuf->coid.cid = frcd->cid;
+      vbuf->coid.oid = frcd->oids[frcd->idx[i]];
+      vbuf->immutable = true;
+      vbuf->commitTs = item->readts;
+      vbuf->readTs = frcd->readts;
+      vbuf->len = item->len;
+      vbuf->u.buf = allocReadBuf(item->len);
+      memcpy(vbuf->u.buf, ptr, item->len);
+      ptr += item->len;
+      frcd->bufs[frcd->idx[i]] = vbuf;
+    }
+  }
+  frcd->sem.signal();
+  return; // free buffer
+}
+
+int Transaction::vgetFilter(Cid cid, int n, Oid *oids, int skip,
+                            const char *filter, int filterlen,
+                            Ptr<Valbuf> *bufs, u8 *filtered){
+  IPPortServerno server;
+  COid coid;
+  FilterReadRPCData *rpcdata;
+  FilterReadCallbackData *frcd;
+  LinkList<FilterReadCallbackData> frcdlist(true);
+  int i, j, res;
+
+  if (State) return GAIAERR_TX_ENDED;
+#ifdef GAIA_OCC
+  return 1; // reads must enter the read set
+#endif
+  // servers do not see the writes of the transaction
+  if (hasWrites || StartTs.isIllegal()) return 1;
+
+  // group objects by server
+  coid.cid = cid;
+  for (i=0; i < n; ++i){
+    filtered[i] = 0;
+    coid.oid = oids[i];
+    Sc->Od->GetServerId(coid, server);
+    for (frcd = frcdlist.getFirst(); frcd != frcdlist.getLast();
+         frcd = frcdlist.getNext(frcd))
+      if (IPPortServerno::cmp(frcd->server, server) == 0) break;
+    if (frcd == frcdlist.getLast()){
+      frcd = new FilterReadCallbackData;
+      frcd->server = server;
+      frcd->cid = cid;
+      frcd->readts = StartTs;
+      frcd->n = 0;
+      frcd->oids = oids;
+      frcd->bufs = bufs;
+      frcd->filtered = filtered;
+      frcd->status = 0;
+      frcdlist.pushTail(frcd);
+    }
+    ++frcd->n;
+  }
+  for (frcd = frcdlist.getFirst(); frcd != frcdlist.getLast();
+       frcd = frcdlist.getNext(frcd)){
+    frcd->idx = new int[frcd->n];
+    frcd->n = 0;
+  }
+  for (i=0; i < n; ++i){
+    coid.oid = oids[i];
+    Sc->Od->GetServerId(coid, server);
+    for (frcd = frcdlist.getFirst(); frcd != frcdlist.getLast();
+         frcd = frcdlist.getNext(frcd))
+      if (IPPortServerno::cmp(frcd->server, server) == 0) break;
+    frcd->idx[frcd->n++] = i;
+  }
+
+  // send one request per server
+  for (frcd = frcdlist.getFirst(); frcd != frcdlist.getLast();
+       frcd = frcdlist.getNext(frcd)){
+    rpcdata = new FilterReadRPCData;
+    rpcdata->data = new FilterReadRPCParm;
+    rpcdata->freedata = true;
+    rpcdata->data->tid = Id;
+    rpcdata->data->ts = StartTs;
+    rpcdata->data->cid = cid;
+    rpcdata->data->noids = frcd->n;
+    rpcdata->data->skip = skip;
+    rpcdata->data->filterlen = filterlen;
+    rpcdata->data->reserved = 0;
+    rpcdata->data->oids = new Oid[frcd->n];
+    for (j=0; j < frcd->n; ++j) rpcdata->data->oids[j] = oids[frcd->idx[j]];
+    rpcdata->data->filter = new char[filterlen];
+    memcpy(rpcdata->data->filter, filter, filterlen);
+    Sc->Rpcc->asyncRPC(frcd->server.ipport, FILTERREAD_RPCNO,
+                       FLAG_HID(TID_TO_RPCHASHID(Id)), rpcdata,
+                       auxfilterreadcallback, frcd);
+  }
+
+  res = 0;
+  for (frcd = frcdlist.getFirst(); frcd != frcdlist.getLast();
+       frcd = frcdlist.getNext(frcd)){
+    frcd->sem.wait(INFINITE);
+    if (frcd->status){ if (!res) res = frcd->status; continue; }
+    Sc->reportSafeTs(frcd->server.serverno, frcd->safeTs);
+  }
+  return res;
+}
+
 // free a buffer returned by Transaction::read
 void Transaction::readFreeBuf(char *buf){
   assert(buf);
@@ -609,6 +828,7 @@ int Transaction::auxprepare(Timestamp &chosents, int &hascommitted){
     rpcdata->data->startts = StartTs;
     //rpcdata->data->committs = committs;
     rpcdata->data->onephasecommit = hascommitted;
+    takeSubtrans(server, rpcdata->data->subtrans);
 
 #ifdef GAIA_WRITE_ON_PREPARE
     if (piggy_buf && IPPortServerno::cmp(server, piggy_server)==0) {
@@ -783,11 +1003,9 @@ int Transaction::startSubtrans(int level){
 // done with a higher level are discarded. Afterwards, currlevel
 // is set to level
 int Transaction::abortSubtrans(int level){
-  int res;
   assert(level <= currlevel);
   if (level < currlevel){
-    res = auxsubtrans(level, 0); // tell servers to abort higher levels
-    if (res) return res;
+    addSubtrans(level, 0); // servers will abort higher levels
     if (piggy_level > level){
       if (piggy_buf) delete piggy_buf;
       piggy_buf = 0;
@@ -806,11 +1024,9 @@ int Transaction::abortSubtrans(int level){
 // Any updates done with a higher level are changed to the given level.
 // Afterwards, currlevel is set to level
 int Transaction::releaseSubtrans(int level){
-  int res;
   assert(level <= currlevel);
   if (level < currlevel){
-    res = auxsubtrans(level, 1); // tell servers to release higher levels
-    if (res) return res;
+    addSubtrans(level, 1); // servers will release higher levels
     if (piggy_level > level) piggy_level = level;
     txCache.releaseLevel(level); // make changes to tx cache
     currlevel = level;
@@ -885,7 +1101,7 @@ void Transaction::auxinbaccallback(char *data, int len, void *callbackdata){
 //    0 if committed,
 //    1 if aborted due to no vote,
 //   <0 if commit error or transaction has ended
-int Transaction::auxinbac(Timestamp committs) {
+int Transaction::auxinbac(Timestamp &committs) {
 
   IPPortServerno server;
   SetNode<IPPortServerno> *it;
@@ -929,6 +1145,7 @@ int Transaction::auxinbac(Timestamp committs) {
     rpcdata->data->committs = committs;
     rpcdata->data->onephasecommit = hascommitted;
     rpcdata->data->inbacId = key;
+    takeSubtrans(server, rpcdata->data->subtrans);
     rpcdata->data->owner = server;
     rpcdata->data->rank = rank;
 
@@ -988,6 +1205,7 @@ int Transaction::tryCommitINBAC(Timestamp *retcommitts) {
 
   if (State) return GAIAERR_TX_ENDED;
 
+  if (readOnly) return 0; // reads are from a snapshot; nothing to commit
 #ifdef GAIA_OCC
   if (!hasWrites && ReadSet.getNitems() <= 1) return 0; // nothing to commit
 #else
@@ -1000,6 +1218,10 @@ int Transaction::tryCommitINBAC(Timestamp *retcommitts) {
   if (outcome==0){
     if (retcommitts) *retcommitts = committs; // if requested, return commit
                                               // timestamp
+    // servers may commit at different timestamps, and only some are
+    // reported back, so read-only transactions of this thread read from now
+    LastCommitTs.setNew();
+    if (Timestamp::cmp(LastCommitTs, committs) < 0) LastCommitTs = committs;
   }
 
   State=-1;  // transaction now invalid
@@ -1024,6 +1246,7 @@ int Transaction::tryCommit2PC(Timestamp *retcommitts){
 
   if (State) return GAIAERR_TX_ENDED;
 
+  if (readOnly) return 0; // reads are from a snapshot; nothing to commit
 #ifdef GAIA_OCC
   if (!hasWrites && ReadSet.getNitems() <= 1) return 0; // nothing to commit
 #else
@@ -1057,8 +1280,7 @@ int Transaction::tryCommit2PC(Timestamp *retcommitts){
   if (outcome==0){
     if (retcommitts) *retcommitts = committs; // if requested, return commit
                                               // timestamp
-    // update lastcommitts
-    //if (lastcommitts < committs.getd1()) lastcommitts = committs.getd1();
+    LastCommitTs = committs; // for read-only transactions of this thread
   }
 
   State=-1;  // transaction now invalid
@@ -1089,66 +1311,24 @@ int Transaction::abort(void){
   return 0;
 }
 
-// ----------------------------- Subtrans RPC ----------------------------------
-
-// static method
-void Transaction::auxsubtranscallback(char *data, int len, void *callbackdata){
-  SubtransCallbackData *ccd = (SubtransCallbackData*) callbackdata;
-  SubtransRPCRespData rpcresp;
-  if (data){
-    rpcresp.demarshall(data);
-    // record information from response
-    ccd->data = *rpcresp.data;
-  } else {
-    ccd->data.status = -1;  // mark error
-  }
-  ccd->sem.signal();
-  return; // free buffer
-}
+// ------------------------- Subtrans level changes ---------------------------
 
-// Auxilliary function to invoke subtrans RPC to all servers
-// in the serverset of transaction
-// action 0 means abort, 1 means release
-int Transaction::auxsubtrans(int level, int action){
-  IPPortServerno server;
-  SubtransRPCData *rpcdata;
-  SubtransCallbackData *ccd;
-  LinkList<SubtransCallbackData> ccdlist(true);
-  Set<IPPortServerno> *serverset;
+// Level changes are not sent to the servers right away. They are recorded
+// here and carried by the next request of the transaction to each server
+// (see SubtransHeader), saving a round trip to all servers per change.
+void Transaction::addSubtrans(int level, int action){
   SetNode<IPPortServerno> *it;
-  int res;
-
-  serverset = &Servers;
-
-  res = 0;
-  for (it = serverset->getFirst(); it != serverset->getLast();
-       it = serverset->getNext(it)){
-    server = it->key;
-
-    rpcdata = new SubtransRPCData;
-    rpcdata->data = new SubtransRPCParm;
-    rpcdata->freedata = true;
+  SubtransHeader *sh;
 
-    // fill out parameters
-    rpcdata->data->tid = Id;
-    rpcdata->data->level = level;
-    rpcdata->data->action = action;
-
-    ccd = new SubtransCallbackData;
-    ccdlist.pushTail(ccd);
-
-    Sc->Rpcc->asyncRPC(server.ipport, SUBTRANS_RPCNO,
-                       FLAG_HID(TID_TO_RPCHASHID(Id)), rpcdata,
-                       auxsubtranscallback, ccd);
-  }
-
-  for (ccd = ccdlist.getFirst(); ccd != ccdlist.getLast();
-       ccd = ccdlist.getNext(ccd)){
-    ccd->sem.wait(INFINITE);
-    if (ccd->data.status < 0) res = GAIAERR_SERVER_TIMEOUT; // error contacting server
+  for (it = Servers.getFirst(); it != Servers.getLast();
+       it = Servers.getNext(it)){
+    PendingSubtrans.lookupInsert(it->key, sh); // creates empty header if new
+    sh->add(level, action);
   }
+}
 
-  return res;
+void Transaction::takeSubtrans(IPPortServerno &server, SubtransHeader &sh){
+  if (PendingSubtrans.lookupRemove(server, 0, sh)) sh.clear();
 }
 
 //// Read an object in the context of a transaction. Returns
@@ -1234,6 +1414,7 @@ int Transaction::writeSuperValue(COid coid, SuperValue *sv){
 
   Sc->Od->GetServerId(coid, server);
   if (State) return GAIAERR_TX_ENDED;
+  if (readOnly) return GAIAERR_READ_ONLY;
 
   // add server index to set of servers participating in transaction
   hasWrites = true;
@@ -1263,6 +1444,7 @@ int Transaction::writeSuperValue(COid coid, SuperValue *sv){
   fp->cid = coid.cid;
   fp->oid = coid.oid;
   fp->level = currlevel;
+  takeSubtrans(server, fp->subtrans);
   fp->nattrs = sv->Nattrs;
   fp->celltype = sv->CellType;
   fp->ncelloids = sv->Ncells;
@@ -1335,6 +1517,7 @@ int Transaction::listAdd(COid coid, ListCell *cell, Ptr<RcKeyInfo> prki,
 
   Sc->Od->GetServerId(coid, server);
   if (State) return GAIAERR_TX_ENDED;
+  if (readOnly) return GAIAERR_READ_ONLY;
 
   localread = tryLocalRead(coid, vbuf, 1);
   if (localread < 0) return localread;
@@ -1374,6 +1557,7 @@ int Transaction::listAdd(COid coid, ListCell *cell, Ptr<RcKeyInfo> prki,
   rpcdata->data->cid = coid.cid;
   rpcdata->data->oid = coid.oid;
   rpcdata->data->level = currlevel;
+  takeSubtrans(server, rpcdata->data->subtrans);
   rpcdata->data->flags = flags;
   rpcdata->data->ts = StartTs;
   rpcdata->data->prki = prki;
@@ -1442,6 +1626,7 @@ int Transaction::listDelRange(COid coid, u8 intervalType, ListCell *cell1,
 
   Sc->Od->GetServerId(coid, server);
  if (State) return GAIAERR_TX_ENDED;
+ if (readOnly) return GAIAERR_READ_ONLY;
 
   localread = tryLocalRead(coid, vbuf, 1);
   if (localread < 0) return localread;
@@ -1459,6 +1644,7 @@ int Transaction::listDelRange(COid coid, u8 intervalType, ListCell *cell1,
   rpcdata->data->cid = coid.cid;
   rpcdata->data->oid = coid.oid;
   rpcdata->data->level = currlevel;
+  takeSubtrans(server, rpcdata->data->subtrans);
   rpcdata->data->prki = prki;
   rpcdata->data->intervalType = intervalType;
   rpcdata->data->cell1 = *cell1;
@@ -1521,6 +1707,7 @@ int Transaction::attrSet(COid coid, u32 attrid, u64 attrvalue){
 
   Sc->Od->GetServerId(coid, server);
   if (State) return GAIAERR_TX_ENDED;
+  if (readOnly) return GAIAERR_READ_ONLY;
 
   localread = tryLocalRead(coid, vbuf, 1);
   if (localread < 0) return localread;
@@ -1538,6 +1725,7 @@ int Transaction::attrSet(COid coid, u32 attrid, u64 attrvalue){
   rpcdata->data->cid = coid.cid;
   rpcdata->data->oid = coid.oid;
   rpcdata->data->level = currlevel;
+  takeSubtrans(server, rpcdata->data->subtrans);
   rpcdata->data->attrid = attrid;
   rpcdata->data->attrvalue = attrvalue;
 
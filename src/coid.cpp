@@ -45,6 +45,9 @@
 
 #include "coid.h"
 #include "kvinterface.h"
+#include "gaiarpcaux.h"
+
+extern StorageConfig *SC;
 
 Tlocal SimplePrng *RndServerPrng=0;
 Tlocal u64 MyOidIssuerId = 0;
@@ -129,6 +132,127 @@ void setRandomServerid(u64 *oid){
   *oid |= serverid; // set lower 32 bits to random serverid
 }
 
+// Loads of servers as last seen by this thread, used by the least-loaded
+// placement policy. Loads are refreshed via GETSTATUS every
+// DTREE_PLACEMENT_LOAD_REFRESH_MS.
+struct ServerLoadView {
+  int nservers;
+  u64 lastrefresh;   // time of last refresh (0 if never)
+  u64 *nrequests;    // request counts at last refresh, to compute rates
+  double *rate;      // requests per ms between last two refreshes
+  double *nobjects;  // objects at server, plus nodes placed there by us
+                     // since the last refresh
+  int *bucket;       // a bucket owned by server, -1 if server owns none
+  ServerLoadView(int n){
+    nservers = n;
+    lastrefresh = 0;
+    nrequests = new u64[n];
+    rate = new double[n];
+    nobjects = new double[n];
+    bucket = new int[n];
+    for (int i=0; i < n; ++i){ nrequests[i]=0; rate[i]=0.0; nobjects[i]=0.0;
+                               bucket[i]=-1; }
+  }
+  ~ServerLoadView(){ delete [] nrequests; delete [] rate; delete [] nobjects;
+                     delete [] bucket; }
+
+  // fetch new loads from servers. Returns 0 if ok, non-zero if some server
+  // did not answer, in which case the previous view is kept
+  int refresh(StorageConfig *sc){
+    GetStatusRPCResp *resps = new GetStatusRPCResp[nservers];
+    u64 now = Time::now();
+    int i, res;
+    res = sc->getStatusServers(resps, false);
+    if (!res){
+      for (i=0; i < nservers; ++i){
+        if (lastrefresh && now > lastrefresh &&
+            resps[i].nrequests >= nrequests[i])
+          rate[i] = (double)(resps[i].nrequests - nrequests[i]) /
+                    (double)(now - lastrefresh);
+        nrequests[i] = resps[i].nrequests;
+        // a long split queue means the server is struggling to keep up;
+        // count each queued split as a node's worth of extra objects
+        nobjects[i] = (double) resps[i].nobjects +
+          (double) resps[i].splitQueueSize * DTREE_SPLIT_SIZE;
+        bucket[i] = sc->Od->bucketOfServer(i, 0);
+      }
+      lastrefresh = now;
+    }
+    delete [] resps;
+    return res;
+  }
+
+  // returns the number of the least loaded server that owns some bucket.
+  // Request rate is weighted the same as number of objects, each normalized
+  // by its average across servers
+  int leastLoaded(){
+    double sumrate=0.0, sumobjects=0.0, score, best=0.0;
+    int i, besti=-1;
+    for (i=0; i < nservers; ++i){ sumrate += rate[i]; sumobjects += nobjects[i]; }
+    for (i=0; i < nservers; ++i){
+      if (bucket[i] < 0) continue; // server is not active
+      score = 0.0;
+      if (sumrate > 0.0) score += rate[i] * nservers / sumrate;
+      if (sumobjects > 0.0) score += nobjects[i] * nservers / sumobjects;
+      if (besti == -1 || score < best){ best = score; besti = i; }
+    }
+    if (besti == -1) return -1;
+    // account for the node about to be placed, so that placements between
+    // refreshes do not all pile onto the same server
+    nobjects[besti] += DTREE_SPLIT_SIZE/2 + 1;
+    return besti;
+  }
+};
+
+Tlocal ServerLoadView *LoadView = 0;
+
+// change oid to have the serverid of the least loaded server. If loads are not
+// available (eg, servers do not answer), pick a random serverid
+void setLeastLoadedServerid(u64 *oid){
+  u64 now;
+  int server, bucket;
+  assert(oid);
+  if (!SC || SC->CS->Nservers <= 0){ setRandomServerid(oid); return; }
+  if (!LoadView || LoadView->nservers != SC->CS->Nservers){
+    if (LoadView) delete LoadView;
+    LoadView = new ServerLoadView(SC->CS->Nservers);
+  }
+  now = Time::now();
+  if (now - LoadView->lastrefresh >= DTREE_PLACEMENT_LOAD_REFRESH_MS)
+    LoadView->refresh(SC);
+  if (!LoadView->lastrefresh){ setRandomServerid(oid); return; }
+
+  server = LoadView->leastLoaded();
+  if (server < 0){ setRandomServerid(oid); return; }
+  // pick a random bucket owned by the chosen server
+  if (!RndServerPrng) RndServerPrng = new SimplePrng();
+  bucket = SC->Od->bucketOfServer(server, (unsigned) RndServerPrng->next());
+  if (bucket < 0) bucket = LoadView->bucket[server];
+  *oid &= ~0xffffLL; // clear lower 16 bits
+  *oid |= (u64) bucket;
+}
+
+// change oid to have a serverid chosen according to placement policy
+void setPlacementServerid(u64 *oid, int policy, Oid sibling){
+  if (policy == DTREE_PLACEMENT_DEFAULT) policy = DTREE_PLACEMENT_POLICY;
+  switch(policy){
+  case DTREE_PLACEMENT_SIBLING:
+    if (sibling){
+      *oid &= ~0xffffLL;
+      *oid |= sibling & 0xffffLL; // same serverid as sibling
+    }
+    else setRandomServerid(oid);
+    break;
+  case DTREE_PLACEMENT_LEASTLOADED:
+    setLeastLoadedServerid(oid);
+    break;
+  case DTREE_PLACEMENT_RANDOM:
+  default:
+    setRandomServerid(oid);
+    break;
+  }
+}
+
 // constructs oid from its components
 void setOid(u64 *oid, u64 issuerid, u64 counter, u64 serverid){
   assert((issuerid & ~0xffffffffLL)==0); // only low 32 bits should be set
@@ -0,0 +1,69 @@
+//
+// coldstore-nop.cpp
+//
+// Cold tier of a storage server with a memory budget. This implementation
+// does nothing. It is used when storage is local to the client
+// (LOCALSTORAGE), which has no memory budget.
+//
+
+/*
+  Original code: Copyright (c) 2014 Microsoft Corporation
+  Modified code: Copyright (c) 2015-2016 VMware, Inc
+  All rights reserved.
+
+  Written by Marcos K. Aguilera
+
+  MIT License
+
+  Permission is hereby granted, free of charge, to any person
+  obtaining a copy of this software and associated documentation files
+  (the "Software"), to deal in the Software without restriction,
+  including without limitation the rights to use, copy, modify, merge,
+  publish, distribute, sublicense, and/or sell copies of the Software,
+  and to permit persons to whom the Software is furnished to do so,
+  subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED *AS IS*, WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+  BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+  ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+
+#ifndef LOCALSTORAGE
+#define LOCALSTORAGE
+#endif
+#include "tmalloc.h"
+#include "debug.h"
+#include "coldstore.h"
+
+ColdStore::ColdStore(){
+  Fd = -1;
+  memset(Segments, 0, sizeof(Segments));
+  NSegments = 0;
+  Next = Garbage = Budget = 0;
+  DS = 0;
+  Lim = 0;
+  ThreadNo = -1;
+}
+ColdStore::~ColdStore(){}
+int ColdStore::open(const char *filename, DiskStorage *ds){ return -1; }
+int ColdStore::put(Ptr<TxUpdateCoid> tucoid, u64 *retoffset, u32 *retlen){
+  return -1;
+}
+int ColdStore::get(COid &coid, u64 offset, u32 len,
+                   Ptr<TxUpdateCoid> &tucoid){
+  return -1;
+}
+void ColdStore::launch(LogInMemory *lim, u64 budget){}
@@ -0,0 +1,172 @@
+//
+// coldstore.cpp
+//
+// Cold tier of a storage server with a memory budget (see coldstore.h)
+//
+
+/*
+  Original code: Copyright (c) 2014 Microsoft Corporation
+  Modified code: Copyright (c) 2015-2016 VMware, Inc
+  All rights reserved.
+
+  Written by Marcos K. Aguilera
+
+  MIT License
+
+  Permission is hereby granted, free of charge, to any person
+  obtaining a copy of this software and associated documentation files
+  (the "Software"), to deal in the Software without restriction,
+  including without limitation the rights to use, copy, modify, merge,
+  publish, distribute, sublicense, and/or sell copies of the Software,
+  and to permit persons to whom the Software is furnished to do so,
+  subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED *AS IS*, WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+  BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+  ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include "tmalloc.h"
+#include "options.h"
+#include "os.h"
+#include "debug.h"
+#include "task.h"
+#include "logmem.h"
+#include "coldstore.h"
+
+ColdStore::ColdStore(){
+  Fd = -1;
+  memset(Segments, 0, sizeof(Segments));
+  NSegments = 0;
+  Next = 0;
+  Garbage = 0;
+  DS = 0;
+  Lim = 0;
+  Budget = 0;
+  ThreadNo = -1;
+}
+
+ColdStore::~ColdStore(){
+  int i;
+  for (i=0; i < NSegments; ++i) munmap(Segments[i], COLDTIER_SEGMENT_BYTES);
+  if (Fd >= 0) close(Fd);
+}
+
+int ColdStore::open(const char *filename, DiskStorage *ds){
+  DS = ds;
+  Fd = ::open(filename, O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (Fd < 0){
+    dprintf(1, "ColdStore: error opening file %s", filename);
+    return -1;
+  }
+  return 0;
+}
+
+// Extends the file by a segment and maps it. Returns 0 if ok, non-zero if
+// error. Assumes Lock is held.
+int ColdStore::addSegment(void){
+  char *seg;
+  off_t off;
+
+  if (NSegments == COLDTIER_MAX_SEGMENTS) return -1;
+  off = (off_t) NSegments * COLDTIER_SEGMENT_BYTES;
+  if (ftruncate(Fd, off + COLDTIER_SEGMENT_BYTES)) return -1;
+  seg = (char*) mmap(0, COLDTIER_SEGMENT_BYTES, PROT_READ | PROT_WRITE,
+                     MAP_SHARED, Fd, off);
+  if (seg == (char*) MAP_FAILED) return -1;
+  Segments[NSegments++] = seg;
+  Next = off;
+  return 0;
+}
+
+int ColdStore::put(Ptr<TxUpdateCoid> tucoid, u64 *retoffset, u32 *retlen){
+  FILE *f;
+  char *ptr;
+  long len;
+  int res, tries, retval=-1;
+  u64 segoff;
+
+  Lock.lock();
+  for (tries=0; tries < 2; ++tries){
+    if (tries || Next / COLDTIER_SEGMENT_BYTES == (u64) NSegments){
+      if (addSegment()) break; // start a new segment
+    }
+    segoff = Next % COLDTIER_SEGMENT_BYTES;
+    ptr = Segments[Next / COLDTIER_SEGMENT_BYTES] + segoff;
+    f = fmemopen(ptr, COLDTIER_SEGMENT_BYTES - segoff, "w");
+    if (!f) break;
+    setvbuf(f, 0, _IONBF, 0); // so that running out of space fails the write
+    res = DS->writeCOidToFile(f, tucoid);
+    len = ftell(f);
+    fclose(f);
+    if (res == 0 && len > 0){
+      *retoffset = Next;
+      *retlen = (u32) len;
+      Next += len;
+      retval = 0;
+      break;
+    }
+    if (segoff == 0) break; // does not fit in an empty segment
+  }
+  Lock.unlock();
+  return retval;
+}
+
+int ColdStore::get(COid &coid, u64 offset, u32 len,
+                   Ptr<TxUpdateCoid> &tucoid){
+  FILE *f;
+  int res;
+  char *ptr;
+
+  assert(offset / COLDTIER_SEGMENT_BYTES < (u64) NSegments);
+  ptr = Segments[offset / COLDTIER_SEGMENT_BYTES] +
+    offset % COLDTIER_SEGMENT_BYTES;
+  f = fmemopen(ptr, len, "r");
+  if (!f) return -1;
+  res = DS->readCOidFromFile(f, coid, tucoid);
+  fclose(f);
+  return res;
+}
+
+void ColdStore::launch(LogInMemory *lim, u64 budget){
+  if (ThreadNo != -1) return;
+  Lim = lim;
+  Budget = budget;
+  lim->setColdStore(this);
+  ThreadNo = gContext.getThread(TCLASS_WORKER, 0);
+  // type 1: event is rescheduled while handler returns 0
+  TaskEventScheduler::AddEvent(ThreadNo, sweepHandler, (void*) this, 1,
+                               COLDTIER_SWEEP_MS);
+}
+
+int ColdStore::sweepHandler(void *parm){
+  ColdStore *cs = (ColdStore*) parm;
+  int nevicted;
+
+  nevicted = cs->Lim->sweepColdTier(cs->Budget);
+  if (nevicted)
+    dprintf(1, "ColdStore: evicted %d objects, %lld bytes in memory, "
+            "%lld bytes in file (%lld garbage)", nevicted,
+            (long long) cs->Lim->getResidentBytes(), (long long) cs->Next,
+            (long long) cs->Garbage);
+  return 0;
+}
@@ -59,6 +59,9 @@
 #include "pendingtx.h"
 #include "task.h"
 
+DiskLogRecord::DiskLogRecord(){}
+DiskLogRecord::~DiskLogRecord(){}
+
 void DiskLog::auxwrite(char *buf, int len){}
 void DiskLog::BufWrite(char *buf, int len){}
 void DiskLog::BufFlush(void){}
@@ -70,3 +73,4 @@ int DiskLog::logUpdatesAndYesVote(Tid tid, Timestamp ts,
                            Ptr<PendingTxInfo> pti, void *notify){ return 0; }
 void DiskLog::logCommitAsync(Tid tid, Timestamp ts){}
 void DiskLog::logAbortAsync(Tid tid, Timestamp ts){}
+void DiskLog::printStats(void){}
@@ -50,6 +50,8 @@
 #include <ctype.h>
 #include <stddef.h>
 #include <unistd.h>
+#include <dirent.h>
+#include <errno.h>
 
 #include <map>
 #include <list>
@@ -60,8 +62,172 @@
 #include "disklog.h"
 #include "diskstorage.h"
 
+DiskLogRecord::DiskLogRecord(){
+  MaxPieces = 64;
+  Pieces = new Piece[MaxPieces];
+  ScratchMax = 4096;
+  Scratch = new char[ScratchMax];
+  MaxIov = 0;
+  Iov = 0;
+  clear();
+}
+
+DiskLogRecord::~DiskLogRecord(){
+  delete [] Pieces;
+  delete [] Scratch;
+  if (Iov) delete [] Iov;
+}
+
+DiskLogRecord::Piece *DiskLogRecord::newPiece(void){
+  if (NPieces == MaxPieces){
+    Piece *newpieces = new Piece[MaxPieces*2];
+    memcpy(newpieces, Pieces, MaxPieces * sizeof(Piece));
+    delete [] Pieces;
+    Pieces = newpieces;
+    MaxPieces *= 2;
+  }
+  return Pieces + NPieces++;
+}
+
+void DiskLogRecord::add(const void *buf, int len){
+  Piece *last;
+  if (len <= 0) return;
+  Len += len;
+  if (ScratchLen + len > ScratchMax){
+    char *newscratch;
+    while (ScratchLen + len > ScratchMax) ScratchMax *= 2;
+    newscratch = new char[ScratchMax];
+    memcpy(newscratch, Scratch, ScratchLen);
+    delete [] Scratch;
+    Scratch = newscratch;
+  }
+  memcpy(Scratch + ScratchLen, buf, len);
+  // extend last piece if it ends where this one starts
+  last = NPieces ? Pieces + NPieces - 1 : 0;
+  if (!last || last->buf || last->off + last->len != ScratchLen){
+    last = newPiece();
+    last->buf = 0;
+    last->off = ScratchLen;
+    last->len = 0;
+  }
+  last->len += len;
+  ScratchLen += len;
+}
+
+void DiskLogRecord::addRef(const void *buf, int len){
+  Piece *piece;
+  if (len < DISKLOG_INPLACE_MIN){ add(buf, len); return; }
+  Len += len;
+  piece = newPiece();
+  piece->buf = (const char*) buf;
+  piece->off = 0;
+  piece->len = len;
+}
+
+iovec *DiskLogRecord::getIovecs(int &niov){
+  int i;
+  if (MaxIov < NPieces+1){
+    if (Iov) delete [] Iov;
+    MaxIov = MaxPieces+1;
+    Iov = new iovec[MaxIov];
+  }
+  for (i=0; i < NPieces; ++i){
+    Iov[i+1].iov_base = (void*) (Pieces[i].buf ? Pieces[i].buf :
+                                 Scratch + Pieces[i].off);
+    Iov[i+1].iov_len = Pieces[i].len;
+  }
+  niov = NPieces+1;
+  return Iov;
+}
+
+u64 DiskLog::lastSegment(const char *logname){
+  char *dirname, *basename, *ptr, *lastptr, *end;
+  DIR *dir;
+  struct dirent *de;
+  int baselen;
+  u64 segno, lastsegno = 0;
+
+  dirname = new char[strlen(logname)+2];
+  strcpy(dirname, logname);
+  ptr = dirname;
+  do { // find the last separator in logname
+    lastptr = ptr;
+    ptr = DiskStorage::searchseparator(ptr);
+  } while (*ptr);
+  basename = (char*) logname + (lastptr - dirname);
+  if (*basename == '/') ++basename; // lastptr is at separator, if any
+  baselen = (int) strlen(basename);
+  if (*lastptr != '/') strcpy(dirname, ".");        // no directory
+  else if (lastptr == dirname) strcpy(dirname, "/"); // root directory
+  else *lastptr = 0;
+
+  dir = opendir(dirname);
+  if (dir){
+    while ((de = readdir(dir)) != 0){
+      if (strncmp(de->d_name, basename, baselen) ||
+          de->d_name[baselen] != '.' ||
+          !isdigit(de->d_name[baselen+1])) continue;
+      segno = strtoull(de->d_name + baselen + 1, &end, 10);
+      if (*end == 0 && segno > lastsegno) lastsegno = segno;
+    }
+    closedir(dir);
+  }
+  delete [] dirname;
+  return lastsegno;
+}
+
+u64 DiskLog::checkSegment(const char *segname, u64 *nframes, bool *torn){
+  DiskLogSegmentHeader sh;
+  DiskLogFrameHeader fh;
+  char *buf = 0;
+  u32 buflen = 0;
+  u64 off;
+  int fd, res;
+  u32 crc;
+
+  *nframes = 0;
+  *torn = false;
+  fd = open(segname, O_RDONLY);
+  if (fd < 0) return 0;
+  res = (int) pread(fd, &sh, sizeof(sh), 0);
+  if (res != sizeof(sh) || sh.magic != DISKLOG_MAGIC ||
+      sh.version != DISKLOG_FORMAT_VERSION){
+    close(fd);
+    return 0;
+  }
+  off = sizeof(sh);
+  while (1){
+    res = (int) pread(fd, &fh, sizeof(fh), off);
+    if (res <= 0) break; // end of file
+    if (res != sizeof(fh)){ *torn = true; break; }
+    if (fh.len == 0){
+      // end of segment, which must be followed by zeroes only
+      *torn = fh.crc != 0;
+      break;
+    }
+    if (fh.len > buflen){
+      if (buf) delete [] buf;
+      buflen = fh.len;
+      buf = new char[buflen];
+    }
+    res = (int) pread(fd, buf, fh.len, off + sizeof(fh));
+    if (res != (int) fh.len){ *torn = true; break; }
+    crc = crc32c(0, &fh.len, sizeof(u32));
+    crc = crc32c(crc, buf, fh.len);
+    if (crc != fh.crc){ *torn = true; break; }
+    off += sizeof(fh) + fh.len;
+    ++*nframes;
+  }
+  if (buf) delete [] buf;
+  close(fd);
+  return off;
+}
+
 #ifdef SKIPLOG
 DiskLog::DiskLog(const char *logname){
+  f = -1;
+  LogName = 0;
+  SegNo = 0;
   RawWritebuf = Writebuf = 0;
   WritebufSize = WritebufLeft = 0;
   WritebufPtr = 0;
@@ -73,6 +239,8 @@ DiskLog::DiskLog(const char *logname){
 DiskLog::~DiskLog(){
 }
 void DiskLog::writeWqi(WriteQueueItem *wqi){}
+void DiskLog::writeFrame(DiskLogRecord &rec){}
+void DiskLog::openSegment(u64 segno){}
 void DiskLog::logCommitAsync(Tid tid, Timestamp ts){}
 void DiskLog::logAbortAsync(Tid tid, Timestamp ts){}
 int DiskLog::logUpdatesAndYesVote(Tid tid, Timestamp ts, Ptr<PendingTxInfo> pti,
@@ -80,6 +248,7 @@ int DiskLog::logUpdatesAndYesVote(Tid tid, Timestamp ts, Ptr<PendingTxInfo> pti,
   return 0; // indicates no notification will happen
 }
 void DiskLog::launch(void){}
+void DiskLog::printStats(void){ printf("Disk log disabled (SKIPLOG)\n"); }
 void DiskLog::test(int niter){}
 
 #else
@@ -96,6 +265,7 @@ static int PROGShipDiskReqs(TaskInfo *ti);
 
 DiskLog::DiskLog(const char *logname){
   char *str, *ptr, *lastptr;
+  u64 lastsegno;
 
   str = new char[strlen(logname)+1];
   strcpy(str, logname);
@@ -134,22 +304,70 @@ DiskLog::DiskLog(const char *logname){
   memset(WriteQueueHead, 0, sizeof(WriteQueueItem));
   WriteQueueHead->next = 0;
 
+  PendingHead = PendingTail = 0;
+  PendingBytes = 0;
+  PendingTxs = 0;
+  FirstPendingUs = LastArrivalUs = ArrivalGapUs = 0;
+
   // create path up to filename
   DiskStorage::Makepath(str);
 
+  LogName = new char[strlen(logname)+1];
+  strcpy(LogName, logname);
+
+  // keep existing segments, and report if the last one ends with a torn
+  // frame
+  lastsegno = lastSegment(logname);
+  if (lastsegno){
+    char *segname = new char[strlen(logname)+24];
+    u64 nframes, validlen;
+    bool torn;
+    sprintf(segname, "%s.%06llu", logname, (unsigned long long) lastsegno);
+    validlen = checkSegment(segname, &nframes, &torn);
+    printf("Disklog: last segment %s has %llu frames (%llu bytes)%s\n",
+           segname, (unsigned long long) nframes,
+           (unsigned long long) validlen,
+           torn ? ", followed by a torn frame" : "");
+    delete [] segname;
+  }
+  f = -1;
+  openSegment(lastsegno+1);
+  PendingBytes = 0;
+
+  diskLogThreadNo = -1;
+  
+  delete [] str;
+}
+
+// Closes the current segment, if any, and starts a new one. Must be called
+// when nothing is buffered other than the partial last block of the current
+// segment, which has already been written.
+void DiskLog::openSegment(u64 segno){
+  char *segname;
+  DiskLogSegmentHeader sh;
+
+  if (f >= 0) close(f);
+  segname = new char[strlen(LogName)+24];
+  sprintf(segname, "%s.%06llu", LogName, (unsigned long long) segno);
 #ifndef DISKLOG_SIMPLE
-  f = open(logname, O_CREAT | O_TRUNC | O_WRONLY | O_DIRECT, 0644);
+  f = open(segname, O_CREAT | O_EXCL | O_WRONLY | O_DIRECT, 0644);
 #else
-  f = open(logname, O_CREAT | O_TRUNC | O_WRONLY, 0644);
+  f = open(segname, O_CREAT | O_EXCL | O_WRONLY, 0644);
 #endif
   if (f<0){
-    printf("Disklog: cannot create %s (errno %d)\n", logname, errno);
+    printf("Disklog: cannot create %s (errno %d)\n", segname, errno);
     exit(1);
   }
+  delete [] segname;
+  SegNo = segno;
+  FileOffset = 0;
+  WritebufPtr = Writebuf;
+  WritebufLeft = WritebufSize;
 
-  diskLogThreadNo = -1;
-  
-  delete [] str;
+  sh.magic = DISKLOG_MAGIC;
+  sh.version = DISKLOG_FORMAT_VERSION;
+  sh.segno = segno;
+  BufWrite((char*) &sh, sizeof(DiskLogSegmentHeader));
 }
 
 DiskLog::~DiskLog(){
@@ -162,16 +380,34 @@ DiskLog::~DiskLog(){
   }
   if (f >= 0) close(f);
   if (RawWritebuf) delete [] RawWritebuf;
+  if (LogName) delete [] LogName;
+}
+
+// writes a frame with the payload gathered in rec
+void DiskLog::writeFrame(DiskLogRecord &rec){
+  DiskLogFrameHeader fh;
+  iovec *iov;
+  int i, niov;
+
+  iov = rec.getIovecs(niov);
+  fh.len = rec.getLen();
+  fh.crc = crc32c(0, &fh.len, sizeof(u32));
+  for (i=1; i < niov; ++i)
+    fh.crc = crc32c(fh.crc, iov[i].iov_base, iov[i].iov_len);
+  iov[0].iov_base = (void*) &fh;
+  iov[0].iov_len = sizeof(DiskLogFrameHeader);
+  BufWritev(iov, niov);
 }
 
 // auxilliary function for disklog write to log a WriteQueueItem
 
 void DiskLog::writeWqi(WriteQueueItem *wqi){
-  int type;
+  int type, litype;
   int celltype;
 
+  Rec.clear();
   if (wqi->utype == 0){
-    BufWrite(wqi->u.buf.buf, wqi->u.buf.len);
+    Rec.add(wqi->u.buf.buf, wqi->u.buf.len);
   } else { // wqi->utype == 1
 
     MultiWriteLogEntry mwle;
@@ -184,83 +420,84 @@ void DiskLog::writeWqi(WriteQueueItem *wqi){
     mwle.tid = wqi->u.updates.tid;
     mwle.ts = wqi->u.updates.ts;
     mwle.ncoids = pti->coidinfo.getNitems();
-    BufWrite((char*) &mwle, sizeof(MultiWriteLogEntry));
+    Rec.add((char*) &mwle, sizeof(MultiWriteLogEntry));
 
     // iterator over all objects
-    SkipListNode<COid, Ptr<TxUpdateCoid> > *it;
+    SkipListNode<COid, Ptr<TxRawCoid> > *it;
     for (it = pti->coidinfo.getFirst(); it != pti->coidinfo.getLast();
          it = pti->coidinfo.getNext(it)){
-      Ptr<TxUpdateCoid> tucoid = it->value;
+      Ptr<TxUpdateCoid> tucoid = it->value->getTucoid(it->key);
       if (tucoid->Writevalue) type = 1;
       else if (tucoid->WriteSV) type = 2;
       else type = 0;
-      BufWrite((char*) &type, sizeof(int));
+      Rec.add((char*) &type, sizeof(int));
 
       if (type == 0){ // write a delta record
         int len;
-        BufWrite((char*)tucoid->SetAttrs, GAIA_MAX_ATTRS);
-        BufWrite((char*)tucoid->Attrs, sizeof(u64)*GAIA_MAX_ATTRS);
+        Rec.add((char*)tucoid->SetAttrs, GAIA_MAX_ATTRS);
+        Rec.add((char*)tucoid->Attrs, sizeof(u64)*GAIA_MAX_ATTRS);
         len = (int) tucoid->Litems.getNitems(); // number of items
-        BufWrite((char*)&len, sizeof(int));
+        Rec.add((char*)&len, sizeof(int));
         // for each item
         for (TxListItem *tli = tucoid->Litems.getFirst();
              tli != tucoid->Litems.getLast();
              tli = tucoid->Litems.getNext(tli)){
-          BufWrite((char*)&tli->type, sizeof(int));
+          litype = tli->type; // i16 in TxListItem
+          Rec.add((char*)&litype, sizeof(int));
           if (tli->type == 0){
             TxListAddItem *tlai = dynamic_cast<TxListAddItem*>(tli);
             // item
-            BufWrite((char*)&tlai->item.nKey, sizeof(int));
+            Rec.add((char*)&tlai->item.nKey, sizeof(i64));
             if (!tlai->item.pKey) celltype=0; // int key
             else celltype=1;
-            BufWrite((char*)&celltype, sizeof(int));
-            if (celltype) BufWrite((char*)tlai->item.pKey,
-                                   (int) tlai->item.nKey);
-            BufWrite((char*) &tlai->item.value, sizeof(u64));
+            Rec.add((char*)&celltype, sizeof(int));
+            if (celltype) Rec.addRef((char*)tlai->item.pKey,
+                                     (int) tlai->item.nKey);
+            Rec.add((char*) &tlai->item.value, sizeof(u64));
           } else { // tli->type == 1
             TxListDelRangeItem *tldri = dynamic_cast<TxListDelRangeItem*>(tli);
-            BufWrite((char*) &tldri->intervalType, 1);
+            Rec.add((char*) &tldri->intervalType, 1);
             // itemstart
-            BufWrite((char*) &tldri->itemstart.nKey, sizeof(int));
+            Rec.add((char*) &tldri->itemstart.nKey, sizeof(i64));
             if (!tldri->itemstart.pKey) celltype=0; // int key
             else celltype = 1;
-            BufWrite((char*) &celltype, sizeof(int));
-            if (celltype) BufWrite((char*)tldri->itemstart.pKey,
-                                   (int)tldri->itemstart.nKey);
-            BufWrite((char*) &tldri->itemstart.value, sizeof(u64));
+            Rec.add((char*) &celltype, sizeof(int));
+            if (celltype) Rec.addRef((char*)tldri->itemstart.pKey,
+                                     (int)tldri->itemstart.nKey);
+            Rec.add((char*) &tldri->itemstart.value, sizeof(u64));
             // itemend
-            BufWrite((char*) &tldri->itemend.nKey, sizeof(int));
+            Rec.add((char*) &tldri->itemend.nKey, sizeof(i64));
             if (!tldri->itemend.pKey) celltype=0; // int key
             else celltype = 1;
-            BufWrite((char*) &celltype, sizeof(int));
-            if (celltype) BufWrite((char*)tldri->itemend.pKey,
-                                   (int)tldri->itemend.nKey);
-            BufWrite((char*) &tldri->itemend.value, sizeof(u64));
+            Rec.add((char*) &celltype, sizeof(int));
+            if (celltype) Rec.addRef((char*)tldri->itemend.pKey,
+                                     (int)tldri->itemend.nKey);
+            Rec.add((char*) &tldri->itemend.value, sizeof(u64));
           }
         }
       } else if (type == 1){ // write a value record
         TxWriteItem *twi = tucoid->Writevalue;
-        BufWrite((char*) &twi->len, sizeof(int));
-        BufWrite((char*)twi->buf, twi->len);
+        Rec.add((char*) &twi->len, sizeof(int));
+        Rec.addRef((char*)twi->buf, twi->len);
       } else { // type == 2
 	int nitems;
         // write a supervalue record
         TxWriteSVItem *twsvi = tucoid->WriteSV;
-        BufWrite((char*)twsvi, offsetof(TxWriteSVItem, attrs)); // header
-        BufWrite((char*)twsvi->attrs, sizeof(u64) * twsvi->nattrs);
+        Rec.addRef((char*)twsvi, offsetof(TxWriteSVItem, attrs)); // header
+        Rec.addRef((char*)twsvi->attrs, sizeof(u64) * twsvi->nattrs);
 	nitems = twsvi->cells.getNitems();
-        BufWrite((char*) &nitems, sizeof(int)); // number of cells
+        Rec.add((char*) &nitems, sizeof(int)); // number of cells
         // for each cell
         SkipListNodeBK<ListCellPlus,int> *ptr;
         for (ptr = twsvi->cells.getFirst(); ptr != twsvi->cells.getLast();
              ptr = twsvi->cells.getNext(ptr)){
           ListCellPlus *lc = ptr->key;
-          BufWrite((char*) &lc->nKey, sizeof(int));
+          Rec.add((char*) &lc->nKey, sizeof(i64));
           if (!lc->pKey) celltype=0; // int key
           else celltype = 1;
-          BufWrite((char*) &celltype, sizeof(int));
-          if (celltype) BufWrite((char*)lc->pKey, (int)lc->nKey);
-          BufWrite((char*) &lc->value, sizeof(u64));
+          Rec.add((char*) &celltype, sizeof(int));
+          if (celltype) Rec.addRef((char*)lc->pKey, (int)lc->nKey);
+          Rec.add((char*) &lc->value, sizeof(u64));
         }
       }
     }
@@ -269,8 +506,9 @@ void DiskLog::writeWqi(WriteQueueItem *wqi){
     le.let = LEVoteYes;
     le.tid = wqi->u.updates.tid;
     le.ts.setIllegal();
-    BufWrite((char*) &le, sizeof(LogEntry));
+    Rec.add((char*) &le, sizeof(LogEntry));
   }
+  writeFrame(Rec);
 }
 
 void logAsync(LogEntry *le){
@@ -333,42 +571,131 @@ void ImmediateFuncEnqueueDiskReq(TaskMsgData &msgdata, TaskScheduler *ts,
   ts->wakeUpTask(dltc->psdrtask); // wake up PROGShipDiskReqs task
 }
 
+// How long a batch may wait for more items before being flushed: a fraction
+// of the flush latency, so that the added latency is small relative to the
+// cost of the flush, up to a fixed maximum
+u64 DiskLog::waitBudgetUs(void){
+  u64 budget;
+  budget = Stats.flushUsAvg * DISKLOG_GROUP_WAIT_PERCENT / 100;
+  if (budget > DISKLOG_GROUP_MAX_WAIT_US) budget = DISKLOG_GROUP_MAX_WAIT_US;
+  return budget;
+}
+
+// Decides whether pending items should be flushed now. Returns the reason
+// for flushing, or -1 to keep waiting for more items
+int DiskLog::flushReason(u64 now){
+  u64 deadline;
+  if (PendingBytes >= DISKLOG_GROUP_BYTES) return DLFlushBytes;
+  if (PendingTxs >= DISKLOG_GROUP_TXS) return DLFlushTxs;
+  deadline = FirstPendingUs + waitBudgetUs();
+  if (now >= deadline) return DLFlushDeadline;
+  // if no other yes vote is expected before the deadline, waiting only adds
+  // latency
+  if (PendingTxs && LastArrivalUs + ArrivalGapUs >= deadline)
+    return DLFlushIdle;
+  return -1;
+}
+
+// flushes pending items, updates statistics, and sends notifications
+void DiskLog::groupFlush(int reason){
+  WriteQueueItem *wqi, *next;
+  u64 start, latency;
+
+  start = Time::nowus();
+  BufFlush();
+  latency = Time::nowus() - start;
+
+  if (Stats.flushUsAvg) Stats.flushUsAvg = (Stats.flushUsAvg*7 + latency)/8;
+  else Stats.flushUsAvg = latency;
+  Stats.waitBudgetUs = waitBudgetUs();
+  Stats.flushUs.put(latency);
+  Stats.batchTxs.put(PendingTxs);
+  Stats.batchBytes.put(PendingBytes);
+  Stats.waitUs.put(start - FirstPendingUs);
+  ++Stats.nflushes[reason];
+
+  // send notifications
+  for (wqi = PendingHead; wqi != 0; wqi = next){
+    if (wqi->notify){
+      // send a message to wqi->notify
+      TaskMsg msg;
+      msg.dest = (TaskInfo*) wqi->notify;
+      msg.flags = 0;
+      memset(&msg.data, 0, sizeof(TaskMsgData));
+      msg.data.data[0] = 0xb0; // check byte only (message carries no
+                               // relevant data; it is just a signal)
+      tsendMessage(msg);
+    }
+    next = wqi->next;
+    delete wqi;
+  }
+  PendingHead = PendingTail = 0;
+  if (FileOffset + (WritebufSize - WritebufLeft) >= DISKLOG_SEGMENT_BYTES)
+    openSegment(SegNo+1);
+  PendingBytes = 0;
+  PendingTxs = 0;
+}
+
+// Group commit: new items are written to Writebuf as they arrive, but
+// Writebuf is flushed (and yes votes acknowledged) only when flushReason()
+// says so. Otherwise, the task waits for more items or for the deadline.
 int DiskLog::PROGShipDiskReqs(TaskInfo *ti){
   DiskLogThreadContext *dltc = (DiskLogThreadContext*)
     tgetSharedSpace(THREADCONTEXT_SPACE_DISKLOG);
   DiskLog *dl = (DiskLog*) ti->getTaskData();
-  WriteQueueItem *wqi, *next;
+  WriteQueueItem *wqi;
+  u64 now, gap;
+  int reason;
 
+  now = Time::nowus();
   if (dltc->ToShipHead->next){ // if ToShip not empty
+    if (!dl->PendingHead) dl->FirstPendingUs = now;
     // write items
     for (wqi = dltc->ToShipHead->next; wqi != 0; wqi = wqi->next){
       dl->writeWqi(wqi);
-    }
-    dl->BufFlush();
-
-    // send notifications
-    for (wqi = dltc->ToShipHead->next; wqi != 0; wqi = next){
       if (wqi->notify){
-        // send a message to wqi->notify
-        TaskMsg msg;
-        msg.dest = (TaskInfo*) wqi->notify;
-        msg.flags = 0;
-        memset(&msg.data, 0, sizeof(TaskMsgData));
-        msg.data.data[0] = 0xb0; // check byte only (message carries no
-                                 // relevant data; it is just a signal)
-        tsendMessage(msg);
+        ++dl->PendingTxs;
+        gap = now - dl->LastArrivalUs;
+        if (gap > 1000000) gap = 1000000;
+        dl->ArrivalGapUs = (dl->ArrivalGapUs*7 + gap)/8;
+        dl->LastArrivalUs = now;
       }
-      next = wqi->next;
-      delete wqi;
     }
+    // move items to pending list
+    if (dl->PendingTail) dl->PendingTail->next = dltc->ToShipHead->next;
+    else dl->PendingHead = dltc->ToShipHead->next;
+    dl->PendingTail = dltc->ToShipTail;
     // clear list
     dltc->ToShipHead->next = 0;
     dltc->ToShipTail = dltc->ToShipHead;
   }
 
+  if (!dl->PendingHead) return SchedulerTaskStateWaiting;
+  reason = dl->flushReason(now);
+  if (reason < 0){
+    // wait for the deadline (in ms, rounded up) or for more items
+    ti->setWakeUpTime((dl->FirstPendingUs + dl->waitBudgetUs())/1000 + 1);
+    return SchedulerTaskStateTimedWaiting;
+  }
+  dl->groupFlush(reason);
   return SchedulerTaskStateWaiting;
 }
 
+void DiskLog::printStats(void){
+  printf("Group commit: flush latency avg %lluus, wait budget %lluus\n",
+         (unsigned long long)Stats.flushUsAvg,
+         (unsigned long long)Stats.waitBudgetUs);
+  printf("Flushes due to bytes %llu txs %llu deadline %llu idle %llu\n",
+         (unsigned long long)Stats.nflushes[DLFlushBytes],
+         (unsigned long long)Stats.nflushes[DLFlushTxs],
+         (unsigned long long)Stats.nflushes[DLFlushDeadline],
+         (unsigned long long)Stats.nflushes[DLFlushIdle]);
+  Stats.batchTxs.print("Batch txs", "");
+  Stats.batchBytes.print("Batch bytes", "");
+  Stats.flushUs.print("Flush latency", "us");
+  Stats.waitUs.print("Batch wait", "us");
+}
+
 void DiskLog::launch(void){
   if (diskLogThreadNo == -1){ // not launched yet
     diskLogThreadNo = SLauncher->createThread("DISKLOG", diskLogThread,
@@ -442,6 +769,8 @@ void DiskLog::BufFlush(){
 void DiskLog::BufWrite(char *buf, int len){
   unsigned long written;
 
+  PendingBytes += len;
+  FileOffset += len;
   while (len > 0){
     written = write(f, buf, len);
     if (written < 0){
@@ -453,6 +782,33 @@ void DiskLog::BufWrite(char *buf, int len){
   }
 }
 
+void DiskLog::BufWritev(iovec *iov, int niov){
+  long written;
+  int i;
+
+  for (i=0; i < niov; ++i){
+    PendingBytes += iov[i].iov_len;
+    FileOffset += iov[i].iov_len;
+  }
+  while (niov > 0){
+    written = writev(f, iov, niov);
+    if (written < 0){
+      printf("Disklog: writev() error %d\n", errno);
+      exit(1);
+    }
+    // skip what was written
+    while (niov > 0 && (size_t) written >= iov->iov_len){
+      written -= iov->iov_len;
+      ++iov;
+      --niov;
+    }
+    if (niov > 0){
+      iov->iov_base = (char*) iov->iov_base + written;
+      iov->iov_len -= written;
+    }
+  }
+}
+
 #else // ifdef DISKLOG_SIMPLE
 // version that uses queues to flush to disk synchronously
 
@@ -512,7 +868,13 @@ void DiskLog::BufFlush(void){
   assert(WritebufLeft == Writebuf + WritebufSize - WritebufPtr);
 }
 
+void DiskLog::BufWritev(iovec *iov, int niov){
+  for (int i=0; i < niov; ++i) BufWrite((char*) iov[i].iov_base,
+                                        (int) iov[i].iov_len);
+}
+
 void DiskLog::BufWrite(char *buf, int len){
+  PendingBytes += len;
   while (len >= WritebufLeft){
     memcpy((void*) WritebufPtr, buf, WritebufLeft);
     WritebufPtr += WritebufLeft;
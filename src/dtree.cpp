@@ -50,12 +50,7 @@
 #include "coid.h"
 #include "dtreesplit.cpp"
 #include "splitter-client.h"
-
-// Header stored before the data in a data KV pair.
-// This header is not used for Dtree nodes.
-struct DataHeader {
-  int dummy;
-};
+#include "dtreescan.h"
 
 /* forward definitions */
 
@@ -458,6 +453,81 @@ int sqlite3BtreeCreateTable(Btree *p, Pgno *piTable, int flags){
   return sqlite3BtreeCreateTableChooseTable(p, piTable, flags);
 }
 
+// Sets the placement policy of a table, which determines the servers where
+// splits place new nodes (see DTREE_PLACEMENT_* in coid.h). The policy is
+// stored in the flags of the table's root node, so it takes effect at all
+// splitters once the transaction commits.
+int sqlite3BtreeSetPlacementPolicy(Btree *p, int iTable, int policy){
+  BtShared *pBt = p->pBt;
+  DTreeNode root;
+  COid coid;
+  u64 flags;
+  int res, rc;
+
+  DTREELOG("btree %p iTable %d policy %d", p, iTable, policy);
+  if (policy < 0 || policy > DTREE_PLACEMENT_MAX) return SQLITE_MISUSE;
+  assert(p->inTrans==TRANS_WRITE);
+
+  rc = SQLITE_OK;
+  sqlite3BtreeEnter(p);
+  coid.cid = getCidTable(pBt->KVdbid, iTable);
+  coid.oid = 0;
+  res = auxReadReal(p->tx, coid, root, 0, 0);
+  if (res){ rc = SQLITE_IOERR; goto end; }
+  flags = (root.Flags() & ~(u64)DTREENODE_FLAG_PLACEMENT_MASK) |
+    ((u64)policy << DTREENODE_FLAG_PLACEMENT_SHIFT);
+  res = KVattrset(p->tx, coid, DTREENODE_ATTRIB_FLAGS, flags);
+  if (res){ rc = SQLITE_IOERR; goto end; }
+ end:
+  sqlite3BtreeLeave(p);
+  DTREELOG("  return %d", rc);
+  return rc;
+}
+
+// Sets the split and merge thresholds of a table (see DTreeThresholds in
+// dtreeaux.h). splitCells and splitBytes of 0 mean use DTREE_SPLIT_SIZE and
+// DTREE_SPLIT_SIZE_BYTES; mergePercent of 0 means use DTREE_MERGE_PERCENT,
+// and -1 means never merge. splitBytes is rounded up to a multiple of
+// DTREENODE_SPLITBYTES_UNIT. The thresholds are stored in the flags of the
+// table's root node. Other nodes pick them up when they are next split or
+// merged.
+int sqlite3BtreeSetSplitThresholds(Btree *p, int iTable, int splitCells,
+                                   int splitBytes, int mergePercent){
+  BtShared *pBt = p->pBt;
+  DTreeNode root;
+  COid coid;
+  u64 flags, units, merge;
+  int res, rc;
+
+  DTREELOG("btree %p iTable %d splitCells %d splitBytes %d mergePercent %d",
+           p, iTable, splitCells, splitBytes, mergePercent);
+  units = ((u64)splitBytes + DTREENODE_SPLITBYTES_UNIT - 1) /
+    DTREENODE_SPLITBYTES_UNIT;
+  if (splitCells < 0 || splitCells == 1 || splitCells > 0xffff ||
+      splitBytes < 0 || units > 0xffff ||
+      mergePercent < -1 || mergePercent > 100)
+    return SQLITE_MISUSE;
+  merge = mergePercent == -1 ? DTREENODE_MERGE_NEVER : (u64) mergePercent;
+  assert(p->inTrans==TRANS_WRITE);
+
+  rc = SQLITE_OK;
+  sqlite3BtreeEnter(p);
+  coid.cid = getCidTable(pBt->KVdbid, iTable);
+  coid.oid = 0;
+  res = auxReadReal(p->tx, coid, root, 0, 0);
+  if (res){ rc = SQLITE_IOERR; goto end; }
+  flags = (root.Flags() & ~(u64)DTREENODE_FLAG_THRESHOLD_MASK) |
+    (merge << DTREENODE_FLAG_MERGE_SHIFT) |
+    ((u64)splitCells << DTREENODE_FLAG_SPLITCELLS_SHIFT) |
+    (units << DTREENODE_FLAG_SPLITBYTES_SHIFT);
+  res = KVattrset(p->tx, coid, DTREENODE_ATTRIB_FLAGS, flags);
+  if (res){ rc = SQLITE_IOERR; goto end; }
+ end:
+  sqlite3BtreeLeave(p);
+  DTREELOG("  return %d", rc);
+  return rc;
+}
+
 static int dtreeRestoreCursorPosition(BtCursor *pCur);
 // Restore cursor position. If cursor's eState is CURSOR_VALID or
 // CURSOR_INVALID, then do nothing and return SQLITE_OK.
@@ -547,6 +617,11 @@ static int btreeCursor(
   memset(pCur->nodetype, 0xff, DTREE_MAX_LEVELS);
   memset(pCur->nodeIndex, 0xff, sizeof(u32) * DTREE_MAX_LEVELS);
 //#endif
+  pCur->pscan = 0;
+  pCur->scanLeaf = 0;
+  pCur->scanFilter = 0;
+  pCur->scanFilterLen = 0;
+  pCur->joinBatch = 0;
 
   /* TO FILL: anything extra to initialize? */
   if (pCur->pNext){
@@ -766,6 +841,257 @@ int DtRefreshCursor(BtCursor *pCur, ListCell *cellguide, Oid targetoid){
   return levelsought;
 }
 
+// Whether a scan of the tree of pCur should be a parallel scan. Requires
+// the cursor to have gone through the root.
+static bool DtUseParallelScan(BtCursor *pCur){
+#ifdef GAIA_OCC
+  return false;
+#else
+  KVTransaction *tx = pCur->pBtree->tx;
+  return DTREE_PSCAN_THREADS > 0 && tx->type == 1 && KVtxreadonly(tx) &&
+         (int) pCur->node[0].Height() >= DTREE_PSCAN_MIN_HEIGHT;
+#endif
+}
+
+// Whether the cursor is still at the leaf last returned by its parallel scan
+static bool DtScanInSync(BtCursor *pCur){
+  return pCur->scanLeaf && pCur->eState == CURSOR_VALID &&
+    &*pCur->scanLeaf->node.raw == &*pCur->node[pCur->levelLeaf].raw;
+}
+
+// Starts a parallel scan that feeds sqlite3BtreeNext, if worthwhile.
+// Requires the cursor to be at the first leaf.
+static void DtStartScan(BtCursor *pCur){
+  DtParallelScan *pscan;
+  DtScanLeaf *leaf;
+  int res;
+
+  if (pCur->wrFlag || !DtUseParallelScan(pCur)) return;
+  res = DtParallelScan::start(pCur->pBtree->tx, pCur->rootCid,
+              DTSCAN_ORDERED | (pCur->intKey ? DTSCAN_FETCHDATA : 0), &pscan,
+              pCur->scanFilter, pCur->scanFilterLen);
+  if (res) return; // keep going sequentially
+  // the scan starts at the leaf of the cursor
+  res = pscan->next(&leaf);
+  if (res || !leaf ||
+      leaf->node.NodeOid() != pCur->node[pCur->levelLeaf].NodeOid()){
+    if (leaf) delete leaf;
+    pscan->close();
+    return;
+  }
+  pCur->node[pCur->levelLeaf] = leaf->node;
+  pCur->pscan = pscan;
+  pCur->scanLeaf = leaf;
+}
+
+// Stops the parallel scan of the cursor, if any
+static void DtStopScan(BtCursor *pCur){
+  if (pCur->scanLeaf){ delete pCur->scanLeaf; pCur->scanLeaf = 0; }
+  if (pCur->pscan){ pCur->pscan->close(); pCur->pscan = 0; }
+}
+
+// Whether the cell of the cursor is known from its parallel scan to fail the
+// scan filter, so that the cursor may skip it
+static bool DtScanFiltered(BtCursor *pCur){
+  return DtScanInSync(pCur) && pCur->scanLeaf->filtered &&
+    pCur->scanLeaf->filtered[pCur->nodeIndex[pCur->levelLeaf]];
+}
+
+/*
+** Sets a filter that a later full scan of the cursor may push down to
+** the storage servers (see scanfilter.h). Rows that fail the filter may then
+** be skipped by sqlite3BtreeFirst and sqlite3BtreeNext, so the filter must
+** be implied by the WHERE clause of the statement. The filter is not copied
+** and must outlive the cursor.
+*/
+int sqlite3BtreeScanFilter(BtCursor *pCur, const char *filter, int len){
+  DTREELOG("BtCursor %p len %d", pCur, len);
+  pCur->scanFilter = len > 0 ? filter : 0;
+  pCur->scanFilterLen = len;
+  return SQLITE_OK;
+}
+
+#if DTREE_JOIN_BATCH > 0
+// Data of rows of an intkey tree, read in one batch ahead of lookups of the
+// rows by a cursor (see sqlite3BtreeJoinBatch)
+struct DtJoinBatch {
+  u64 id;          // unique among batches
+  u64 srcCid;      // the keys come from the cells [srcStart,srcEnd) of leaf
+  Oid srcOid;      //   srcOid of tree srcCid, or from the rows of batch
+  int srcStart;    //   srcOid of a cursor on tree srcCid if srcStart < 0
+  int srcEnd;
+  int n;
+  i64 keys[DTREE_JOIN_BATCH];         // in increasing order
+  Ptr<Valbuf> data[DTREE_JOIN_BATCH]; // unset if the row could not be read
+
+  // Returns the index of key, or -1 if not in batch
+  int find(i64 key){
+    int lo = 0, hi = n-1, mid;
+    while (lo <= hi){
+      mid = (lo + hi) / 2;
+      if (keys[mid] == key) return mid;
+      if (keys[mid] < key) lo = mid + 1;
+      else hi = mid - 1;
+    }
+    return -1;
+  }
+};
+
+static u64 DtJoinBatchLastId = 0;
+
+// Whether lookups of pCur may use rows read ahead. The rows are read at the
+// snapshot of the transaction, so this holds only while it has not written.
+static bool DtUseJoinBatch(BtCursor *pCur){
+#ifdef GAIA_OCC
+  return false; // reads by other servers would not enter the read set
+#else
+  KVTransaction *tx = pCur->pBtree->tx;
+  return pCur->intKey && !pCur->wrFlag && tx->type == 1 && KVtxreadonly(tx);
+#endif
+}
+
+// If the row with key of pCur was read ahead, sets data to it and returns
+// true. Otherwise returns false.
+static bool DtJoinBatchData(BtCursor *pCur, i64 key, Ptr<Valbuf> &data){
+  int i;
+  if (!pCur->joinBatch || !DtUseJoinBatch(pCur)) return false;
+  i = pCur->joinBatch->find(key);
+  if (i < 0 || !pCur->joinBatch->data[i].isset()) return false;
+  data = pCur->joinBatch->data[i];
+  return true;
+}
+
+// Reads the rows with the n keys (n <= DTREE_JOIN_BATCH) of the tree of
+// pCur into a new batch, with one request per storage server. Returns the
+// batch, or 0 if error.
+static DtJoinBatch *DtJoinBatchRead(BtCursor *pCur, i64 *keys, int n){
+  DtJoinBatch *batch;
+  Oid oids[DTREE_JOIN_BATCH];
+  u8 filtered[DTREE_JOIN_BATCH];
+  i64 key;
+  int i, j, res;
+
+  assert(n <= DTREE_JOIN_BATCH);
+  batch = new DtJoinBatch;
+  batch->id = AtomicInc64(&DtJoinBatchLastId);
+  batch->n = 0;
+  for (i=0; i < n; ++i){ // insertion sort, without duplicates
+    key = keys[i];
+    for (j = batch->n; j > 0 && batch->keys[j-1] > key; --j)
+      batch->keys[j] = batch->keys[j-1];
+    if (j > 0 && batch->keys[j-1] == key){ // duplicate, undo shift
+      for (; j < batch->n; ++j) batch->keys[j] = batch->keys[j+1];
+      continue;
+    }
+    batch->keys[j] = key;
+    ++batch->n;
+  }
+  for (i=0; i < batch->n; ++i) oids[i] = (Oid) batch->keys[i];
+  // no filter: just read the rows
+  res = KVgetFilter(pCur->pBtree->tx, DATA_CID(pCur->rootCid), batch->n,
+                    oids, 0, 0, 0, batch->data, filtered);
+  if (res){ delete batch; return 0; }
+  return batch;
+}
+
+// Extracts into *key the key that a lookup would take from column col of a
+// row with data buf, or from its rowid if col < 0. Returns 0 if ok,
+// non-zero if the column is not an integer.
+static int DtJoinBatchKey(i64 rowid, Ptr<Valbuf> &buf, int col, i64 *key){
+  if (col < 0){ *key = rowid; return 0; }
+  if (!buf.isset() || buf->len < (int) sizeof(DataHeader)) return -1;
+  return myRecordIntField(buf->u.buf + sizeof(DataHeader),
+                          buf->len - sizeof(DataHeader), col, key);
+}
+
+/*
+** Prepares for lookups by rowid on cursor pCur whose rowids come from column
+** iCol of the rows of cursor pSrc, or from the rowids of pSrc if iCol < 0.
+** This is the inner loop of a join by rowid. If pSrc is at a leaf, takes the
+** keys of the next rows of pSrc in the leaf; if pSrc was itself positioned
+** from a batch, takes the keys of the rows of that batch. Then reads the
+** rows of pCur with those keys in one batch, so that the lookups do not
+** each wait for a round trip to the storage servers. Keys already batched
+** are not read again. Lookups of keys not in the batch read the row as usual.
+*/
+int sqlite3BtreeJoinBatch(BtCursor *pCur, BtCursor *pSrc, int iCol){
+  DtJoinBatch *batch = pCur->joinBatch, *srcbatch = pSrc->joinBatch;
+  i64 keys[DTREE_JOIN_BATCH], key, srckeys[DTREE_JOIN_BATCH];
+  Ptr<Valbuf> buf;
+  DTreeNode *leaf;
+  Oid srcoid;
+  int i, n, start, end;
+
+  DTREELOG("BtCursor %p src %p col %d", pCur, pSrc, iCol);
+  if (!DtUseJoinBatch(pCur) || !pSrc->intKey) return SQLITE_OK;
+  n = 0;
+  if (pSrc->eState == CURSOR_VALID){ // next rows in leaf of pSrc
+    leaf = &pSrc->node[pSrc->levelLeaf];
+    srcoid = leaf->NodeOid();
+    start = pSrc->nodeIndex[pSrc->levelLeaf];
+    if (batch && batch->srcCid == pSrc->rootCid && batch->srcOid == srcoid &&
+        batch->srcStart <= start && start < batch->srcEnd)
+      return SQLITE_OK; // already batched
+    end = leaf->Ncells();
+    if (end > start + DTREE_JOIN_BATCH) end = start + DTREE_JOIN_BATCH;
+    if (iCol >= 0 && !(DtScanInSync(pSrc) && pSrc->scanLeaf->data) &&
+        DtUseJoinBatch(pSrc) &&
+        !(srcbatch && srcbatch->srcCid == pSrc->rootCid &&
+          srcbatch->srcOid == srcoid && srcbatch->srcStart <= start &&
+          end <= srcbatch->srcEnd)){
+      // the columns are in the data of the rows of pSrc, which have not been
+      // read yet: read them in a batch too
+      for (i=start; i < end; ++i) srckeys[i-start] = leaf->Cells()[i].nKey;
+      srcbatch = DtJoinBatchRead(pSrc, srckeys, end-start);
+      if (!srcbatch) return SQLITE_OK;
+      srcbatch->srcCid = pSrc->rootCid;
+      srcbatch->srcOid = srcoid;
+      srcbatch->srcStart = start;
+      srcbatch->srcEnd = end;
+      if (pSrc->joinBatch) delete pSrc->joinBatch;
+      pSrc->joinBatch = srcbatch;
+    }
+    for (i=start; i < end; ++i){
+      key = leaf->Cells()[i].nKey;
+      if (iCol >= 0){
+        if (DtScanInSync(pSrc) && pSrc->scanLeaf->data){
+          if (pSrc->scanLeaf->filtered && pSrc->scanLeaf->filtered[i])
+            continue; // row will be skipped
+          buf = pSrc->scanLeaf->data[i];
+        }
+        else if (!DtJoinBatchData(pSrc, key, buf)) continue;
+      }
+      if (!DtJoinBatchKey(key, buf, iCol, &keys[n])) ++n;
+    }
+  } else if (pSrc->eState == CURSOR_DIRECT && srcbatch){ // rows of batch
+    start = end = -1;
+    srcoid = srcbatch->id;
+    if (batch && batch->srcCid == pSrc->rootCid && batch->srcStart < 0 &&
+        batch->srcOid == srcoid)
+      return SQLITE_OK; // already batched
+    for (i=0; i < srcbatch->n; ++i)
+      if (!DtJoinBatchKey(srcbatch->keys[i], srcbatch->data[i], iCol,
+                          &keys[n]))
+        ++n;
+  } else return SQLITE_OK;
+
+  if (n == 0) return SQLITE_OK;
+  batch = DtJoinBatchRead(pCur, keys, n);
+  if (!batch) return SQLITE_OK; // lookups will read rows one by one
+  batch->srcCid = pSrc->rootCid;
+  batch->srcOid = srcoid;
+  batch->srcStart = start;
+  batch->srcEnd = end;
+  if (pCur->joinBatch) delete pCur->joinBatch;
+  pCur->joinBatch = batch;
+  return SQLITE_OK;
+}
+#else
+int sqlite3BtreeJoinBatch(BtCursor *pCur, BtCursor *pSrc, int iCol){
+  return SQLITE_OK;
+}
+#endif
+
 /*
 ** Reads the data of a tree node at the cursor.
 ** Requires the cursor to be valid and of type intKey
@@ -781,9 +1107,17 @@ int DtReadData(BtCursor *pCur){
   else { // pCur->eState == CURSOR_VALID
     int levelleaf = pCur->levelLeaf;
     int index = pCur->nodeIndex[levelleaf];
+    if (DtScanInSync(pCur) && pCur->scanLeaf->data &&
+        pCur->scanLeaf->data[index].isset()){
+      pCur->data = pCur->scanLeaf->data[index]; // prefetched by the scan
+      return 0;
+    }
     coid.oid = pCur->node[levelleaf].Cells()[index].nKey;
   }
 
+#if DTREE_JOIN_BATCH > 0
+  if (DtJoinBatchData(pCur, coid.oid, pCur->data)) return 0; // read ahead
+#endif
   pCur->data=0;
   res = KVget(pCur->pBtree->tx, coid, pCur->data);
   return res;
@@ -1741,7 +2075,15 @@ int DtFirst(BtCursor *pCur, int *pRes){
 int sqlite3BtreeFirst(BtCursor *pCur, int *pRes){
   int res;
   DTREELOG("BtCursor %p", pCur);
+  DtStopScan(pCur);
   res = DtFirst(pCur, pRes);
+  if (res == 0 && *pRes == 0){
+    DtStartScan(pCur);
+    if (DtScanFiltered(pCur)){ // skip to first cell that may pass the filter
+      res = sqlite3BtreeNext(pCur, pRes);
+      if (res == 0 && *pRes) pCur->eState = CURSOR_INVALID;
+    }
+  }
   DTREELOG("  return %d", res);
   return res;
 }
@@ -1875,14 +2217,44 @@ int sqlite3BtreeNext(BtCursor *pCur, int *pRes){
 
   assert(pCur->eState == CURSOR_VALID);
   int levelleaf = pCur->levelLeaf;
+ nextcell:
   ++pCur->nodeIndex[levelleaf];
   if (pCur->nodeIndex[levelleaf] < pCur->node[levelleaf].Ncells()){
     // still cells in this node
+    if (DtScanFiltered(pCur)) goto nextcell; // fails the scan filter
     *pRes=0;
     DTREELOG("  return %d", 0);
     return 0;
   }
 
+  if (pCur->pscan && DtScanInSync(pCur)){ // next leaf comes from the scan
+    DtScanLeaf *leaf;
+    res = pCur->pscan->next(&leaf);
+    if (res){
+      DtStopScan(pCur);
+      DTREELOG("  return %d", SQLITE_IOERR);
+      return SQLITE_IOERR;
+    }
+    delete pCur->scanLeaf;
+    pCur->scanLeaf = leaf;
+    if (leaf){
+      pCur->node[levelleaf] = leaf->node;
+      pCur->nodetype[levelleaf] = 1; // mark as real node
+      pCur->nodeIndex[levelleaf] = 0; // start at first cell
+      if (DtScanFiltered(pCur)){ // fails the scan filter
+        pCur->nodeIndex[levelleaf] = -1;
+        goto nextcell;
+      }
+      *pRes=0;
+    } else {
+      DtStopScan(pCur);
+      *pRes=1; /* this is the last cell in last node  */
+    }
+    DTREELOG("  return %d", 0);
+    return 0;
+  }
+  DtStopScan(pCur); // cursor moved elsewhere since the scan started
+
   if (pCur->node[levelleaf].RightPtr()){ // there is a next node
     /* move to next node */
     coid.cid = pCur->rootCid;
@@ -1963,6 +2335,48 @@ int sqlite3BtreePrevious(BtCursor *pCur, int *pRes){
   return 0;
 }
 
+/*
+** Reads all cells of the tree of pCur with a parallel scan, invoking
+** callback in the calling thread with the key and data of each cell. For
+** index trees, data is 0. If ordered, cells come in key order.
+** Used by treedirect.
+*/
+int DtParallelScanCells(BtCursor *pCur, bool ordered, bool fetchdata,
+     void (*callback)(i64 key, const char *data, int len, void *parm),
+     void *parm){
+  DtParallelScan *pscan;
+  DtScanLeaf *leaf;
+  ListCell *cell;
+  Ptr<Valbuf> vbuf;
+  COid coid;
+  int res, i, flags;
+
+  flags = (ordered ? DTSCAN_ORDERED : 0);
+  if (fetchdata && pCur->intKey) flags |= DTSCAN_FETCHDATA;
+  res = DtParallelScan::start(pCur->pBtree->tx, pCur->rootCid, flags, &pscan);
+  if (res) return SQLITE_IOERR;
+  coid.cid = DATA_CID(pCur->rootCid);
+  while ((res = pscan->next(&leaf)) == 0 && leaf){
+    for (i=0; i < leaf->node.Ncells(); ++i){
+      cell = &leaf->node.Cells()[i];
+      if (!(flags & DTSCAN_FETCHDATA)){ callback(cell->nKey, 0, 0, parm); continue; }
+      if (leaf->data) vbuf = leaf->data[i];
+      else vbuf = 0;
+      if (!vbuf.isset()){ // not prefetched
+        coid.oid = cell->nKey;
+        KVget(pCur->pBtree->tx, coid, vbuf);
+      }
+      if (vbuf.isset() && vbuf->len >= (int) sizeof(DataHeader))
+        callback(cell->nKey, vbuf->u.buf + sizeof(DataHeader),
+                 vbuf->len - sizeof(DataHeader), parm);
+      else callback(cell->nKey, 0, 0, parm);
+    }
+    delete leaf;
+  }
+  pscan->close();
+  return res ? SQLITE_IOERR : 0;
+}
+
 /*
 ** The first argument, pCur, is a cursor opened on some b-tree. Count the
 ** number of entries in the b-tree and write the result to *pnEntry.
@@ -1992,6 +2406,22 @@ int sqlite3BtreeCount(BtCursor *pCur, i64 *pnEntry){
     return 0;
   }
 
+  if (DtUseParallelScan(pCur)){ // count leaves in parallel, in any order
+    DtParallelScan *pscan;
+    DtScanLeaf *leaf;
+    res = DtParallelScan::start(pCur->pBtree->tx, pCur->rootCid, 0, &pscan);
+    if (res){ DTREELOG("  return %d", SQLITE_IOERR); return SQLITE_IOERR; }
+    while ((res = pscan->next(&leaf)) == 0 && leaf){
+      nentries += leaf->node.Ncells();
+      delete leaf;
+    }
+    pscan->close();
+    if (res){ DTREELOG("  return %d", SQLITE_IOERR); return SQLITE_IOERR; }
+    *pnEntry = nentries;
+    DTREELOG("  return %d", 0);
+    return 0;
+  }
+
   coid.cid = pCur->rootCid;
   levelleaf = pCur->levelLeaf;
 
@@ -2008,6 +2438,95 @@ int sqlite3BtreeCount(BtCursor *pCur, i64 *pnEntry){
   return 0;
 }
 
+// Adds server s to the n distinct servers in array servers, if not there
+// and if there is room
+static void DtStatsAddServer(int *servers, int *n, int s){
+  int i;
+  for (i=0; i < *n; ++i) if (servers[i] == s) return;
+  if (*n < DTREE_STATS_MAX_SERVERS) servers[(*n)++] = s;
+}
+
+/*
+** YESQUEL CH: added. Estimates the shape of tree iTable for the query
+** planner, by reading DTREE_STATS_PATHS paths from the root to a leaf,
+** spread evenly across the tree. Inner nodes come from the node cache when
+** there, so this typically reads one leaf per path. The number of leaves is
+** the product of the average fanouts seen at each level, and the number of
+** rows is that times the average cells per leaf. The servers are those
+** holding the leaves read, or the data of their cells for intkey trees.
+** Does nothing if pStats was filled less than DTREE_STATS_REFRESH_MS ago.
+** Reads in the transaction of p if there is one, otherwise in a
+** transaction of its own, since the planner may run outside a transaction. Returns SQLITE_OK, or an error if the root cannot be read
+** (in which case pStats is left unchanged).
+*/
+int sqlite3BtreeTreeStats(Btree *p, u64 iTable, BtTreeStats *pStats){
+  KVTransaction *tx;
+  DTreeNode node;
+  COid coid, datacoid;
+  double fanout[DTREE_MAX_LEVELS];
+  int nfanout[DTREE_MAX_LEVELS];
+  double leafcells = 0, nleaf;
+  int nleaves = 0, height = 0;
+  int servers[DTREE_STATS_MAX_SERVERS], nservers = 0;
+  int path, level, i, n, real, res;
+  u64 now = Time::now();
+
+  if (pStats->tSample && now - pStats->tSample < DTREE_STATS_REFRESH_MS)
+    return SQLITE_OK;
+  DTREELOG("btree %p iTable %llx", p, (long long)iTable);
+  memset(fanout, 0, sizeof(fanout));
+  memset(nfanout, 0, sizeof(nfanout));
+  if (p->inTrans != TRANS_NONE && p->tx) tx = p->tx;
+  else beginTx(&tx, !isDBIdEphemeral(p->pBt->KVdbid));
+  coid.cid = getCidTable(p->pBt->KVdbid, iTable);
+  datacoid.cid = DATA_CID(coid.cid);
+  for (path=0; path < DTREE_STATS_PATHS; ++path){
+    coid.oid = DTREE_ROOT_OID;
+    for (level=0; level < DTREE_MAX_LEVELS; ++level){
+      res = auxReadCacheOrReal(tx, coid, node, real, 0, 0);
+      if (res) break; // e.g., stale cached pointer; give up this path
+      if (node.isLeaf()){
+        leafcells += node.Ncells();
+        ++nleaves;
+        if (level > height) height = level;
+        if (node.isIntKey()){
+          for (i=0; i < node.Ncells(); ++i){
+            datacoid.oid = node.Cells()[i].nKey;
+            DtStatsAddServer(servers, &nservers, KVserverOf(datacoid));
+          }
+        } else DtStatsAddServer(servers, &nservers, KVserverOf(coid));
+        break;
+      }
+      n = node.Ncells() + 1; // pointers in inner node
+      if (level >= DTREE_MAX_LEVELS - 1) break;
+      fanout[level] += n;
+      ++nfanout[level];
+      // follow the pointer at the middle of this path's share of the node
+      coid.oid = node.GetPtr((int)((2 * path + 1) * (double) n /
+                                   (2 * DTREE_STATS_PATHS)));
+    }
+    if (path == 0 && res && level == 0){ // cannot read root
+      if (tx != p->tx) freeTx(tx);
+      DTREELOG("  return %d", SQLITE_IOERR);
+      return SQLITE_IOERR;
+    }
+  }
+  if (tx != p->tx) freeTx(tx);
+  if (nleaves == 0){ DTREELOG("  return %d", SQLITE_IOERR); return SQLITE_IOERR; }
+
+  nleaf = 1;
+  for (level=0; level < height; ++level)
+    if (nfanout[level]) nleaf *= fanout[level] / nfanout[level];
+  pStats->nLeaf = nleaf;
+  pStats->nRow = nleaf * leafcells / nleaves;
+  pStats->nHeight = height;
+  pStats->nServer = nservers ? nservers : 1;
+  pStats->tSample = now;
+  DTREELOG("  rows %.0f leaves %.0f height %d servers %d", pStats->nRow,
+           pStats->nLeaf, pStats->nHeight, pStats->nServer);
+  return SQLITE_OK;
+}
+
 // Delete all child nodes of given oid and below, recursively, including any
 // data nodes of leaf nodes.
 // Also current oid if it is not the root, or it eraseRoot=true.
@@ -2060,7 +2579,10 @@ static int auxClearTable(Btree *pBtree, int level, COid coid, int *pnChange,
     SuperValue sv;
     DTreeNode::InitSuperValue(&sv, ptrNode.isIntKey() ? 0 : 1);
     sv.Attrs[DTREENODE_ATTRIB_FLAGS] = DTREENODE_FLAG_LEAF |
-      (ptrNode.isIntKey() ? DTREENODE_FLAG_INTKEY : 0);
+      (ptrNode.isIntKey() ? DTREENODE_FLAG_INTKEY : 0) |
+      (ptrNode.Flags() & (DTREENODE_FLAG_PLACEMENT_MASK |
+                          DTREENODE_FLAG_THRESHOLD_MASK)); // keep policy and
+                                                           // thresholds
     sv.Attrs[DTREENODE_ATTRIB_HEIGHT] = 0;
     sv.Attrs[DTREENODE_ATTRIB_LASTPTR] = 0;
     sv.Attrs[DTREENODE_ATTRIB_LEFTPTR] = 0;
@@ -2619,6 +3141,12 @@ int sqlite3BtreeBeginTrans(Btree *p, int wrflag){
     freeTx(p->tx);
     p->tx = 0;
   }
+#ifdef DTREE_READONLY_SAFE_TS
+  // read transactions become write transactions by starting a new
+  // transaction (see above), so a read-only transaction suffices
+  if (!wrflag) rc = beginReadOnlyTx(&p->tx, remote);
+  else
+#endif
   rc = beginTx(&p->tx, remote);
 
   if (rc==SQLITE_OK){
@@ -3361,6 +3889,10 @@ void sqlite3BtreeCacheOverflow(BtCursor *pCur){
 /* inline */
 void DtFreeCursorFields(BtCursor *pCur){
   int i;
+  DtStopScan(pCur);
+#if DTREE_JOIN_BATCH > 0
+  if (pCur->joinBatch){ delete pCur->joinBatch; pCur->joinBatch = 0; }
+#endif
   if (pCur->savepKey){ sqlite3_free(pCur->savepKey); pCur->savepKey=0; }
   pCur->data = 0;
   for (i=0; i < DTREE_MAX_LEVELS; ++i)
@@ -0,0 +1,365 @@
+//
+// dtreeload.cpp
+//
+// Bulk loading of a distributed B-tree (see dtreeload.h)
+//
+
+/*
+  Original code: Copyright (c) 2014 Microsoft Corporation
+  Modified code: Copyright (c) 2015-2016 VMware, Inc
+  All rights reserved.
+
+  Written by Marcos K. Aguilera
+
+  MIT License
+
+  Permission is hereby granted, free of charge, to any person
+  obtaining a copy of this software and associated documentation files
+  (the "Software"), to deal in the Software without restriction,
+  including without limitation the rights to use, copy, modify, merge,
+  publish, distribute, sublicense, and/or sell copies of the Software,
+  and to permit persons to whom the Software is furnished to do so,
+  subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED *AS IS*, WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+  BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+  ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#include <stdio.h>
+#include <assert.h>
+#include <string.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <stdlib.h>
+
+#include "tmalloc.h"
+#include "options.h"
+#include "os.h"
+#include "gaiatypes.h"
+#include "coid.h"
+#include "sqlite3.h"
+#include "dtreeload.h"
+
+#define DTREE_BULKLOAD_RETRIES 5 // commit attempts of each transaction
+
+// A write of a node (sv) or of a row (buf) waiting to be committed. The
+// writes of a transaction are kept until it commits, to retry them if it
+// aborts.
+struct DtLoadWrite {
+  COid coid;
+  SuperValue *sv;
+  char *buf;
+  int len;
+
+  DtLoadWrite(){ sv = 0; buf = 0; len = 0; }
+  ~DtLoadWrite(){ if (sv) delete sv; if (buf) free(buf); }
+};
+
+DtBulkLoad::DtBulkLoad(){
+  int i;
+  RootCid = 0;
+  Remote = true;
+  RootFlags = 0;
+  Policy = 0;
+  MaxCells = MaxBytes = 0;
+  FirstLeaf = 0;
+  FirstLeafNode = 0;
+  for (i=0; i < DTREE_MAX_LEVELS; ++i){
+    Levels[i].oid = 0;
+    Levels[i].nnodes = 0;
+    Levels[i].hasPending = false;
+    Levels[i].maxKey = 0;
+  }
+  HasLastKey = false;
+  LastKey = 0;
+  NRows = NNodes = NTxs = 0;
+}
+
+DtBulkLoad::~DtBulkLoad(){
+  int i;
+  for (i=0; i < (int) Batch.size(); ++i) delete Batch[i];
+  if (FirstLeafNode) delete FirstLeafNode;
+}
+
+int DtBulkLoad::start(u64 rootcid, bool remote, DtBulkLoad **loadp){
+  KVTransaction *tx;
+  DtBulkLoad *load;
+  DTreeNode root, leaf;
+  DTreeThresholds thresholds;
+  COid coid;
+  int res;
+
+  coid.cid = rootcid;
+  coid.oid = 0;
+  beginTx(&tx, remote);
+  res = auxReadReal(tx, coid, root, 0, 0);
+  if (res){ freeTx(tx); return SQLITE_IOERR; }
+  if (!root.isIntKey() || root.Ncells() != 0){ freeTx(tx); return SQLITE_MISUSE; }
+  if (root.isInner()){ // table as created: empty root above an empty leaf
+    coid.oid = root.LastPtr();
+    res = auxReadReal(tx, coid, leaf, 0, 0);
+    if (res){ freeTx(tx); return SQLITE_IOERR; }
+    if (root.Height() != 1 || leaf.Ncells() != 0){
+      freeTx(tx);
+      return SQLITE_MISUSE;
+    }
+  }
+  freeTx(tx);
+
+  load = new DtBulkLoad;
+  load->RootCid = rootcid;
+  load->Remote = remote;
+  load->RootFlags = root.Flags();
+  load->Policy = root.PlacementPolicy();
+  if (load->Policy == DTREE_PLACEMENT_DEFAULT ||
+      load->Policy > DTREE_PLACEMENT_MAX)
+    load->Policy = DTREE_PLACEMENT_POLICY;
+  thresholds.fromFlags(load->RootFlags);
+  load->MaxCells = thresholds.splitCells * DTREE_BULKLOAD_FILL_PERCENT / 100;
+  if (load->MaxCells < 2) load->MaxCells = 2;
+  load->MaxBytes = thresholds.splitBytes * DTREE_BULKLOAD_FILL_PERCENT / 100;
+  if (root.isInner()) load->FirstLeaf = coid.oid;
+  *loadp = load;
+  return 0;
+}
+
+// Returns a new oid placed according to the table's policy
+Oid DtBulkLoad::newOid(Oid sibling){
+  Oid oid = NewOid(Remote);
+  setPlacementServerid(&oid, Policy, sibling);
+  return oid;
+}
+
+// Starts a new node at a level, to the right of the last node there
+void DtBulkLoad::openNode(int level, Oid oid){
+  Level *l = &Levels[level];
+  SuperValue *sv = &l->node;
+
+  DTreeNode::InitSuperValue(sv, 0);
+  sv->Cells = new ListCell[MaxCells+1];
+  sv->Attrs[DTREENODE_ATTRIB_FLAGS] = DTREENODE_FLAG_INTKEY |
+    (level == 0 ? DTREENODE_FLAG_LEAF : 0) |
+    (RootFlags & DTREENODE_FLAG_THRESHOLD_MASK);
+  sv->Attrs[DTREENODE_ATTRIB_HEIGHT] = level;
+  sv->Attrs[DTREENODE_ATTRIB_LEFTPTR] = l->nnodes ? l->oid : 0;
+  l->oid = oid;
+  ++l->nnodes;
+}
+
+static bool nodeFull(SuperValue *sv, int maxcells, int maxbytes, int cellsize){
+  return sv->Ncells >= maxcells ||
+    sv->Ncells > 0 && sv->CellsSize + cellsize > maxbytes;
+}
+
+static void appendCell(SuperValue *sv, ListCell &cell){
+  sv->Cells[sv->Ncells].copy(cell);
+  ++sv->Ncells;
+  sv->CellsSize += cell.size();
+}
+
+// Finishes the node at a level, whose right neighbor will be rightoid (0 if
+// none), and adds it as a child of the level above
+int DtBulkLoad::closeNode(int level, Oid rightoid){
+  Level *l = &Levels[level];
+  SuperValue *sv = &l->node;
+  ListCell child;
+  COid coid;
+  int res;
+
+  sv->Attrs[DTREENODE_ATTRIB_RIGHTPTR] = rightoid;
+  if (level > 0) child.nKey = l->maxKey;
+  else if (sv->Ncells) child.nKey = sv->Cells[sv->Ncells-1].nKey;
+  else child.nKey = 0; // empty table: leaf goes in the root's last pointer
+  child.value = l->oid;
+
+  if (l->oid == FirstLeaf && level == 0){ // written with the root
+    FirstLeafNode = new SuperValue(*sv);
+    res = 0;
+  } else {
+    coid.cid = RootCid;
+    coid.oid = l->oid;
+    res = write(coid, new SuperValue(*sv), 0, 0);
+  }
+  sv->Free();
+  ++NNodes;
+  if (res) return res;
+  return addChild(level+1, child);
+}
+
+// Adds a child to the inner node at a level. Children are placed one step
+// behind, since the last child of a node goes in its last pointer rather than
+// in a cell, and a child is known to be last only when the next one arrives.
+int DtBulkLoad::addChild(int level, ListCell &child){
+  Level *l = &Levels[level];
+  Oid rightoid;
+  int res;
+
+  if (level >= DTREE_MAX_LEVELS) return SQLITE_FULL;
+  if (!l->hasPending) openNode(level, newOid(0)); // first child at level
+  else if (nodeFull(&l->node, MaxCells, MaxBytes, l->pending.size())){
+    l->node.Attrs[DTREENODE_ATTRIB_LASTPTR] = l->pending.value;
+    l->maxKey = l->pending.nKey;
+    rightoid = newOid(l->oid);
+    res = closeNode(level, rightoid);
+    if (res) return res;
+    openNode(level, rightoid);
+  }
+  else appendCell(&l->node, l->pending);
+  l->pending = child;
+  l->hasPending = true;
+  return 0;
+}
+
+int DtBulkLoad::add(i64 key, const char *data, int len){
+  Level *l = &Levels[0];
+  DataHeader dh;
+  ListCell cell;
+  Oid rightoid;
+  COid coid;
+  char *buf;
+  int res;
+
+  if (HasLastKey && key <= LastKey) return SQLITE_MISUSE; // not sorted
+  HasLastKey = true;
+  LastKey = key;
+
+  cell.nKey = key;
+  cell.value = 0xabcdabcdabcdabcd; // not used
+  if (l->nnodes == 0) openNode(0, FirstLeaf ? FirstLeaf : newOid(0));
+  else if (nodeFull(&l->node, MaxCells, MaxBytes, cell.size())){
+    rightoid = newOid(l->oid);
+    res = closeNode(0, rightoid);
+    if (res) return res;
+    openNode(0, rightoid);
+  }
+  appendCell(&l->node, cell);
+
+  // the row, stored as in DtWriteData
+  strcpy((char*) &dh.dummy, "DAT");
+  buf = (char*) malloc(sizeof(DataHeader) + len);
+  memcpy(buf, &dh, sizeof(DataHeader));
+  memcpy(buf + sizeof(DataHeader), data, len);
+  coid.cid = DATA_CID(RootCid);
+  coid.oid = key;
+  ++NRows;
+  return write(coid, 0, buf, sizeof(DataHeader) + len);
+}
+
+// Queues a write, committing the queued writes if there are enough of them.
+// Takes ownership of sv and buf.
+int DtBulkLoad::write(COid coid, SuperValue *sv, char *buf, int len){
+  DtLoadWrite *w = new DtLoadWrite;
+  w->coid = coid;
+  w->sv = sv;
+  w->buf = buf;
+  w->len = len;
+  Batch.push_back(w);
+  if ((int) Batch.size() >= DTREE_BULKLOAD_BATCH) return flush();
+  return 0;
+}
+
+// Commits the queued writes in one transaction. The objects are new, so the
+// transaction does not conflict with others; it aborts only when the commit
+// protocol times out waiting for a server, and it is then retried right away.
+// A retry rewrites every object of the batch, so it also repairs an attempt
+// that some servers applied and others did not.
+int DtBulkLoad::flush(void){
+  KVTransaction *tx;
+  DtLoadWrite *w;
+  int i, res, attempt;
+
+  if (Batch.empty()) return 0;
+  res = 0;
+  for (attempt=0; attempt < DTREE_BULKLOAD_RETRIES; ++attempt){
+    beginTx(&tx, Remote);
+    for (i=0; i < (int) Batch.size(); ++i){
+      w = Batch[i];
+      if (w->sv) res = KVwriteSuperValue(tx, w->coid, w->sv);
+      else res = KVput(tx, w->coid, w->buf, w->len);
+      if (res) break;
+    }
+    if (!res) res = commitTx(tx);
+    freeTx(tx);
+    if (!res) break;
+  }
+  if (res) return SQLITE_IOERR;
+  ++NTxs;
+  for (i=0; i < (int) Batch.size(); ++i) delete Batch[i];
+  Batch.clear();
+  return 0;
+}
+
+// Makes top, of the given height, the root of the table. The first leaf is
+// written in the same transaction, since it replaces the empty leaf that the
+// old root points to.
+int DtBulkLoad::swapRoot(SuperValue *top, int height){
+  KVTransaction *tx;
+  DTreeNode root, leaf;
+  COid coid;
+  int res, attempt;
+
+  top->Attrs[DTREENODE_ATTRIB_FLAGS] = RootFlags & ~DTREENODE_FLAG_LEAF;
+  top->Attrs[DTREENODE_ATTRIB_HEIGHT] = height;
+  top->Attrs[DTREENODE_ATTRIB_LEFTPTR] = 0;
+  top->Attrs[DTREENODE_ATTRIB_RIGHTPTR] = 0;
+
+  res = 0;
+  for (attempt=0; attempt < DTREE_BULKLOAD_RETRIES; ++attempt){
+    if (attempt) mssleep(100);
+    beginTx(&tx, Remote);
+    // check that nobody wrote the table in the meantime
+    coid.cid = RootCid;
+    coid.oid = 0;
+    res = auxReadReal(tx, coid, root, 0, 0);
+    if (!res && (root.Ncells() != 0 || root.Height() > 1)) res = SQLITE_MISUSE;
+    if (!res && FirstLeaf){
+      coid.oid = FirstLeaf;
+      res = auxReadReal(tx, coid, leaf, 0, 0);
+      if (!res && leaf.Ncells() != 0) res = SQLITE_MISUSE;
+      if (!res) res = KVwriteSuperValue(tx, coid, FirstLeafNode);
+    }
+    coid.oid = 0;
+    if (!res) res = KVwriteSuperValue(tx, coid, top);
+    if (!res) res = commitTx(tx);
+    freeTx(tx);
+    if (!res || res == SQLITE_MISUSE) break;
+  }
+  if (res) return res == SQLITE_MISUSE ? res : SQLITE_IOERR;
+  ++NTxs;
+  coid.oid = 0;
+  GCache.remove(coid); // our cached root is stale
+  return 0;
+}
+
+int DtBulkLoad::finish(void){
+  Level *l;
+  int level, res;
+
+  if (Levels[0].nnodes == 0) // no rows: the table keeps an empty leaf
+    openNode(0, FirstLeaf ? FirstLeaf : newOid(0));
+  for (level=0; ; ++level){
+    l = &Levels[level];
+    if (level > 0){ // last child goes in the last pointer
+      l->node.Attrs[DTREENODE_ATTRIB_LASTPTR] = l->pending.value;
+      l->maxKey = l->pending.nKey;
+      l->hasPending = false;
+      if (l->nnodes == 1) break; // single node at this level: the root
+    }
+    res = closeNode(level, 0);
+    if (res) return res;
+  }
+  res = flush();
+  if (!res) res = swapRoot(&l->node, level);
+  l->node.Free();
+  return res;
+}
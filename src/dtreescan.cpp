@@ -0,0 +1,440 @@
+//
+// dtreescan.cpp
+//
+// Parallel scans of a distributed B-tree (see dtreescan.h)
+//
+
+/*
+  Original code: Copyright (c) 2014 Microsoft Corporation
+  Modified code: Copyright (c) 2015-2016 VMware, Inc
+  All rights reserved.
+
+  Written by Marcos K. Aguilera
+
+  MIT License
+
+  Permission is hereby granted, free of charge, to any person
+  obtaining a copy of this software and associated documentation files
+  (the "Software"), to deal in the Software without restriction,
+  including without limitation the rights to use, copy, modify, merge,
+  publish, distribute, sublicense, and/or sell copies of the Software,
+  and to permit persons to whom the Software is furnished to do so,
+  subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED *AS IS*, WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+  BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+  ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#include <stdio.h>
+#include <assert.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include <vector>
+#include <list>
+
+#include "tmalloc.h"
+#include "options.h"
+#include "os.h"
+#include "gaiatypes.h"
+#include "gaiarpcaux.h"
+#include "datastruct.h"
+#include "task.h"
+#include "dtreeaux.h"
+#include "dtreescan.h"
+
+enum { PART_QUEUED=0, PART_RUNNING, PART_INLINE, PART_DONE };
+
+struct DtScanPart {
+  Oid first, end;     // subtrees delimiting the part (see dtreescan.h)
+  bool hasEnd;        // false if part goes until the last leaf
+  int state;          // PART_*
+  DtScanLeaf *head, *tail; // leaves read but not yet returned
+  bool started;       // whether nextLeaf and endLeaf are set
+  bool finished;      // whether all leaves have been read
+  Oid nextLeaf, endLeaf;
+
+  DtScanPart(){
+    first = end = 0; hasEnd = false; state = PART_QUEUED;
+    head = tail = 0; started = finished = false; nextLeaf = endLeaf = 0;
+  }
+  ~DtScanPart(){
+    DtScanLeaf *leaf;
+    while (head){ leaf = head; head = head->next; delete leaf; }
+  }
+};
+
+// Threads shared by all parallel scans of the process. They take parts of
+// the scans in the order the scans started.
+class DtScanPool {
+private:
+  std::mutex Lock; // protects fields below
+  std::condition_variable Cv;
+  std::list<DtParallelScan*> Scans; // scans that may have unclaimed parts
+  bool Launched;
+  static OSTHREAD_FUNC workerThread(void *parm);
+
+public:
+  DtScanPool(){ Launched = false; }
+  void add(DtParallelScan *scan);
+  void remove(DtParallelScan *scan);
+};
+
+static DtScanPool ScanPool;
+
+OSTHREAD_FUNC DtScanPool::workerThread(void *parm){
+  DtScanPool *pool = (DtScanPool*) parm;
+  DtParallelScan *scan;
+  int partno;
+
+  initThreadContext("dtreescan", 0);
+  while (1){
+    std::unique_lock<std::mutex> lk(pool->Lock);
+    while (pool->Scans.empty()) pool->Cv.wait(lk);
+    scan = pool->Scans.front();
+    partno = scan->claim(false); // with pool lock held, so scan is not
+                                 // closed before it counts us as running
+    if (partno < 0){ pool->Scans.pop_front(); continue; }
+    lk.unlock();
+    scan->runPart(partno);
+  }
+  return 0;
+}
+
+void DtScanPool::add(DtParallelScan *scan){
+  int i, res;
+  OSThread_t thr;
+  std::unique_lock<std::mutex> lk(Lock);
+  if (!Launched){
+    Launched = true;
+    for (i=0; i < DTREE_PSCAN_THREADS; ++i){
+      res = OSCreateThread(&thr, workerThread, (void*) this); assert(res==0);
+    }
+  }
+  Scans.push_back(scan);
+  Cv.notify_all();
+}
+
+void DtScanPool::remove(DtParallelScan *scan){
+  std::unique_lock<std::mutex> lk(Lock);
+  Scans.remove(scan);
+}
+
+// Sets *leafoid to the leftmost leaf of the subtree with root oid, which is
+// at the given height
+static int leftmostLeaf(KVTransaction *tx, u64 cid, Oid oid, int height,
+                        Oid *leafoid){
+  COid coid;
+  DTreeNode node;
+  int res;
+
+  coid.cid = cid;
+  coid.oid = oid;
+  while (height > 0){
+    res = auxReadReal(tx, coid, node, 0, 0);
+    if (res) return res;
+    coid.oid = node.GetPtr(0);
+    --height;
+  }
+  *leafoid = coid.oid;
+  return 0;
+}
+
+DtParallelScan::~DtParallelScan(){
+  if (Parts) delete [] Parts;
+  if (Filter) delete [] Filter;
+}
+
+// Splits the tree into up to maxparts parts. Subtrees are taken from the
+// highest level of the tree that has at least maxparts nodes (or from the
+// leaves), and consecutive subtrees are grouped into parts.
+int DtParallelScan::split(int maxparts){
+  std::vector<Oid> frontier, children;
+  COid coid;
+  DTreeNode node;
+  int res, i, j, nf, height;
+
+  coid.cid = RootCid;
+  coid.oid = DTREE_ROOT_OID;
+  res = auxReadReal(Tx, coid, node, 0, 0);
+  if (res) return res;
+  frontier.push_back(DTREE_ROOT_OID);
+  height = (int) node.Height();
+
+  while ((int) frontier.size() < maxparts && height > 0){
+    children.clear();
+    for (i=0; i < (int) frontier.size(); ++i){
+      coid.oid = frontier[i];
+      if (coid.oid != DTREE_ROOT_OID){ // root was read above
+        res = auxReadReal(Tx, coid, node, 0, 0);
+        if (res) return res;
+      }
+      for (j=0; j <= node.Ncells(); ++j) children.push_back(node.GetPtr(j));
+    }
+    frontier.swap(children);
+    --height;
+  }
+  FrontierHeight = height;
+
+  nf = (int) frontier.size();
+  NParts = nf < maxparts ? nf : maxparts;
+  Parts = new DtScanPart[NParts];
+  for (i=0; i < NParts; ++i){
+    Parts[i].first = frontier[(i * nf) / NParts];
+    if (i < NParts-1){
+      Parts[i].end = frontier[((i+1) * nf) / NParts];
+      Parts[i].hasEnd = true;
+    }
+  }
+  return 0;
+}
+
+int DtParallelScan::start(KVTransaction *tx, u64 rootcid, int flags,
+                          DtParallelScan **pscan, const char *filter,
+                          int filterlen){
+  DtParallelScan *scan;
+  bool usethreads;
+  int res;
+
+  scan = new DtParallelScan;
+  scan->Tx = tx;
+  scan->RootCid = rootcid;
+  scan->Flags = flags;
+  scan->NParts = 0;
+  scan->Parts = 0;
+  scan->NextQueued = 0;
+  scan->Consuming = 0;
+  scan->Buffered = 0;
+  scan->Running = 0;
+  scan->Err = 0;
+  scan->Canceled = false;
+  scan->FrontierHeight = 0;
+  if (filter && (flags & DTSCAN_FETCHDATA)){ // keep a copy
+    scan->Filter = new char[filterlen];
+    memcpy(scan->Filter, filter, filterlen);
+    scan->FilterLen = filterlen;
+  }
+
+  // pool threads read in their own transactions, which do not see the
+  // writes of tx, nor add to its read set
+  usethreads = DTREE_PSCAN_THREADS > 0 && !(flags & DTSCAN_NOTHREADS) &&
+               tx->type == 1 && KVtxreadonly(tx);
+#ifdef GAIA_OCC
+  usethreads = false;
+#endif
+
+  res = scan->split(usethreads ? DTREE_PSCAN_THREADS *
+                                 DTREE_PSCAN_PARTS_PER_THREAD : 1);
+  if (!res && usethreads) // split read the root, so tx has a start ts
+    res = txStartTs(tx, &scan->StartTs);
+  if (res){ delete scan; return res; }
+
+  if (usethreads && scan->NParts > 1) ScanPool.add(scan);
+  *pscan = scan;
+  return 0;
+}
+
+// Claims the next part nobody has claimed. If inline_, the part is read by
+// the scanning thread as leaves are needed; otherwise, by the calling pool
+// thread. Returns the part number, or -1 if there are no more parts.
+int DtParallelScan::claim(bool inline_){
+  int partno;
+  std::unique_lock<std::mutex> lk(Lock, std::defer_lock);
+  if (!inline_) lk.lock(); // scanning thread already holds lock
+  if (Canceled || NextQueued >= NParts) return -1;
+  partno = NextQueued++;
+  if (inline_) Parts[partno].state = PART_INLINE;
+  else {
+    Parts[partno].state = PART_RUNNING;
+    ++Running;
+  }
+  return partno;
+}
+
+// Reads the next non-empty leaf of a part, setting *leafp to it, or to 0 if
+// there are no more leaves
+int DtParallelScan::readLeaf(DtScanPart *part, KVTransaction *tx,
+                             DtScanLeaf **leafp){
+  COid coid, datacoid;
+  DTreeNode node;
+  DtScanLeaf *leaf;
+  int res, i;
+
+  *leafp = 0;
+  if (!part->started){
+    res = leftmostLeaf(tx, RootCid, part->first, FrontierHeight,
+                       &part->nextLeaf);
+    if (res) return res;
+    if (part->hasEnd){
+      res = leftmostLeaf(tx, RootCid, part->end, FrontierHeight,
+                         &part->endLeaf);
+      if (res) return res;
+    }
+    part->started = true;
+  }
+
+  coid.cid = RootCid;
+  while (!part->finished){
+    coid.oid = part->nextLeaf;
+    res = auxReadReal(tx, coid, node, 0, 0);
+    if (res) return res;
+    if (!node.isLeaf()) return GAIAERR_WRONG_TYPE; // tree is corrupted
+    part->nextLeaf = node.RightPtr();
+    if (part->nextLeaf == 0 || part->hasEnd && part->nextLeaf==part->endLeaf)
+      part->finished = true;
+    if (node.Ncells() == 0) continue; // skip empty leaves
+
+    leaf = new DtScanLeaf;
+    leaf->node = node;
+    if ((Flags & DTSCAN_FETCHDATA) && node.isIntKey()){
+      // data that cannot be read is left unset, for the caller to retry
+      leaf->data = new Ptr<Valbuf>[node.Ncells()];
+      datacoid.cid = DATA_CID(RootCid);
+      if (Filter){ // servers send only the data that passes the filter
+        Oid *oids = new Oid[node.Ncells()];
+        for (i=0; i < node.Ncells(); ++i) oids[i] = node.Cells()[i].nKey;
+        leaf->filtered = new u8[node.Ncells()];
+        res = KVgetFilter(tx, datacoid.cid, node.Ncells(), oids,
+                          sizeof(DataHeader), Filter, FilterLen, leaf->data,
+                          leaf->filtered);
+        delete [] oids;
+        if (res) memset(leaf->filtered, 0, node.Ncells());
+      } else {
+        for (i=0; i < node.Ncells(); ++i){
+          datacoid.oid = node.Cells()[i].nKey;
+          KVget(tx, datacoid, leaf->data[i]);
+        }
+      }
+    }
+    *leafp = leaf;
+    return 0;
+  }
+  return 0;
+}
+
+// Pool thread: reads a part in its own transaction, handing leaves to the
+// scanning thread. Stops reading ahead when too many leaves are waiting,
+// unless the scanning thread is waiting for this very part.
+void DtParallelScan::runPart(int partno){
+  KVTransaction *tx;
+  DtScanPart *part = &Parts[partno];
+  DtScanLeaf *leaf;
+  int res;
+
+  beginReadOnlyTxAt(&tx, StartTs);
+  while (1){
+    res = readLeaf(part, tx, &leaf);
+    std::unique_lock<std::mutex> lk(Lock);
+    if (res && !Err) Err = res;
+    if (res || !leaf || Canceled){
+      if (leaf) delete leaf;
+      part->state = PART_DONE;
+      --Running;
+      Cv.notify_all();
+      break;
+    }
+    if (part->tail) part->tail->next = leaf;
+    else part->head = leaf;
+    part->tail = leaf;
+    ++Buffered;
+    Cv.notify_all();
+    while (Buffered >= DTREE_PSCAN_MAX_LEAVES && !Canceled &&
+           !((Flags & DTSCAN_ORDERED) && partno == Consuming))
+      Cv.wait(lk);
+  }
+  freeTx(tx);
+}
+
+int DtParallelScan::next(DtScanLeaf **leafp){
+  DtScanPart *part;
+  int i, res, partno;
+  bool waited = false;
+  std::unique_lock<std::mutex> lk(Lock);
+
+  *leafp = 0;
+  while (1){
+    if (Err) return Err;
+
+    if (Flags & DTSCAN_ORDERED){
+      if (Consuming >= NParts) return 0; // end of scan
+      partno = Consuming;
+    } else {
+      // any leaf will do
+      for (i=0; i < NParts; ++i) if (Parts[i].head) break;
+      if (i == NParts){ // nothing buffered: read a part we are reading
+        for (i=0; i < NParts; ++i) if (Parts[i].state == PART_INLINE) break;
+      }
+      if (i == NParts){
+        if (NextQueued < NParts) i = NextQueued; // claim below
+        else if (Running > 0){ Cv.wait(lk); continue; }
+        else return 0; // end of scan
+      }
+      partno = i;
+    }
+
+    part = &Parts[partno];
+    if (part->head){
+      *leafp = part->head;
+      part->head = part->head->next;
+      if (!part->head) part->tail = 0;
+      (*leafp)->next = 0;
+      --Buffered;
+      Cv.notify_all();
+      return 0;
+    }
+
+    switch (part->state){
+    case PART_DONE:
+      assert(Flags & DTSCAN_ORDERED);
+      ++Consuming;
+      Cv.notify_all(); // pool thread of the next part may go on reading
+      continue;
+    case PART_RUNNING:
+      Cv.wait(lk);
+      continue;
+    case PART_QUEUED:
+      // no pool thread took it yet. Give them a moment, then read it here
+      // rather than wait, since they may all be busy (perhaps with other
+      // scans of this thread)
+      if (!waited && Running < DTREE_PSCAN_THREADS){
+        waited = true;
+        Cv.wait_for(lk, std::chrono::milliseconds(1));
+        continue;
+      }
+      res = claim(true);
+      assert(res == partno);
+      // fall through
+    case PART_INLINE:
+      lk.unlock();
+      res = readLeaf(part, Tx, leafp);
+      lk.lock();
+      if (res) return res;
+      if (*leafp) return 0;
+      part->state = PART_DONE;
+      if (!(Flags & DTSCAN_ORDERED)) continue;
+      ++Consuming;
+      Cv.notify_all();
+      continue;
+    }
+  }
+}
+
+void DtParallelScan::close(void){
+  ScanPool.remove(this); // no more parts claimed by pool threads
+  {
+    std::unique_lock<std::mutex> lk(Lock);
+    Canceled = true;
+    Cv.notify_all();
+    while (Running > 0) Cv.wait(lk);
+  }
+  delete this;
+}
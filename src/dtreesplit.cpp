@@ -186,6 +186,39 @@ int FindParentCache(KVTransaction *tx, COid targetcoid, ListCell &cell,
   return 0;
 }
 
+// Returns the flags of the root of the table containing coid, which hold the
+// table's placement policy and split/merge thresholds. If the root cannot be
+// read, returns 0, meaning use the defaults.
+// root is the root node if the caller already has it, otherwise 0.
+static u64 GetTableFlags(KVTransaction *tx, COid coid, DTreeNode *root){
+  DTreeNode node;
+  int real, res;
+
+  if (!root){
+    coid.oid = 0;
+    res = auxReadCacheOrReal(tx, coid, node, real, 0, 0);
+    if (res) return 0;
+    root = &node;
+  }
+  return root->Flags();
+}
+
+// Returns the placement policy for new nodes given the flags of the table's
+// root. If the table has no policy, returns the default DTREE_PLACEMENT_POLICY.
+static int GetPlacementPolicy(u64 rootflags){
+  int policy = (int)((rootflags & DTREENODE_FLAG_PLACEMENT_MASK) >>
+                     DTREENODE_FLAG_PLACEMENT_SHIFT);
+  if (policy == DTREE_PLACEMENT_DEFAULT || policy > DTREE_PLACEMENT_MAX)
+    policy = DTREE_PLACEMENT_POLICY;
+  return policy;
+}
+
+// Returns flags with the split/merge thresholds replaced by those in rootflags
+static u64 RefreshThresholds(u64 flags, u64 rootflags){
+  return (flags & ~(u64)DTREENODE_FLAG_THRESHOLD_MASK) |
+    (rootflags & DTREENODE_FLAG_THRESHOLD_MASK);
+}
+
 // checks that a node matches what is in node.
 int chknode(COid coid, DTreeNode node, bool remote){
   KVTransaction *tx;
@@ -258,6 +291,9 @@ int DtSplit(COid toSplit, ListCellPlus *cell, bool remote,
   DTreeNode nodesplit, nodeparent;
   Ptr<RcKeyInfo> prki;
   Timestamp committs;
+  int policy;
+  u64 rootflags;
+  DTreeThresholds thresholds;
 
   parentcoid.cid = toSplit.cid;
   leftcoid.cid = toSplit.cid;
@@ -279,13 +315,26 @@ int DtSplit(COid toSplit, ListCellPlus *cell, bool remote,
 
   prki = nodesplit.Prki();
 
-  // check if cell==0 and node is too large (node has been split already)
+  splitroot = toSplit.oid == 0;
+  rootflags = GetTableFlags(tx, toSplit, splitroot ? &nodesplit : 0);
+  thresholds.fromFlags(rootflags);
+
+  // check if cell==0 and node is not too large (node has been split already)
   //       or cell!=0 and node smaller than minimum splittable size (no
   //       split possible)
-  if (!cell && nodesplit.Ncells() <= DTREE_SPLIT_SIZE &&
-      nodesplit.CellsSize() <= DTREE_SPLIT_SIZE_BYTES ||
+  if (!cell && !thresholds.needSplit(nodesplit.Ncells(),nodesplit.CellsSize())||
       cell && nodesplit.Ncells() < DTREE_SPLIT_MINSIZE){ // do not split
     dputchar(1,'_');
+    if (!splitroot &&
+        RefreshThresholds(nodesplit.Flags(), rootflags) != nodesplit.Flags()){
+      // node has stale thresholds, which is probably why we were asked to
+      // split it; refresh them so that its server stops asking
+      res = KVattrset(tx, toSplit, DTREENODE_ATTRIB_FLAGS,
+                      RefreshThresholds(nodesplit.Flags(), rootflags));
+      if (!res) res = commitTx(tx);
+      freeTx(tx);
+      return res;
+    }
     freeTx(tx);
     return 0;
   }
@@ -304,9 +353,17 @@ int DtSplit(COid toSplit, ListCellPlus *cell, bool remote,
   for (i = splitindex+1; i < nodesplit.Ncells(); ++i)
     cellSizeInNodesplit += nodesplit.Cells()[i].size();
 
+  policy = GetPlacementPolicy(rootflags);
+
   // obtain new coid for left node
   leftcoid.oid = NewOid(remote);
-  setRandomServerid(&leftcoid.oid); // random serverid policy
+  if (splitroot){
+    // root will move to a new oid, which is the left node's sibling
+    nodesplit.raw->coid.oid = NewOid(remote);
+    setPlacementServerid(&nodesplit.raw->coid.oid, policy, 0);
+    setPlacementServerid(&leftcoid.oid, policy, nodesplit.raw->coid.oid);
+  }
+  else setPlacementServerid(&leftcoid.oid, policy, toSplit.oid);
 
   // copy splitindex cell, and set its pointer to the left node
   ListCell lc(nodesplit.Cells()[splitindex]);
@@ -321,8 +378,10 @@ int DtSplit(COid toSplit, ListCellPlus *cell, bool remote,
   leftnode.CellType = nodesplit.CellType();
   leftnode.prki = nodesplit.Prki();
   leftnode.Attrs = new u64[DTREENODE_NATTRIBS];
-  // copy flags and height from right node (toSplit node)
-  leftnode.Attrs[DTREENODE_ATTRIB_FLAGS] = nodesplit.Flags();
+  // copy flags and height from right node (toSplit node), with the table's
+  // current thresholds
+  leftnode.Attrs[DTREENODE_ATTRIB_FLAGS] =
+    RefreshThresholds(nodesplit.Flags(), rootflags);
   leftnode.Attrs[DTREENODE_ATTRIB_HEIGHT] = nodesplit.Height();
 
   //DTreeNode::InitSuperValue(&leftnode, 1);
@@ -343,12 +402,8 @@ int DtSplit(COid toSplit, ListCellPlus *cell, bool remote,
       // changing the node to split. Note that oldleftcoid.oid will be 0
       // if there is not left pointer in node to be split
 
-  splitroot = toSplit.oid == 0;
-
   if (splitroot){
-    // change oid of node to be split
-    nodesplit.raw->coid.oid = NewOid(remote);
-    setRandomServerid(&nodesplit.raw->coid.oid); // random serverid policy
+    // oid of node to be split was changed above
     parentcoid.oid = 0; //root is parent
 
     SuperValue newroot;
@@ -490,6 +545,13 @@ int DtSplit(COid toSplit, ListCellPlus *cell, bool remote,
     res = KVattrset(tx, toSplit, DTREENODE_ATTRIB_LEFTPTR, leftcoid.oid);
     if (res){ dprintf(1, "j%d ", res); goto end; }
 
+    // bring thresholds of toSplit up to date, if needed
+    if (RefreshThresholds(nodesplit.Flags(), rootflags) != nodesplit.Flags()){
+      res = KVattrset(tx, toSplit, DTREENODE_ATTRIB_FLAGS,
+                      RefreshThresholds(nodesplit.Flags(), rootflags));
+      if (res){ dprintf(1, "j%d ", res); goto end; }
+    }
+
     // attrSet the right pointer of the node to the left of toSplit (if not 0)
     // to be the left cell
     if (oldleftcoid.oid){
@@ -550,6 +612,7 @@ int DtSplit(COid toSplit, ListCellPlus *cell, bool remote,
         tofix.raw->commitTs = committs; // update timestamps
         tofix.raw->readTs = committs;
         tofix.LeftPtr() = leftcoid.oid;
+        tofix.Flags() = RefreshThresholds(tofix.Flags(), rootflags);
         tofix.raw->u.raw->DeleteCellRange(0, splitindex+1);
 #if (DTREE_SPLIT_LOCATION==1)
         GCache.remove(toSplit);
@@ -592,8 +655,7 @@ int DtSplit(COid toSplit, ListCellPlus *cell, bool remote,
       res = KVreadSuperValue(tx, parentcoid, nodeparent.raw, 0, 0);
       if (res){ dprintf(1, "n%d ", res); goto end; }
       freeTx(tx);
-      if (nodeparent.Ncells() > DTREE_SPLIT_SIZE ||
-          nodeparent.CellsSize() > DTREE_SPLIT_SIZE_BYTES){
+      if (thresholds.needSplit(nodeparent.Ncells(), nodeparent.CellsSize())){
         //dprintf(1, "Need to further split parent %llx %llx\n",
         //          (long long)parentcoid.cid, p(long long)arentcoid.oid);
         enqueueMoreSplit(parentcoid, 0, enqueueMoreSplitParm, 0); // enqueue
@@ -602,8 +664,7 @@ int DtSplit(COid toSplit, ListCellPlus *cell, bool remote,
     }
 
     // see if we need to further split left node
-    if (leftnode.Ncells > DTREE_SPLIT_SIZE ||
-        leftnode.CellsSize > DTREE_SPLIT_SIZE_BYTES){
+    if (thresholds.needSplit(leftnode.Ncells, leftnode.CellsSize)){
       //dprintf(1, "Need to further split left node %llx %llx\n",
       //            (long long)leftcoid.cid, (long long)leftcoid.oid);
       enqueueMoreSplit(leftcoid, 1, enqueueMoreSplitParm,
@@ -611,8 +672,7 @@ int DtSplit(COid toSplit, ListCellPlus *cell, bool remote,
     }
 
     // see if we need to further split right node
-    if (cellsInNodesplit > DTREE_SPLIT_SIZE ||
-        cellSizeInNodesplit > DTREE_SPLIT_SIZE_BYTES){
+    if (thresholds.needSplit(cellsInNodesplit, cellSizeInNodesplit)){
       //dprintf(1, "Need to further split right node %llx %llx\n",
       //(long long)nodesplit.raw->coid.cid, (long long)nodesplit.raw->coid.oid);
       enqueueMoreSplit(nodesplit.raw->coid, 1, enqueueMoreSplitParm,
@@ -624,3 +684,209 @@ int DtSplit(COid toSplit, ListCellPlus *cell, bool remote,
   lc.Free();
   return res;
 }
+
+// Merges a sparse node with a sibling that has the same parent: its right
+// sibling or, if the node is the last child of its parent, its left sibling.
+// The cells of the left node of the pair are moved into the right node, the
+// left node is deleted, and the cell of the parent pointing to the left node
+// is removed. If the parent is the root and is left with a single child, the
+// contents of that child move into the root, which reduces the height of the
+// tree. Nodes are merged only if they are below the table's merge threshold
+// and the merged node is small enough (see DTreeThresholds).
+// toMerge: node to merge
+// remote: type of transaction to use (normally set to true)
+// Returns 0 if the merge was done or is not needed or not possible, non-zero
+// if it could not complete (eg, the transaction aborted) and may be retried.
+int DtMerge(COid toMerge, bool remote){
+  // start a new transaction
+  // read real toMerge node; if not sparse, we are done
+  // find real parent by doing a traversal using a cell of toMerge (or of its
+  //      left sibling, if toMerge has no cells)
+  // pick the sibling to merge with, and the cell of the parent separating
+  //      the two (sepindex)
+  // read real left and right nodes; check the merged node is not too large
+  // create merged node with cells of left node, the separator cell (if inner
+  //      nodes), and cells of right node
+  // if parent is root with a single cell, write merged node to root and
+  //      delete left and right nodes
+  // otherwise, writeSV merged node to right node, DelRange the separator
+  //      cell from parent, attrSet right pointer of the node to the left of
+  //      the left node (if not 0), and delete left node
+  // commit transaction
+
+  int res, i, j, index, sepindex, ncells, size;
+  KVTransaction *tx;
+  COid parentcoid, leftcoid, rightcoid, oldleftcoid, guidecoid;
+  DTreeNode node, nodeparent, nodeleft, noderight, nodeguide;
+  Timestamp committs;
+  u64 rootflags;
+  DTreeThresholds thresholds;
+  SuperValue merged;
+  bool collapse;
+
+  if (toMerge.oid == 0) return 0; // root is never merged
+  parentcoid.cid = leftcoid.cid = rightcoid.cid = toMerge.cid;
+  oldleftcoid.cid = guidecoid.cid = toMerge.cid;
+
+  // start a new transaction
+#ifndef DTREE_SPLIT_DEFER_TS
+  beginTx(&tx, remote);
+#else
+  beginTx(&tx, remote, true);
+#endif
+
+  // read real toMerge node
+  res = auxReadReal(tx, toMerge, node, 0, 0);
+  if (res){ dprintf(1,"Ma%d ", res); goto end; }
+  assert(node.raw->type==1); // must be supervalue
+
+  rootflags = GetTableFlags(tx, toMerge, 0);
+  thresholds.fromFlags(rootflags);
+  if (!thresholds.needMerge(node.Ncells(), node.CellsSize())) goto end;
+
+  // find real parent, using a cell that leads to toMerge or to its left
+  // sibling
+  if (node.Ncells() > 0){
+    guidecoid = toMerge;
+    nodeguide = node;
+  } else {
+    // inner node with only a last pointer
+    if (!node.LeftPtr()) goto end;
+    guidecoid.oid = node.LeftPtr();
+    res = auxReadReal(tx, guidecoid, nodeguide, 0, 0);
+    if (res){ dprintf(1,"Mb%d ", res); goto end; }
+    if (nodeguide.Ncells() == 0) goto end;
+  }
+  res = FindParentCache(tx, guidecoid, nodeguide.Cells()[0], nodeguide.Prki(),
+                        parentcoid.oid);
+  if (res)
+    res = FindParentReal(tx, guidecoid, nodeguide.Cells()[0],
+                         nodeguide.Prki(), parentcoid.oid);
+  if (res){ dprintf(1,"Mc%d ", res); goto end; }
+  res = auxReadReal(tx, parentcoid, nodeparent, 0, 0);
+  if (res){ dprintf(1,"Md%d ", res); goto end; }
+
+  // find toMerge in parent. If it is not there, then toMerge and the guide
+  // node have different parents and we cannot merge them
+  for (index = 0; index <= nodeparent.Ncells(); ++index)
+    if (nodeparent.GetPtr(index) == toMerge.oid) break;
+  if (index > nodeparent.Ncells()) goto end;
+  if (index < nodeparent.Ncells()) sepindex = index; // merge with right sibling
+  else if (index > 0) sepindex = index-1; // last child, merge with left sibling
+  else goto end; // only child
+  leftcoid.oid = nodeparent.GetPtr(sepindex);
+  rightcoid.oid = nodeparent.GetPtr(sepindex+1);
+
+  // read real left and right nodes
+  if (leftcoid.oid == toMerge.oid) nodeleft = node;
+  else {
+    res = auxReadReal(tx, leftcoid, nodeleft, 0, 0);
+    if (res){ dprintf(1,"Me%d ", res); goto end; }
+  }
+  if (rightcoid.oid == toMerge.oid) noderight = node;
+  else {
+    res = auxReadReal(tx, rightcoid, noderight, 0, 0);
+    if (res){ dprintf(1,"Mf%d ", res); goto end; }
+  }
+  if (nodeleft.RightPtr() != rightcoid.oid ||
+      noderight.LeftPtr() != leftcoid.oid ||
+      nodeleft.Height() != noderight.Height()){
+    dprintf(1,"Mg ");
+    goto end; // siblings do not match
+  }
+
+  // check the merged node is not too large
+  ncells = nodeleft.Ncells() + noderight.Ncells();
+  size = nodeleft.CellsSize() + noderight.CellsSize();
+  if (nodeleft.isInner()){
+    ++ncells;
+    size += nodeparent.Cells()[sepindex].size();
+  }
+  if (!thresholds.canMerge(ncells, size)) goto end;
+
+  // create merged node with cells of left node, the separator cell pointing
+  // to the last pointer of the left node (if inner nodes), and cells of right
+  // node
+  merged.Nattrs = DTREENODE_NATTRIBS;
+  merged.CellType = noderight.CellType();
+  merged.prki = noderight.Prki();
+  merged.Attrs = new u64[DTREENODE_NATTRIBS];
+  merged.Ncells = ncells;
+  merged.CellsSize = size;
+  merged.Cells = new ListCell[ncells];
+  i = 0;
+  for (j=0; j < nodeleft.Ncells(); ++j)
+    merged.Cells[i++].copy(nodeleft.Cells()[j]);
+  if (nodeleft.isInner()){
+    merged.Cells[i].copy(nodeparent.Cells()[sepindex]);
+    merged.Cells[i++].value = nodeleft.LastPtr();
+  }
+  for (j=0; j < noderight.Ncells(); ++j)
+    merged.Cells[i++].copy(noderight.Cells()[j]);
+  assert(i == ncells);
+  merged.Attrs[DTREENODE_ATTRIB_HEIGHT] = noderight.Height();
+  merged.Attrs[DTREENODE_ATTRIB_LASTPTR] = noderight.LastPtr();
+
+  collapse = nodeparent.isRoot() && nodeparent.Ncells() == 1;
+  if (collapse){
+    // root keeps its own flags (policy, thresholds), except for the leaf flag
+    merged.Attrs[DTREENODE_ATTRIB_FLAGS] =
+      (nodeparent.Flags() & ~(u64)DTREENODE_FLAG_LEAF) |
+      (noderight.Flags() & DTREENODE_FLAG_LEAF);
+    merged.Attrs[DTREENODE_ATTRIB_LEFTPTR] = 0;
+    merged.Attrs[DTREENODE_ATTRIB_RIGHTPTR] = 0;
+
+    // write merged node to root and delete left and right nodes
+    res = KVwriteSuperValue(tx, parentcoid, &merged);
+    if (res){ dprintf(1,"Mh%d ", res); goto end; }
+    res = KVput(tx, leftcoid, 0, 0);
+    if (res){ dprintf(1,"Mi%d ", res); goto end; }
+    res = KVput(tx, rightcoid, 0, 0);
+    if (res){ dprintf(1,"Mj%d ", res); goto end; }
+  } else {
+    merged.Attrs[DTREENODE_ATTRIB_FLAGS] =
+      RefreshThresholds(noderight.Flags(), rootflags);
+    merged.Attrs[DTREENODE_ATTRIB_LEFTPTR] = nodeleft.LeftPtr();
+    merged.Attrs[DTREENODE_ATTRIB_RIGHTPTR] = noderight.RightPtr();
+
+    // writeSV merged node to right node
+    res = KVwriteSuperValue(tx, rightcoid, &merged);
+    if (res){ dprintf(1,"Mk%d ", res); goto end; }
+
+    // DelRange the separator cell from parent
+    res = KVlistdelrange(tx, parentcoid, 4, &nodeparent.Cells()[sepindex],
+                         &nodeparent.Cells()[sepindex], nodeparent.Prki());
+    if (res){ dprintf(1,"Ml%d ", res); goto end; }
+
+    // attrSet the right pointer of the node to the left of the left node
+    // (if not 0) to be the right node
+    oldleftcoid.oid = nodeleft.LeftPtr();
+    if (oldleftcoid.oid){
+      res = KVattrset(tx, oldleftcoid, DTREENODE_ATTRIB_RIGHTPTR,
+                      rightcoid.oid);
+      if (res){ dprintf(1,"Mm%d ", res); goto end; }
+    }
+
+    // delete left node
+    res = KVput(tx, leftcoid, 0, 0);
+    if (res){ dprintf(1,"Mn%d ", res); goto end; }
+  }
+
+  // commit transaction
+  res = commitTx(tx, &committs);
+  if (res){ dprintf(1,"Mo%d ", res); goto end; }
+
+  // remove modified inner nodes from the cache, so that they are refetched.
+  // Caches elsewhere may still point to the deleted node; readers detect
+  // that it is no longer a supervalue and refetch the path (as they do for
+  // nodes removed by DtDelete)
+  auxRemoveCache(parentcoid);
+  auxRemoveCache(leftcoid);
+  auxRemoveCache(rightcoid);
+  if (oldleftcoid.oid) auxRemoveCache(oldleftcoid);
+  dputchar(1,'G');
+
+ end:
+  freeTx(tx);
+  return res;
+}
@@ -56,6 +56,11 @@ RPCTcp::RPCTcp() :
   refcount = 0;
   CurrXid=0;
   NextServer=0;
+  ReplyTag=0;
+  ReplyTagObserver=0;
+  ReplyTagCtx=0;
+  RequestObserver=0;
+  RequestCtx=0;
 }
 
 // these are intended to be overloaded by child classes
@@ -68,6 +73,8 @@ void RPCTcp::handleMsg(int handlerid, IPPort *dest, u32 req, u32 xid,
                        u32 flags, TaskMultiBuffer *tmb, char *data, int len){
   if (handlerid == -1){ // client stuff
     OutstandingRPC *orpc;
+    if ((flags & FLAG_TAG_MASK) && ReplyTagObserver)
+      ReplyTagObserver(ReplyTagCtx, (u16)(flags & FLAG_TAG_MASK));
     orpc = RequestLookupAndDelete(xid);
     if (orpc && orpc->callback){
       orpc->callback(data, len, orpc->callbackdata);
@@ -82,8 +89,9 @@ void RPCTcp::handleMsg(int handlerid, IPPort *dest, u32 req, u32 xid,
     assert(0 <= handlerid && handlerid < NextServer);
 
     TaskScheduler *ts = tgetTaskScheduler();
-    TaskInfo *ti = new RPCTaskInfo(handlerid, (ProgFunc) RPCStart, 0, dest,
-                                   req, xid, flags, tmb, data, len);
+    RPCTaskInfo *ti = new RPCTaskInfo(handlerid, (ProgFunc) RPCStart, 0, dest,
+                                      req, xid, flags, tmb, data, len);
+    if (RequestObserver) ti->startus = Time::nowus();
     ti->setEndFunc((ProgFunc) RPCEnd); // set ending function
     ts->createTask(ti); // creates task
   }
@@ -173,7 +181,7 @@ int RPCTcp::RPCEnd(RPCTaskInfo *rti){
   dmsg.ipport = rti->src;
   dmsg.req = rti->req;
   dmsg.xid = rti->xid;
-  dmsg.flags = rti->flags; // or should we clear the flags?
+  dmsg.flags = (rti->flags & ~FLAG_TAG_MASK) | rpctcp->ReplyTag;
   //dmsg.freedata = idempotent ? true : false;
   // // if not idempotent then do not free result after sending
   // //    since we are caching it
@@ -181,6 +189,9 @@ int RPCTcp::RPCEnd(RPCTaskInfo *rti){
   dmsg.freedata = true;
 
   rpctcp->sendMsgFromWorker(&dmsg);
+  if (rpctcp->RequestObserver && rti->startus)
+    rpctcp->RequestObserver(rpctcp->RequestCtx, rti->req,
+                            Time::nowus() - rti->startus);
 
   freeMB(rti->tmb); // free incoming RPC data
   return SchedulerTaskStateEnding;
@@ -57,6 +57,7 @@
 #endif
 
 #include "kvinterface.h"
+#include "scanfilter.h"
 
 #include "clientlib.h"
 #include "clientlib-local.h"
@@ -159,6 +160,42 @@ int beginTx(KVTransaction **txp, bool remote, bool deferred){
   return 0;
 }
 
+int beginReadOnlyTx(KVTransaction **txp, bool remote, int maxstalems){
+  KVTransaction *tx;
+  tx = *txp = new KVTransaction;
+  KVLOG("Tx %p", tx);
+
+  if (NOGAIA_BOOL) remote=0;
+  tx->type = remote ? 1 : 0;
+
+  if (!remote){ // local
+    tx->u.lt = new LocalTransaction;
+    tx->u.lt->startReadOnly(maxstalems);
+  }
+  else {
+    tx->u.t = new Transaction(SC);
+    tx->u.t->startReadOnly(maxstalems);
+  }
+  return 0;
+}
+
+int beginReadOnlyTxAt(KVTransaction **txp, Timestamp startts){
+  KVTransaction *tx;
+  tx = *txp = new KVTransaction;
+  KVLOG("Tx %p", tx);
+  tx->type = 1;
+  tx->u.t = new Transaction(SC);
+  tx->u.t->startReadOnlyAt(startts);
+  return 0;
+}
+
+int txStartTs(KVTransaction *tx, Timestamp *startts){
+  if (tx->type != 1) return -1;
+  *startts = tx->u.t->getStartTs();
+  if (startts->isIllegal()) return -1;
+  return 0;
+}
+
 bool HasKVInterfaceInit = false;
 
 #if (DTREE_SPLIT_LOCATION==1)
@@ -274,6 +311,35 @@ int KVget(KVTransaction *tx, COid coid, Ptr<Valbuf> &buf){
   return res;
 }
 
+int KVgetFilter(KVTransaction *tx, Cid cid, int n, Oid *oids, int skip,
+                const char *filter, int filterlen, Ptr<Valbuf> *bufs,
+                u8 *filtered){
+  COid coid;
+  int i, res=1;
+
+  if (tx->type==1){
+    assert(!(cid >> 48 & EPHEMDB_CID_BIT));
+    res = tx->u.t->vgetFilter(cid, n, oids, skip, filter, filterlen, bufs,
+                              filtered);
+  }
+  if (res <= 0) return res;
+
+  // evaluate filter here
+  coid.cid = cid;
+  for (i=0; i < n; ++i){
+    coid.oid = oids[i];
+    filtered[i] = 0;
+    if (KVget(tx, coid, bufs[i])) continue; // leave buf unset
+    if (bufs[i]->len >= skip &&
+        !ScanFilterMatch(filter, filterlen, bufs[i]->u.buf + skip,
+                         bufs[i]->len - skip)){
+      filtered[i] = 1;
+      bufs[i] = 0;
+    }
+  }
+  return 0;
+}
+
 int KVput(KVTransaction *tx, COid coid,  char *data, int len){
   int res=-1;
   tx->readonly = 0;
@@ -448,3 +514,11 @@ int KVattrset(KVTransaction *tx, COid coid, u32 attrid, u64 attrval){
 int KVtxreadonly(KVTransaction *tx){
   return tx->readonly;
 }
+
+// return the storage server of an object (0 if storage is local)
+int KVserverOf(COid coid){
+  IPPortServerno server;
+  if (NOGAIA_BOOL || !SC) return 0;
+  SC->Od->GetServerId(coid, server);
+  return server.serverno;
+}
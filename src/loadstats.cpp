@@ -1,11 +1,8 @@
 //
 // loadstats.cpp
 //
-// Keeps statistics about access to coid's and cells within coids.
-// We keep track of all read accesses within the last StatIntervalMs ms.
-// Then, once this interval is past, we look at the statistics to find
-// coids with a large number of accesses. For those coids, we look at
-// the cell accesses to determine where they should be split.
+// Keeps statistics about access to coid's and cells within coids, to find
+// hot nodes and split them at the median accessed cell. See loadstats.h.
 //
 
 /*
@@ -49,87 +46,236 @@
 // function to be called to split a node
 void SplitNode(COid &coid, ListCellPlus *cell);
 
-static void dellcp(ListCellPlus *lc){ if (lc) delete lc; }
 static void delcoidstatkey(COidStat *cs){ if (cs) delete cs; }
 
 COidStat::~COidStat(){
-  CellStat.clear(dellcp, 0);
+  for (int i=0; i < NSample; ++i) Sample[i].Free();
 }
 
-void LoadStats::report(COid &coid, ListCellPlus *cell){ // reports an access
+LoadStats::LoadStats(){
+  PeriodStart = Time::now();
+  PeriodHits = 0;
+  PeakHits = 0;
+  Prng.SetSeed((long) PeriodStart);
+  memset(Recent, 0, sizeof(Recent));
+  NextRecent = 0;
+  memset(&LS, 0, sizeof(LS));
+}
+
+void LoadStats::report(COid &coid, ListCell &cell, Ptr<RcKeyInfo> prki){
   COidStat **csptr, *cs;
-  int res;
-  res = Stats.lookupInsert(coid, csptr);
-  if (res){ // item was created
-    *csptr = 0; // do not record exact cell for the first access. This is
-                // because we expect lots of items with a single access only
-    delete cell;
-    return;
+  int res, r;
+
+  ++PeriodHits;
+  if (Stats.getNitems() >= LOADSPLIT_MAX_COIDS){
+    // table is full: track only nodes already there
+    res = Stats.lookup(coid, csptr);
+    if (res) return;
+  } else {
+    res = Stats.lookupInsert(coid, csptr);
+    if (res){ // item was created
+      *csptr = 0; // do not record exact cell for the first access. This is
+                  // because we expect lots of items with a single access only
+      return;
+    }
   }
   if (!*csptr){
     // this is the second time this coid is accessed; create a COidStat for it
     *csptr = new COidStat;
+    (*csptr)->prki = prki;
   }
   cs = *csptr;
-
-  int *countptr;
   ++cs->Hits;
-  res = cs->CellStat.lookupInsert(cell, countptr);
-  if (res){ // item was just created
-    *countptr = 0;
+
+  // reservoir sampling: the i-th access replaces a random sample with
+  // probability LOADSPLIT_SAMPLE_CELLS/i. Seen is decayed with Hits, so
+  // recent accesses weigh more than old ones
+  ++cs->Seen;
+  if (cs->NSample < LOADSPLIT_SAMPLE_CELLS)
+    cs->Sample[cs->NSample++].copy(cell);
+  else {
+    r = (int)(Prng.next32() % (u32)cs->Seen);
+    if (r < LOADSPLIT_SAMPLE_CELLS){
+      cs->Sample[r].Free();
+      cs->Sample[r].copy(cell);
+    }
   }
-  ++*countptr; // bump counter for cell
 }
 
-// check if period is done. If so, find heavy hitters, call the splitter and
-// start new period.
+// accesses per period that a server thread can take
+int LoadStats::capacity(void){
+#if LOADSPLIT_CAPACITY > 0
+  return (int)((u64)LOADSPLIT_CAPACITY * LOADSPLIT_INTERVAL_MS / 1000);
+#else
+  return PeakHits;
+#endif
+}
+
+// Request a load split of coid at the median of the sampled cells, and
+// remember it to report later how the load redistributed
+void LoadStats::splitHot(COid &coid, COidStat *cs, int rate){
+  ListCellPlus *sorted[LOADSPLIT_SAMPLE_CELLS], *tmp;
+  int i, j, n;
+
+  n = cs->NSample;
+  if (n < 2) return;
+  // sort sampled cells (insertion sort, since there are only a few)
+  for (i=0; i < n; ++i){
+    tmp = new ListCellPlus(cs->Sample[i], cs->prki);
+    for (j=i; j > 0 && ListCellPlus::cmp(*sorted[j-1], *tmp) > 0; --j)
+      sorted[j] = sorted[j-1];
+    sorted[j] = tmp;
+  }
+  // sorted[n/2] is the first cell of the second half of the split.
+  // If it is also the first sampled cell, a few keys get most accesses; split
+  // right after the hottest one of them instead
+  i = n/2;
+  if (ListCellPlus::cmp(*sorted[0], *sorted[i]) == 0){
+    for (i = n/2+1; i < n; ++i)
+      if (ListCellPlus::cmp(*sorted[i-1], *sorted[i]) != 0) break;
+  }
+  if (i < n){
+#ifndef DISABLE_NODESPLITS
+    SplitNode(coid, sorted[i]); // SplitNode owns sorted[i]
+    sorted[i] = 0;
+#endif
+    ++LS.nsplits;
+    Recent[NextRecent].coid = coid;
+    Recent[NextRecent].rateBefore = rate;
+    Recent[NextRecent].periods = 0;
+    NextRecent = (NextRecent + 1) % LOADSPLIT_TRACK_SPLITS;
+    dprintf(1, "LOADSPLIT %016llx:%016llx rate %d capacity %d",
+            (long long)coid.cid, (long long)coid.oid, rate, capacity());
+  }
+  for (j=0; j < n; ++j) if (sorted[j]) delete sorted[j];
+}
+
+// One period after a load split, report the percentage of the load that
+// stayed in the split node. Ideally, the split node keeps half
+void LoadStats::reportSplits(void){
+  COidStat **csptr;
+  LoadSplitRecord *lsr;
+  int i, rateafter, percent;
+
+  for (i=0; i < LOADSPLIT_TRACK_SPLITS; ++i){
+    lsr = &Recent[i];
+    if (lsr->rateBefore == 0) continue; // unused entry
+    if (lsr->periods++ < 1) continue; // split happened during last period
+    if (!Stats.lookup(lsr->coid, csptr) && *csptr) rateafter = (*csptr)->Hits;
+    else rateafter = 0;
+    percent = (int)((i64)rateafter * 100 / lsr->rateBefore);
+    ++LS.nreported;
+    LS.sumRemainPercent += percent;
+    dprintf(1, "LOADSPLIT %016llx:%016llx rate %d -> %d (%d%% stayed)",
+            (long long)lsr->coid.cid, (long long)lsr->coid.oid,
+            lsr->rateBefore, rateafter, percent);
+    lsr->rateBefore = 0;
+  }
+}
+
+// Decays counters by LOADSPLIT_DECAY_PERCENT once per period that elapsed,
+// dropping coids whose counters reach 0
+void LoadStats::decay(int nperiods){
+  SkipListNode<COid,COidStat*> *ptr, *next;
+  COidStat *cs;
+  COid coid;
+  int i;
+
+  if (nperiods > 16){ // everything decays to 0
+    Stats.clear(0, delcoidstatkey);
+    return;
+  }
+  for (ptr = Stats.getFirst(); ptr != Stats.getLast(); ptr = next){
+    next = Stats.getNext(ptr);
+    cs = ptr->value;
+    if (cs){
+      for (i=0; i < nperiods; ++i){
+        cs->Hits = (int)((i64)cs->Hits * LOADSPLIT_DECAY_PERCENT / 100);
+        cs->Seen = (int)((i64)cs->Seen * LOADSPLIT_DECAY_PERCENT / 100);
+      }
+      if (cs->Seen < cs->NSample) cs->Seen = cs->NSample;
+      if (cs->Hits > 0) continue;
+    }
+    coid = ptr->key;
+    Stats.lookupRemove(coid, 0, cs);
+    if (cs) delete cs;
+  }
+}
+
+// check if period is done. If so, find hot nodes, call the splitter, decay
+// counters, and start new period.
 // Returns 0 if period continues, non-zero if new period started
 int LoadStats::check(void){
   u64 now;
-  ListCellPlus *cell;
+  int nperiods, rate, threshold, hot;
   now = Time::now();
-  if (now-PeriodStart < StatIntervalMs) return 0;
+  if (now-PeriodStart < LOADSPLIT_INTERVAL_MS) return 0;
+  nperiods = (int)((now-PeriodStart) / LOADSPLIT_INTERVAL_MS);
 
-  // iterate over Stats finding heavy hitters
-  SkipListNode<COid,COidStat*> *ptr;
+  // update estimate of capacity. The peak decays slowly so that the
+  // estimate recovers from outliers
+  PeakHits -= PeakHits / 100;
+  if (PeriodHits > PeakHits) PeakHits = PeriodHits;
+
+  reportSplits();
+
+  // A node is hot if its access rate is above a fraction of the capacity.
+  // Hits is a decayed sum; in steady state it is the rate per period
+  // divided by (1-decay)
+  threshold = (int)((i64)capacity() * LOADSPLIT_HOT_PERCENT / 100);
+  if (threshold < LOADSPLIT_MIN_RATE * LOADSPLIT_INTERVAL_MS / 1000)
+    threshold = LOADSPLIT_MIN_RATE * LOADSPLIT_INTERVAL_MS / 1000;
+
+  SkipListNode<COid,COidStat*> *ptr, *next;
   COidStat *cs;
-    
-  for (ptr = Stats.getFirst(); ptr != Stats.getLast();
-       ptr = Stats.getNext(ptr)){
+  COid coid;
+  hot = 0;
+  for (ptr = Stats.getFirst(); ptr != Stats.getLast(); ptr = next){
+    next = Stats.getNext(ptr);
     cs = ptr->value;
-    if (cs && cs->Hits > HeavyHitterThreshold){
-      SkipListNodeBK<ListCellPlus,int> *nptr;
-      int hitthres = cs->Hits / 2;
-      int count = 0;
-      for (nptr = cs->CellStat.getFirst(); nptr != cs->CellStat.getLast();
-           nptr = cs->CellStat.getNext(nptr)){
-	count += nptr->value;
-	if (count >= hitthres)
-          break; // stop when we are past half the number of hits
-      }
-      assert(count >= hitthres);
-      // nptr points to ListCellPlus where split should happen. The cell
-      // pointed to is the first cell of the second half of the split.
-
-      // split coid ptr->key at cell nptr->key
-#ifndef DISABLE_NODESPLITS
-      // clone the listcellplus and its RcKeyInfo
-      cell = new ListCellPlus(*nptr->key, nptr->key->pprki.getprki());
-      SplitNode(ptr->key, cell);
-#endif      
+    if (!cs) continue;
+    rate = (int)((i64)cs->Hits * (100 - LOADSPLIT_DECAY_PERCENT) / 100);
+    if (rate > threshold){
+      ++hot;
+      coid = ptr->key;
+      splitHot(coid, cs, rate);
+      // start afresh, so that the node is not split again before its
+      // counters reflect the split
+      Stats.lookupRemove(coid, 0, cs);
+      delete cs;
     }
   }
 
-  // clear up everything for new period
-  Stats.clear(0, delcoidstatkey);
+  decay(nperiods);
+  LS.hotNodes = hot;
+  LS.capacity = capacity();
+  LS.tracked = Stats.getNitems();
+  PeriodHits = 0;
   PeriodStart = now;
   return -1;
 }
 
+// whether coid is at least half as loaded as a hot node. Used to avoid
+// merging nodes that a load split has just separated
+bool LoadStats::isHot(COid &coid){
+  COidStat **csptr;
+  int threshold;
+  if (Stats.lookup(coid, csptr) || !*csptr) return false;
+  threshold = (int)((i64)capacity() * LOADSPLIT_HOT_PERCENT / 100);
+  if (threshold < LOADSPLIT_MIN_RATE * LOADSPLIT_INTERVAL_MS / 1000)
+    threshold = LOADSPLIT_MIN_RATE * LOADSPLIT_INTERVAL_MS / 1000;
+  return (i64)(*csptr)->Hits * (100 - LOADSPLIT_DECAY_PERCENT) / 100 >
+    threshold / 2;
+}
+
 // prints all stats
 void LoadStats::print(void){
   u64 now = Time::now();
-  printf("Age %lld\n", (long long) (now-PeriodStart));
+  printf("Age %lld capacity %d hot %d splits %lld", (long long)(now-PeriodStart),
+         capacity(), LS.hotNodes, (long long)LS.nsplits);
+  if (LS.nreported)
+    printf(" stayed %lld%%", (long long)(LS.sumRemainPercent / LS.nreported));
+  putchar('\n');
     
   // iterate over Stats
   SkipListNode<COid,COidStat*> *ptr;
@@ -143,14 +289,9 @@ void LoadStats::print(void){
     cs = ptr->value;
     if (!cs){ printf("\n"); continue; } // no further data
     printf(" %d [", cs->Hits);
-    SkipListNodeBK<ListCellPlus,int> *nptr;
-    int notfirst=0;
-    for (nptr = cs->CellStat.getFirst(); nptr != cs->CellStat.getLast();
-         nptr = cs->CellStat.getNext(nptr)){
-      if (notfirst) printf(", ");
-      else notfirst = 1;
-      nptr->key->printShort(false, false);
-      printf(":%d", nptr->value);
+    for (int i=0; i < cs->NSample; ++i){
+      if (i) printf(", ");
+      printf("%llx", (long long)cs->Sample[i].nKey);
     }
     printf("]\n");
   }
@@ -162,7 +303,6 @@ int main(){
   int i, j, k, l;
   LoadStats ls;
   ListCell lc;
-  ListCellPlus *lcptr;
   COid coid;
   int res;
   
@@ -183,8 +323,7 @@ int main(){
       lc.nKey = Time::now() % j;
       lc.pKey = 0;
       lc.value = 0;
-      lcptr = new ListCellPlus(lc,(RcKeyInfo*)0);
-      ls.report(coid, lcptr);
+      ls.report(coid, lc, Ptr<RcKeyInfo>());
     }
   }
 
@@ -56,12 +56,15 @@
 #include <map>
 #include <list>
 #include <set>
+#include <vector>
 
 #include "tmalloc.h"
 #include "os.h"
 #include "options.h"
 #include "debug.h"
 #include "logmem.h"
+#include "coldstore.h"
+#include "newconfig.h"
 #include "storageserver.h"
 
 using namespace std;
@@ -94,6 +97,7 @@ void LogOneObjectInMemory::printdetail(COid &coid, bool locklooim){
 
   if (locklooim) lock();
   printf(" LastRead %llx\n", (long long)LastRead.getd1());
+  if (Cold) printf(" cold ts %llx\n", (long long)ColdTs.getd1());
   if (logentries.empty()){ printf(" logentries empty\n"); }
   else {
     printf(" logentries-------------\n");
@@ -197,7 +201,10 @@ LogInMemory::LogInMemory(DiskStorage *ds) :
 LogInMemory::LogInMemory(DiskStorage *ds) :
   COidMap(COID_CACHE_HASHTABLE_SIZE_LOCAL)   
 #endif
-{ DS = ds; SingleVersion = false; }
+{
+  DS = ds; SingleVersion = false; NObjects = 0; NVersions = 0;
+  Cold = 0; ResidentBytes = 0; NCold = 0;
+}
 
 void LogInMemory::getAndLockaux(int res, LogOneObjectInMemory **looimptr){
   if (res) *looimptr = new LogOneObjectInMemory; // not found, so create object
@@ -218,9 +225,15 @@ LogOneObjectInMemory *LogInMemory::getAndLock(COid& coid, bool writelock,
 
   res = COidMap.lookupInsert(coid, looimptr, getAndLockaux);
   looim = *looimptr;
+  looim->Referenced = 1;
   if (res==0){ // object found
     if (writelock) looim->lock();
     else looim->lockRead();
+    if (looim->Cold){
+      if (!writelock){ looim->unlockRead(); looim->lock(); }
+      faultIn(coid, looim);
+      if (!writelock){ looim->unlock(); looim->lockRead(); }
+    }
     return looim;
   }
 
@@ -233,6 +246,7 @@ LogOneObjectInMemory *LogInMemory::getAndLock(COid& coid, bool writelock,
                                                             // as requested
     return looim;
   }
+  AtomicInc64(&NObjects);
   
   // try to read object from disk
   size = DS->getCOidSize(coid);
@@ -255,6 +269,7 @@ LogOneObjectInMemory *LogInMemory::getAndLock(COid& coid, bool writelock,
 
     // insert one item into list
     looim->logentries.pushTail(sleim);
+    AtomicInc64(&NVersions);
   } else {
     if (createfirstlog){  // create a first log entry
       sleim = new SingleLogEntryInMemory;
@@ -268,6 +283,7 @@ LogOneObjectInMemory *LogInMemory::getAndLock(COid& coid, bool writelock,
       sleim->tucoid = new TxUpdateCoid(twi);
       sleim->ts.setLowest(); 
       looim->logentries.pushTail(sleim);
+      AtomicInc64(&NVersions);
     }
   }
 #if (SYNC_TYPE != 3)
@@ -278,6 +294,120 @@ LogOneObjectInMemory *LogInMemory::getAndLock(COid& coid, bool writelock,
   return looim;
 }
 
+void LogInMemory::faultIn(COid &coid, LogOneObjectInMemory *looim){
+  SingleLogEntryInMemory *sleim;
+  Ptr<TxUpdateCoid> tucoid;
+  int res;
+
+  if (!looim->Cold) return; // brought back by someone else
+  assert(looim->logentries.empty());
+  res = Cold->get(coid, looim->ColdOffset, looim->ColdLen, tucoid);
+  assert(res==0);
+  sleim = new SingleLogEntryInMemory;
+  sleim->ts = looim->ColdTs;
+  sleim->flags = 0;
+  sleim->tucoid = tucoid;
+  looim->logentries.pushTail(sleim);
+  looim->Cold = false;
+  looim->Size = estimateSize(tucoid);
+  AtomicInc64(&NVersions);
+  AtomicDec64(&NCold);
+  FetchAndAdd64(&ResidentBytes, looim->Size);
+}
+
+int LogInMemory::evict(LogOneObjectInMemory *looim){
+  SingleLogEntryInMemory *sleim;
+  u64 offset;
+  u32 len;
+  int res;
+
+  if (!looim->pendingentries.empty()) return -1;
+  if (looim->logentries.getNitems() != 1) return -1;
+  sleim = looim->logentries.getFirst();
+  if (!sleim->tucoid->Writevalue && !sleim->tucoid->WriteSV) return -1;
+
+  // the copy in the cold store can be reused if the object has not changed
+  // since it was brought back
+  if (!looim->ColdLen || Timestamp::cmp(looim->ColdTs, sleim->ts) != 0){
+    res = Cold->put(sleim->tucoid, &offset, &len);
+    if (res) return -1;
+    if (looim->ColdLen) Cold->release(looim->ColdLen);
+    looim->ColdOffset = offset;
+    looim->ColdLen = len;
+    looim->ColdTs = sleim->ts;
+  }
+  looim->logentries.popHead();
+  delete sleim;
+  looim->Cold = true;
+  FetchAndAdd64(&ResidentBytes, -(i64)looim->Size);
+  looim->Size = 0;
+  AtomicDec64(&NVersions);
+  AtomicInc64(&NCold);
+  return 0;
+}
+
+// Visits every object in memory once, remeasuring its size, and evicts
+// objects not accessed since the previous sweep while over budget. This
+// is a single-handed clock: the Referenced bit of an object gives it a
+// second chance.
+int LogInMemory::sweepColdTier(u64 budget){
+  std::vector<COid> keys;
+  LogOneObjectInMemory *looim;
+  SingleLogEntryInMemory *sleim;
+  int nbuckets, i, res, nevicted=0;
+  unsigned j;
+  u32 size;
+
+  assert(Cold);
+  nbuckets = COidMap.GetNbuckets();
+  for (i=0; i < nbuckets; ++i){
+    keys.clear();
+    COidMap.getBucketKeys(i, keys);
+    for (j=0; j < keys.size(); ++j){
+      res = COidMap.lookup(keys[j], looim);
+      if (res) continue;
+      looim->lock();
+      if (!looim->Cold){
+        size = 0;
+        for (sleim = looim->logentries.getFirst();
+             sleim != looim->logentries.getLast();
+             sleim = looim->logentries.getNext(sleim))
+          size += estimateSize(sleim->tucoid);
+        FetchAndAdd64(&ResidentBytes, (i64)size - (i64)looim->Size);
+        looim->Size = size;
+        if (ResidentBytes > budget && !looim->Referenced &&
+            evict(looim) == 0)
+          ++nevicted;
+        looim->Referenced = 0;
+      }
+      looim->unlock();
+    }
+  }
+  return nevicted;
+}
+
+u32 LogInMemory::estimateSize(Ptr<TxUpdateCoid> tucoid){
+  TxWriteSVItem *twsvi;
+  SkipListNodeBK<ListCellPlus,int> *ptr;
+  u32 size = sizeof(SingleLogEntryInMemory) + sizeof(TxUpdateCoid);
+
+  if (tucoid->Writevalue)
+    size += sizeof(TxWriteItem) + tucoid->Writevalue->len;
+  else if (tucoid->WriteSV){
+    twsvi = tucoid->WriteSV;
+    size += sizeof(TxWriteSVItem) + twsvi->nattrs * sizeof(u64) +
+      twsvi->cells.getNitems() *
+      (sizeof(ListCellPlus) + sizeof(SkipListNodeBK<ListCellPlus,int>));
+    if (twsvi->celltype != 0){ // cells have keys
+      for (ptr = twsvi->cells.getFirst(); ptr != twsvi->cells.getLast();
+           ptr = twsvi->cells.getNext(ptr))
+        size += (u32) ptr->key->nKey;
+    }
+  }
+  size += tucoid->Litems.getNitems() * sizeof(TxListAddItem);
+  return size;
+}
+
 #ifndef NDEBUG
 static int checkTucoid(Ptr<TxUpdateCoid> tucoid){
   int i;
@@ -359,6 +489,7 @@ int LogInMemory::gClog(LogOneObjectInMemory *looim, Timestamp ts){
     delete sleim;
     sleim = looim->logentries.getFirst();
   }
+  FetchAndAdd64(&NVersions, -(i64)ndeleted);
   return ndeleted;
 }
 
@@ -614,6 +745,7 @@ int LogInMemory::readCOid(COid& coid, Timestamp ts,
         //toadd->pending = false;
         toadd->tucoid = tucoid;
         looim->logentries.addBefore(toadd, sleim);
+        AtomicInc64(&NVersions);
         //assert(checklog(looim->logentries));
       }
     }
@@ -652,6 +784,36 @@ int LogInMemory::writeCOid(COid& coid, Timestamp ts, Ptr<TxUpdateCoid> tucoid){
   return 0;
 }
 
+// Installs a version of an object without reading the object from disk
+// when it is not in memory. Used when loading a snapshot, which supersedes
+// what is on disk.
+int LogInMemory::installCOid(COid& coid, Timestamp ts,
+                             Ptr<TxUpdateCoid> tucoid){
+  LogOneObjectInMemory *looim, **looimptr;
+  int res;
+
+  assert(tucoid->Writevalue&&!tucoid->WriteSV ||
+         !tucoid->Writevalue&&tucoid->WriteSV);
+  assert(tucoid->Litems.getNitems()==0);
+
+  res = COidMap.lookupInsert(coid, looimptr, getAndLockaux);
+  looim = *looimptr;
+  if (res) AtomicInc64(&NObjects); // object not found, so it was created
+  looim->lock();
+  if (looim->Cold) faultIn(coid, looim);
+  auxAddSleimToLogentries(looim, ts, true, tucoid);
+  looim->unlock();
+  return 0;
+}
+
+int LogInMemory::applyCOid(COid& coid, Timestamp ts, Ptr<TxUpdateCoid> tucoid){
+  LogOneObjectInMemory *looim;
+  looim = getAndLock(coid, true, false);
+  auxAddSleimToLogentries(looim, ts, true, tucoid);
+  looim->unlock();
+  return 0;
+}
+
 // Wakes up deferred RPCs in the waiting list of a sleim or move them to the
 // sleim of another pending entry, based on the ts of the waiting list item.
 // If that ts is < than all pending entries (though it suffices to check the
@@ -760,55 +922,6 @@ void LogInMemory::flushToDisk(Timestamp &ts){
 }
 
 
-// flushes all entries in memory to file.
-// Returns 0 if ok, non-zero if error.
-int LogInMemory::flushToFile(Timestamp &ts, char *flushfilename){
-  int res, size;
-  char *filename;
-  FILE *f=0;
-  int retval=0;
-  Ptr<TxUpdateCoid> tucoid;
-  int nbuckets, i;
-  SkipList<COid, LogOneObjectInMemory*> *bucket;
-  SkipListNode<COid, LogOneObjectInMemory*> *ptr;
-
-  filename = flushfilename;
-  f = fopen(filename, "wbS");
-  if (!f){
-    dprintf(1, "flushToFile: error opening file %s for writing", filename);
-    goto error;
-  }
-  //delete [] filename;
-
-  // iterate over all oids in memory
-  nbuckets = COidMap.GetNbuckets();
-  for (i=0; i < nbuckets; ++i){
-    bucket = COidMap.GetBucket(i);
-    for (ptr = bucket->getFirst(); ptr != bucket->getLast();
-         ptr = bucket->getNext(ptr)){
-      // read entire oid
-      size = readCOid(ptr->key, ts, tucoid, 0, 0);
-      if (size >= 0){
-        // write coid
-        res = (int) fwrite((void*)&ptr->key, 1, sizeof(COid), f);
-        if (res != sizeof(COid)) goto error;
-  
-        res = DS->writeCOidToFile(f, tucoid);
-        if (res) goto error;
-      }
-    }
-  }
-
- end:
-  if (f) fclose(f);
-  return retval;
-
- error:
-  retval = -1;
-  goto end;
-}
-
-
 // load contents of disk into memory cache
 void LogInMemory::loadFromDisk(void){
   char *dirname;
@@ -879,40 +992,144 @@ void LogInMemory::loadFromDisk(void){
   if (pathname) free(pathname);
 }
 
-// load contents of disk into memory cache
-int LogInMemory::loadFromFile(char *flushfilename){
-  int res;
-  COid coid;
-  char *filename;
-  Timestamp ts;
-  FILE *f=0;
-  int retval = 0;
+// count pending entries of objects in the selected buckets
+u64 LogInMemory::countPending(u8 *inbucket){
+  int nbuckets, i;
+  u64 count=0;
+  SkipList<COid, LogOneObjectInMemory*> *bucket;
+  SkipListNode<COid, LogOneObjectInMemory*> *ptr;
+  LogOneObjectInMemory *looim;
+  SingleLogEntryInMemory *sleim;
+
+  nbuckets = COidMap.GetNbuckets();
+  for (i=0; i < nbuckets; ++i){
+    bucket = COidMap.GetBucket(i);
+    for (ptr = bucket->getFirst(); ptr != bucket->getLast();
+         ptr = bucket->getNext(ptr)){
+      if (!inbucket[PLACEMENT_BUCKET(ptr->key.oid)]) continue;
+      looim = ptr->value;
+      looim->lockRead();
+      for (sleim = looim->pendingentries.getFirst();
+           sleim != looim->pendingentries.getLast();
+           sleim = looim->pendingentries.getNext(sleim))
+        ++count;
+      looim->unlockRead();
+    }
+  }
+  return count;
+}
+
+// Serialize the latest version of objects in the selected buckets. For each
+// object, the format is coid, timestamp of version, largest read timestamp,
+// followed by the object in the format of DiskStorage::writeCOidToFile.
+// Returns 0 if ok, non-0 if error.
+int LogInMemory::exportBuckets(u8 *inbucket, char **retbuf, int *retlen,
+                               u64 *retcount){
+  int res, size;
+  FILE *f;
+  char *buf=0;
+  long len=0;
+  int retval=0;
+  u64 count=0;
+  Timestamp ts, readts, lastread;
   Ptr<TxUpdateCoid> tucoid;
+  int nbuckets, i;
+  SkipList<COid, LogOneObjectInMemory*> *bucket;
+  SkipListNode<COid, LogOneObjectInMemory*> *ptr;
+  LogOneObjectInMemory *looim;
 
-  filename = flushfilename;
+  // serialize into a temporary file, since DiskStorage writes to a FILE
+  f = tmpfile();
+  if (!f) return -1;
 
-  f = fopen(filename, "r");
-  if (!f){
-    dprintf(1, "loadFromFile: error opening file %s for reading", filename);
-    goto error;
+  ts.setIllegal(); // read latest version
+  nbuckets = COidMap.GetNbuckets();
+  for (i=0; i < nbuckets; ++i){
+    bucket = COidMap.GetBucket(i);
+    for (ptr = bucket->getFirst(); ptr != bucket->getLast();
+         ptr = bucket->getNext(ptr)){
+      if (!inbucket[PLACEMENT_BUCKET(ptr->key.oid)]) continue;
+      looim = ptr->value;
+      looim->lockRead();
+      lastread = looim->LastRead;
+      looim->unlockRead();
+
+      size = readCOid(ptr->key, ts, tucoid, &readts, 0);
+      if (size < 0) continue; // object has no readable version
+      if (Timestamp::cmp(lastread, readts) < 0) lastread = readts;
+      res = (int) fwrite((void*)&ptr->key, 1, sizeof(COid), f);
+      if (res != sizeof(COid)) goto error;
+      res = (int) fwrite((void*)&readts, 1, sizeof(Timestamp), f);
+      if (res != sizeof(Timestamp)) goto error;
+      res = (int) fwrite((void*)&lastread, 1, sizeof(Timestamp), f);
+      if (res != sizeof(Timestamp)) goto error;
+      res = DS->writeCOidToFile(f, tucoid);
+      if (res) goto error;
+      ++count;
+    }
   }
-  //delete [] filename;
 
-  ts.setNew();
+  // read serialized data into buffer
+  len = ftell(f);
+  if (len < 0) goto error;
+  buf = (char*) malloc(len ? len : 1);
+  rewind(f);
+  if ((long) fread(buf, 1, len, f) != len) goto error;
+
+ end:
+  fclose(f);
+  if (retval){ if (buf) free(buf); buf = 0; len = 0; }
+  *retbuf = buf;
+  *retlen = (int) len;
+  *retcount = count;
+  return retval;
+
+ error:
+  retval = -1;
+  goto end;
+}
+
+// Load objects serialized by exportBuckets, keeping their version timestamps
+// and raising their largest read timestamps, so that transactions that
+// commit here later are serialized after those that read from the old owner.
+// Returns 0 if ok, non-0 if error.
+int LogInMemory::importBuckets(char *buf, int len, u64 *retcount){
+  int res;
+  COid coid;
+  Timestamp readts, lastread;
+  FILE *f;
+  int retval=0;
+  u64 count=0;
+  Ptr<TxUpdateCoid> tucoid;
+  LogOneObjectInMemory *looim;
+
+  *retcount = 0;
+  if (len == 0) return 0;
+  f = fmemopen(buf, len, "r");
+  if (!f) return -1;
 
   while (!feof(f)){
-    // read one object
-    res = (int)fread((void*)&coid, 1, sizeof(COid), f); // coid
-    if (res == 0){ 
+    res = (int)fread((void*)&coid, 1, sizeof(COid), f);
+    if (res == 0){
       if (!feof(f)) goto error;
       continue;
     }
     if (res != sizeof(COid)) goto error;
+    res = (int)fread((void*)&readts, 1, sizeof(Timestamp), f);
+    if (res != sizeof(Timestamp)) goto error;
+    res = (int)fread((void*)&lastread, 1, sizeof(Timestamp), f);
+    if (res != sizeof(Timestamp)) goto error;
     res = DS->readCOidFromFile(f, coid, tucoid); if (res) goto error;
-    res = writeCOid(coid, ts, tucoid); if (res) goto error;
+    res = writeCOid(coid, readts, tucoid); if (res) goto error;
+    looim = getAndLock(coid, true, false);
+    if (Timestamp::cmp(looim->LastRead, lastread) < 0)
+      looim->LastRead = lastread;
+    looim->unlock();
+    ++count;
   }
  end:
-  if (f) fclose(f);
+  fclose(f);
+  *retcount = count;
   return retval;
  error:
   retval = -1;
@@ -94,6 +94,7 @@
 extern StorageConfig *SC;
 
 #include "util-more.h"
+#include "servermetrics.h"
 
 extern StorageServerState *S; // defined in storageserver.c
 
@@ -118,12 +119,16 @@ RPCProc RPCProcs[] = {  nullRpcStub,         // RPC 0
                         loadfileRpcStub,     // RPC 15
                         inbacRpcStub,        // RPC 16
                         inbacmessageRpcStub,  // RPC 17
-                        consmessageRpcStub   // RPC 18
-
+                        consmessageRpcStub,  // RPC 18
 #ifdef STORAGESERVER_SPLITTER
-                        ,
-                        ss_getrowidRpcStub   // RPC 19
+                        ss_getrowidRpcStub,  // RPC 19
+#else
+                        nullRpcStub,         // RPC 19 (unused)
 #endif
+                        directoryRpcStub,    // RPC 20
+                        migrateRpcStub,      // RPC 21
+                        replicateRpcStub,    // RPC 22
+                        filterreadRpcStub    // RPC 23
                      };
 
 struct ConsoleCmdMap {
@@ -142,11 +147,16 @@ int cmd_print_detail(char *parm, StorageServerState *sss);
 int cmd_splitter(char *parm, StorageServerState *sss);
 int cmd_quit(char *parm, StorageServerState *sss);
 int cmd_debug(char *parm, StorageServerState *sss);
+int cmd_disklog(char *parm, StorageServerState *sss);
+int cmd_repl(char *parm, StorageServerState *sss);
+int cmd_stats(char *parm, StorageServerState *sss);
 int cmd_leakcheck(char *parm, StorageServerState *sss);
 
 
 ConsoleCmdMap ConsoleCmds[] = {
   {"debug", " n:         set debug level to n", cmd_debug},
+  {"disklog", ":         show group commit statistics of disk log",
+   cmd_disklog},
   {"help", ":            show this message", cmd_help},
   {"load_individual", ": load contents from disk", cmd_load},
   {"load", " filename:   load contents from file", cmd_loadfile},
@@ -155,6 +165,8 @@ ConsoleCmdMap ConsoleCmds[] = {
   {"save_individual", ": flush contents to disk", cmd_flush},
   {"save", " filename:   flush contents to file", cmd_flushfile},
   {"splitter", ":        start splitter", cmd_splitter},
+  {"repl", ":            show replication statistics", cmd_repl},
+  {"stats", ":           show metrics of server", cmd_stats},
   {"quit", ":            quit server", cmd_quit},
 #ifdef VALG_LEAK
   {"vchk", ":            run valgrind's leak check", cmd_leakcheck},
@@ -263,6 +275,24 @@ int cmd_debug(char *parm, StorageServerState *S){
   return 0;
 }
 
+int cmd_disklog(char *parm, StorageServerState *S){
+  S->cDiskLog.printStats();
+  return 0;
+}
+
+int cmd_repl(char *parm, StorageServerState *S){
+  S->cRepl.printStats();
+  return 0;
+}
+
+int cmd_stats(char *parm, StorageServerState *S){
+  ServerMetrics *m = new ServerMetrics;
+  getServerMetrics(m);
+  m->print();
+  delete m;
+  return 0;
+}
+
 int cmd_leakcheck(char *parm, StorageServerState *S){
 #ifdef VALG_LEAK
   VALGRIND_DO_ADDED_LEAK_CHECK;
@@ -342,6 +372,9 @@ protected:
 public:
   RPCServerGaia(RPCProc *procs, int nprocs, int portno) : RPCTcp() {
     launch(SERVER_WORKERTHREADS);
+#ifdef SERVER_METRICS
+    setRequestObserver(ServerMetricsRequestObserver, 0);
+#endif
     registerNewServer(procs, nprocs, portno);
   }
 };
@@ -369,14 +402,22 @@ int main(int argc, char **argv)
   int uselogfile=0;
   int setdebug=0;
   int skipsplitter=0;
+  int nactive=0;
+  int backupof=-1;
+  int nbackups=0;
+  char *backupnames[REPL_MAX_BACKUPS];
   char *loadfilename=0;
   char *logfilename=0;
+  int budgetmb=0;
 
   srand((unsigned)time(0));
 
   badargs=0;
-  while ((c = getopt(argc,argv, "cd:g:l:o:s")) != -1){
+  while ((c = getopt(argc,argv, "b:cd:g:l:m:n:o:r:s")) != -1){
     switch(c){
+    case 'b':
+      backupof = atoi(optarg);
+      break;
     case 'c':
       useconsole = 1;
       break;
@@ -394,10 +435,25 @@ int main(int argc, char **argv)
       loadfilename = (char*) malloc(strlen(optarg)+1);
       strcpy(loadfilename, optarg);
       break;
+    case 'm':
+      budgetmb = atoi(optarg);
+      break;
+    case 'n':
+      nactive = atoi(optarg);
+      break;
     case 'o':
       Configfile = (char*) malloc(strlen(optarg)+1);
       strcpy(Configfile, optarg);
       break;
+    case 'r':
+      if (nbackups == REPL_MAX_BACKUPS){
+        fprintf(stderr, "Too many backups (max %d)\n", REPL_MAX_BACKUPS);
+        ++badargs;
+        break;
+      }
+      backupnames[nbackups] = (char*) malloc(strlen(optarg)+1);
+      strcpy(backupnames[nbackups++], optarg);
+      break;
     case 's':
       skipsplitter = 1;
       break;
@@ -419,13 +475,22 @@ int main(int argc, char **argv)
     myport = atoi(argv[optind]);
     break;
   default:
-    fprintf(stderr, "usage: %s [-cgs] [-d debuglevel] [-l filename] "
-                        "[-o configfile] [-g logfile] [portno]\n", argv[0]);
+    fprintf(stderr, "usage: %s [-cgs] [-b serverno] [-d debuglevel] "
+                        "[-l filename] [-m megabytes] [-n nactive]\n"
+                        "          [-o configfile] [-g logfile] "
+                        "[-r host:port]... [portno]\n",
+            argv[0]);
+    fprintf(stderr, "   -b  run as a backup of the given server, serving follower reads\n");
     fprintf(stderr, "   -c  enable console\n");
     fprintf(stderr, "   -d  set debuglevel to given value\n");
     fprintf(stderr, "   -g  use log file\n");
     fprintf(stderr, "   -l  load state from given file\n");
+    fprintf(stderr, "   -m  keep about this many megabytes of objects in memory, evicting\n");
+    fprintf(stderr, "       objects not accessed recently to a memory-mapped file\n");
+    fprintf(stderr, "   -n  place objects only on the first nactive servers of the config file\n");
+    fprintf(stderr, "       (the others start empty and get objects with \"callserver resize\")\n");
     fprintf(stderr, "   -o  use given configuration file\n");
+    fprintf(stderr, "   -r  replicate to the backup at host:port (may be repeated)\n");
     fprintf(stderr, "   -s  do not start splitter (storageserver-splitter version)\n");
     fprintf(stderr, "       This is useful with more than one server, in which case it may be better\n");
     fprintf(stderr, "       to start the splitter remotely after all servers have started already,\n");
@@ -493,12 +558,71 @@ int main(int argc, char **argv)
   RPCServer = new RPCServerGaia(RPCProcs, sizeof(RPCProcs)/sizeof(RPCProc),
                                 myrealport);
 
+  // install initial placement directory, where bucket b belongs to server
+  // b % nactive. All servers must be started with the same nactive.
+  for (int i=0; i < cs->Nservers; ++i)
+    if (IPPort::cmp(cs->Servers[i]->ipport, hc->ipport) == 0) S->MyServerno = i;
+  if (backupof >= 0){
+    if (S->MyServerno >= 0 || backupof >= cs->Nservers || nbackups){
+      fprintf(stderr, "Backup must be a host of the config file that is not "
+              "a server, and backup of a valid server\n");
+      exit(1);
+    }
+    // backup owns the same buckets as its primary
+    S->MyServerno = backupof;
+    S->cRepl.setBackupOf(backupof);
+    printf("Backup of server %d\n", backupof);
+  }
+  for (int i=0; i < nbackups; ++i){
+    char *colon = strrchr(backupnames[i], ':');
+    IPPort backupipport;
+    u32 backupip;
+    if (!colon){
+      fprintf(stderr, "Backup %s must be given as host:port\n",
+              backupnames[i]);
+      exit(1);
+    }
+    *colon = 0;
+    backupip = IPMisc::resolveName(backupnames[i], cs->PreferredIP,
+                                   cs->PreferredIPMask);
+    backupipport.set(backupip, htons(atoi(colon+1)));
+    S->cRepl.addBackup(backupipport);
+    printf("Replicating to %s:%s\n", backupnames[i], colon+1);
+    free(backupnames[i]);
+  }
+  if (nactive <= 0 || nactive > cs->Nservers) nactive = cs->Nservers;
+  if (S->MyServerno >= 0){
+    PlacementDir *dir = new PlacementDir;
+    dir->setDefault(nactive, cs->Nservers, 1);
+    S->setDirectory(dir);
+    delete dir;
+    printf("Server number %d, active servers %d\n", S->MyServerno, nactive);
+  }
+
   if (loadfile){
     printf("Load state from file %s...", loadfilename); fflush(stdout);
     S->cLogInMemory.loadFromFile(loadfilename);
     putchar('\n'); fflush(stdout);
   }
 
+  if (budgetmb > 0){
+    // the cold tier goes next to the store directory
+    char *coldname = (char*) malloc(strlen(hc->storedir)+6);
+    strcpy(coldname, hc->storedir);
+    while (strlen(coldname) > 1 && coldname[strlen(coldname)-1] == '/')
+      coldname[strlen(coldname)-1] = 0;
+    strcat(coldname, ".cold");
+    if (S->cColdStore.open(coldname, &S->cDiskStorage)){
+      fprintf(stderr, "Cannot create cold tier file %s\n", coldname);
+      exit(1);
+    }
+    S->cColdStore.launch(&S->cLogInMemory, (u64) budgetmb << 20);
+    printf("Memory budget %d MB, cold tier %s\n", budgetmb, coldname);
+    free(coldname);
+  }
+
+  S->cRepl.launch(&RPCServer);
+
   //RPCServer->launch(0);
   mssleep(1000);
 
@@ -176,6 +176,8 @@ ConfigState *ConfigState::ParseConfig(const char *configfilename){
             configfilename);
     return 0;
   }
+  CS->Dir = new PlacementDir;
+  CS->Dir->setDefault(CS->Nservers, CS->Nservers, 0);
   return CS;
 }
 
@@ -706,7 +706,7 @@ void TxUpdateCoid::printdetail(COid coid){ // to check
 }
 
 
-PendingTx::PendingTx() : cTxList(PENDINGTX_HASHTABLE_SIZE){}
+PendingTx::PendingTx() : cTxList(PENDINGTX_HASHTABLE_SIZE){ NPending = 0; }
 
 int PendingTx::getInfoLockaux(Tid &tid, Ptr<PendingTxInfo> *pti, int status,
                               SkipList<Tid,Ptr<PendingTxInfo>> *b, u64 parm){
@@ -732,6 +732,7 @@ int PendingTx::getInfoLockaux(Tid &tid, Ptr<PendingTxInfo> *pti, int status,
 int PendingTx::getInfo(Tid &tid, Ptr<PendingTxInfo> &retpti){
   int res;
   res = cTxList.lookupApply(tid, getInfoLockaux, (u64) &retpti);
+  if (res == 1) AtomicInc64(&NPending);
   //retpti->lock();
   return res;
 }
@@ -754,5 +755,6 @@ int PendingTx::removeInfo(Tid &tid){
   int res;
 
   res = cTxList.remove(tid, 0);
+  if (!res) AtomicDec64(&NPending);
   return res;
 }
@@ -20,6 +20,7 @@
 #include "debug.h"
 #define _RECORD_C
 #include "record.h"
+#include "scanfilter.h"
 
 
 // Prototype definitions
@@ -1799,6 +1800,110 @@ int testRecordPack(UnpackedRecord *pIdxKey, int file_format){
 }
 
 
+// ------------------------------- scan filters --------------------------------
+
+// Decodes field col of a record into *pMem. Returns 0 if ok, non-zero if the
+// record has fewer fields or is malformed.
+static int recordField(const u8 *aKey, int nKey, int col, Mem *pMem){
+  u32 szHdr, serial_type, len;
+  u32 idx, d;
+  int i;
+
+  idx = getVarint32(aKey, szHdr);
+  if (szHdr > (u32) nKey) return -1;
+  d = szHdr;
+  for (i=0; idx < szHdr; ++i){
+    idx += getVarint32(aKey+idx, serial_type);
+    len = sqlite3VdbeSerialTypeLen(serial_type);
+    if (i == col){
+      if (d + len > (u32) nKey) return -1;
+      sqlite3VdbeSerialGet(aKey+d, serial_type, pMem);
+      return 0;
+    }
+    d += len;
+  }
+  return -1;
+}
+
+// Evaluates a term against a field. Returns 0 if the term is false, 1 if
+// it is true or cannot be told.
+static int scanFilterTerm(const ScanFilterTerm *t, const char *text,
+                          Mem *pMem){
+  int c, i;
+
+  if (pMem->flags & MEM_Null) return t->op == SCANF_ISNULL;
+  switch(t->op){
+  case SCANF_ISNULL: return 0;
+  case SCANF_NOTNULL: return 1;
+  case SCANF_PREFIX:
+  case SCANF_PREFIX_NOCASE:
+    if (!(pMem->flags & MEM_Str)) return 1; // LIKE converts other types
+    if ((u32) pMem->n < t->len) return 0;
+    if (t->op == SCANF_PREFIX) return memcmp(pMem->z, text, t->len) == 0;
+    for (i=0; i < (int) t->len; ++i){
+      if ((u8)pMem->z[i] != (u8)text[i] &&
+          ((u8)pMem->z[i] >= 0x80 || (u8)text[i] >= 0x80 ||
+           sqlite3UpperToLower[(u8)pMem->z[i]] !=
+           sqlite3UpperToLower[(u8)text[i]]))
+        return 0;
+    }
+    return 1;
+  }
+
+  // comparison: only between a number and a number, or text and text
+  if (t->type == SCANF_TEXT){
+    if (!(pMem->flags & MEM_Str)) return 1;
+    c = memcmp(pMem->z, text, pMem->n < (int) t->len ? pMem->n : t->len);
+    if (c == 0) c = pMem->n - (int) t->len;
+  } else if (t->type == SCANF_INT || t->type == SCANF_REAL){
+    if (!(pMem->flags & (MEM_Int|MEM_Real))) return 1;
+    if (t->type == SCANF_INT && (pMem->flags & MEM_Int))
+      c = pMem->u.i < t->v.i ? -1 : pMem->u.i > t->v.i ? 1 : 0;
+    else {
+      double r1, r2;
+      r1 = (pMem->flags & MEM_Int) ? (double) pMem->u.i : pMem->r;
+      r2 = t->type == SCANF_INT ? (double) t->v.i : t->v.r;
+      c = r1 < r2 ? -1 : r1 > r2 ? 1 : 0;
+    }
+  } else return 1;
+
+  switch(t->op){
+  case SCANF_EQ: return c == 0;
+  case SCANF_NE: return c != 0;
+  case SCANF_LT: return c < 0;
+  case SCANF_LE: return c <= 0;
+  case SCANF_GT: return c > 0;
+  case SCANF_GE: return c >= 0;
+  }
+  return 1;
+}
+
+int ScanFilterMatch(const char *filter, int filterlen, const char *rec,
+                    int reclen){
+  const char *p, *end;
+  const ScanFilterTerm *t;
+  Mem mem;
+
+  end = filter + filterlen;
+  for (p = filter; p + (int) sizeof(ScanFilterTerm) <= end;
+       p += ScanFilterTermSize(t->len)){
+    t = (const ScanFilterTerm*) p;
+    if (recordField((const u8*) rec, reclen, t->col, &mem))
+      continue; // cannot tell
+    if (!scanFilterTerm(t, p + sizeof(ScanFilterTerm), &mem)) return 0;
+  }
+  return 1;
+}
+
+int myRecordIntField(const char *rec, int reclen, int col, i64 *value){
+  Mem mem;
+  if (recordField((const u8*) rec, reclen, col, &mem)) return -1;
+  if (!(mem.flags & MEM_Int)) return -1;
+  *value = mem.u.i;
+  return 0;
+}
+
+
 void *RcKeyInfo::operator new(std::size_t sz, int ncoll, int nsort){
   sz += ncoll * sizeof(CollSeq*) + nsort;
   return malloc(sz);
@@ -0,0 +1,80 @@
+//
+// replication-nop.cpp
+//
+// Primary-backup replication. This implementation does nothing. It is used
+// when storage is local to the client (LOCALSTORAGE), where there is no
+// server to replicate.
+//
+
+/*
+  Original code: Copyright (c) 2014 Microsoft Corporation
+  Modified code: Copyright (c) 2015-2016 VMware, Inc
+  All rights reserved. 
+
+  Written by Marcos K. Aguilera
+
+  MIT License
+
+  Permission is hereby granted, free of charge, to any person
+  obtaining a copy of this software and associated documentation files
+  (the "Software"), to deal in the Software without restriction,
+  including without limitation the rights to use, copy, modify, merge,
+  publish, distribute, sublicense, and/or sell copies of the Software,
+  and to permit persons to whom the Software is furnished to do so,
+  subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED *AS IS*, WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+  BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+  ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <assert.h>
+#include <limits.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <malloc.h>
+
+#include <list>
+#include <map>
+#include <set>
+
+#ifndef LOCALSTORAGE
+#define LOCALSTORAGE
+#endif
+#include "tmalloc.h"
+#include "debug.h"
+#include "replication.h"
+
+Replication::Replication(){
+  NBackups = 0;
+  QueueBuf = 0;
+  QueueLen = QueueSize = 0;
+  QueueOverflow = false;
+  ThreadNo = -1;
+  Rpcc = 0;
+  BackupOf = -1;
+  PrimaryStreamId = ExpectedSeq = AppliedWatermark = 0;
+  AppliedBatches = AppliedTxs = 0;
+  StreamId = 0;
+}
+Replication::~Replication(){}
+int Replication::addBackup(IPPort ipport){ return -1; }
+void Replication::launch(Ptr<RPCTcp> *rpcc){}
+void Replication::committed(Tid tid, Timestamp committs,
+                            Ptr<PendingTxInfo> pti){}
+int Replication::apply(LogInMemory *lim, int op, u64 streamid, u64 seq,
+                       u64 watermark, char *buf, int len){
+  return GAIAERR_NOT_IMPL;
+}
+void Replication::printStats(void){ printf("Replication disabled\n"); }
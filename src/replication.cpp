@@ -0,0 +1,508 @@
+//
+// replication.cpp
+//
+// Asynchronous primary-backup replication of a storage server
+//
+
+/*
+  Original code: Copyright (c) 2014 Microsoft Corporation
+  Modified code: Copyright (c) 2015-2016 VMware, Inc
+  All rights reserved.
+
+  Written by Marcos K. Aguilera
+
+  MIT License
+
+  Permission is hereby granted, free of charge, to any person
+  obtaining a copy of this software and associated documentation files
+  (the "Software"), to deal in the Software without restriction,
+  including without limitation the rights to use, copy, modify, merge,
+  publish, distribute, sublicense, and/or sell copies of the Software,
+  and to permit persons to whom the Software is furnished to do so,
+  subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED *AS IS*, WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+  BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+  ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+// How a backup knows which reads it can serve. Each batch carries as
+// watermark the safe timestamp of the primary (see safets.h), computed
+// before the batch is taken from the queue. A committed transaction is
+// queued before it leaves the safe timestamp, so every transaction that
+// commits below the watermark is in the batch that carries the watermark,
+// or in an earlier one.
+//
+// A backup that misses a batch (or a new backup) gets a full copy of the
+// objects of the primary, followed by the stream. Transactions in the batch
+// shipped after the copy may already be in the copy; applying them again at
+// the same timestamp has no effect.
+
+#include <stdio.h>
+
+#include <assert.h>
+#include <string.h>
+#include <stdlib.h>
+#include <malloc.h>
+#include <sys/types.h>
+
+#include "tmalloc.h"
+#include "os.h"
+#include "options.h"
+#include "debug.h"
+#include "task.h"
+#include "gaiarpcaux.h"
+#include "gaiarpcauxfunc.h"
+#include "logmem.h"
+#include "storageserverstate.h"
+#include "replication.h"
+
+extern StorageServerState *S; // defined in storageserver.cpp
+
+// growable buffer where transactions are serialized
+class ReplBuf {
+public:
+  char *buf;
+  int len, size;
+  ReplBuf(){ buf = 0; len = size = 0; }
+  ~ReplBuf(){ if (buf) free(buf); }
+  void add(const void *data, int n){
+    if (len + n > size){
+      size = size ? size * 2 : 1024;
+      if (size < len + n) size = len + n;
+      buf = (char*) (buf ? realloc(buf, size) : malloc(size)); assert(buf);
+    }
+    memcpy(buf + len, data, n);
+    len += n;
+  }
+  void addKeyinfo(Ptr<RcKeyInfo> prki){
+    int kilen;
+    char *ki = marshall_keyinfo_onebuf(prki, kilen);
+    add(&kilen, sizeof(int));
+    add(ki, kilen);
+    free(ki);
+  }
+  void addCell(ListCell &cell){
+    u8 haspkey = cell.pKey != 0;
+    add(&cell.nKey, sizeof(i64));
+    add(&haspkey, 1);
+    if (haspkey) add(cell.pKey, (int) cell.nKey);
+    add(&cell.value, sizeof(u64));
+  }
+};
+
+// cursor over a received buffer. Each method returns non-0 if the buffer
+// is too short
+class ReplCursor {
+public:
+  char *ptr, *end;
+  ReplCursor(char *buf, int len){ ptr = buf; end = buf + len; }
+  bool done(){ return ptr >= end; }
+  int get(void *data, int n){
+    if (end - ptr < n) return -1;
+    memcpy(data, ptr, n);
+    ptr += n;
+    return 0;
+  }
+  int getKeyinfo(Ptr<RcKeyInfo> &prki){
+    int kilen;
+    char *p;
+    if (get(&kilen, sizeof(int)) || kilen < (int)sizeof(int) ||
+        end - ptr < kilen) return -1;
+    p = ptr;
+    prki = demarshall_keyinfo(&p);
+    ptr += kilen;
+    return 0;
+  }
+  // cell.pKey points into the buffer
+  int getCell(ListCell &cell){
+    u8 haspkey;
+    if (get(&cell.nKey, sizeof(i64)) || get(&haspkey, 1)) return -1;
+    cell.pKey = 0;
+    if (haspkey){
+      if (cell.nKey < 0 || end - ptr < cell.nKey) return -1;
+      cell.pKey = ptr;
+      ptr += cell.nKey;
+    }
+    return get(&cell.value, sizeof(u64));
+  }
+};
+
+// Serializes the updates of a transaction to an object. Returns 0 if
+// serialized, non-0 if the transaction did not change the object.
+// Format: COid, u8 base (0=none, 1=value, 2=supervalue), the base if any,
+// SetAttrs, Attrs, int number of list items, list items.
+static int encodeTucoid(ReplBuf &rb, COid &coid, Ptr<TxUpdateCoid> tucoid){
+  u8 base;
+  int i, nitems;
+  TxListItem *tli;
+
+  base = tucoid->Writevalue ? 1 : tucoid->WriteSV ? 2 : 0;
+  nitems = tucoid->Litems.getNitems();
+  if (!base && !nitems){
+    for (i=0; i < GAIA_MAX_ATTRS; ++i) if (tucoid->SetAttrs[i]) break;
+    if (i == GAIA_MAX_ATTRS) return -1; // nothing changed
+  }
+
+  rb.add(&coid, sizeof(COid));
+  rb.add(&base, 1);
+  if (base == 1){
+    TxWriteItem *twi = tucoid->Writevalue;
+    rb.add(&twi->len, sizeof(int));
+    rb.add(twi->buf, twi->len);
+  } else if (base == 2){
+    TxWriteSVItem *twsvi = tucoid->WriteSV;
+    int ncelloids, lencelloids;
+    char *celloids;
+    rb.add(&twsvi->nattrs, sizeof(u16));
+    rb.add(&twsvi->celltype, sizeof(u8));
+    rb.add(twsvi->attrs, twsvi->nattrs * sizeof(u64));
+    rb.addKeyinfo(twsvi->prki);
+    // serialize cells here rather than with getCelloids, which caches the
+    // result in the item while other threads may be reading it
+    celloids = ListCellsToCelloids(twsvi->cells, ncelloids, lencelloids);
+    rb.add(&ncelloids, sizeof(int));
+    rb.add(&lencelloids, sizeof(int));
+    rb.add(celloids, lencelloids);
+    delete [] celloids;
+  }
+  rb.add(tucoid->SetAttrs, sizeof(u8)*GAIA_MAX_ATTRS);
+  rb.add(tucoid->Attrs, sizeof(u64)*GAIA_MAX_ATTRS);
+  rb.add(&nitems, sizeof(int));
+  for (tli = tucoid->Litems.getFirst(); tli != tucoid->Litems.getLast();
+       tli = tucoid->Litems.getNext(tli)){
+    u8 type = (u8) tli->type;
+    rb.add(&type, 1);
+    if (tli->type == 0){
+      TxListAddItem *tlai = dynamic_cast<TxListAddItem*>(tli);
+      rb.addKeyinfo(tlai->prki);
+      rb.addCell(tlai->item);
+    } else {
+      TxListDelRangeItem *tldri = dynamic_cast<TxListDelRangeItem*>(tli);
+      rb.add(&tldri->intervalType, 1);
+      rb.addKeyinfo(tldri->prki);
+      rb.addCell(tldri->itemstart);
+      rb.addCell(tldri->itemend);
+    }
+  }
+  return 0;
+}
+
+// Reverse of encodeTucoid. Returns 0 if ok, non-0 if buffer is malformed.
+static int decodeTucoid(ReplCursor &rc, COid &coid,
+                        Ptr<TxUpdateCoid> &rettucoid){
+  u8 base, type, intervaltype;
+  int i, nitems;
+  Ptr<TxUpdateCoid> tucoid;
+  Ptr<RcKeyInfo> prki;
+  ListCell cell, cellend;
+
+  if (rc.get(&coid, sizeof(COid)) || rc.get(&base, 1)) return -1;
+  if (base == 1){
+    TxWriteItem *twi = new TxWriteItem(coid, 0);
+    twi->alloctype = 1; // allocated via malloc
+    twi->rpcrequest = 0;
+    twi->buf = 0;
+    tucoid = new TxUpdateCoid(twi);
+    if (rc.get(&twi->len, sizeof(int)) || twi->len < 0) return -1;
+    twi->buf = (char*) malloc(twi->len ? twi->len : 1);
+    if (rc.get(twi->buf, twi->len)) return -1;
+  } else if (base == 2){
+    TxWriteSVItem *twsvi = new TxWriteSVItem(coid, 0);
+    int ncelloids, lencelloids;
+    tucoid = new TxUpdateCoid(twsvi);
+    if (rc.get(&twsvi->nattrs, sizeof(u16)) ||
+        rc.get(&twsvi->celltype, sizeof(u8))) return -1;
+    twsvi->attrs = new u64[twsvi->nattrs];
+    if (rc.get(twsvi->attrs, twsvi->nattrs * sizeof(u64))) return -1;
+    if (rc.getKeyinfo(twsvi->prki)) return -1;
+    if (rc.get(&ncelloids, sizeof(int)) || rc.get(&lencelloids, sizeof(int)) ||
+        lencelloids < 0 || rc.end - rc.ptr < lencelloids) return -1;
+    CelloidsToListCells(rc.ptr, ncelloids, twsvi->celltype, twsvi->cells,
+                        &twsvi->prki);
+    rc.ptr += lencelloids;
+  } else if (base == 0) tucoid = new TxUpdateCoid;
+  else return -1;
+
+  if (rc.get(tucoid->SetAttrs, sizeof(u8)*GAIA_MAX_ATTRS) ||
+      rc.get(tucoid->Attrs, sizeof(u64)*GAIA_MAX_ATTRS) ||
+      rc.get(&nitems, sizeof(int))) return -1;
+  for (i=0; i < nitems; ++i){
+    if (rc.get(&type, 1)) return -1;
+    if (type == 0){
+      if (rc.getKeyinfo(prki) || rc.getCell(cell)) return -1;
+      tucoid->Litems.pushTail(new TxListAddItem(coid, prki, cell, 0));
+    } else if (type == 1){
+      if (rc.get(&intervaltype, 1) || rc.getKeyinfo(prki) ||
+          rc.getCell(cell) || rc.getCell(cellend)) return -1;
+      tucoid->Litems.pushTail(new TxListDelRangeItem(coid, prki, intervaltype,
+                                                     cell, cellend, 0));
+    } else return -1;
+  }
+  rettucoid = tucoid;
+  return 0;
+}
+
+Replication::Replication(){
+  NBackups = 0;
+  memset(Backups, 0, sizeof(Backups));
+  StreamId = Time::nowus();
+  QueueBuf = 0;
+  QueueLen = QueueSize = 0;
+  QueueOverflow = false;
+  ThreadNo = -1;
+  Rpcc = 0;
+  BackupOf = -1;
+  PrimaryStreamId = 0;
+  ExpectedSeq = 0;
+  AppliedWatermark = 0;
+  AppliedBatches = AppliedTxs = 0;
+}
+
+Replication::~Replication(){
+  if (QueueBuf) free(QueueBuf);
+}
+
+int Replication::addBackup(IPPort ipport){
+  if (NBackups >= REPL_MAX_BACKUPS || ThreadNo != -1) return -1;
+  memset(&Backups[NBackups], 0, sizeof(ReplBackup));
+  Backups[NBackups].ipport = ipport;
+  Backups[NBackups].needSnapshot = true;
+  ++NBackups;
+  return 0;
+}
+
+void Replication::launch(Ptr<RPCTcp> *rpcc){
+  if (!NBackups || ThreadNo != -1) return;
+  Rpcc = rpcc;
+  ThreadNo = SLauncher->createThread("REPLICATOR", replicatorThread,
+                                     (void*) this, false);
+}
+
+void Replication::committed(Tid tid, Timestamp committs,
+                            Ptr<PendingTxInfo> pti){
+  ReplBuf rb;
+  ReplTxHeader hdr;
+  SkipListNode<COid, Ptr<TxRawCoid> > *ptr;
+
+  if (!NBackups) return;
+  memset(&hdr, 0, sizeof(ReplTxHeader));
+  hdr.committs = committs;
+  rb.add(&hdr, sizeof(ReplTxHeader));
+  for (ptr = pti->coidinfo.getFirst(); ptr != pti->coidinfo.getLast();
+       ptr = pti->coidinfo.getNext(ptr)){
+    if (!encodeTucoid(rb, ptr->key, ptr->value->getTucoid(ptr->key)))
+      ++((ReplTxHeader*) rb.buf)->ncoids;
+  }
+
+  Lock.lock();
+  if (((ReplTxHeader*) rb.buf)->ncoids && !QueueOverflow){
+    if (QueueLen + rb.len > REPL_MAX_QUEUE_BYTES){
+      // backups are too far behind; drop queue and send them full copies
+      if (QueueBuf) free(QueueBuf);
+      QueueBuf = 0;
+      QueueLen = QueueSize = 0;
+      QueueOverflow = true;
+    } else {
+      if (QueueLen + rb.len > QueueSize){
+        QueueSize = QueueSize ? QueueSize * 2 : 64*1024;
+        if (QueueSize < QueueLen + rb.len) QueueSize = QueueLen + rb.len;
+        QueueBuf = (char*) (QueueBuf ? realloc(QueueBuf, QueueSize)
+                                     : malloc(QueueSize));
+        assert(QueueBuf);
+      }
+      memcpy(QueueBuf + QueueLen, rb.buf, rb.len);
+      QueueLen += rb.len;
+    }
+  }
+  Lock.unlock();
+}
+
+// Invokes a REPLICATE RPC at a backup. Returns the status of the RPC.
+static int replicateRPC(Ptr<RPCTcp> rpcc, IPPort ipport, int op, u64 streamid,
+                        u64 seq, u64 watermark, char *buf, int len,
+                        u64 *retcount){
+  ReplicateRPCData *parm;
+  ReplicateRPCRespData rpcresp;
+  char *resp;
+  int status;
+
+  parm = new ReplicateRPCData;
+  parm->data = new ReplicateRPCParm;
+  parm->freedata = true;
+  memset(parm->data, 0, sizeof(ReplicateRPCParm));
+  parm->data->op = op;
+  parm->data->len = len;
+  parm->data->serverno = S->MyServerno;
+  parm->data->streamid = streamid;
+  parm->data->seq = seq;
+  parm->data->watermark = watermark;
+  parm->data->buf = buf;
+  resp = rpcc->syncRPC(ipport, REPLICATE_RPCNO, 0, parm);
+  if (!resp) return GAIAERR_SERVER_TIMEOUT;
+  rpcresp.demarshall(resp);
+  status = rpcresp.data->status;
+  if (retcount) *retcount = rpcresp.data->count;
+  free(resp);
+  return status;
+}
+
+void Replication::shipToBackup(ReplBackup *b, char *buf, int len,
+                               u64 watermark){
+  int res, i;
+  u8 *inbucket;
+  char *sbuf;
+  int slen;
+  u64 count;
+  PlacementDir *dir;
+
+  if (!b->connected){
+    (*Rpcc)->clientconnect(b->ipport); // retries until backup is up
+    b->connected = true;
+  }
+
+  if (b->needSnapshot){
+    // copy the objects this server owns
+    inbucket = new u8[PLACEMENT_NBUCKETS];
+    dir = S->Dir;
+    for (i=0; i < PLACEMENT_NBUCKETS; ++i)
+      inbucket[i] = !dir || dir->owner[i] == S->MyServerno;
+    res = S->cLogInMemory.exportBuckets(inbucket, &sbuf, &slen, &count);
+    delete [] inbucket;
+    if (!res){
+      res = replicateRPC(*Rpcc, b->ipport, REPL_OP_SNAPSHOT, StreamId, 0, 0,
+                         sbuf, slen, 0);
+      free(sbuf);
+    }
+    if (res){
+      ++b->failures;
+      dprintf(1, "Replication: full copy to %s failed with %d",
+              IPMisc::ipToStr(b->ipport.ip), res);
+      return; // try again with next batch
+    }
+    b->needSnapshot = false;
+    b->nextseq = 1;
+    ++b->snapshots;
+    dprintf(1, "Replication: sent %llu objects to %s",
+            (unsigned long long) count, IPMisc::ipToStr(b->ipport.ip));
+  }
+
+  // send batch even if empty, to advance the watermark of the backup
+  res = replicateRPC(*Rpcc, b->ipport, REPL_OP_BATCH, StreamId, b->nextseq,
+                     watermark, buf, len, 0);
+  if (res){
+    ++b->failures;
+    b->needSnapshot = true;
+    return;
+  }
+  ++b->nextseq;
+  ++b->batches;
+}
+
+OSTHREAD_FUNC Replication::replicatorThread(void *parm){
+  Replication *r = (Replication*) parm;
+  u64 watermark;
+  char *buf;
+  int len, i;
+  bool overflow;
+
+  while (1){
+    mssleep(REPL_INTERVAL_MS);
+
+    // must be computed before taking the queue
+    watermark = S->cSafeTs.advance().getd1() - 1; // reads at the watermark
+                                                  // are below the safe ts
+    r->Lock.lock();
+    buf = r->QueueBuf;
+    len = r->QueueLen;
+    overflow = r->QueueOverflow;
+    r->QueueBuf = 0;
+    r->QueueLen = r->QueueSize = 0;
+    r->QueueOverflow = false;
+    r->Lock.unlock();
+
+    for (i=0; i < r->NBackups; ++i){
+      if (overflow) r->Backups[i].needSnapshot = true;
+      r->shipToBackup(&r->Backups[i], buf, len, watermark);
+    }
+    if (buf) free(buf);
+  }
+  return 0;
+}
+
+int Replication::apply(LogInMemory *lim, int op, u64 streamid, u64 seq,
+                       u64 watermark, char *buf, int len){
+  int res=0;
+  int i;
+  u64 ntxs=0;
+  ReplTxHeader hdr;
+  COid coid;
+  Ptr<TxUpdateCoid> tucoid;
+  ReplCursor rc(buf, len);
+
+  Lock.lock();
+  if (op == REPL_OP_SNAPSHOT){
+    AppliedWatermark = 0; // refuse reads until next batch
+    res = lim->importBuckets(buf, len, &ntxs);
+    if (res){ PrimaryStreamId = 0; goto end; }
+    PrimaryStreamId = streamid;
+    ExpectedSeq = 1;
+    goto end;
+  }
+
+  if (op != REPL_OP_BATCH){ res = GAIAERR_NOT_IMPL; goto end; }
+  if (streamid != PrimaryStreamId || seq != ExpectedSeq){
+    res = GAIAERR_REPL_GAP;
+    goto end;
+  }
+  while (!rc.done()){
+    if (rc.get(&hdr, sizeof(ReplTxHeader))) goto error;
+    for (i=0; i < hdr.ncoids; ++i){
+      if (decodeTucoid(rc, coid, tucoid)) goto error;
+      lim->applyCOid(coid, hdr.committs, tucoid);
+    }
+    ++ntxs;
+  }
+  ++ExpectedSeq;
+  ++AppliedBatches;
+  AppliedTxs += ntxs;
+  MemBarrier(); // ensure updates are visible before the watermark
+  if (watermark > AppliedWatermark) AppliedWatermark = watermark;
+
+ end:
+  Lock.unlock();
+  return res;
+
+ error:
+  // part of the batch may have been applied; start over with a full copy
+  PrimaryStreamId = 0;
+  res = GAIAERR_REPL_GAP;
+  goto end;
+}
+
+void Replication::printStats(void){
+  int i;
+  Timestamp now;
+  if (BackupOf >= 0){
+    now.setNew();
+    printf("Backup of server %d: batches %llu txs %llu watermark lag %lld ms\n",
+           BackupOf, (unsigned long long) AppliedBatches,
+           (unsigned long long) AppliedTxs, AppliedWatermark ?
+           (long long) ((now.getd1() - AppliedWatermark) / 1000) : -1LL);
+  }
+  if (!NBackups && BackupOf < 0) printf("Replication disabled\n");
+  for (i=0; i < NBackups; ++i)
+    printf("Backup %s:%d: batches %llu full copies %llu failures %llu\n",
+           IPMisc::ipToStr(Backups[i].ipport.ip), ntohs(Backups[i].ipport.port),
+           (unsigned long long) Backups[i].batches,
+           (unsigned long long) Backups[i].snapshots,
+           (unsigned long long) Backups[i].failures);
+}
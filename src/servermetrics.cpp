@@ -0,0 +1,149 @@
+//
+// servermetrics.cpp
+//
+// Per-thread metrics of a storage server. See servermetrics.h.
+//
+
+/*
+  Original code: Copyright (c) 2014 Microsoft Corporation
+  Modified code: Copyright (c) 2015-2016 VMware, Inc
+  All rights reserved.
+
+  Written by Marcos K. Aguilera
+
+  MIT License
+
+  Permission is hereby granted, free of charge, to any person
+  obtaining a copy of this software and associated documentation files
+  (the "Software"), to deal in the Software without restriction,
+  including without limitation the rights to use, copy, modify, merge,
+  publish, distribute, sublicense, and/or sell copies of the Software,
+  and to permit persons to whom the Software is furnished to do so,
+  subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED *AS IS*, WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+  BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+  ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#include <stdio.h>
+#include <string.h>
+
+#include "servermetrics.h"
+
+static const char *RpcNames[SERVERMETRICS_NRPCS] = {
+  "null", "getstatus", "write", "read", "fullwrite", "fullread", "listadd",
+  "listdelrange", "attrset", "prepare", "commit", "subtrans", "shutdown",
+  "startsplitter", "flushfile", "loadfile", "inbac", "inbacmessage",
+  "consmessage", "getrowid", "directory", "migrate", "replicate", "filterread",
+  "rpc24+"
+};
+
+static const char *VoteNoNames[VoteNoNReasons] = {
+  "wrongserver", "readset", "committed", "pending"
+};
+
+void ServerMetrics::reset(){
+  int i;
+  memset(rpcCount, 0, sizeof(rpcCount));
+  for (i=0; i < SERVERMETRICS_NRPCS; ++i) rpcLatencyUs[i].reset();
+  deferredReads = 0;
+  voteYes = 0;
+  memset(voteNo, 0, sizeof(voteNo));
+  nthreads = 0;
+  splitQueueSize = 0;
+  nobjects = nversions = pendingTxs = 0;
+  tmallocInUse = tmallocReserved = 0;
+}
+
+void ServerMetrics::add(ServerMetrics &m){
+  int i;
+  for (i=0; i < SERVERMETRICS_NRPCS; ++i){
+    rpcCount[i] += m.rpcCount[i];
+    rpcLatencyUs[i].add(m.rpcLatencyUs[i]);
+  }
+  deferredReads += m.deferredReads;
+  voteYes += m.voteYes;
+  for (i=0; i < VoteNoNReasons; ++i) voteNo[i] += m.voteNo[i];
+}
+
+void ServerMetrics::print(void){
+  int i;
+  u64 nvoteno=0;
+  for (i=0; i < VoteNoNReasons; ++i) nvoteno += voteNo[i];
+
+  printf("  objects %llu versions %llu pendingtxs %llu splitqueue %u\n",
+         (unsigned long long) nobjects, (unsigned long long) nversions,
+         (unsigned long long) pendingTxs, splitQueueSize);
+  printf("  tmalloc inuse %lluKB reserved %lluKB (%u threads)\n",
+         (unsigned long long) tmallocInUse/1024,
+         (unsigned long long) tmallocReserved/1024, nthreads);
+  printf("  deferred reads %llu\n", (unsigned long long) deferredReads);
+  printf("  prepare yes %llu no %llu", (unsigned long long) voteYes,
+         (unsigned long long) nvoteno);
+  for (i=0; i < VoteNoNReasons; ++i)
+    printf(" %s %llu", VoteNoNames[i], (unsigned long long) voteNo[i]);
+  putchar('\n');
+  for (i=0; i < SERVERMETRICS_NRPCS; ++i){
+    if (!rpcCount[i]) continue;
+    printf("  ");
+    rpcLatencyUs[i].printSummary(RpcNames[i], "us");
+  }
+}
+
+// Threads register their instance in Threads[] the first time they record
+// something. Instances are never freed, since threads of the server live
+// until it exits.
+static ServerMetrics *Threads[SERVERMETRICS_MAX_THREADS];
+static void *Pools[SERVERMETRICS_MAX_THREADS]; // tmalloc pool of each thread
+static Align4 u32 NThreads=0;
+
+#ifdef SERVER_METRICS
+static Tlocal ServerMetrics *LocalMetrics=0;
+
+ServerMetrics *ServerMetricsLocal(void){
+  ServerMetrics *m = LocalMetrics;
+  if (m) return m;
+  m = new ServerMetrics;
+  u32 i = AtomicInc32(&NThreads)-1;
+  if (i < SERVERMETRICS_MAX_THREADS){ // otherwise m is never collected
+    Pools[i] = _tgetpool();
+    MemBarrier();
+    Threads[i] = m;
+  }
+  LocalMetrics = m;
+  return m;
+}
+
+void ServerMetricsRequestObserver(void *ctx, u32 req, u64 elapsedus){
+  ServerMetrics *m = ServerMetricsLocal();
+  if (req >= SERVERMETRICS_NRPCS) req = SERVERMETRICS_NRPCS-1;
+  ++m->rpcCount[req];
+  m->rpcLatencyUs[req].put(elapsedus);
+}
+#else
+void ServerMetricsRequestObserver(void *ctx, u32 req, u64 elapsedus){}
+#endif
+
+void ServerMetricsCollect(ServerMetrics *m){
+  u32 i, n;
+  size_t inuse, reserved;
+  n = NThreads;
+  if (n > SERVERMETRICS_MAX_THREADS) n = SERVERMETRICS_MAX_THREADS;
+  for (i=0; i < n; ++i){
+    if (!Threads[i]) continue; // being registered
+    m->add(*Threads[i]);
+    ++m->nthreads;
+    _tgetpoolusage(Pools[i], &inuse, &reserved);
+    m->tmallocInUse += inuse;
+    m->tmallocReserved += reserved;
+  }
+}
@@ -0,0 +1,374 @@
+//
+// snapshot.cpp
+//
+// Snapshots of the objects of a storage server (see snapshot.h)
+//
+
+/*
+  Original code: Copyright (c) 2014 Microsoft Corporation
+  Modified code: Copyright (c) 2015-2016 VMware, Inc
+  All rights reserved.
+
+  Written by Marcos K. Aguilera
+
+  MIT License
+
+  Permission is hereby granted, free of charge, to any person
+  obtaining a copy of this software and associated documentation files
+  (the "Software"), to deal in the Software without restriction,
+  including without limitation the rights to use, copy, modify, merge,
+  publish, distribute, sublicense, and/or sell copies of the Software,
+  and to permit persons to whom the Software is furnished to do so,
+  subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED *AS IS*, WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+  BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+  ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <zlib.h>
+
+#include <vector>
+
+#include "tmalloc.h"
+#include "options.h"
+#include "os.h"
+#include "debug.h"
+#include "util-more.h"
+#include "gaiarpcaux.h"
+#include "logmem.h"
+#include "snapshot.h"
+
+SnapshotWriter::SnapshotWriter(){
+  F = 0;
+  Chunk = 0;
+  ChunkObjects = 0;
+  Offset = 0;
+  NObjects = 0;
+}
+
+SnapshotWriter::~SnapshotWriter(){
+  if (Chunk) fclose(Chunk);
+  if (F) fclose(F);
+}
+
+int SnapshotWriter::open(const char *filename, Timestamp ts){
+  SnapshotHeader sh;
+  int res;
+
+  F = fopen(filename, "wb");
+  if (!F){
+    dprintf(1, "SnapshotWriter: error opening file %s for writing", filename);
+    return -1;
+  }
+  memset(&sh, 0, sizeof(SnapshotHeader));
+  sh.magic = SNAPSHOT_MAGIC;
+  sh.version = SNAPSHOT_FORMAT_VERSION;
+  sh.ts = ts;
+  res = (int) fwrite((void*)&sh, 1, sizeof(SnapshotHeader), F);
+  if (res != sizeof(SnapshotHeader)) return -1;
+  Offset = sizeof(SnapshotHeader);
+
+  // objects are serialized into a temporary file, since DiskStorage writes
+  // to a FILE
+  Chunk = tmpfile();
+  if (!Chunk) return -1;
+  return 0;
+}
+
+int SnapshotWriter::add(COid &coid, Ptr<TxUpdateCoid> tucoid,
+                        DiskStorage *ds){
+  int res;
+  res = (int) fwrite((void*)&coid, 1, sizeof(COid), Chunk);
+  if (res != sizeof(COid)) return -1;
+  res = ds->writeCOidToFile(Chunk, tucoid); if (res) return -1;
+  ++ChunkObjects;
+  ++NObjects;
+  if (ftell(Chunk) >= SNAPSHOT_CHUNK_BYTES) return flushChunk();
+  return 0;
+}
+
+// compresses the current chunk and writes it to the file
+int SnapshotWriter::flushChunk(void){
+  SnapshotIndexEntry ie;
+  uLongf clen;
+  long len;
+  char *buf=0, *cbuf=0;
+  int res, retval=0;
+
+  if (ChunkObjects == 0) return 0;
+  len = ftell(Chunk);
+  if (len < 0) return -1;
+  buf = (char*) malloc(len ? len : 1);
+  rewind(Chunk);
+  if ((long) fread(buf, 1, len, Chunk) != len) goto error;
+  clen = compressBound(len);
+  cbuf = (char*) malloc(clen);
+  res = compress2((Bytef*) cbuf, &clen, (Bytef*) buf, len,
+                  SNAPSHOT_COMPRESS_LEVEL);
+  if (res != Z_OK) goto error;
+
+  ie.offset = Offset;
+  ie.ch.clen = (u32) clen;
+  ie.ch.ulen = (u32) len;
+  ie.ch.nobjects = ChunkObjects;
+  ie.ch.crc = crc32c(0, cbuf, clen);
+  res = (int) fwrite((void*)&ie.ch, 1, sizeof(SnapshotChunkHeader), F);
+  if (res != sizeof(SnapshotChunkHeader)) goto error;
+  res = (int) fwrite((void*)cbuf, 1, clen, F);
+  if (res != (int) clen) goto error;
+  Index.push_back(ie);
+  Offset += sizeof(SnapshotChunkHeader) + clen;
+
+  // start a new chunk
+  rewind(Chunk);
+  if (ftruncate(fileno(Chunk), 0)) goto error;
+  ChunkObjects = 0;
+
+ end:
+  if (buf) free(buf);
+  if (cbuf) free(cbuf);
+  return retval;
+
+ error:
+  retval = -1;
+  goto end;
+}
+
+int SnapshotWriter::close(void){
+  SnapshotFooter sf;
+  int res, len, retval=0;
+
+  res = flushChunk(); if (res) goto error;
+  memset(&sf, 0, sizeof(SnapshotFooter));
+  sf.indexoffset = Offset;
+  sf.nchunks = Index.size();
+  sf.nobjects = NObjects;
+  len = (int)(Index.size() * sizeof(SnapshotIndexEntry));
+  sf.crc = len ? crc32c(0, &Index[0], len) : 0;
+  sf.magic = SNAPSHOT_MAGIC;
+  if (len){
+    res = (int) fwrite((void*)&Index[0], 1, len, F);
+    if (res != len) goto error;
+  }
+  res = (int) fwrite((void*)&sf, 1, sizeof(SnapshotFooter), F);
+  if (res != sizeof(SnapshotFooter)) goto error;
+
+ end:
+  if (fclose(F)) retval = -1; // catches errors writing buffered data
+  F = 0;
+  return retval;
+
+ error:
+  retval = -1;
+  goto end;
+}
+
+SnapshotReader::~SnapshotReader(){
+  if (Fd >= 0) ::close(Fd);
+}
+
+int SnapshotReader::open(const char *filename){
+  SnapshotHeader sh;
+  SnapshotFooter sf;
+  struct stat st;
+  int res, len;
+
+  Fd = ::open(filename, O_RDONLY);
+  if (Fd < 0){
+    dprintf(1, "SnapshotReader: error opening file %s for reading", filename);
+    return -1;
+  }
+  res = fstat(Fd, &st); if (res) return -1;
+  if (st.st_size < (off_t)(sizeof(SnapshotHeader) + sizeof(SnapshotFooter)))
+    return -1;
+
+  res = (int) pread(Fd, &sh, sizeof(SnapshotHeader), 0);
+  if (res != sizeof(SnapshotHeader)) return -1;
+  if (sh.magic != SNAPSHOT_MAGIC || sh.version != SNAPSHOT_FORMAT_VERSION){
+    dprintf(1, "SnapshotReader: %s is not a snapshot", filename);
+    return -1;
+  }
+  Ts = sh.ts;
+
+  res = (int) pread(Fd, &sf, sizeof(SnapshotFooter),
+                    st.st_size - sizeof(SnapshotFooter));
+  if (res != sizeof(SnapshotFooter)) return -1;
+  if (sf.magic != SNAPSHOT_MAGIC) return -1; // truncated snapshot
+  if (sf.indexoffset + sf.nchunks * sizeof(SnapshotIndexEntry) +
+      sizeof(SnapshotFooter) != (u64) st.st_size) return -1;
+  NObjects = sf.nobjects;
+
+  Index.resize(sf.nchunks);
+  len = (int)(sf.nchunks * sizeof(SnapshotIndexEntry));
+  if (len){
+    res = (int) pread(Fd, &Index[0], len, sf.indexoffset);
+    if (res != len) return -1;
+  }
+  if ((len ? crc32c(0, &Index[0], len) : 0) != sf.crc) return -1;
+  return 0;
+}
+
+int SnapshotReader::readChunk(int i, char **retbuf, int *retlen){
+  SnapshotIndexEntry *ie;
+  SnapshotChunkHeader *ch;
+  char *cbuf=0, *buf=0;
+  uLongf ulen;
+  int res, len, retval=0;
+
+  assert(0 <= i && i < (int) Index.size());
+  ie = &Index[i];
+  len = sizeof(SnapshotChunkHeader) + ie->ch.clen;
+  cbuf = (char*) malloc(len);
+  res = (int) pread(Fd, cbuf, len, ie->offset); if (res != len) goto error;
+  ch = (SnapshotChunkHeader*) cbuf;
+  if (memcmp(ch, &ie->ch, sizeof(SnapshotChunkHeader))) goto error;
+  if (crc32c(0, cbuf+sizeof(SnapshotChunkHeader), ch->clen) != ch->crc)
+    goto error;
+
+  ulen = ch->ulen;
+  buf = (char*) malloc(ulen ? ulen : 1);
+  res = uncompress((Bytef*) buf, &ulen,
+                   (Bytef*) cbuf+sizeof(SnapshotChunkHeader), ch->clen);
+  if (res != Z_OK || ulen != ch->ulen) goto error;
+
+ end:
+  if (cbuf) free(cbuf);
+  if (retval){ if (buf) free(buf); buf = 0; ulen = 0; }
+  *retbuf = buf;
+  *retlen = (int) ulen;
+  return retval;
+
+ error:
+  retval = -1;
+  goto end;
+}
+
+// Write a snapshot of all objects as of timestamp ts. The caller should pick
+// ts so that transactions that commit with a timestamp up to ts are already
+// done or pending (e.g., by waiting a while after picking it), and the
+// server keeps serving requests meanwhile. Objects are visited one bucket at
+// a time; if a transaction is pending on an object, wait for it to commit or
+// abort, since it may commit with a timestamp before ts.
+// Returns 0 if ok, non-zero if error.
+int LogInMemory::flushToFile(Timestamp &ts, char *flushfilename){
+  SnapshotWriter sw;
+  std::vector<COid> keys;
+  Ptr<TxUpdateCoid> tucoid;
+  int res, size, nbuckets, i, waited;
+  unsigned j;
+
+  res = sw.open(flushfilename, ts); if (res) return -1;
+
+  nbuckets = COidMap.GetNbuckets();
+  for (i=0; i < nbuckets; ++i){
+    keys.clear();
+    COidMap.getBucketKeys(i, keys);
+    for (j=0; j < keys.size(); ++j){
+      waited = 0;
+      while ((size = readCOid(keys[j], ts, tucoid, 0, 0)) ==
+             GAIAERR_PENDING_DATA){
+        if (waited >= SNAPSHOT_PENDING_WAIT_MS){
+          dprintf(1, "flushToFile: object %016llx:%016llx remains pending",
+                  (long long) keys[j].cid, (long long) keys[j].oid);
+          return -1;
+        }
+        mssleep(1);
+        ++waited;
+      }
+      if (size < 0) continue; // no version as of ts
+      res = sw.add(keys[j], tucoid, DS); if (res) return -1;
+    }
+  }
+  res = sw.close(); if (res) return -1;
+  dprintf(1, "flushToFile: wrote %lld objects to %s",
+          (long long) sw.getNObjects(), flushfilename);
+  return 0;
+}
+
+struct SnapshotLoadState {
+  LogInMemory *lim;
+  DiskStorage *ds;
+  SnapshotReader *sr;
+  Timestamp ts;
+  u32 nextchunk; // next chunk to be claimed by a thread
+  int error;
+};
+
+// Thread that loads chunks of a snapshot until none are left
+static OSTHREAD_FUNC loadChunksThread(void *parm){
+  SnapshotLoadState *sls = (SnapshotLoadState*) parm;
+  Ptr<TxUpdateCoid> tucoid;
+  COid coid;
+  FILE *f;
+  char *buf;
+  int i, len, res, nchunks;
+
+  nchunks = sls->sr->getNChunks();
+  while (!sls->error){
+    i = (int) AtomicInc32(&sls->nextchunk) - 1;
+    if (i >= nchunks) break;
+    res = sls->sr->readChunk(i, &buf, &len);
+    if (res){ sls->error = 1; break; }
+    f = fmemopen(buf, len, "r");
+    if (!f){ free(buf); sls->error = 1; break; }
+    while (1){
+      res = (int) fread((void*)&coid, 1, sizeof(COid), f);
+      if (res == 0) break;
+      if (res != sizeof(COid)){ sls->error = 1; break; }
+      res = sls->ds->readCOidFromFile(f, coid, tucoid);
+      if (res){ sls->error = 1; break; }
+      sls->lim->installCOid(coid, sls->ts, tucoid);
+    }
+    fclose(f);
+    free(buf);
+  }
+  return 0;
+}
+
+// Load a snapshot written by flushToFile, with chunks decompressed and
+// installed by SNAPSHOT_LOAD_THREADS threads. Objects are installed with a
+// new timestamp, so that they supersede what is in memory.
+// Returns 0 if ok, non-zero if error.
+int LogInMemory::loadFromFile(char *flushfilename){
+  SnapshotReader sr;
+  SnapshotLoadState sls;
+  OSThread_t thr[SNAPSHOT_LOAD_THREADS];
+  int i, res, nthreads;
+
+  res = sr.open(flushfilename); if (res) return -1;
+
+  sls.lim = this;
+  sls.ds = DS;
+  sls.sr = &sr;
+  sls.ts.setNew();
+  sls.nextchunk = 0;
+  sls.error = 0;
+  nthreads = sr.getNChunks();
+  if (nthreads > SNAPSHOT_LOAD_THREADS) nthreads = SNAPSHOT_LOAD_THREADS;
+  for (i=0; i < nthreads; ++i){
+    res = OSCreateThread(&thr[i], loadChunksThread, (void*) &sls);
+    assert(res==0);
+  }
+  for (i=0; i < nthreads; ++i) OSWaitThread(thr[i], 0);
+  if (sls.error) return -1;
+  dprintf(1, "loadFromFile: loaded %lld objects from %s",
+          (long long) sr.getNObjects(), flushfilename);
+  return 0;
+}
@@ -35,6 +35,7 @@
 #include "yesql-init.h"
 
 #include "dtreeaux.h"
+#include "scanfilter.h"
 
 //#include <assert.h>
 /************** Begin file global.c ******************************************/
@@ -10279,8 +10280,8 @@ SQLITE_PRIVATE const char *sqlite3OpcodeName(int i){
      /* 136 */ "Trace",
      /* 137 */ "Noop",
      /* 138 */ "Explain",
-     /* 139 */ "NotUsed_139",
-     /* 140 */ "NotUsed_140",
+     /* 139 */ "ScanFilter",
+     /* 140 */ "JoinBatch",
      /* 141 */ "ToText",
      /* 142 */ "ToBlob",
      /* 143 */ "ToNumeric",
@@ -18336,6 +18337,10 @@ SQLITE_PRIVATE VdbeOp *sqlite3VdbeGetOp(Vdbe *p, int addr){
 static char *displayP4(Op *pOp, char *zTemp, int nTemp){
   char *zP4 = zTemp;
   assert( nTemp>=20 );
+  if( pOp->opcode==OP_ScanFilter ){ // YESQUEL CH: added (P4 is binary)
+    sqlite3_snprintf(nTemp, zTemp, "filter(%d)", pOp->p3);
+    return zTemp;
+  }
   switch( pOp->p4type ){
     case P4_KEYINFO_STATIC:
     case P4_KEYINFO: {
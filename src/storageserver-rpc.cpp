@@ -241,6 +241,43 @@ int loadfileRpcStub(RPCTaskInfo *rti){
   return SchedulerTaskStateEnding;
 }
 
+int directoryRpcStub(RPCTaskInfo *rti){
+  DirectoryRPCData d;
+  Marshallable *resp;
+  d.demarshall(rti->data);
+  resp = directoryRpc(&d);
+  rti->setResp(resp);
+  return SchedulerTaskStateEnding;
+}
+int migrateRpcStub(RPCTaskInfo *rti){
+  MigrateRPCData d;
+  Marshallable *resp;
+  d.demarshall(rti->data);
+  resp = migrateRpc(&d);
+  rti->setResp(resp);
+  return SchedulerTaskStateEnding;
+}
+int replicateRpcStub(RPCTaskInfo *rti){
+  ReplicateRPCData d;
+  Marshallable *resp;
+  d.demarshall(rti->data);
+  resp = replicateRpc(&d);
+  rti->setResp(resp);
+  return SchedulerTaskStateEnding;
+}
+
+int filterreadRpcStub(RPCTaskInfo *rti){
+  FilterReadRPCData d;
+  Marshallable *resp;
+  bool defer;
+  defer = false;
+  d.demarshall(rti->data);
+  resp = filterreadRpc(&d, (void*) rti, defer);
+  if (defer) return SchedulerTaskStateWaiting;
+  rti->setResp(resp);
+  return SchedulerTaskStateEnding;
+}
+
 int inbacRpcStub(RPCTaskInfo *rti){;
   if (rti->nbFuncCalls == 0) {
     InbacRPCData d;
@@ -171,6 +171,10 @@ struct TaskMsgDataSplitterNewWork {
   //TaskMsgDataSplitterNewWork(COid &c, int w) : coid(c), where(w) {}
 };
 
+struct TaskMsgDataSplitterMergeWork {
+  COid coid; // coid to merge with a sibling
+};
+
 struct TaskMsgDataSplitterReply {
   SplitterStats stats; //
   COid coid; // coid that was just split, if stat.splitTimeRetryingMs == 0,
@@ -221,19 +225,41 @@ void SplitNode(COid &coid, ListCellPlus *cell){
   }
 }
 
+// Worker thread calls this function to request a sparse node to be merged
+// with a sibling. Like splits, merges are done by the splitter thread, but
+// with lower priority. Unlike splits, the worker is not told when the merge
+// is done: if the node is still sparse after being updated again, it will
+// ask again.
+void MergeNode(COid &coid){
+  TaskMsgDataSplitterMergeWork tmdsmw;
+  assert(sizeof(TaskMsgDataSplitterMergeWork) <= sizeof(TaskMsgData));
+  tmdsmw.coid = coid;
+  sendIFMsg(gContext.getThread(TCLASS_SPLITTER, 0),
+            IMMEDIATEFUNC_SPLITTERTHREADMERGEWORK, &tmdsmw,
+            sizeof(TaskMsgDataSplitterMergeWork));
+}
+
 // Reports access to a cell within a coid for load splitting. Periodically
 // check if a load split is needed and, if so, call SplitNode to get it.
 //
-// The cell object and its associated RcKeyInfo will be owned by the reporting
-// data structure
-void ReportAccess(COid &coid, ListCellPlus *cell){
+// The cell is copied if the reporting data structure needs to keep it
+void ReportAccess(COid &coid, ListCell &cell, Ptr<RcKeyInfo> prki){
   ServerSplitterState *SS = (ServerSplitterState*)
     tgetSharedSpace(THREADCONTEXT_SPACE_SPLITTER);
   assert(SS);
-  SS->Load.report(coid, cell);
+  SS->Load.report(coid, cell, prki);
   SS->Load.check();
 }
 
+// Returns whether coid is close to being hot, according to the load
+// statistics of this worker thread
+bool IsHotNode(COid &coid){
+  ServerSplitterState *SS = (ServerSplitterState*)
+    tgetSharedSpace(THREADCONTEXT_SPACE_SPLITTER);
+  assert(SS);
+  return SS->Load.isHot(coid);
+}
+
 // getrowid RPC implementation
 int ss_getrowidRpcStub(RPCTaskInfo *rti){
   GetRowidRPCData d;
@@ -378,6 +404,9 @@ public:
 struct ServerSplitterThreadState {
   SplitStats Stats;
   LinkList<ThreadSplitItem> ThreadSplitQueue;
+  LinkList<ThreadSplitItem> ThreadMergeQueue; // nodes to merge; processed
+                                             // only when there are no splits
+  Set<COid> MergeQueued; // coids in ThreadMergeQueue, to avoid duplicates
 };
 
 SplitStats *Stats=0;
@@ -406,6 +435,16 @@ void ImmediateFuncSplitterThreadNewWork(TaskMsgData &msgdata,
   else TSS->ThreadSplitQueue.pushTail(tsi);
 }
 
+void ImmediateFuncSplitterThreadMergeWork(TaskMsgData &msgdata,
+                                          TaskScheduler *ts, int srcthread){
+  TaskMsgDataSplitterMergeWork *mw = (TaskMsgDataSplitterMergeWork*) &msgdata;
+  ThreadSplitItem *tsi;
+  if (TSS->MergeQueued.insert(mw->coid)) return; // already queued
+  tsi = new ThreadSplitItem(mw->coid, 0, -1); // -1: no one to report to
+  assert(tsi);
+  TSS->ThreadMergeQueue.pushTail(tsi);
+}
+
 // remove repeated elements from split queue
 void cleanupThreadSplitQueue(void){
   ThreadSplitItem *ptr, *next;
@@ -453,12 +492,15 @@ OSTHREAD_FUNC ServerSplitterThread(void *parm){
   int res;
   assert(TSS);
   static int scount=0, xcount=0, ocount=0;
+  bool merging=false; // whether tsi is a merge rather than a split
 
   // SLauncher->initThreadContext("ServerSplitter",0);
   ts = tgetTaskScheduler();
 
   ts->assignImmediateFunc(IMMEDIATEFUNC_SPLITTERTHREADNEWWORK,
                           ImmediateFuncSplitterThreadNewWork);
+  ts->assignImmediateFunc(IMMEDIATEFUNC_SPLITTERTHREADMERGEWORK,
+                          ImmediateFuncSplitterThreadMergeWork);
 
   int sleepeventfd = ts->getSleepEventFd();
   struct pollfd ev;
@@ -475,6 +517,11 @@ OSTHREAD_FUNC ServerSplitterThread(void *parm){
         if (++scount % 100 == 0) dputchar(1, 'S');
         tsi = TSS->ThreadSplitQueue.popHead();
         tsi->starttime = Time::now();
+        merging = false;
+      } else if (!TSS->ThreadMergeQueue.empty()){
+        tsi = TSS->ThreadMergeQueue.popHead();
+        if (!tsi->starttime) tsi->starttime = Time::now();
+        merging = true;
       } else { // no work to do, try to go to sleep
         if (!something){ // start sleep cycle
           ts->setAsleep(1);
@@ -493,7 +540,23 @@ OSTHREAD_FUNC ServerSplitterThread(void *parm){
 	continue;
       }
     }
-    if (tsi){
+    if (tsi && merging){
+      // merges are best effort: if the merge fails, put it back at the end of
+      // the queue, behind other merges and any new splits, unless we have
+      // been trying for too long
+      res = DtMerge(tsi->coid, true); // merges of parents are triggered by
+      // the servers holding them, as with splits
+      if (res && res != GAIAERR_WRONG_TYPE &&
+          Time::now() - tsi->starttime < DTREE_MERGE_RETRY_MS){
+        TSS->ThreadMergeQueue.pushTail(tsi);
+        mssleep(1);
+      } else {
+        TSS->MergeQueued.remove(tsi->coid);
+        delete tsi;
+      }
+      tsi = 0;
+    }
+    else if (tsi){
       res = DtSplit(tsi->coid, tsi->cell, true, 0, 0);  // do not trigger
       // splitting of parents, since this will be detected at each server
       endtime = Time::now();
@@ -61,6 +61,7 @@
 #include "gaiarpcauxfunc.h"
 
 #include "dtreeaux.h"
+#include "scanfilter.h"
 
 #include "storageserver.h"
 #include "storageserverstate.h"
@@ -113,9 +114,79 @@ Marshallable *getstatusRpc(GetStatusRPCData *d){
   resp->data = new GetStatusRPCResp;
   resp->freedata = true;
   resp->data->reserved = 0;
+  resp->data->splitQueueSize = serverSplitQueueSize();
+  resp->data->nobjects = S->cLogInMemory.getNObjects();
+  resp->data->nrequests = S->NRequests;
+  resp->data->metricslen = 0;
+  resp->data->reserved2 = 0;
+  if (d->data->flags & GETSTATUS_FLAG_METRICS){
+    resp->metrics = new ServerMetrics;
+    getServerMetrics(resp->metrics);
+    resp->data->metricslen = sizeof(ServerMetrics);
+  }
   return resp;
 }
 
+// number of nodes waiting to be split at this server
+u32 serverSplitQueueSize(void){
+  u32 size = 0;
+#if defined(STORAGESERVER_SPLITTER) && !defined(LOCALSTORAGE)
+  int ExtractQueueFromServerSplitterState(void *sss);
+  void *sss = tgetSharedSpace(THREADCONTEXT_SPACE_SPLITTER);
+  if (sss) size = ExtractQueueFromServerSplitterState(sss);
+#endif
+  return size;
+}
+
+void getServerMetrics(ServerMetrics *m){
+  m->reset();
+  ServerMetricsCollect(m);
+  m->splitQueueSize = serverSplitQueueSize();
+  m->nobjects = S->cLogInMemory.getNObjects();
+  m->nversions = S->cLogInMemory.getNVersions();
+  m->pendingTxs = S->cPendingTx.getNPending();
+}
+
+// Applies a subtransaction level change to the updates of a transaction.
+// Action 0 discards updates with level > level, action 1 changes updates
+// with level > level to level.
+static void applySubtrans(Ptr<PendingTxInfo> &pti, int level, int action){
+  SkipListNode<COid,Ptr<TxRawCoid> > *ptr, *next;
+  Ptr<TxRawCoid> trcoid;
+  int empty;
+  // iterate over all objects updated by transaction
+  for (ptr = pti->coidinfo.getFirst(); ptr != pti->coidinfo.getLast();
+       ptr = next){
+    next = pti->coidinfo.getNext(ptr);
+    trcoid = ptr->value;
+    switch(action){
+    case 0: // abort
+      empty = trcoid->abortLevel(level);
+      if (empty){
+        Ptr<TxRawCoid> tmptrcoid;
+        pti->coidinfo.lookupRemove(ptr->key, 0, tmptrcoid);
+      }
+      break;
+    case 1: // release
+      trcoid->releaseLevel(level);
+      break;
+    default: // error
+      assert(0);
+      break;
+    }
+  }
+}
+
+// Applies the level changes piggybacked on a request (see SubtransHeader)
+static void applySubtransHeader(Ptr<PendingTxInfo> &pti, SubtransHeader &sh){
+  if (sh.empty()) return;
+  dprintf(1, "SUBTRA   piggybacked abort lev %d release lev %d",
+          sh.abortlevel, sh.releaselevel);
+  if (sh.abortlevel != SUBTRANS_NOLEVEL) applySubtrans(pti, sh.abortlevel, 0);
+  if (sh.releaselevel != SUBTRANS_NOLEVEL)
+    applySubtrans(pti, sh.releaselevel, 1);
+}
+
 Marshallable *writeRpc(WriteRPCData *d){
   Ptr<PendingTxInfo> pti;
   WriteRPCRespData *resp;
@@ -128,6 +199,7 @@ Marshallable *writeRpc(WriteRPCData *d){
   int status=0;
 
   assert(S); // if this assert fails, forgot to call initStorageServer()
+  AtomicInc64(&S->NRequests);
   dshowchar('w');
 
   coid.cid = d->data->cid;
@@ -145,6 +217,13 @@ Marshallable *writeRpc(WriteRPCData *d){
 #endif
 
   S->cPendingTx.getInfo(d->data->tid, pti);
+  applySubtransHeader(pti, d->data->subtrans);
+
+  status = S->checkOwner(coid, true);
+  if (status){ // object not here or being migrated
+    pti->status = PTISTATUS_VOTEDNO; // tx must abort
+    goto end;
+  }
 
   twi = new TxWriteItem(coid, d->data->level);
   buf = (char*) malloc(d->data->len);
@@ -167,6 +246,7 @@ Marshallable *writeRpc(WriteRPCData *d){
   if (IsCoidCachable(coid))
     pti->updatesCachable = true; // marks tx as updating cachable data
 
+ end:
   //pti->unlock();
   resp = new WriteRPCRespData;
   resp->data = new WriteRPCResp;
@@ -185,6 +265,7 @@ Marshallable *readRpc(ReadRPCData *d, void *handle, bool &defer){
   Ptr<TxUpdateCoid> tucoid;
 
   assert(S); // if this assert fails, forgot to call initStorageServer()
+  AtomicInc64(&S->NRequests);
   dshowchar('r');
 #ifndef SHORT_OP_LOG
   dprintf(1, "READ     tid %016llx:%016llx coid %016llx:%016llx "
@@ -202,9 +283,15 @@ Marshallable *readRpc(ReadRPCData *d, void *handle, bool &defer){
   coid.cid=d->data->cid;
   coid.oid=d->data->oid;
 
-  res = S->cLogInMemory.readCOid(coid, d->data->ts, tucoid, &readts, handle);
+  res = S->checkOwner(coid, false);
+  if (!res) res = S->cRepl.checkRead(d->data->ts); // backup may be behind
+  if (!res)
+    res = S->cLogInMemory.readCOid(coid, d->data->ts, tucoid, &readts, handle);
 
   if (res == GAIAERR_DEFER_RPC){ // defer the RPC
+#ifdef SERVER_METRICS
+    ++ServerMetricsLocal()->deferredReads;
+#endif
     defer = true; // defer RPC (go to sleep instead of finishing task)
     return 0;
   }
@@ -244,6 +331,7 @@ Marshallable *readRpc(ReadRPCData *d, void *handle, bool &defer){
   }
 
   updateRPCResp(resp->data); // updated piggybacked fields for client caching
+  resp->data->safeTs = S->cSafeTs.get(); // for read-only transactions
 
 #ifndef SHORT_OP_LOG
   dprintf(1, "READR    tid %016llx:%016llx coid %016llx:%016llx "
@@ -264,6 +352,109 @@ Marshallable *readRpc(ReadRPCData *d, void *handle, bool &defer){
   return resp;
 }
 
+Marshallable *filterreadRpc(FilterReadRPCData *d, void *handle, bool &defer){
+  FilterReadRPCRespData *resp;
+  FilterReadRPCItem *items;
+  Ptr<TxUpdateCoid> *tucoids;
+  TxWriteItem *twi;
+  COid coid;
+  int i, res, skip, buflen, nmatch;
+  char *buf;
+
+  assert(S); // if this assert fails, forgot to call initStorageServer()
+  AtomicInc64(&S->NRequests);
+  dshowchar('f');
+#ifndef SHORT_OP_LOG
+  dprintf(1, "FREAD    tid %016llx:%016llx cid %016llx noids %d "
+          "ts %016llx:%016llx filterlen %d",
+          (long long)d->data->tid.d1, (long long)d->data->tid.d2,
+          (long long)d->data->cid, d->data->noids,
+          (long long)d->data->ts.getd1(), (long long)d->data->ts.getd2(),
+          d->data->filterlen);
+#else
+  dshortprintf(1, "FREAD    %016llx noids %d", (long long)d->data->cid,
+               d->data->noids);
+#endif
+
+  items = new FilterReadRPCItem[d->data->noids];
+  tucoids = new Ptr<TxUpdateCoid>[d->data->noids];
+  skip = d->data->skip;
+  coid.cid = d->data->cid;
+  buflen = 0;
+  nmatch = 0;
+
+  // read the objects and evaluate the filter
+  for (i=0; i < d->data->noids; ++i){
+    coid.oid = d->data->oids[i];
+    items[i].readts.setIllegal();
+    items[i].len = 0;
+    res = S->checkOwner(coid, false);
+    if (!res) res = S->cRepl.checkRead(d->data->ts); // backup may be behind
+    if (!res)
+      res = S->cLogInMemory.readCOid(coid, d->data->ts, tucoids[i],
+                                     &items[i].readts, handle);
+    if (res == GAIAERR_DEFER_RPC){ // defer the whole RPC, which is rerun
+                                   // from the beginning when woken up
+#ifdef SERVER_METRICS
+      ++ServerMetricsLocal()->deferredReads;
+#endif
+      delete [] items;
+      delete [] tucoids;
+      defer = true;
+      return 0;
+    }
+    if (!res && tucoids[i]->WriteSV) res = GAIAERR_WRONG_TYPE;
+    if (res < 0){ items[i].status = res; continue; }
+
+    twi = tucoids[i]->Writevalue;
+    assert(twi);
+    if (twi->len >= skip &&
+        !ScanFilterMatch(d->data->filter, d->data->filterlen, twi->buf + skip,
+                         twi->len - skip))
+      items[i].status = FILTERREAD_FILTERED;
+    else {
+      items[i].status = FILTERREAD_MATCH;
+      items[i].len = twi->len;
+      buflen += twi->len;
+      ++nmatch;
+    }
+  }
+
+  // gather the data of matching objects
+  buf = buflen ? (char*) malloc(buflen) : 0;
+  buflen = 0;
+  for (i=0; i < d->data->noids; ++i){
+    if (items[i].status != FILTERREAD_MATCH) continue;
+    memcpy(buf + buflen, tucoids[i]->Writevalue->buf, items[i].len);
+    buflen += items[i].len;
+  }
+  delete [] tucoids;
+
+  resp = new FilterReadRPCRespData;
+  resp->data = new FilterReadRPCResp;
+  resp->data->status = 0;
+  resp->data->nitems = d->data->noids;
+  resp->data->buflen = buflen;
+  resp->data->reserved = 0;
+  resp->data->safeTs = S->cSafeTs.get(); // for read-only transactions
+  resp->data->items = items;
+  resp->data->buf = buf;
+  resp->freedata = true;
+
+#ifndef SHORT_OP_LOG
+  dprintf(1, "FREADR   tid %016llx:%016llx cid %016llx noids %d "
+          "[match %d len %d]",
+          (long long)d->data->tid.d1, (long long)d->data->tid.d2,
+          (long long)d->data->cid, d->data->noids, nmatch, buflen);
+#else
+  dshortprintf(1, "FREADR   %016llx [match %d len %d]",
+               (long long)d->data->cid, nmatch, buflen);
+#endif
+
+  defer = false;
+  return resp;
+}
+
 Marshallable *fullwriteRpc(FullWriteRPCData *d){
   Ptr<PendingTxInfo> pti;
   FullWriteRPCRespData *resp;
@@ -275,6 +466,7 @@ Marshallable *fullwriteRpc(FullWriteRPCData *d){
   int status=0;
 
   assert(S); // if this assert fails, forgot to call initStorageServer()
+  AtomicInc64(&S->NRequests);
   dshowchar('W');
 #ifndef SHORT_OP_LOG
   dprintf(1, "WRITESV  tid %016llx:%016llx coid %016llx:%016llx nattrs %d "
@@ -289,12 +481,19 @@ Marshallable *fullwriteRpc(FullWriteRPCData *d){
        d->data->level);
 #endif
 
+  coid.cid = d->data->cid;
+  coid.oid = d->data->oid;
+
   S->cPendingTx.getInfo(d->data->tid, pti);
+  applySubtransHeader(pti, d->data->subtrans);
 
-  twsvi = fullWriteRPCParmToTxWriteSVItem(d->data);
+  status = S->checkOwner(coid, true);
+  if (status){ // object not here or being migrated
+    pti->status = PTISTATUS_VOTEDNO; // tx must abort
+    goto end;
+  }
 
-  coid.cid = d->data->cid;
-  coid.oid = d->data->oid;
+  twsvi = fullWriteRPCParmToTxWriteSVItem(d->data);
 
   res = pti->coidinfo.lookupInsert(coid, trcoidptr);
   if (res){
@@ -303,6 +502,7 @@ Marshallable *fullwriteRpc(FullWriteRPCData *d){
   } else trcoid = *trcoidptr;
   trcoid->add(twsvi);
 
+ end:
   //pti->unlock();
   resp = new FullWriteRPCRespData;
   resp->data = new FullWriteRPCResp;
@@ -322,6 +522,7 @@ Marshallable *fullreadRpc(FullReadRPCData *d, void *handle, bool &defer){
   Ptr<TxUpdateCoid> tucoid;
 
   assert(S); // if this assert fails, forgot to call initStorageServer()
+  AtomicInc64(&S->NRequests);
   dshowchar('R');
 
 #ifndef SHORT_OP_LOG
@@ -341,17 +542,21 @@ Marshallable *fullreadRpc(FullReadRPCData *d, void *handle, bool &defer){
 
 #if defined(STORAGESERVER_SPLITTER) && !defined(LOCALSTORAGE) && (DTREE_SPLIT_LOCATION != 1) && defined(DTREE_LOADSPLITS)
   if (d->data->cellPresent){
-    ListCellPlus *cell;
     //printf("FULLREADRPC got cell nkey %lld (%llx) pkey %p\n",
     //   (long long) d->data->cell.nKey, (long long) d->data->cell.nKey,
     //   d->data->cell.pKey);
-    cell = new ListCellPlus(d->data->cell, d->data->prki);
-    ReportAccess(coid, cell);
+    ReportAccess(coid, d->data->cell, d->data->prki);
   }
 #endif
-  res = S->cLogInMemory.readCOid(coid, d->data->ts, tucoid, &readts, handle);
+  res = S->checkOwner(coid, false);
+  if (!res) res = S->cRepl.checkRead(d->data->ts); // backup may be behind
+  if (!res)
+    res = S->cLogInMemory.readCOid(coid, d->data->ts, tucoid, &readts, handle);
 
   if (res == GAIAERR_DEFER_RPC){ // defer the RPC
+#ifdef SERVER_METRICS
+    ++ServerMetricsLocal()->deferredReads;
+#endif
     defer = true; // special value to mark RPC as deferred
     return 0;
   }
@@ -403,6 +608,7 @@ Marshallable *fullreadRpc(FullReadRPCData *d, void *handle, bool &defer){
   }
 
   updateRPCResp(resp->data); // updated piggybacked fields for client caching
+  resp->data->safeTs = S->cSafeTs.get(); // for read-only transactions
 
 #ifndef SHORT_OP_LOG
   dprintf(1, "READSVR  tid %016llx:%016llx coid %016llx:%016llx "
@@ -530,6 +736,7 @@ Marshallable *listaddRpc(ListAddRPCData *d, void *&state){
 #endif
 
   assert(S); // if this assert fails, forgot to call initStorageServer()
+  AtomicInc64(&S->NRequests);
   dshowchar('+');
 #ifndef SHORT_OP_LOG
   dprintf(1, "LISTADD  tid %016llx:%016llx coid %016llx:%016llx nkey %lld "
@@ -564,6 +771,13 @@ Marshallable *listaddRpc(ListAddRPCData *d, void *&state){
 #endif
 
   S->cPendingTx.getInfo(d->data->tid, pti);
+  applySubtransHeader(pti, d->data->subtrans);
+
+  status = S->checkOwner(coid, true);
+  if (status){ // object not here or being migrated
+    pti->status = PTISTATUS_VOTEDNO; // tx must abort
+    goto end;
+  }
 
   // when flags&1: check that we are at leaf node and that cell is in scope for
   //     this node. In that case, add cell to node if it isn't there already
@@ -665,6 +879,7 @@ Marshallable *listdelrangeRpc(ListDelRangeRPCData *d){
   int status=0;
 
   assert(S); // if this assert fails, forgot to call initStorageServer()
+  AtomicInc64(&S->NRequests);
   dshowchar('-');
 #ifndef SHORT_OP_LOG
   dprintf(1, "LISTDELR tid %016llx:%016llx coid %016llx:%016llx "
@@ -685,15 +900,22 @@ Marshallable *listdelrangeRpc(ListDelRangeRPCData *d){
   coid.oid = d->data->oid;
 
   S->cPendingTx.getInfo(d->data->tid, pti);
+  applySubtransHeader(pti, d->data->subtrans);
+
+  status = S->checkOwner(coid, true);
+  if (status){ // object not here or being migrated
+    pti->status = PTISTATUS_VOTEDNO; // tx must abort
+    goto end;
+  }
 
   res = pti->coidinfo.lookupInsert(coid, trcoidptr);
   if (res){ *trcoidptr = new TxRawCoid; }
   trcoid = *trcoidptr;
 
-  TxListDelRangeItem *tldri = new TxListDelRangeItem(coid, d->data->prki,
-       d->data->intervalType, d->data->cell1, d->data->cell2, d->data->level);
-  trcoid->add(tldri);
+  trcoid->add(new TxListDelRangeItem(coid, d->data->prki,
+       d->data->intervalType, d->data->cell1, d->data->cell2, d->data->level));
 
+ end:
   //pti->unlock();
   resp = new ListDelRangeRPCRespData;
   resp->data = new ListDelRangeRPCResp;
@@ -715,6 +937,7 @@ Marshallable *attrsetRpc(AttrSetRPCData *d){
   int status=0;
 
   assert(S); // if this assert fails, forgot to call initStorageServer()
+  AtomicInc64(&S->NRequests);
   dshowchar('a');
 #ifndef SHORT_OP_LOG
   dprintf(1, "ATTRSET  tid %016llx:%016llx coid %016llx:%016llx attrid %x "
@@ -732,14 +955,21 @@ Marshallable *attrsetRpc(AttrSetRPCData *d){
   coid.oid = d->data->oid;
 
   S->cPendingTx.getInfo(d->data->tid, pti);
+  applySubtransHeader(pti, d->data->subtrans);
+
+  status = S->checkOwner(coid, true);
+  if (status){ // object not here or being migrated
+    pti->status = PTISTATUS_VOTEDNO; // tx must abort
+    goto end;
+  }
 
   res = pti->coidinfo.lookupInsert(coid, trcoidptr);
   if (res){ *trcoidptr = new TxRawCoid; }
   trcoid = *trcoidptr;
   assert(d->data->attrid < GAIA_MAX_ATTRS);
-  TxSetAttrItem *tsai = new TxSetAttrItem(coid, d->data->attrid,
-                                          d->data->attrvalue, d->data->level);
-  trcoid->add(tsai);
+  trcoid->add(new TxSetAttrItem(coid, d->data->attrid,
+                                d->data->attrvalue, d->data->level));
+ end:
   //pti->unlock();
   resp = new AttrSetRPCRespData;
   resp->data = new AttrSetRPCResp;
@@ -785,6 +1015,7 @@ Marshallable *prepareRpc(PrepareRPCData *d, void *&state, void *rpctasknotify){
   int waitforlog;
   PREPARERPCState *pstate = (PREPARERPCState*) state;
   int immediatetransition=0;
+  int votereason=VoteNoWrongServer; // why we vote no, for metrics
 
   assert(S); // if this assert fails, forgot to call initStorageServer()
   dshowchar('p');
@@ -810,8 +1041,15 @@ Marshallable *prepareRpc(PrepareRPCData *d, void *&state, void *rpctasknotify){
       abort();
       vote=1; goto end;
     }
+    applySubtransHeader(pti, d->data->subtrans);
     if (pti->status == PTISTATUS_VOTEDYES){ vote=0; goto end; }
-    if (pti->status == PTISTATUS_VOTEDNO){ vote=1; goto end; }
+    if (pti->status == PTISTATUS_VOTEDNO){ // update refused by checkOwner
+      vote=1;
+#ifdef SERVER_METRICS
+      ++ServerMetricsLocal()->voteNo[VoteNoWrongServer];
+#endif
+      goto end;
+    }
     if (pti->status == PTISTATUS_CLEAREDABORT){
       printf("Yesquel critical error: tx status os cleared abort on prepare\n");
       fflush(stdout);
@@ -893,6 +1131,7 @@ Marshallable *prepareRpc(PrepareRPCData *d, void *&state, void *rpctasknotify){
         // check for pending updates
         if (!looim->pendingentries.empty()){
           vote = 1;
+          votereason = VoteNoReadSet;
         }
         else {
           // check for updates in logentries
@@ -901,6 +1140,7 @@ Marshallable *prepareRpc(PrepareRPCData *d, void *&state, void *rpctasknotify){
           if (sleim != looim->logentries.rGetLast()){
             if (Timestamp::cmp(sleim->ts, startts) >= 0){
               vote = 1; // something changed
+              votereason = VoteNoReadSet;
             }
           }
         }
@@ -923,6 +1163,14 @@ Marshallable *prepareRpc(PrepareRPCData *d, void *&state, void *rpctasknotify){
       //looim->printdetail(ptr->key, false);
       looim_list.pushTail(looim); // looims that we locked
 
+      // refuse if object is not here or is being migrated. This is checked
+      // with the object locked, so that MIGRATE_OP_PENDING, which counts
+      // pending entries under the same lock, does not miss this tx
+      if (S->checkOwner(ptr->key, true)){
+        vote = 1;
+        votereason = VoteNoWrongServer;
+      }
+
       // check last-read timestamp
       if (Timestamp::cmp(proposecommitts, looim->LastRead) < 0)
         proposecommitts = looim->LastRead; // track largest read timestamp seen
@@ -944,6 +1192,7 @@ Marshallable *prepareRpc(PrepareRPCData *d, void *&state, void *rpctasknotify){
           if (sleim->tucoid->hasConflicts(tucoid, sleim)){
             // conflict, must abort
             vote = 1;
+            votereason = VoteNoCommitted;
             break;
           }
         }
@@ -960,6 +1209,7 @@ Marshallable *prepareRpc(PrepareRPCData *d, void *&state, void *rpctasknotify){
           if (sleim->tucoid->hasConflicts(tucoid, sleim)){
             // conflict, must abort
             vote = 1;
+            votereason = VoteNoPending;
             break;
           }
         }
@@ -970,6 +1220,11 @@ Marshallable *prepareRpc(PrepareRPCData *d, void *&state, void *rpctasknotify){
     done_checking_votes:
 #endif
 
+#ifdef SERVER_METRICS
+    if (vote) ++ServerMetricsLocal()->voteNo[votereason];
+    else ++ServerMetricsLocal()->voteYes;
+#endif
+
     if (vote){ // if aborting, then release locks immediately
       pti->status = PTISTATUS_VOTEDNO;
       for (looim_list_it = looim_list.getFirst();
@@ -982,6 +1237,9 @@ Marshallable *prepareRpc(PrepareRPCData *d, void *&state, void *rpctasknotify){
     }
     else { // vote is to commit
       pti->status = PTISTATUS_VOTEDYES;
+      // keep proposecommitts above timestamps that may already be read
+      // without waiting (see safets.h)
+      S->cSafeTs.prepared(d->data->tid, proposecommitts);
       // (4) add entry to in-memory pendingentries
       ptr = pti->coidinfo.getFirst();
       looim_list_it = looim_list.getFirst();
@@ -1114,6 +1372,18 @@ int checkTucoidForGrowth(Ptr<TxUpdateCoid> tucoid){
   return 0;
 }
 
+// checks if tucoid has operations that could have made it sparse:
+// a listdelrange or a write of the entire value
+int checkTucoidForShrink(Ptr<TxUpdateCoid> tucoid){
+  if (tucoid->WriteSV){ return 1; } // if tx is writing value, then yes
+  for (TxListItem *tli = tucoid->Litems.getFirst();
+       tli != tucoid->Litems.getLast();
+       tli = tucoid->Litems.getNext(tli)){
+    if (tli->type == 1){ return 1;} // listdelrange item
+  }
+  return 0;
+}
+
 // does the actual work in COMMITRPC
 // Assumes lock is held in pti.
 int doCommitWork(CommitRPCParm *parm, Ptr<PendingTxInfo> pti,
@@ -1123,6 +1393,7 @@ int doCommitWork(CommitRPCParm *parm, Ptr<PendingTxInfo> pti,
   SingleLogEntryInMemory *pendingsleim;
 #if (DTREE_SPLIT_LOCATION != 1) && !defined(LOCALSTORAGE)
   Set<COid> toSplit;
+  Set<COid> toMerge;
 #endif
   int status=0;
   waitingts.setIllegal();
@@ -1152,7 +1423,8 @@ int doCommitWork(CommitRPCParm *parm, Ptr<PendingTxInfo> pti,
 #if (DTREE_SPLIT_LOCATION != 1) && !defined(LOCALSTORAGE)
         // check if coid has listadd, listdelrange, or fullwrite operations
         if (checkTucoidForGrowth(tucoid)){
-          int res;
+          int res, shrink;
+          shrink = checkTucoidForShrink(tucoid);
           Ptr<TxUpdateCoid> tucoid;
           // check if the coid has become too large
           res = S->cLogInMemory.readCOid(ptr->key, parm->committs, tucoid,0,0);
@@ -1168,14 +1440,19 @@ int doCommitWork(CommitRPCParm *parm, Ptr<PendingTxInfo> pti,
             TxWriteSVItem *twsvi = tucoid->WriteSV;
             if (twsvi){
               int ncells = twsvi->cells.getNitems();
-              // split if too many cells
-              if (ncells > DTREE_SPLIT_SIZE) toSplit.insert(ptr->key);
-              else {
-                int sizecells = ListCellsSize(twsvi->cells);
-                // split if cell size is too large, but not if too few cells
-                if (sizecells > DTREE_SPLIT_SIZE_BYTES && ncells >= 2)
-                  toSplit.insert(ptr->key);
-              } // else
+              int sizecells = ListCellsSize(twsvi->cells);
+              // use the thresholds of the node's table, which nodes carry
+              // in their flags
+              DTreeThresholds thresholds(twsvi->nattrs > DTREENODE_ATTRIB_FLAGS
+                              ? twsvi->attrs[DTREENODE_ATTRIB_FLAGS] : 0);
+              // split if too many cells or cell size is too large, but not if
+              // too few cells
+              if (thresholds.needSplit(ncells, sizecells))
+                toSplit.insert(ptr->key);
+              // merge if node became too sparse (except root)
+              else if (shrink && ptr->key.oid != 0 &&
+                       thresholds.needMerge(ncells, sizecells))
+                toMerge.insert(ptr->key);
             } // if
           } // else
         } // if checkTucoidForGrowth
@@ -1184,6 +1461,8 @@ int doCommitWork(CommitRPCParm *parm, Ptr<PendingTxInfo> pti,
     } // for
 
     S->cDiskLog.logCommitAsync(parm->tid, parm->committs);
+    S->cRepl.committed(parm->tid, parm->committs, pti);
+    S->cSafeTs.finished(parm->tid);
 
 #if (DTREE_SPLIT_LOCATION != 1) && !defined(LOCALSTORAGE)
     // now issue splits
@@ -1192,6 +1471,14 @@ int doCommitWork(CommitRPCParm *parm, Ptr<PendingTxInfo> pti,
          coidnode = toSplit.getNext(coidnode)){
       SplitNode(coidnode->key, 0);
     }
+    for (coidnode = toMerge.getFirst(); coidnode != toMerge.getLast();
+         coidnode = toMerge.getNext(coidnode)){
+#ifdef DTREE_LOADSPLITS
+      // a sparse node that is hot was probably left by a load split
+      if (IsHotNode(coidnode->key)) continue;
+#endif
+      MergeNode(coidnode->key);
+    }
 #endif
   } else {
     // note: abort due to application (parm->commit == 2) does not
@@ -1211,6 +1498,7 @@ int doCommitWork(CommitRPCParm *parm, Ptr<PendingTxInfo> pti,
         }
       }
       S->cDiskLog.logAbortAsync(parm->tid, parm->committs);
+      S->cSafeTs.finished(parm->tid);
     }
     pti->clear();   // delete update items in transaction
     // question: will this free the tucoids within the pti? I believe so,
@@ -1302,32 +1590,7 @@ Marshallable *subtransRpc(SubtransRPCData *d){
       fflush(stdout);
       abort();
     }
-    else {
-      SkipListNode<COid,Ptr<TxRawCoid> > *ptr, *next;
-      Ptr<TxRawCoid> trcoid;
-      int empty;
-      // iterate over all objects updated by transaction
-      for (ptr = pti->coidinfo.getFirst(); ptr != pti->coidinfo.getLast();
-           ptr = next){
-        next = pti->coidinfo.getNext(ptr);
-        trcoid = ptr->value;
-        switch(d->data->action){
-        case 0: // abort
-          empty = trcoid->abortLevel(d->data->level);
-          if (empty){
-            Ptr<TxRawCoid> tmptrcoid;
-            pti->coidinfo.lookupRemove(ptr->key, 0, tmptrcoid);
-          }
-          break;
-        case 1: // release
-          trcoid->releaseLevel(d->data->level);
-          break;
-        default: // error
-          assert(0);
-          break;
-        }
-      }
-    }
+    else applySubtrans(pti, d->data->level, d->data->action);
     //pti->unlock();
   }
 
@@ -1446,6 +1709,108 @@ Marshallable *loadfileRpc(LoadFileRPCData *d){
   return resp;
 }
 
+Marshallable *directoryRpc(DirectoryRPCData *d){
+  DirectoryRPCRespData *resp;
+  PlacementDir *dir;
+  int status=0;
+  assert(S); // if this assert fails, forgot to call initStorageServer()
+  dshowchar('y');
+
+  if (d->data->set){
+    if (d->data->dirlen != sizeof(PlacementDir)) status = GAIAERR_GENERIC;
+    else {
+      dir = (PlacementDir*) d->data->dir;
+      dprintf(1, "Directory: set epoch %u", dir->epoch);
+      if (!S->Dir || dir->nservers != S->Dir->nservers)
+        status = GAIAERR_GENERIC;
+      else S->setDirectory(dir); // ignored if not newer
+    }
+  }
+
+  dir = S->Dir;
+  resp = new DirectoryRPCRespData;
+  resp->data = new DirectoryRPCResp;
+  resp->freedata = true;
+  resp->data->status = status;
+  resp->data->epoch = dir ? dir->epoch : 0;
+  resp->data->dirlen = dir ? (int) sizeof(PlacementDir) : 0;
+  resp->data->dir = (char*) dir; // never freed, see StorageServerState::Dir
+  return resp;
+}
+
+Marshallable *migrateRpc(MigrateRPCData *d){
+  MigrateRPCRespData *resp;
+  u8 *inbucket;
+  int i;
+  int status=0;
+  u64 count=0;
+  char *buf=0;
+  int len=0;
+  assert(S); // if this assert fails, forgot to call initStorageServer()
+  dshowchar('m');
+
+  inbucket = new u8[PLACEMENT_NBUCKETS];
+  memset(inbucket, 0, PLACEMENT_NBUCKETS);
+  for (i=0; i < d->data->nbuckets; ++i) inbucket[d->data->buckets[i]] = 1;
+  dprintf(1, "Migrate: op %d nbuckets %d len %d", d->data->op,
+          d->data->nbuckets, d->data->len);
+
+  switch(d->data->op){
+  case MIGRATE_OP_FREEZE:
+  case MIGRATE_OP_SEAL:
+  case MIGRATE_OP_UNFREEZE:
+    for (i=0; i < d->data->nbuckets; ++i)
+      S->Frozen[d->data->buckets[i]] = d->data->op == MIGRATE_OP_FREEZE ? 1 :
+                                       d->data->op == MIGRATE_OP_SEAL ? 2 : 0;
+    MemBarrier(); // ensure freeze is visible before counting pending entries
+    break;
+  case MIGRATE_OP_PENDING:
+    count = S->cLogInMemory.countPending(inbucket);
+    break;
+  case MIGRATE_OP_EXPORT:
+    status = S->cLogInMemory.exportBuckets(inbucket, &buf, &len, &count);
+    break;
+  case MIGRATE_OP_IMPORT:
+    status = S->cLogInMemory.importBuckets(d->data->buf, d->data->len, &count);
+    break;
+  default:
+    status = GAIAERR_NOT_IMPL;
+  }
+  delete [] inbucket;
+
+  resp = new MigrateRPCRespData;
+  resp->data = new MigrateRPCResp;
+  resp->freedata = true;
+  resp->freebuf = buf;
+  resp->data->status = status;
+  resp->data->len = len;
+  resp->data->count = count;
+  resp->data->buf = buf;
+  return resp;
+}
+
+Marshallable *replicateRpc(ReplicateRPCData *d){
+  ReplicateRPCRespData *resp;
+  int status;
+  assert(S); // if this assert fails, forgot to call initStorageServer()
+  dshowchar('R');
+
+  if (!S->cRepl.isBackup()) status = GAIAERR_WRONG_SERVER;
+  else status = S->cRepl.apply(&S->cLogInMemory, d->data->op,
+                   d->data->streamid, d->data->seq, d->data->watermark,
+                   d->data->buf, d->data->len);
+  dprintf(1, "Replicate: op %d seq %llu len %d status %d", d->data->op,
+          (unsigned long long) d->data->seq, d->data->len, status);
+
+  resp = new ReplicateRPCRespData;
+  resp->data = new ReplicateRPCResp;
+  resp->freedata = true;
+  resp->data->status = status;
+  resp->data->reserved = 0;
+  resp->data->count = 0;
+  return resp;
+}
+
 Marshallable *inbacRpc(InbacRPCData *d, void *&state, void *rpctasknotify) {
 
   RPCTaskInfo *rti = (RPCTaskInfo*) rpctasknotify;
@@ -1463,6 +1828,7 @@ Marshallable *inbacRpc(InbacRPCData *d, void *&state, void *rpctasknotify) {
   rpcdata->data->tid = d->data->tid;
   rpcdata->data->startts = d->data->committs;
   rpcdata->data->onephasecommit = d->data->onephasecommit;
+  rpcdata->data->subtrans = d->data->subtrans;
 
   rpcdata->data->piggy_cid = d->data->piggy_cid;
   rpcdata->data->piggy_oid = d->data->piggy_oid;
@@ -37,6 +37,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <assert.h>
 #include <limits.h>
 #include <sys/types.h>
@@ -57,4 +58,13 @@ StorageServerState::StorageServerState(HostConfig *hc) :
       {
         cLogInMemory.setSingleVersion(true); // keep only one version of
                                              // each object
+        NRequests = 0;
+        Dir = 0;
+        MyServerno = -1;
+        memset(Frozen, 0, sizeof(Frozen));
       }
+
+// local storage has no placement directory
+int StorageServerState::setDirectory(PlacementDir *newdir){
+  return -1;
+}
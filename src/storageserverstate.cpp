@@ -65,5 +65,26 @@ StorageServerState::StorageServerState(HostConfig *hc) :
       {
         Rpcc = hc->Rpcc;
         ipport = hc->ipport;
+        NRequests = 0;
+        Dir = 0;
+        MyServerno = -1;
+        memset(Frozen, 0, sizeof(Frozen));
         cDiskLog.launch();
       }
+
+int StorageServerState::setDirectory(PlacementDir *newdir){
+  PlacementDir *dir;
+  int b;
+
+  DirLock.lock();
+  if (Dir && newdir->epoch <= Dir->epoch){ DirLock.unlock(); return -1; }
+  dir = new PlacementDir;
+  *dir = *newdir;
+  MemBarrier(); // ensure directory contents are visible before the pointer
+  Dir = dir;
+  for (b=0; b < PLACEMENT_NBUCKETS; ++b)
+    if (dir->owner[b] != MyServerno) Frozen[b] = 0;
+  if (Rpcc) (*Rpcc)->setReplyTag((u16)(dir->epoch & FLAG_TAG_MASK));
+  DirLock.unlock();
+  return 0;
+}
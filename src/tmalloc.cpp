@@ -223,6 +223,7 @@ void FixedAllocatorNolock::grow(int inc){
     tmp += Realsize;
   }
   pbprev->next = savenext;
+  NUnits += inc;
 }
 
 FixedAllocatorNolock::FixedAllocatorNolock(int size, int startpool,
@@ -240,6 +241,7 @@ FixedAllocatorNolock::FixedAllocatorNolock(int size, int startpool,
   Realsize = Size + sizeof(PadBefore) + sizeof(PadAfter);
   IncGrow = incgrow;
   NAllocated = 0;
+  NUnits = 0;
   Tag = tag;
   PageSize = pagesize;
   PageAllocFunc = pageallocfunc;
@@ -390,6 +392,17 @@ void VariableAllocatorNolock::free(void *ptr){
   FixedPools[pool].free(ptr);
 }
 
+void VariableAllocatorNolock::getUsage(size_t *inuse, size_t *reserved){
+  int i;
+  *inuse = *reserved = 0;
+  for (i=0; i < VARALLOC_NPOOLS; ++i){
+    *inuse += (size_t) FixedPools[i].getNAllocated() *
+              FixedPools[i].getUnitSize();
+    *reserved += (size_t) FixedPools[i].getNUnits() *
+                 FixedPools[i].getRealUnitSize();
+  }
+}
+
 u64 VariableAllocatorNolock::getTag(void *ptr){
   return FixedAllocatorNolock::getTag(ptr);
 }
@@ -539,6 +552,10 @@ void *_tmallocnogc(size_t size){
 void *_tmalloc(size_t size){ return ::malloc(size); }
 void _tfree(void *buf){ return ::free(buf); }
 void *_trealloc(void *buf, size_t size){ return ::realloc(buf, size); }
+void *_tgetpool(void){ return 0; }
+void _tgetpoolusage(void *pool, size_t *inuse, size_t *reserved){
+  *inuse = *reserved = 0;
+}
 #else
 
 void *_tmalloc(size_t size){
@@ -599,6 +616,19 @@ size_t _tgetsize(void *buf){
   return VariableAllocatorNolock::getSize(buf);
 }
 
+void *_tgetpool(void){
+  if (!_TMthreadinfo) _tinit();
+  return (void*) _TMthreadinfo;
+}
+
+// NAllocated and NUnits are read without synchronization, which is fine
+// for statistics
+void _tgetpoolusage(void *pool, size_t *inuse, size_t *reserved){
+  _TMThreadInfo *ti = (_TMThreadInfo*) pool;
+  if (!ti){ *inuse = *reserved = 0; return; }
+  ti->allocator.getUsage(inuse, reserved);
+}
+
 void *_trealloc(void *ptr, size_t size){
   if (size==0){ // if new size is 0, free location
     _tfree(ptr);
@@ -49,11 +49,18 @@
 #include "os.h"
 #include "tmalloc.h"
 #include "treedirect.h"
+#include "dtreeload.h"
 
 // forward definitions
 int DtMovetoaux(BtCursor *pCur, const void *pKey, i64 nKey, int bias,
                 int *pRes, bool tryDirect);
 int sqlite3BtreeCreateTableChooseTable(Btree *p, Pgno *piTable, int flags);
+int sqlite3BtreeSetPlacementPolicy(Btree *p, int iTable, int policy);
+int sqlite3BtreeSetSplitThresholds(Btree *p, int iTable, int splitCells,
+                                   int splitBytes, int mergePercent);
+int DtParallelScanCells(BtCursor *pCur, bool ordered, bool fetchdata,
+     void (*callback)(i64 key, const char *data, int len, void *parm),
+     void *parm);
 
 int DdInit(){
   return sqlite3_initialize();
@@ -122,6 +129,25 @@ int DdCreateTable(DdConnection *conn, u64 iTable, DdTable *&table){
   return DdOpenTable(conn, iTable, table);
 }
 
+int DdSetPlacementPolicy(DdTable *table, int policy){
+  int res;
+  res = DdStartTx(table->conn); if (res) return res;
+  res = sqlite3BtreeSetPlacementPolicy(table->conn->pBtree,
+                                       (int) table->iTable, policy);
+  if (res){ DdRollbackTx(table->conn); return res; }
+  return DdCommitTx(table->conn);
+}
+
+int DdSetSplitThresholds(DdTable *table, int splitCells, int splitBytes,
+                         int mergePercent){
+  int res;
+  res = DdStartTx(table->conn); if (res) return res;
+  res = sqlite3BtreeSetSplitThresholds(table->conn->pBtree,
+                  (int) table->iTable, splitCells, splitBytes, mergePercent);
+  if (res){ DdRollbackTx(table->conn); return res; }
+  return DdCommitTx(table->conn);
+}
+
 int DdCloseCursor(DdTable *table){
   int res=0;
   if (table->pCur){
@@ -132,6 +158,34 @@ int DdCloseCursor(DdTable *table){
   return res;
 }
 
+int DdBulkLoad(DdTable *table,
+  int (*next)(i64 *key, const char **data, int *len, void *nextparm),
+  void *nextparm, u64 *nrows){
+  DtBulkLoad *load;
+  u64 dbid, rootcid;
+  i64 key;
+  const char *data;
+  int len, res;
+
+  dbid = table->conn->pBtree->pBt->KVdbid;
+  rootcid = getCidTable(dbid, table->iTable & ~0xffff800000000000LL);
+  res = DtBulkLoad::start(rootcid, !isDBIdEphemeral(dbid), &load);
+  if (res){ dprintf(1, "DtBulkLoad::start fails: %d", res); return res; }
+  while (next(&key, &data, &len, nextparm) == 0){
+    res = load->add(key, data, len);
+    if (res){
+      dprintf(1, "DtBulkLoad::add fails: %d", res);
+      delete load;
+      return res;
+    }
+  }
+  res = load->finish();
+  if (res) dprintf(1, "DtBulkLoad::finish fails: %d", res);
+  if (nrows) *nrows = load->getNRows();
+  delete load;
+  return res;
+}
+
 void DdCloseTable(DdTable *table){
   if (table->pCur) DdCloseCursor(table);
 }
@@ -344,3 +398,16 @@ int DdScan(DdTable *table, i64 key, int nelems,
   DdCloseCursor(table);
   return 0;
 }
+
+int DdParallelScan(DdTable *table, bool ordered,
+  void (*callback)(i64 key, const char *data, int len, void *callbackparm),
+  void *callbackparm, bool fetchdata){
+  int res;
+
+  DdInitCursor(table);
+  res = DtParallelScanCells(table->pCur, ordered, fetchdata, callback,
+                            callbackparm);
+  if (res) dprintf(1, "DtParallelScanCells fails: %d", res);
+  DdCloseCursor(table);
+  return res;
+}
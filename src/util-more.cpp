@@ -120,3 +120,105 @@ void MovingAverage::put(double item){
   sumsquare += item*item;
   ++nitems;
 }
+
+void Log2Histogram::put(u64 item){
+  int i;
+  u64 v;
+  for (i=0, v=item; v && i < LOG2HISTOGRAM_NBUCKETS-1; ++i) v >>= 1;
+  ++buckets[i];
+  ++nitems;
+  sum += item;
+  if (item > max) max = item;
+}
+
+u64 Log2Histogram::getPercentile(int percent){
+  u64 count, target;
+  int i;
+  if (!nitems) return 0;
+  target = (nitems * percent + 99) / 100;
+  count = 0;
+  for (i=0; i < LOG2HISTOGRAM_NBUCKETS; ++i){
+    count += buckets[i];
+    if (count >= target) break;
+  }
+  if (i == LOG2HISTOGRAM_NBUCKETS) i = LOG2HISTOGRAM_NBUCKETS-1;
+  return bucketLimit(i) < max ? bucketLimit(i) : max;
+}
+
+void Log2Histogram::add(Log2Histogram &h){
+  int i;
+  for (i=0; i < LOG2HISTOGRAM_NBUCKETS; ++i) buckets[i] += h.buckets[i];
+  nitems += h.nitems;
+  sum += h.sum;
+  if (h.max > max) max = h.max;
+}
+
+void Log2Histogram::printSummary(const char *name, const char *unit){
+  printf("%s: n %llu avg %.1f%s p50 %llu%s p99 %llu%s max %llu%s\n", name,
+         (unsigned long long)nitems, getAvg(), unit,
+         (unsigned long long)getPercentile(50), unit,
+         (unsigned long long)getPercentile(99), unit,
+         (unsigned long long)max, unit);
+}
+
+void Log2Histogram::print(const char *name, const char *unit){
+  int i;
+  printSummary(name, unit);
+  for (i=0; i < LOG2HISTOGRAM_NBUCKETS; ++i){
+    if (!buckets[i]) continue;
+    printf("  <%llu: %llu\n", (unsigned long long)bucketLimit(i),
+           (unsigned long long)buckets[i]);
+  }
+}
+
+// Table for CRC32C with the reflected polynomial 0x82f63b78, filled on
+// first use
+static u32 Crc32cTable[256];
+static bool Crc32cTableReady = false;
+
+static void crc32cInitTable(void){
+  u32 c;
+  int i, j;
+  for (i=0; i < 256; ++i){
+    c = i;
+    for (j=0; j < 8; ++j) c = c & 1 ? (c >> 1) ^ 0x82f63b78 : c >> 1;
+    Crc32cTable[i] = c;
+  }
+  MemBarrier();
+  Crc32cTableReady = true;
+}
+
+static u32 crc32cSoft(u32 crc, const u8 *p, size_t len){
+  if (!Crc32cTableReady) crc32cInitTable();
+  while (len--) crc = Crc32cTable[(crc ^ *p++) & 0xff] ^ (crc >> 8);
+  return crc;
+}
+
+#if defined(__x86_64__) && defined(__GNUC__)
+__attribute__((target("sse4.2")))
+static u32 crc32cHard(u32 crc, const u8 *p, size_t len){
+  u64 c = crc;
+  while (len && ((u64)p & 7)){ // align to 8 bytes
+    c = __builtin_ia32_crc32qi((u32)c, *p++);
+    --len;
+  }
+  while (len >= 8){
+    c = __builtin_ia32_crc32di(c, *(u64*)p);
+    p += 8;
+    len -= 8;
+  }
+  while (len--) c = __builtin_ia32_crc32qi((u32)c, *p++);
+  return (u32)c;
+}
+
+static int Crc32cHasHard = -1; // whether CPU has SSE4.2, -1 if unknown
+#endif
+
+u32 crc32c(u32 crc, const void *buf, size_t len){
+  crc = ~crc;
+#if defined(__x86_64__) && defined(__GNUC__)
+  if (Crc32cHasHard < 0) Crc32cHasHard = __builtin_cpu_supports("sse4.2") ? 1:0;
+  if (Crc32cHasHard) return ~crc32cHard(crc, (const u8*) buf, len);
+#endif
+  return ~crc32cSoft(crc, (const u8*) buf, len);
+}
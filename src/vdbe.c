@@ -3669,6 +3669,40 @@ case OP_OpenWrite: {
   break;
 }
 
+/* Opcode: ScanFilter P1 * P3 P4 *
+**
+** YESQUEL CH: added. Give cursor P1 a filter that a full scan of its table
+** may push down to the storage servers. P4 is the filter and P3 its length
+** in bytes (see scanfilter.h). Rows that fail the filter may be skipped by
+** the cursor, so the filter must be implied by the WHERE clause.
+*/
+case OP_ScanFilter: {
+  assert( p->apCsr[pOp->p1]!=0 );
+  if( p->apCsr[pOp->p1]->pCursor ){
+    rc = sqlite3BtreeScanFilter(p->apCsr[pOp->p1]->pCursor, pOp->p4.z,
+                                pOp->p3);
+  }
+  break;
+}
+
+/* Opcode: JoinBatch P1 P2 P3 * *
+**
+** YESQUEL CH: added. Cursor P1 is about to be looked up by rowid, with the
+** rowid taken from column P3 of cursor P2, or from the rowid of P2 if P3 is
+** negative. Reads ahead, in one batch, the rows of P1 that the next rows of
+** P2 will look up (see sqlite3BtreeJoinBatch).
+*/
+case OP_JoinBatch: {
+  VdbeCursor *pC = p->apCsr[pOp->p1];
+  VdbeCursor *pSrc = p->apCsr[pOp->p2];
+  assert( pC!=0 && pSrc!=0 );
+  if( pC->pCursor && pSrc->pCursor && !pSrc->nullRow
+   && !pSrc->deferredMoveto ){
+    rc = sqlite3BtreeJoinBatch(pC->pCursor, pSrc->pCursor, pOp->p3);
+  }
+  break;
+}
+
 /* Opcode: OpenEphemeral P1 P2 * P4 *
 **
 ** Open a new cursor P1 to a transient table.
@@ -2661,6 +2661,56 @@ static int whereInScanEst(
 #endif /* defined(SQLITE_ENABLE_STAT2) */
 
 
+#if DTREE_COST_RPC > 0
+/*
+** YESQUEL CH: added. Re-estimates the cost of a plan of bestBtreeIndex() for
+** a distributed tree, where what matters is the number of round trips to
+** the storage servers rather than the number of binary searches. Inner
+** nodes are normally in the node cache, so each seek costs one round trip
+** for a leaf, a table row is one more round trip (rows are separate objects
+** addressed by rowid), and a full scan reads each leaf and then the rows of
+** the leaf in one batch per server. Scans of a whole index are costed as
+** index range scans. Returns cost unchanged if the trees
+** involved have not been sampled (see whereDtreeStats).
+*/
+static double whereRpcCost(
+  Table *pTab,          /* The table being planned */
+  Index *pIdx,          /* The index used, or 0 for the rowid */
+  int wsFlags,          /* WHERE_* flags of the plan */
+  int bLookup,          /* True if index entries need a table lookup */
+  int nInMul,           /* Number of seeks */
+  double nRow,          /* Estimated number of rows visited */
+  double cost           /* Cost computed by sqlite */
+){
+  BtTreeStats *pT = &pTab->dtStats;
+  double R = DTREE_COST_RPC;
+  double nPerLeaf, nRpc;
+
+  if( pT->tSample==0 || pT->nLeaf<1 ) return cost;
+  nPerLeaf = pT->nRow / pT->nLeaf;
+  if( nPerLeaf<1 ) nPerLeaf = 1;
+  if( pIdx==0 && (wsFlags & WHERE_NOT_FULLSCAN)==0 ){
+    nRpc = pT->nLeaf * (1 + (pT->nServer<nPerLeaf ? pT->nServer : nPerLeaf));
+    if( DTREE_PSCAN_THREADS>0 && pT->nHeight>=DTREE_PSCAN_MIN_HEIGHT ){
+      nRpc /= DTREE_PSCAN_THREADS;
+    }
+    return pT->nRow + R*nRpc;
+  }
+  if( pIdx ){
+    if( pIdx->dtStats.tSample==0 || pIdx->dtStats.nLeaf<1 ) return cost;
+    nPerLeaf = pIdx->dtStats.nRow / pIdx->dtStats.nLeaf;
+    if( nPerLeaf<1 ) nPerLeaf = 1;
+    nRpc = nInMul + nRow/nPerLeaf;
+    if( bLookup ) nRpc += nRow;
+  }else if( wsFlags & WHERE_ROWID_EQ ){
+    nRpc = nInMul;
+  }else{
+    nRpc = nInMul + nRow/nPerLeaf + nRow;
+  }
+  return nRow + R*nRpc;
+}
+#endif /* DTREE_COST_RPC > 0 */
+
 /*
 ** Find the best query plan for accessing a particular table.  Write the
 ** best query plan and its cost into the WhereCost object supplied as the
@@ -3018,6 +3068,13 @@ static void bestBtreeIndex(
       }
     }
 
+#if DTREE_COST_RPC > 0
+    if( (pParse->db->flags & SQLITE_RpcCost)==0 ){
+      cost = whereRpcCost(pSrc->pTab, pIdx, wsFlags, bLookup, nInMul, nRow,
+                          cost);
+    }
+#endif
+
     /* Add in the estimated cost of sorting the result.  Actual experimental
     ** measurements of sorting performance in SQLite show that sorting time
     ** adds C*N*log10(N) to the cost, where N is the number of rows to be 
@@ -3589,6 +3646,36 @@ static void explainOneScan(
 #endif /* SQLITE_OMIT_EXPLAIN */
 
 
+#if DTREE_JOIN_BATCH > 0
+/*
+** YESQUEL CH: added. Level iLevel looks up its table by rowid with the
+** equality term pTerm. If the rowid is a column of the table of an outer
+** loop that visits rows in order of a leaf (a full scan) or that itself
+** looks up rows by rowid, have the lookups read their rows ahead in batches
+** (see OP_JoinBatch).
+*/
+static void whereJoinBatch(WhereInfo *pWInfo, int iLevel, WhereTerm *pTerm){
+  Vdbe *v = pWInfo->pParse->pVdbe;
+  Expr *pX = pTerm->pExpr->pRight;
+  WhereLevel *pLevel;
+  int i, iCur = pWInfo->pTabList->a[pWInfo->a[iLevel].iFrom].iCursor;
+
+  if( pTerm->eOperator!=WO_EQ || pX==0 || pX->op!=TK_COLUMN ) return;
+  for(i=0; i<iLevel; i++){
+    pLevel = &pWInfo->a[i];
+    if( pWInfo->pTabList->a[pLevel->iFrom].iCursor!=pX->iTable ) continue;
+    if( (pLevel->plan.wsFlags & WHERE_ROWID_EQ)==0
+     && (pLevel->plan.wsFlags & (WHERE_INDEXED|WHERE_ROWID_RANGE
+                                 |WHERE_TEMP_INDEX|WHERE_MULTI_OR
+                                 |WHERE_VIRTUALTABLE|WHERE_REVERSE)) ){
+      return;  /* outer rows do not come from a leaf or a batch */
+    }
+    sqlite3VdbeAddOp3(v, OP_JoinBatch, iCur, pX->iTable, pX->iColumn);
+    return;
+  }
+}
+#endif /* DTREE_JOIN_BATCH > 0 */
+
 /*
 ** Generate code for the start of the iLevel-th loop in the WHERE clause
 ** implementation described by pWInfo.
@@ -3705,6 +3792,9 @@ static Bitmask codeOneLoopStart(
     assert( pTerm->leftCursor==iCur );
     assert( omitTable==0 );
     testcase( pTerm->wtFlags & TERM_VIRTUAL ); /* EV: R-30575-11662 */
+#if DTREE_JOIN_BATCH > 0
+    whereJoinBatch(pWInfo, iLevel, pTerm);
+#endif
     iRowidReg = codeEqualityTerm(pParse, pTerm, pLevel, iReleaseReg);
     addrNxt = pLevel->addrNxt;
     sqlite3VdbeAddOp2(v, OP_MustBeInt, iRowidReg, addrNxt);
@@ -4282,6 +4372,268 @@ static void whereInfoFree(sqlite3 *db, WhereInfo *pWInfo){
 }
 
 
+#ifdef DTREE_SCAN_FILTER
+/*
+** YESQUEL CH: added. Appends a term to the scan filter in *pzBuf, which
+** has *pnBuf bytes, followed by nText bytes of text zText.
+*/
+static void whereScanFilterAppend(
+  sqlite3 *db,
+  char **pzBuf,
+  int *pnBuf,
+  ScanFilterTerm *pTerm,
+  const char *zText,
+  int nText
+){
+  int n = ScanFilterTermSize(nText);
+  char *z = (char*)sqlite3DbRealloc(db, *pzBuf, *pnBuf + n);
+  if( z==0 ) return;
+  pTerm->len = nText;
+  memset(&z[*pnBuf], 0, n);
+  memcpy(&z[*pnBuf], pTerm, sizeof(ScanFilterTerm));
+  if( nText ) memcpy(&z[*pnBuf + sizeof(ScanFilterTerm)], zText, nText);
+  *pzBuf = z;
+  *pnBuf += n;
+}
+
+/*
+** YESQUEL CH: added. Returns the operator of pExpr, looking through the
+** TK_REGISTER that replaces constants factored out of the loop.
+*/
+static int whereLiteralOp(Expr *pExpr){
+  return pExpr->op==TK_REGISTER ? pExpr->op2 : pExpr->op;
+}
+
+/*
+** YESQUEL CH: added. Whether pExpr is a literal that sqlite3ValueFromExpr
+** can evaluate once its operator is whereLiteralOp(pExpr).
+*/
+static int whereIsLiteral(Expr *pExpr){
+  int op = whereLiteralOp(pExpr);
+  if( op==TK_UMINUS ) op = pExpr->pLeft->op==TK_STRING ? 0 : pExpr->pLeft->op;
+  return op==TK_INTEGER || op==TK_FLOAT || op==TK_STRING;
+}
+
+/*
+** YESQUEL CH: added. Converts the WHERE term pExpr into a filter term on
+** table cursor iCur, appending it to *pzBuf. Only terms of the form
+** "column OP literal", "column IS [NOT] NULL", "column BETWEEN literals",
+** and "column LIKE/GLOB pattern" are converted, and only if the storage
+** servers can evaluate them exactly as sqlite would, or conservatively
+** (see ScanFilterMatch). Others are ignored, since the VDBE evaluates
+** all terms anyway.
+*/
+static void whereScanFilterTerm(
+  Parse *pParse,
+  Expr *pExpr,
+  int iCur,
+  char **pzBuf,
+  int *pnBuf,
+  int *pnTerm
+){
+  sqlite3 *db = pParse->db;
+  Expr *pCol, *pLit, sLit;
+  ScanFilterTerm t;
+  sqlite3_value *pVal = 0;
+  CollSeq *pColl;
+  char aff;
+  int op = pExpr->op;
+
+  if( *pnTerm>=SCANFILTER_MAX_TERMS ) return;
+  memset(&t, 0, sizeof(t));
+  switch( op ){
+    case TK_ISNULL:
+    case TK_NOTNULL:
+      pCol = pExpr->pLeft;
+      if( pCol->op!=TK_COLUMN || pCol->iTable!=iCur || pCol->iColumn<0 ){
+        return;
+      }
+      t.op = op==TK_ISNULL ? SCANF_ISNULL : SCANF_NOTNULL;
+      t.col = (u16)pCol->iColumn;
+      whereScanFilterAppend(db, pzBuf, pnBuf, &t, 0, 0);
+      ++*pnTerm;
+      return;
+
+    case TK_BETWEEN: {
+      Expr sCmp;
+      if( pExpr->x.pList->nExpr!=2 ) return;
+      memset(&sCmp, 0, sizeof(sCmp));
+      sCmp.op = TK_GE;
+      sCmp.pLeft = pExpr->pLeft;
+      sCmp.pRight = pExpr->x.pList->a[0].pExpr;
+      whereScanFilterTerm(pParse, &sCmp, iCur, pzBuf, pnBuf, pnTerm);
+      sCmp.op = TK_LE;
+      sCmp.pRight = pExpr->x.pList->a[1].pExpr;
+      whereScanFilterTerm(pParse, &sCmp, iCur, pzBuf, pnBuf, pnTerm);
+      return;
+    }
+
+    case TK_FUNCTION: {
+      int noCase, cnt;
+      char wc[3];
+      const char *z;
+      if( !sqlite3IsLikeFunction(db, pExpr, &noCase, wc) ) return;
+      if( pExpr->x.pList->nExpr!=2 ) return; /* no ESCAPE clause */
+      pCol = pExpr->x.pList->a[1].pExpr;
+      pLit = pExpr->x.pList->a[0].pExpr;
+      if( pCol->op!=TK_COLUMN || pCol->iTable!=iCur || pCol->iColumn<0
+       || whereLiteralOp(pLit)!=TK_STRING || ENC(db)!=SQLITE_UTF8 ){
+        return;
+      }
+      z = pLit->u.zToken;
+      for(cnt=0; z[cnt] && z[cnt]!=wc[0] && z[cnt]!=wc[1] && z[cnt]!=wc[2];
+          cnt++){}
+      if( cnt==0 ) return;
+      t.op = noCase ? SCANF_PREFIX_NOCASE : SCANF_PREFIX;
+      t.type = SCANF_TEXT;
+      t.col = (u16)pCol->iColumn;
+      whereScanFilterAppend(db, pzBuf, pnBuf, &t, z, cnt);
+      ++*pnTerm;
+      return;
+    }
+
+    case TK_EQ: t.op = SCANF_EQ; break;
+    case TK_NE: t.op = SCANF_NE; break;
+    case TK_LT: t.op = SCANF_LT; break;
+    case TK_LE: t.op = SCANF_LE; break;
+    case TK_GT: t.op = SCANF_GT; break;
+    case TK_GE: t.op = SCANF_GE; break;
+    default: return;
+  }
+
+  /* comparison: put the column on the left */
+  pCol = pExpr->pLeft;
+  pLit = pExpr->pRight;
+  if( pCol->op!=TK_COLUMN ){
+    pCol = pExpr->pRight;
+    pLit = pExpr->pLeft;
+    switch( t.op ){
+      case SCANF_LT: t.op = SCANF_GT; break;
+      case SCANF_LE: t.op = SCANF_GE; break;
+      case SCANF_GT: t.op = SCANF_LT; break;
+      case SCANF_GE: t.op = SCANF_LE; break;
+    }
+  }
+  if( pCol->op!=TK_COLUMN || pCol->iTable!=iCur || pCol->iColumn<0
+   || !whereIsLiteral(pLit) ){
+    return;
+  }
+  t.col = (u16)pCol->iColumn;
+  aff = sqlite3ExprAffinity(pCol);
+  sLit = *pLit;
+  sLit.op = (u8)whereLiteralOp(pLit);
+  if( sqlite3ValueFromExpr(db, &sLit, SQLITE_UTF8, SQLITE_AFF_NONE, &pVal)
+   || pVal==0 ){
+    return;
+  }
+  if( pVal->flags & (MEM_Int|MEM_Real) ){
+    /* a number is compared as text with columns of TEXT affinity */
+    if( aff==SQLITE_AFF_TEXT ) goto scan_filter_done;
+    if( pVal->flags & MEM_Int ){
+      t.type = SCANF_INT;
+      t.v.i = pVal->u.i;
+    }else{
+      t.type = SCANF_REAL;
+      t.v.r = pVal->r;
+    }
+    whereScanFilterAppend(db, pzBuf, pnBuf, &t, 0, 0);
+    ++*pnTerm;
+  }else if( pVal->flags & MEM_Str ){
+    /* text may be converted to a number with columns of numeric affinity,
+    ** and is compared with the collating sequence of the column */
+    if( aff!=SQLITE_AFF_TEXT && aff!=SQLITE_AFF_NONE ) goto scan_filter_done;
+    if( ENC(db)!=SQLITE_UTF8 ) goto scan_filter_done;
+    pColl = sqlite3BinaryCompareCollSeq(pParse, pExpr->pLeft, pExpr->pRight);
+    if( pColl && sqlite3StrICmp(pColl->zName, "BINARY")!=0 ){
+      goto scan_filter_done;
+    }
+    t.type = SCANF_TEXT;
+    whereScanFilterAppend(db, pzBuf, pnBuf, &t, pVal->z, pVal->n);
+    ++*pnTerm;
+  }
+scan_filter_done:
+  sqlite3ValueFree(pVal);
+}
+
+/*
+** YESQUEL CH: added. If pLevel is a full scan of a table, gives its cursor
+** a filter with the terms of the WHERE clause that involve only the table,
+** so that a parallel scan of the table can skip rows at the storage
+** servers (see OP_ScanFilter).
+*/
+static void whereScanFilter(
+  Parse *pParse,
+  WhereClause *pWC,
+  struct SrcList_item *pTabItem,
+  WhereLevel *pLevel
+){
+  Vdbe *v = pParse->pVdbe;
+  Bitmask mask = getMask(pWC->pMaskSet, pTabItem->iCursor);
+  WhereTerm *pTerm;
+  char *zBuf = 0;
+  int nBuf = 0, nTerm = 0, i;
+
+  if( pLevel->plan.wsFlags & (WHERE_INDEXED|WHERE_ROWID_EQ|WHERE_ROWID_RANGE
+                              |WHERE_TEMP_INDEX|WHERE_MULTI_OR) ){
+    return;  /* not a full scan */
+  }
+  /* rows of the right table of a LEFT JOIN that fail the WHERE clause
+  ** still produce a NULL row */
+  if( pTabItem->jointype & JT_LEFT ) return;
+  for(i=0, pTerm=pWC->a; i<pWC->nTerm; i++, pTerm++){
+    if( pTerm->wtFlags & TERM_VIRTUAL ) continue;
+    if( pTerm->prereqAll!=mask ) continue;
+    if( ExprHasProperty(pTerm->pExpr, EP_FromJoin) ) continue;
+    whereScanFilterTerm(pParse, pTerm->pExpr, pTabItem->iCursor, &zBuf,
+                        &nBuf, &nTerm);
+  }
+  if( nTerm==0 ){
+    sqlite3DbFree(pParse->db, zBuf);
+    return;
+  }
+  sqlite3VdbeAddOp4(v, OP_ScanFilter, pTabItem->iCursor, 0, nBuf, zBuf,
+                    P4_DYNAMIC);
+}
+#endif /* DTREE_SCAN_FILTER */
+
+
+#if DTREE_COST_RPC > 0
+/*
+** YESQUEL CH: added. Samples the trees of table pTab and of its indices
+** (see sqlite3BtreeTreeStats) for whereRpcCost(). Unless RPC-aware costs are
+** disabled, the sampled number of rows also replaces the default row
+** estimates of sqlite, but not estimates loaded from sqlite_stat1 by
+** ANALYZE.
+*/
+static void whereDtreeStats(Parse *pParse, Table *pTab){
+  sqlite3 *db = pParse->db;
+  Btree *pBt;
+  Index *pIdx;
+  double nOld = pTab->dtStats.nRow;
+  unsigned nEst;
+  int iDb, i;
+
+  if( pTab->pSelect || IsVirtual(pTab) || pTab->tnum==0 ) return;
+  iDb = sqlite3SchemaToIndex(db, pTab->pSchema);
+  if( iDb<0 || (pBt = db->aDb[iDb].pBt)==0 ) return;
+  if( sqlite3BtreeTreeStats(pBt, pTab->tnum, &pTab->dtStats) ) return;
+  for(pIdx=pTab->pIndex; pIdx; pIdx=pIdx->pNext){
+    sqlite3BtreeTreeStats(pBt, pIdx->tnum, &pIdx->dtStats);
+  }
+  if( db->flags & SQLITE_RpcCost ) return;
+  if( pTab->nRowEst!=1000000 && pTab->nRowEst!=(unsigned)nOld ) return;
+  nEst = pTab->dtStats.nRow<1e9 ? (unsigned)pTab->dtStats.nRow : 1000000000;
+  pTab->nRowEst = nEst;
+  if( nEst<10 ) nEst = 10;
+  for(pIdx=pTab->pIndex; pIdx; pIdx=pIdx->pNext){
+    pIdx->aiRowEst[0] = nEst;
+    for(i=1; i<=pIdx->nColumn; i++){
+      if( pIdx->aiRowEst[i]>nEst ) pIdx->aiRowEst[i] = nEst;
+    }
+  }
+}
+#endif /* DTREE_COST_RPC > 0 */
+
 /*
 ** Generate the beginning of the loop used for WHERE clause processing.
 ** The return value is a pointer to an opaque structure that contains
@@ -4517,6 +4869,11 @@ SQLITE_PRIVATE WhereInfo *sqlite3WhereBegin(
   ** This loop also figures out the nesting order of tables in the FROM
   ** clause.
   */
+#if DTREE_COST_RPC > 0
+  for(i=0; i<nTabList; i++){
+    if( pTabList->a[i].pTab ) whereDtreeStats(pParse, pTabList->a[i].pTab);
+  }
+#endif
   notReady = ~(Bitmask)0;
   andFlags = ~0;
   WHERETRACE(("*** Optimizer Start ***\n"));
@@ -4765,6 +5122,11 @@ SQLITE_PRIVATE WhereInfo *sqlite3WhereBegin(
                             (const char*) (SQLITE_INT_TO_PTR(n)), P4_INT32);
         assert( n<=pTab->nCol );
       }
+#ifdef DTREE_SCAN_FILTER
+      if( !pWInfo->okOnePass ){
+        whereScanFilter(pParse, pWC, pTabItem, pLevel); // YESQUEL CH: added
+      }
+#endif
     }else{
       sqlite3TableLock(pParse, iDb, pTab->tnum, 0, pTab->zName);
     }